@@ -0,0 +1 @@
+#include "AtomicAccess.h"
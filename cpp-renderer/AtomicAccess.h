@@ -0,0 +1,69 @@
+#ifndef ATOMICACCESS_H
+#define ATOMICACCESS_H
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+/**
+ * Loads and stores of a flag, counter or pointer that hand data from one thread to another - or from one process to
+ * another through shared memory - without a lock. Whatever a thread wrote before it stores a value with
+ * storeRelease() is visible to a thread that reads the value with loadAcquire().
+ *
+ * On x86 both compile to plain moves, so they are cheap enough for the inner loops that check whether data is ready.
+ * Unlike #pragma omp flush, they also order the accesses of threads that OpenMP does not know about (such as
+ * QThreads) and of other processes, and they do not depend on the build enabling OpenMP.
+ */
+class AtomicAccess
+{
+public:
+    /// Read a value written with storeRelease(), along with everything written before it
+    template <typename T>
+    static T loadAcquire(const volatile T &value) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __atomic_load_n(&value, __ATOMIC_ACQUIRE);
+#elif defined(_MSC_VER)
+        // Volatile accesses of MSVC have acquire and release semantics
+        const T result = value;
+        _ReadWriteBarrier();
+        return result;
+#else
+#error "AtomicAccess needs atomic loads and stores for this compiler"
+#endif
+    }
+
+    /// Write a value, after everything written before it
+    template <typename T>
+    static void storeRelease(volatile T &value, T newValue) {
+#if defined(__GNUC__) || defined(__clang__)
+        __atomic_store_n(&value, newValue, __ATOMIC_RELEASE);
+#elif defined(_MSC_VER)
+        _ReadWriteBarrier();
+        value = newValue;
+#else
+#error "AtomicAccess needs atomic loads and stores for this compiler"
+#endif
+    }
+
+    /// Order the writes before the fence before the writes after it, as seen by a thread that reads them in the
+    /// opposite order with acquireFence() between its reads
+    static void releaseFence() {
+#if defined(__GNUC__) || defined(__clang__)
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+#elif defined(_MSC_VER)
+        _ReadWriteBarrier();
+#endif
+    }
+
+    /// Order the reads before the fence before the reads after it; see releaseFence()
+    static void acquireFence() {
+#if defined(__GNUC__) || defined(__clang__)
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+#elif defined(_MSC_VER)
+        _ReadWriteBarrier();
+#endif
+    }
+
+}; /* AtomicAccess */
+
+#endif // ATOMICACCESS_H
@@ -0,0 +1 @@
+#include "CompressedVolumeFile.h"
@@ -0,0 +1,531 @@
+#ifndef COMPRESSEDVOLUMEFILE_H
+#define COMPRESSEDVOLUMEFILE_H
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "LzCodec.h"
+#include "Volume.h"
+
+using std::vector;
+
+/**
+ * Bricked, block-compressed volume file (.cvol), which is smaller on disk than a DAT file and faster to load from
+ * slow storage. The voxels are stored in bricks of BRICK_SIZE^3 voxels, each compressed on its own with LzCodec,
+ * so that bricks can be decompressed in parallel and one at a time.
+ *
+ * The file starts with a Header, followed by the compressed bricks in order of z, y and x, and ends with an index
+ * that gives the offset, the compressed size and the smallest and largest voxel value of every brick. Before
+ * compression, the 12-bit voxel values of a brick are replaced by the differences between neighbouring voxels
+ * and split into a plane of low bytes and a plane of high bytes, which gives the codec long runs of similar bytes.
+ * The header and the index are written field by field, and all numbers are little endian like the DAT files, so
+ * the files can be shared between platforms.
+ *
+ * Use convert() to create a file from a DAT file, and open() and load() to read it into a volume. Bricks whose
+ * smallest and largest value are the same, such as the empty space around a scanned object, are filled in without
+ * being decompressed.
+ */
+class CompressedVolumeFile
+{
+    // ********************************************************************************************************
+    // *** Basic methods **************************************************************************************
+public:
+    /// Constructor; no file is open until open() is called
+    CompressedVolumeFile() : m_bricksX(0), m_bricksY(0), m_bricksZ(0)
+    {
+        memset(&m_header, 0, sizeof(Header));
+    }
+
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    /// Return true if the file name has the extension of compressed volume files
+    static bool isCompressedVolumeFile(const std::string &filename) {
+        const std::string extension = ".cvol";
+        return filename.size() >= extension.size() &&
+               filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+    }
+
+    /// Convert a DAT file to a compressed volume file. Return false if the DAT file cannot be read or the output
+    /// cannot be written.
+    static bool convert(const std::string &datFilename, const std::string &filename) {
+        std::ifstream fileIn(datFilename.c_str(), std::ifstream::in | std::ifstream::binary);
+        if (!fileIn.is_open()) {
+            std::cerr << "+ Error opening the file." << std::endl;
+            return false;
+        }
+
+        int width, height, depth;
+        if (!Volume::readDatDimensions(datFilename, width, height, depth) || width <= 0 || height <= 0 || depth <= 0) {
+            std::cerr << "+ " << datFilename << " is not a DAT file." << std::endl;
+            return false;
+        }
+
+        std::ofstream fileOut(filename.c_str(), std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+        if (!fileOut.is_open()) {
+            std::cerr << "+ Error creating the file " << filename << "." << std::endl;
+            return false;
+        }
+
+        CompressedVolumeFile layout;
+        Header &header = layout.m_header;
+        memcpy(header.magic, "VVBRICK", 8);
+        header.version = FORMAT_VERSION;
+        header.brickSize = BRICK_SIZE;
+
+        layout.setDimensions(width, height, depth);
+        fileIn.seekg(DAT_HEADER_BYTES);
+
+        std::cout << "- Compressing " << width << "x" << height << "x" << depth << " voxels into " << filename
+                  << " ..." << std::endl;
+
+        // Leave room for the header, which is written last
+        writeHeader(fileOut, header);
+
+        // Compress one layer of bricks at a time: read the slices it covers, then compress its bricks in parallel
+        const int bricksPerLayer = layout.m_bricksX * layout.m_bricksY;
+        const std::streamoff sliceBytes = (std::streamoff)width * height * 2;
+
+        vector<char> raw;
+        vector<unsigned short> slices;
+        vector<vector<unsigned char> > compressed(bricksPerLayer);
+        vector<BrickEntry> &index = layout.m_index;
+        index.resize(layout.getBrickCount());
+
+        int64_t offset = HEADER_BYTES;
+
+        for (int layer = 0 ; layer < layout.m_bricksZ ; layer++) {
+            const int sliceCount = std::min((int)BRICK_SIZE, depth - layer * BRICK_SIZE);
+
+            raw.resize(sliceCount * sliceBytes);
+            fileIn.read(&raw[0], raw.size());
+            if (fileIn.gcount() < (std::streamsize)raw.size()) {
+                printf("Reached end of data file prematurely. Dataset may be corrupted. End reached at slice %d.\n", layer * BRICK_SIZE);
+                return false;
+            }
+
+            slices.resize(raw.size() / 2);
+            for (int i = 0 ; i < (int)slices.size() ; i++) {
+                slices[i] = BYTE2INT(raw[2*i], raw[2*i + 1]);
+            }
+
+            #pragma omp parallel for schedule(dynamic)
+            for (int i = 0 ; i < bricksPerLayer ; i++) {
+                const int brick = layer * bricksPerLayer + i;
+                compressed[i].clear();
+                layout.compressBrick(brick, &slices[0], compressed[i], index[brick]);
+            }
+
+            for (int i = 0 ; i < bricksPerLayer ; i++) {
+                BrickEntry &entry = index[layer * bricksPerLayer + i];
+                entry.offset = offset;
+                entry.size = (int32_t)compressed[i].size();
+                fileOut.write((const char*)&compressed[i][0], compressed[i].size());
+                offset += compressed[i].size();
+            }
+        }
+
+        header.indexOffset = offset;
+        writeIndex(fileOut, index);
+        fileOut.seekp(0);
+        writeHeader(fileOut, header);
+        fileOut.close();
+
+        if (!fileOut) {
+            std::cerr << "+ Error writing the file " << filename << "." << std::endl;
+            return false;
+        }
+
+        const int64_t rawBytes = (int64_t)width * height * depth * 2 + 6;
+        const int64_t fileBytes = offset + (int64_t)index.size() * BRICK_ENTRY_BYTES;
+        std::cout << "Done compressing: " << rawBytes << " bytes to " << fileBytes << " bytes ("
+                  << (100.0 * fileBytes / rawBytes) << "%)." << std::endl << std::endl;
+
+        return true;
+    } /* convert() */
+
+    /// Open a compressed volume file and read its index. Return false if it cannot be read, is not a compressed
+    /// volume file of this version, or its index is corrupt.
+    bool open(const std::string &filename) {
+        close();
+
+        m_file.open(filename.c_str(), std::ifstream::in | std::ifstream::binary);
+        if (!m_file.is_open()) {
+            std::cerr << "+ Error opening the file." << std::endl;
+            return false;
+        }
+
+        if (!readHeader(m_file, m_header) || memcmp(m_header.magic, "VVBRICK", 8) != 0 || m_header.version != FORMAT_VERSION ||
+            m_header.brickSize != BRICK_SIZE || m_header.width <= 0 || m_header.height <= 0 || m_header.depth <= 0 ||
+            m_header.width > 65535 || m_header.height > 65535 || m_header.depth > 65535 ||
+            m_header.indexOffset < HEADER_BYTES) {
+            std::cerr << "+ " << filename << " is not a compressed volume file of this version." << std::endl;
+            close();
+            return false;
+        }
+
+        setDimensions(m_header.width, m_header.height, m_header.depth);
+
+        m_file.seekg(m_header.indexOffset);
+        if (!readIndex(m_file, getBrickCount(), m_index)) {
+            std::cerr << "+ The index of " << filename << " is incomplete." << std::endl;
+            close();
+            return false;
+        }
+
+        // The bricks follow the header one after the other, up to the index; the reads and the decompression rely
+        // on it
+        int64_t offset = HEADER_BYTES;
+        for (size_t brick = 0 ; brick < m_index.size() ; brick++) {
+            if (m_index[brick].offset != offset || m_index[brick].size < 0 ||
+                m_index[brick].size > m_header.indexOffset - offset) {
+                std::cerr << "+ The index of " << filename << " is corrupt." << std::endl;
+                close();
+                return false;
+            }
+            offset += m_index[brick].size;
+        }
+        if (offset != m_header.indexOffset) {
+            std::cerr << "+ The index of " << filename << " is corrupt." << std::endl;
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    /// Close the file
+    void close() {
+        if (m_file.is_open()) {
+            m_file.close();
+        }
+        m_file.clear();
+        m_index.clear();
+        memset(&m_header, 0, sizeof(Header));
+        m_bricksX = m_bricksY = m_bricksZ = 0;
+    }
+
+    /// Return the dimensions of the volume in the file
+    int getWidth() const { return m_header.width; }
+    int getHeight() const { return m_header.height; }
+    int getDepth() const { return m_header.depth; }
+
+    /// Return the number of bricks
+    int getBrickCount() const { return m_bricksX * m_bricksY * m_bricksZ; }
+
+    /// Load the whole file into a volume, keeping its gradient policy. The bricks of each layer are decompressed
+    /// in parallel, while the next layer is read. Call computeDerivedData() on the volume afterwards. Return false
+    /// if the file is corrupt.
+    bool load(Volume &volume) {
+        volume.allocateVoxels(getWidth(), getHeight(), getDepth());
+
+        std::cout << "- Decompressing " << getWidth() << "x" << getHeight() << "x" << getDepth() << " voxels ..." << std::endl;
+
+        const int bricksPerLayer = m_bricksX * m_bricksY;
+        vector<unsigned char> layers[2];
+        bool valid = readBricks(0, bricksPerLayer, layers[0]);
+
+        for (int layer = 0 ; layer < m_bricksZ && valid ; layer++) {
+            const vector<unsigned char> &current = layers[layer % 2];
+            const int64_t layerOffset = m_index[layer * bricksPerLayer].offset;
+            bool nextValid = true;
+
+            #pragma omp parallel
+            {
+                #pragma omp single nowait
+                {
+                    if (layer + 1 < m_bricksZ) {
+                        nextValid = readBricks((layer + 1) * bricksPerLayer, (layer + 2) * bricksPerLayer, layers[(layer + 1) % 2]);
+                    }
+                }
+
+                vector<unsigned short> voxels(BRICK_SIZE * BRICK_SIZE * BRICK_SIZE);
+
+                // Each thread clears its own copy of valid for a corrupt brick; the copies are combined at the end
+                #pragma omp for schedule(dynamic) reduction(&&:valid)
+                for (int i = 0 ; i < bricksPerLayer ; i++) {
+                    const int brick = layer * bricksPerLayer + i;
+                    const BrickEntry &entry = m_index[brick];
+
+                    if (entry.minimum == entry.maximum) {
+                        fillBrick(brick, entry.minimum, volume);
+                        continue;
+                    }
+
+                    // The brick must lie within the bytes read for its layer
+                    if (entry.offset < layerOffset || entry.offset - layerOffset + entry.size > (int64_t)current.size() ||
+                        !decompressBrick(brick, &current[0] + (entry.offset - layerOffset), &voxels[0])) {
+                        valid = false;
+                        continue;
+                    }
+                    storeBrick(brick, &voxels[0], volume);
+                }
+            }
+
+            valid = valid && nextValid;
+        }
+
+        if (!valid) {
+            std::cerr << "+ The compressed volume file is corrupt." << std::endl;
+            return false;
+        }
+
+        std::cout << "Done decompressing." << std::endl << std::endl;
+        return true;
+    } /* load() */
+
+    // ********************************************************************************************************
+    // *** Private types **************************************************************************************
+private:
+    static const uint32_t FORMAT_VERSION = 1;
+    static const int BRICK_SIZE = 32; // Voxels of a brick along each axis
+    static const int DAT_HEADER_BYTES = 6;
+    static const int HEADER_BYTES = 40;      // Size of a Header in the file
+    static const int BRICK_ENTRY_BYTES = 16; // Size of a BrickEntry in the file
+
+    /// Beginning of a compressed volume file
+    struct Header {
+        char magic[8];       // "VVBRICK"
+        uint32_t version;    // FORMAT_VERSION
+        int32_t brickSize;   // BRICK_SIZE
+        int32_t width, height, depth;
+        int32_t reserved;
+        int64_t indexOffset; // Offset of the index from the start of the file
+    };
+
+    /// Index entry of a brick
+    struct BrickEntry {
+        int64_t offset;      // Of the compressed brick from the start of the file
+        int32_t size;        // Compressed size in bytes
+        uint16_t minimum;    // Smallest and largest voxel value, as stored in the DAT file
+        uint16_t maximum;
+    };
+
+    // ********************************************************************************************************
+    // *** Private methods ************************************************************************************
+private:
+    /// Store the lowest bytes of a value, least significant first
+    static void putLittleEndian(uint64_t value, int bytes, unsigned char *out) {
+        for (int i = 0 ; i < bytes ; i++) {
+            out[i] = (unsigned char)(value >> (8 * i));
+        }
+    }
+
+    /// Read a value stored by putLittleEndian()
+    static uint64_t getLittleEndian(const unsigned char *in, int bytes) {
+        uint64_t value = 0;
+        for (int i = 0 ; i < bytes ; i++) {
+            value |= (uint64_t)in[i] << (8 * i);
+        }
+        return value;
+    }
+
+    /// Write a header field by field, so that the file is the same on every platform
+    static void writeHeader(std::ostream &out, const Header &header) {
+        unsigned char bytes[HEADER_BYTES];
+        memcpy(bytes, header.magic, 8);
+        putLittleEndian(header.version, 4, bytes + 8);
+        putLittleEndian((uint32_t)header.brickSize, 4, bytes + 12);
+        putLittleEndian((uint32_t)header.width, 4, bytes + 16);
+        putLittleEndian((uint32_t)header.height, 4, bytes + 20);
+        putLittleEndian((uint32_t)header.depth, 4, bytes + 24);
+        putLittleEndian((uint32_t)header.reserved, 4, bytes + 28);
+        putLittleEndian((uint64_t)header.indexOffset, 8, bytes + 32);
+        out.write((const char*)bytes, HEADER_BYTES);
+    }
+
+    /// Read a header written by writeHeader(). Return false if the stream ends prematurely.
+    static bool readHeader(std::istream &in, Header &header) {
+        unsigned char bytes[HEADER_BYTES];
+        if (!in.read((char*)bytes, HEADER_BYTES)) {
+            return false;
+        }
+
+        memcpy(header.magic, bytes, 8);
+        header.version = (uint32_t)getLittleEndian(bytes + 8, 4);
+        header.brickSize = (int32_t)getLittleEndian(bytes + 12, 4);
+        header.width = (int32_t)getLittleEndian(bytes + 16, 4);
+        header.height = (int32_t)getLittleEndian(bytes + 20, 4);
+        header.depth = (int32_t)getLittleEndian(bytes + 24, 4);
+        header.reserved = (int32_t)getLittleEndian(bytes + 28, 4);
+        header.indexOffset = (int64_t)getLittleEndian(bytes + 32, 8);
+        return true;
+    }
+
+    /// Write the brick index, entry by entry
+    static void writeIndex(std::ostream &out, const vector<BrickEntry> &index) {
+        vector<unsigned char> bytes(index.size() * BRICK_ENTRY_BYTES);
+        for (size_t i = 0 ; i < index.size() ; i++) {
+            unsigned char *entry = &bytes[i * BRICK_ENTRY_BYTES];
+            putLittleEndian((uint64_t)index[i].offset, 8, entry);
+            putLittleEndian((uint32_t)index[i].size, 4, entry + 8);
+            putLittleEndian(index[i].minimum, 2, entry + 12);
+            putLittleEndian(index[i].maximum, 2, entry + 14);
+        }
+        out.write((const char*)&bytes[0], bytes.size());
+    }
+
+    /// Read an index of count entries written by writeIndex(). Return false if the stream ends prematurely.
+    static bool readIndex(std::istream &in, int count, vector<BrickEntry> &index) {
+        vector<unsigned char> bytes((size_t)count * BRICK_ENTRY_BYTES);
+        if (!in.read((char*)&bytes[0], bytes.size())) {
+            return false;
+        }
+
+        index.resize(count);
+        for (int i = 0 ; i < count ; i++) {
+            const unsigned char *entry = &bytes[(size_t)i * BRICK_ENTRY_BYTES];
+            index[i].offset = (int64_t)getLittleEndian(entry, 8);
+            index[i].size = (int32_t)getLittleEndian(entry + 8, 4);
+            index[i].minimum = (uint16_t)getLittleEndian(entry + 12, 2);
+            index[i].maximum = (uint16_t)getLittleEndian(entry + 14, 2);
+        }
+        return true;
+    }
+
+    /// Set the dimensions of the volume and of the brick grid
+    void setDimensions(int width, int height, int depth) {
+        m_header.width = width;
+        m_header.height = height;
+        m_header.depth = depth;
+
+        m_bricksX = (width + BRICK_SIZE - 1) / BRICK_SIZE;
+        m_bricksY = (height + BRICK_SIZE - 1) / BRICK_SIZE;
+        m_bricksZ = (depth + BRICK_SIZE - 1) / BRICK_SIZE;
+    }
+
+    /// Get the first voxel and the dimensions of a brick; the bricks on the upper borders may be smaller
+    void getBrickExtent(int brick, int start[3], int size[3]) const {
+        start[0] = (brick % m_bricksX) * BRICK_SIZE;
+        start[1] = ((brick / m_bricksX) % m_bricksY) * BRICK_SIZE;
+        start[2] = (brick / (m_bricksX * m_bricksY)) * BRICK_SIZE;
+
+        size[0] = std::min((int)BRICK_SIZE, m_header.width - start[0]);
+        size[1] = std::min((int)BRICK_SIZE, m_header.height - start[1]);
+        size[2] = std::min((int)BRICK_SIZE, m_header.depth - start[2]);
+    }
+
+    /// Compress a brick and fill in its value range. voxels holds the DAT values of the slices of the brick's
+    /// layer.
+    void compressBrick(int brick, const unsigned short *voxels, vector<unsigned char> &out, BrickEntry &entry) const {
+        int start[3], size[3];
+        getBrickExtent(brick, start, size);
+
+        const int count = size[0] * size[1] * size[2];
+        vector<unsigned char> planes(count * 2);
+
+        unsigned short minimum = 65535, maximum = 0, previous = 0;
+        int i = 0;
+
+        for (int z = 0 ; z < size[2] ; z++) {
+            for (int y = 0 ; y < size[1] ; y++) {
+                const unsigned short *row = voxels + ((int64_t)z * m_header.height + start[1] + y) * m_header.width + start[0];
+
+                for (int x = 0 ; x < size[0] ; x++, i++) {
+                    const unsigned short delta = (unsigned short)(row[x] - previous);
+                    planes[i] = (unsigned char)(delta & 255);
+                    planes[count + i] = (unsigned char)(delta >> 8);
+
+                    previous = row[x];
+                    minimum = std::min(minimum, row[x]);
+                    maximum = std::max(maximum, row[x]);
+                }
+            }
+        }
+
+        LzCodec::compress(&planes[0], count * 2, out);
+
+        entry.minimum = minimum;
+        entry.maximum = maximum;
+    }
+
+    /// Decompress a brick into voxels, in order of z, y and x within the brick. Return false if it is corrupt.
+    bool decompressBrick(int brick, const unsigned char *compressed, unsigned short *voxels) const {
+        int start[3], size[3];
+        getBrickExtent(brick, start, size);
+
+        const int count = size[0] * size[1] * size[2];
+        vector<unsigned char> planes(count * 2);
+
+        if (!LzCodec::decompress(compressed, m_index[brick].size, &planes[0], count * 2)) {
+            return false;
+        }
+
+        unsigned short previous = 0;
+        for (int i = 0 ; i < count ; i++) {
+            previous = (unsigned short)(previous + (planes[i] | (planes[count + i] << 8)));
+            voxels[i] = previous;
+        }
+
+        return true;
+    }
+
+    /// Write the decompressed voxels of a brick into a volume, scaled to [0,1]
+    void storeBrick(int brick, const unsigned short *voxels, Volume &volume) const {
+        int start[3], size[3];
+        getBrickExtent(brick, start, size);
+
+        for (int z = 0 ; z < size[2] ; z++) {
+            for (int y = 0 ; y < size[1] ; y++) {
+                float *row = &volume.getVoxel(start[0], start[1] + y, start[2] + z);
+                for (int x = 0 ; x < size[0] ; x++) {
+                    row[x] = *voxels++ / 4095.0; // Scaling to [0,1].
+                }
+            }
+        }
+    }
+
+    /// Fill a brick of a volume with a single DAT value, scaled to [0,1]
+    void fillBrick(int brick, unsigned short value, Volume &volume) const {
+        int start[3], size[3];
+        getBrickExtent(brick, start, size);
+
+        for (int z = 0 ; z < size[2] ; z++) {
+            for (int y = 0 ; y < size[1] ; y++) {
+                float *row = &volume.getVoxel(start[0], start[1] + y, start[2] + z);
+                std::fill(row, row + size[0], (float)(value / 4095.0)); // Scaling to [0,1].
+            }
+        }
+    }
+
+    /// Read the compressed bricks from first up to last, which are contiguous in the file. Return false if the
+    /// file ends prematurely, or the bricks are not within the file.
+    bool readBricks(int first, int last, vector<unsigned char> &out) {
+        if (first < 0 || last > (int)m_index.size() || first >= last) {
+            return false;
+        }
+
+        const int64_t begin = m_index[first].offset;
+        const int64_t end = m_index[last - 1].offset + m_index[last - 1].size;
+        if (begin < HEADER_BYTES || end < begin || end > m_header.indexOffset) {
+            return false;
+        }
+
+        // An empty read still needs an element to point to
+        out.resize(std::max(end - begin, (int64_t)1));
+        m_file.seekg(begin);
+        m_file.read((char*)&out[0], end - begin);
+        return (int64_t)m_file.gcount() == end - begin;
+    }
+
+    // Not copyable
+    CompressedVolumeFile(const CompressedVolumeFile&);
+    CompressedVolumeFile& operator=(const CompressedVolumeFile&);
+
+    // ********************************************************************************************************
+    // *** Class members **************************************************************************************
+private:
+    std::ifstream m_file;
+    Header m_header;
+    vector<BrickEntry> m_index;
+    int m_bricksX, m_bricksY, m_bricksZ;
+
+}; /* CompressedVolumeFile */
+
+#endif // COMPRESSEDVOLUMEFILE_H
@@ -0,0 +1 @@
+#include "DatasetCatalogDialog.h"
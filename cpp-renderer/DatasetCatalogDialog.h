@@ -0,0 +1,183 @@
+#ifndef DATASETCATALOGDIALOG_H
+#define DATASETCATALOGDIALOG_H
+
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QDir>
+#include <QIcon>
+#include <QImage>
+#include <QListWidget>
+#include <QPixmap>
+#include <QPushButton>
+#include <QStringList>
+#include <QThread>
+#include <QVBoxLayout>
+
+#include "AtomicAccess.h"
+#include "DatasetThumbnail.h"
+
+/**
+ * Dialog to pick a dataset from a directory of DAT files by their thumbnails and dimensions, without loading any of
+ * them. The datasets are listed at once; a scan thread then makes their thumbnails (see DatasetThumbnail), several
+ * files at a time, and each is shown as soon as it is ready. Cached thumbnails only cost reading a small PNG, so a
+ * directory that has been browsed before fills in almost at once.
+ */
+class DatasetCatalogDialog : public QDialog
+{
+    Q_OBJECT
+
+    // ********************************************************************************************************
+    // *** Basic methods **************************************************************************************
+public:
+    /// Constructor; starts scanning the datasets of the directory
+    DatasetCatalogDialog(const QString &directory, QWidget *parent = 0) : QDialog(parent), m_directory(directory),
+        m_scanner(NULL), m_stopping(false)
+    {
+        m_files = m_directory.entryList(QStringList() << "*.dat", QDir::Files | QDir::Readable, QDir::Name);
+
+        // Icons in a grid that wraps with the width of the dialog
+        m_list = new QListWidget;
+        m_list->setViewMode(QListView::IconMode);
+        m_list->setIconSize(QSize(DatasetThumbnail::SIZE, DatasetThumbnail::SIZE));
+        m_list->setGridSize(QSize(DatasetThumbnail::SIZE + 48, DatasetThumbnail::SIZE + 40));
+        m_list->setResizeMode(QListView::Adjust);
+        m_list->setMovement(QListView::Static);
+        m_list->setUniformItemSizes(true);
+        for (int i = 0 ; i < m_files.size() ; i++) {
+            new QListWidgetItem(m_files[i], m_list);
+        }
+        m_list->setCurrentRow(0);
+
+        // Create buttons
+        m_btOpen = new QPushButton(tr("&Open"));
+        m_btOpen->setDefault(true);
+        m_btCancel = new QPushButton(tr("&Cancel"));
+
+        // Button box
+        m_bxButtons = new QDialogButtonBox(Qt::Horizontal);
+        m_bxButtons->addButton(m_btOpen, QDialogButtonBox::AcceptRole);
+        m_bxButtons->addButton(m_btCancel, QDialogButtonBox::RejectRole);
+
+        // Layout
+        m_layout = new QVBoxLayout;
+        m_layout->addWidget(m_list);
+        m_layout->addWidget(m_bxButtons);
+
+        // Connections and dialog setup
+        connect(m_bxButtons, SIGNAL(accepted()), this, SLOT(accept()));
+        connect(m_bxButtons, SIGNAL(rejected()), this, SLOT(reject()));
+        connect(m_list, SIGNAL(itemActivated(QListWidgetItem *)), this, SLOT(accept()));
+
+        // Emitted by the scan thread, and handled in the thread of the dialog
+        connect(this, SIGNAL(datasetScanned(int, QImage, QString)), this, SLOT(showDataset(int, QImage, QString)),
+                Qt::QueuedConnection);
+
+        setLayout(m_layout);
+        setWindowTitle(tr("Dataset catalog of %1").arg(m_directory.absolutePath()));
+        this->resize(720, 480);
+
+        m_scanner = new ScanThread(this);
+        m_scanner->start(QThread::LowPriority);
+    } /* Constructor */
+
+    /// Destructor; stops scanning
+    virtual ~DatasetCatalogDialog() {
+        AtomicAccess::storeRelease(m_stopping, true);
+        m_scanner->wait();
+        delete m_scanner;
+
+        delete m_list;
+        delete m_btOpen;
+        delete m_btCancel;
+        delete m_bxButtons;
+        delete m_layout;
+    }
+
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    /// Return the path of the dataset picked, or an empty string if the directory holds none
+    QString getSelectedFile() const {
+        const int row = m_list->currentRow();
+        return (row >= 0 && row < m_files.size()) ? m_directory.absoluteFilePath(m_files[row]) : QString();
+    }
+
+    // ********************************************************************************************************
+    // *** Signals ********************************************************************************************
+signals:
+    /// The thumbnail and description of a dataset are ready (emitted from the scan thread)
+    void datasetScanned(int index, const QImage &thumbnail, const QString &description);
+
+    // ********************************************************************************************************
+    // *** Private slots **************************************************************************************
+private slots:
+    /// Show the thumbnail and description of a dataset
+    void showDataset(int index, const QImage &thumbnail, const QString &description) {
+        QListWidgetItem *item = m_list->item(index);
+        if (!thumbnail.isNull()) {
+            item->setIcon(QIcon(QPixmap::fromImage(thumbnail)));
+        }
+        item->setText(m_files[index] + "\n" + description);
+        item->setToolTip(m_directory.absoluteFilePath(m_files[index]));
+    }
+
+    // ********************************************************************************************************
+    // *** Private types **************************************************************************************
+private:
+    /// Thread making the thumbnails of the datasets
+    class ScanThread : public QThread
+    {
+    public:
+        explicit ScanThread(DatasetCatalogDialog *catalog) : m_catalog(catalog) {}
+
+    protected:
+        void run() { m_catalog->scanDatasets(); }
+
+    private:
+        DatasetCatalogDialog *m_catalog;
+    };
+
+    // ********************************************************************************************************
+    // *** Private methods ************************************************************************************
+private:
+    /// Body of the scan thread: make the thumbnails of several datasets at a time, as their reads mostly wait for
+    /// the disk, until all are made or the dialog is closed
+    void scanDatasets() {
+        const int count = m_files.size();
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int i = 0 ; i < count ; i++) {
+            if (AtomicAccess::loadAcquire(m_stopping)) {
+                continue;
+            }
+
+            int width, height, depth;
+            const QImage thumbnail = DatasetThumbnail::get(m_directory.absoluteFilePath(m_files[i]), width, height, depth);
+            const QString description = thumbnail.isNull() ? tr("Not a dataset") :
+                                        QString("%1x%2x%3").arg(width).arg(height).arg(depth);
+            emit datasetScanned(i, thumbnail, description);
+        }
+    }
+
+    // Not copyable
+    DatasetCatalogDialog(const DatasetCatalogDialog&);
+    DatasetCatalogDialog& operator=(const DatasetCatalogDialog&);
+
+    // ********************************************************************************************************
+    // *** Class members **************************************************************************************
+private:
+    QDir m_directory;
+    QStringList m_files;                // Names of the datasets, in the order of the list
+
+    QListWidget *m_list;
+    QPushButton *m_btOpen;
+    QPushButton *m_btCancel;
+    QDialogButtonBox *m_bxButtons;
+    QVBoxLayout *m_layout;
+
+    ScanThread *m_scanner;
+    volatile bool m_stopping;           // Set when the dialog closes, to stop scanning
+
+}; /* DatasetCatalogDialog */
+
+#endif // DATASETCATALOGDIALOG_H
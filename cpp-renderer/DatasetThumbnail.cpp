@@ -0,0 +1,4 @@
+#include "DatasetThumbnail.h"
+
+const char *const DatasetThumbnail::KEY_TEXT = "VolViz dataset";
+const char *const DatasetThumbnail::DIMENSIONS_TEXT = "VolViz dimensions";
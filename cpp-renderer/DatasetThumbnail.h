@@ -0,0 +1,127 @@
+#ifndef DATASETTHUMBNAIL_H
+#define DATASETTHUMBNAIL_H
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QString>
+
+#include "Volume.h"
+
+using std::vector;
+
+/**
+ * Small maximum intensity projection of a DAT file along z, to tell datasets apart without loading them. Only a
+ * strided sample of the voxels is read, as a region of the dataset (see Volume::Region), so a thumbnail takes about
+ * as long to make for a large scan as for a small one.
+ *
+ * Thumbnails are cached in a sidecar PNG next to the dataset (dataset.dat.thumb.png), which also records the size,
+ * modification time and dimensions of the dataset. A thumbnail whose dataset has changed is made again. When the
+ * dataset's directory is not writable, nothing is cached.
+ */
+class DatasetThumbnail
+{
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    static const int SIZE = 96;               ///< Largest side of a thumbnail in pixels
+    static const int SAMPLE_VOXELS = 1 << 18; ///< Largest number of voxels read to make a thumbnail
+
+    /// Return the thumbnail of a dataset, from the cache if it is valid, and the dimensions of the dataset. Return a
+    /// null image if the file is not a readable dataset. May be called from several threads at once.
+    static QImage get(const QString &datasetFile, int &width, int &height, int &depth) {
+        const QString key = makeKey(datasetFile);
+
+        QImage thumbnail;
+        if (thumbnail.load(thumbnailFile(datasetFile), "PNG") && thumbnail.text(KEY_TEXT) == key) {
+            std::istringstream dimensions(thumbnail.text(DIMENSIONS_TEXT).toStdString());
+            if (dimensions >> width >> height >> depth) {
+                return thumbnail;
+            }
+        }
+
+        thumbnail = make(datasetFile.toStdString(), width, height, depth);
+        if (!thumbnail.isNull()) {
+            thumbnail.setText(KEY_TEXT, key);
+            thumbnail.setText(DIMENSIONS_TEXT, QString("%1 %2 %3").arg(width).arg(height).arg(depth));
+            store(thumbnail, datasetFile);
+        }
+        return thumbnail;
+    }
+
+    /// Return the path of the cached thumbnail of a dataset
+    static QString thumbnailFile(const QString &datasetFile) {
+        return datasetFile + ".thumb.png";
+    }
+
+    // ********************************************************************************************************
+    // *** Private methods ************************************************************************************
+private:
+    static const char *const KEY_TEXT;        // PNG text holding the size and modification time of the dataset
+    static const char *const DIMENSIONS_TEXT; // PNG text holding the dimensions of the dataset
+
+    /// Project the maximum along z of a strided sample of a dataset, which sets the stride so that the thumbnail
+    /// is at most SIZE pixels across and at most SAMPLE_VOXELS voxels are read. The projection is scaled to its
+    /// brightest pixel.
+    static QImage make(const std::string &datasetFile, int &width, int &height, int &depth) {
+        if (!Volume::readDatDimensions(datasetFile, width, height, depth) || width <= 0 || height <= 0 || depth <= 0) {
+            return QImage();
+        }
+
+        const int stride = std::max(Volume::previewStride(datasetFile, SAMPLE_VOXELS),
+                                    (std::max(width, height) + SIZE - 1) / SIZE);
+        Volume sample;
+        if (!sample.loadVolumeDat(datasetFile, Volume::Region(0, 0, 0, width, height, depth, stride), false)) {
+            return QImage();
+        }
+
+        const int columns = sample.getWidth();
+        const int rows = sample.getHeight();
+        vector<float> projection((size_t)columns * rows, 0);
+        const float *voxels = sample.getData();
+        for (int z = 0 ; z < sample.getDepth() ; z++) {
+            for (size_t i = 0 ; i < projection.size() ; i++) {
+                projection[i] = std::max(projection[i], voxels[(size_t)z * projection.size() + i]);
+            }
+        }
+
+        const float brightest = *std::max_element(projection.begin(), projection.end());
+        const float scale = (brightest > 0) ? 255 / brightest : 0;
+
+        QImage thumbnail(columns, rows, QImage::Format_RGB32);
+        for (int y = 0 ; y < rows ; y++) {
+            for (int x = 0 ; x < columns ; x++) {
+                const int value = (int)(projection[(size_t)y * columns + x] * scale + 0.5f);
+                thumbnail.setPixel(x, y, qRgb(value, value, value));
+            }
+        }
+        return thumbnail;
+    }
+
+    /// Write a thumbnail to the cache of a dataset
+    static void store(const QImage &thumbnail, const QString &datasetFile) {
+        // Write to a temporary file first, so that an interrupted write never leaves a thumbnail that looks valid
+        const QString path = thumbnailFile(datasetFile);
+        QFile file(path + ".tmp");
+        const bool written = thumbnail.save(file.fileName(), "PNG");
+
+        QFile::remove(path);
+        if (!written || !file.rename(path)) {
+            file.remove();
+        }
+    }
+
+    /// Return what identifies the version of a dataset: its size and modification time
+    static QString makeKey(const QString &datasetFile) {
+        QFileInfo info(datasetFile);
+        return QString("%1 %2").arg(info.size()).arg((qint64)info.lastModified().toTime_t());
+    }
+
+}; /* DatasetThumbnail */
+
+#endif // DATASETTHUMBNAIL_H
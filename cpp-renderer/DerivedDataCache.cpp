@@ -0,0 +1 @@
+#include "DerivedDataCache.h"
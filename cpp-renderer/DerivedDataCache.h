@@ -0,0 +1,227 @@
+#ifndef DERIVEDDATACACHE_H
+#define DERIVEDDATACACHE_H
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QString>
+
+#include "Volume.h"
+
+using std::vector;
+
+/**
+ * On-disk cache of the data derived from the voxels of a dataset, so that re-opening a dataset does not recompute
+ * it: the histogram, the value range and, with PRECOMPUTED_GRADIENTS, the gradients and gradient magnitudes.
+ *
+ * The cache is a sidecar file next to the dataset (dataset.dat.cache). It starts with a header that identifies the
+ * dataset by its path, size, modification time and a hash of the voxel values, followed by the histogram and the
+ * gradient arrays, which are stored exactly as Volume keeps them in memory. Loading maps the file into memory and
+ * lets the volume use the mapped gradients directly, so nothing is read until it is sampled.
+ *
+ * A cache whose version, key or layout does not match is ignored, and rewritten after the derived data has been
+ * recomputed. When the dataset's directory is not writable, nothing is cached.
+ */
+class DerivedDataCache
+{
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    /// Give the volume, whose voxels have been loaded from datasetFile, its derived data from the cache. Return
+    /// false if there is no valid cache for the dataset, or it lacks gradients the volume needs.
+    static bool load(Volume *volume, const QString &datasetFile) {
+        QFile *file = new QFile(cacheFile(datasetFile));
+        if (!file->open(QIODevice::ReadOnly) || file->size() < (qint64)sizeof(Header)) {
+            delete file;
+            return false;
+        }
+
+        const uchar *data = file->map(0, file->size());
+        if (data == NULL) {
+            delete file;
+            return false;
+        }
+
+        const Header &header = *(const Header*)data;
+        const bool needGradients = volume->getGradientPolicy() == Volume::PRECOMPUTED_GRADIENTS;
+        const qint64 voxels = volume->getVoxelNum();
+
+        if (!matches(header, makeHeader(*volume, datasetFile)) || (needGradients && !header.hasGradients) ||
+            header.histogramOffset + header.histogramSize * (qint64)sizeof(float) > file->size() ||
+            (header.hasGradients && header.magnitudeOffset + voxels * (qint64)sizeof(double) > file->size())) {
+            std::cout << "Derived data cache of " << datasetFile.toStdString() << " is stale." << std::endl;
+            delete file;
+            return false;
+        }
+
+        const float *histogram = (const float*)(data + header.histogramOffset);
+        const Vector3d *gradients = header.hasGradients ? (const Vector3d*)(data + header.gradientOffset) : NULL;
+        const double *magnitudes = header.hasGradients ? (const double*)(data + header.magnitudeOffset) : NULL;
+
+        // The volume keeps the file, and with it the mapping, for as long as it uses the gradients
+        volume->adoptDerivedData(new MappedFile(file), gradients, magnitudes,
+                                 vector<float>(histogram, histogram + header.histogramSize),
+                                 header.minimumValue, header.maximumValue);
+
+        std::cout << "Loaded derived data from the cache of " << datasetFile.toStdString() << "." << std::endl;
+        return true;
+    }
+
+    /// Write the derived data of the volume, whose voxels have been loaded from datasetFile, to the cache
+    static void store(const Volume &volume, const QString &datasetFile) {
+        if (!volume.isHistogramReady() || !volume.areGradientsReady()) {
+            return;
+        }
+
+        Header header = makeHeader(volume, datasetFile);
+        const vector<float> histogram = volume.GetHistogram();
+        const Vector3d *gradients = volume.getGradientData();
+        const double *magnitudes = volume.getGradientMagnitudeData();
+        const qint64 voxels = volume.getVoxelNum();
+
+        header.hasGradients = (gradients != NULL) ? 1 : 0;
+        header.minimumValue = volume.getMinimumValue();
+        header.maximumValue = volume.getMaximumValue();
+        header.histogramSize = (qint32)histogram.size();
+        header.histogramOffset = sizeof(Header);
+        header.gradientOffset = align(header.histogramOffset + header.histogramSize * sizeof(float));
+        header.magnitudeOffset = align(header.gradientOffset + (header.hasGradients ? voxels * sizeof(Vector3d) : 0));
+
+        // Write to a temporary file first, so that an interrupted write never leaves a cache that looks valid
+        const QString path = cacheFile(datasetFile);
+        QFile file(path + ".tmp");
+        if (!file.open(QIODevice::WriteOnly)) {
+            std::cout << "Cannot write the derived data cache " << path.toStdString() << "." << std::endl;
+            return;
+        }
+
+        bool written = file.write((const char*)&header, sizeof(Header)) == (qint64)sizeof(Header);
+        if (!histogram.empty()) {
+            written = written && file.write((const char*)&histogram[0], histogram.size() * sizeof(float)) == (qint64)(histogram.size() * sizeof(float));
+        }
+        if (header.hasGradients) {
+            written = written && file.seek(header.gradientOffset) &&
+                      file.write((const char*)gradients, voxels * sizeof(Vector3d)) == voxels * (qint64)sizeof(Vector3d) &&
+                      file.seek(header.magnitudeOffset) &&
+                      file.write((const char*)magnitudes, voxels * sizeof(double)) == voxels * (qint64)sizeof(double);
+        }
+        file.close();
+
+        QFile::remove(path);
+        if (!written || !file.rename(path)) {
+            std::cout << "Cannot write the derived data cache " << path.toStdString() << "." << std::endl;
+            file.remove();
+            return;
+        }
+
+        std::cout << "Stored derived data in the cache " << path.toStdString() << "." << std::endl;
+    }
+
+    /// Return the path of the cache file of a dataset
+    static QString cacheFile(const QString &datasetFile) {
+        return datasetFile + ".cache";
+    }
+
+    /// 64-bit FNV-1a hash of a block of bytes, taken eight bytes at a time
+    static quint64 hash(const uchar *data, qint64 size, quint64 seed) {
+        quint64 result = 14695981039346656037ULL ^ seed;
+
+        qint64 i = 0;
+        for ( ; i + 8 <= size ; i += 8) {
+            quint64 word;
+            memcpy(&word, data + i, 8);
+            result = (result ^ word) * 1099511628211ULL;
+        }
+        for ( ; i < size ; i++) {
+            result = (result ^ data[i]) * 1099511628211ULL;
+        }
+
+        return result;
+    }
+
+    // ********************************************************************************************************
+    // *** Private types **************************************************************************************
+private:
+    /// Increase when the layout of the cache or the computation of the derived data changes
+    static const quint32 CACHE_VERSION = 1;
+
+    /// Alignment of the arrays in the cache file
+    static const qint64 ALIGNMENT = 64;
+
+    /// Beginning of a cache file
+    struct Header {
+        char magic[8];             // "VVCACHE"
+        quint32 version;           // CACHE_VERSION
+        quint32 vectorSize;        // sizeof(Vector3d), which the stored gradients were written with
+        quint64 pathHash;          // Key: hash of the dataset's absolute path,
+        qint64 fileSize;           //      its size in bytes,
+        qint64 modified;           //      its modification time in seconds since the epoch,
+        quint64 contentHash;       //      and a hash of its voxel values
+        qint32 width, height, depth;
+        qint32 hasGradients;       // Whether the gradient arrays are present
+        float minimumValue;
+        float maximumValue;
+        qint32 histogramSize;      // Number of histogram bins
+        qint32 reserved;
+        qint64 histogramOffset;    // Offsets of the arrays from the start of the file
+        qint64 gradientOffset;
+        qint64 magnitudeOffset;
+    };
+
+    /// Keeps a cache file open, and so its mapping valid, for a volume using the mapped gradients
+    class MappedFile : public Volume::DerivedDataStorage
+    {
+    public:
+        explicit MappedFile(QFile *file) : m_file(file) {}
+        ~MappedFile() { delete m_file; }
+
+    private:
+        QFile *m_file;
+    };
+
+    // ********************************************************************************************************
+    // *** Private methods ************************************************************************************
+private:
+    /// Return a header with the identification of a dataset filled in
+    static Header makeHeader(const Volume &volume, const QString &datasetFile) {
+        Header header;
+        memset(&header, 0, sizeof(Header));
+
+        memcpy(header.magic, "VVCACHE", 8);
+        header.version = CACHE_VERSION;
+        header.vectorSize = sizeof(Vector3d);
+
+        QFileInfo info(datasetFile);
+        const QByteArray path = info.absoluteFilePath().toUtf8();
+        header.pathHash = hash((const uchar*)path.constData(), path.size(), 0);
+        header.fileSize = info.size();
+        header.modified = info.lastModified().toTime_t();
+        header.contentHash = hash((const uchar*)volume.getData(), volume.getVoxelNum() * (qint64)sizeof(float), 0);
+
+        header.width = volume.getWidth();
+        header.height = volume.getHeight();
+        header.depth = volume.getDepth();
+
+        return header;
+    }
+
+    /// Return true if a cache header identifies the same dataset, and was written by this version
+    static bool matches(const Header &cached, const Header &expected) {
+        return memcmp(cached.magic, expected.magic, 8) == 0 && cached.version == expected.version &&
+               cached.vectorSize == expected.vectorSize && cached.pathHash == expected.pathHash &&
+               cached.fileSize == expected.fileSize && cached.modified == expected.modified &&
+               cached.contentHash == expected.contentHash && cached.width == expected.width &&
+               cached.height == expected.height && cached.depth == expected.depth;
+    }
+
+    /// Round an offset up to the alignment of the arrays
+    static qint64 align(qint64 offset) {
+        return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+
+}; /* DerivedDataCache */
+
+#endif // DERIVEDDATACACHE_H
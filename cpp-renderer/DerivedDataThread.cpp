@@ -0,0 +1 @@
+#include "DerivedDataThread.h"
@@ -0,0 +1,80 @@
+#ifndef DERIVEDDATATHREAD_H
+#define DERIVEDDATATHREAD_H
+
+#include <QString>
+#include <QThread>
+
+#include "DerivedDataCache.h"
+#include "Volume.h"
+
+/**
+ * Computes the data derived from the voxels of a volume - the gradients for its gradient policy and the histogram -
+ * on a low priority background thread, so that a newly loaded volume can be rendered as soon as its voxels are read.
+ *
+ * When the volume was loaded from a file, the derived data is taken from its DerivedDataCache if that is valid,
+ * and otherwise stored in the cache after it has been computed.
+ *
+ * Until the gradients are ready, the volume computes them on the fly, and its histogram is empty. The finished()
+ * signal tells when everything is ready. Do not change or delete the volume before the thread has finished; wait()
+ * blocks until then. As finished() is queued to the receiver, it may arrive after the next computation has started:
+ * compare getRunNumber() with the number computeFor() returned to tell which computation it is about.
+ */
+class DerivedDataThread : public QThread
+{
+    // ********************************************************************************************************
+    // *** Basic methods **************************************************************************************
+public:
+    /// Constructor
+    explicit DerivedDataThread(QObject *parent = NULL) : QThread(parent), m_volume(NULL), m_runNumber(0)
+    {
+    }
+
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    /// Start computing the derived data of a volume whose voxels have been loaded from datasetFile (or an empty
+    /// string if the volume does not come from a file, which bypasses the cache). Return the number of this
+    /// computation (above 0).
+    int computeFor(Volume *volume, const QString &datasetFile = QString()) {
+        wait();
+
+        m_volume = volume;
+        m_datasetFile = datasetFile;
+        m_runNumber++;
+        start(QThread::LowPriority);
+        return m_runNumber;
+    }
+
+    /// Return the number of the last computation started
+    int getRunNumber() const { return m_runNumber; }
+
+    /// Return the file of the volume given to computeFor(), or an empty string if it does not come from a file
+    const QString& getDatasetFile() const { return m_datasetFile; }
+
+    // ********************************************************************************************************
+    // *** Protected methods **********************************************************************************
+protected:
+    void run() {
+        if (!m_datasetFile.isEmpty() && DerivedDataCache::load(m_volume, m_datasetFile)) {
+            return;
+        }
+
+        std::cout << "Computing gradients and histogram in the background." << std::endl;
+        m_volume->computeDerivedData();
+        std::cout << "Gradients and histogram ready." << std::endl;
+
+        if (!m_datasetFile.isEmpty()) {
+            DerivedDataCache::store(*m_volume, m_datasetFile);
+        }
+    }
+
+    // ********************************************************************************************************
+    // *** Class members **************************************************************************************
+private:
+    Volume *m_volume;
+    QString m_datasetFile;
+    int m_runNumber;
+
+}; /* DerivedDataThread */
+
+#endif // DERIVEDDATATHREAD_H
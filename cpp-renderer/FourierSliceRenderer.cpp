@@ -0,0 +1 @@
+#include "FourierSliceRenderer.h"
@@ -0,0 +1,348 @@
+#ifndef FOURIERSLICERENDERER_H
+#define FOURIERSLICERENDERER_H
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "FourierTransform.h"
+#include "RayGeometry.h"
+#include "Volume.h"
+
+using std::vector;
+
+/**
+ * X-ray renderer based on the Fourier projection-slice theorem (Malzbender, "Fourier Volume Rendering").
+ *
+ * The 2D Fourier transform of a parallel projection of the volume equals the slice through the origin of the
+ * volume's 3D Fourier transform that lies perpendicular to the projection direction. The 3D transform is computed
+ * once per volume. Each view then costs one interpolated slice extraction and one inverse 2D transform,
+ * O(N^2 log N) instead of the O(N^3) of marching every ray through the volume.
+ *
+ * To keep the interpolation errors small the volume is zero padded (twice its size along each axis when memory
+ * permits), centered around the origin of the periodic grid, and pre-divided by the transform of the trilinear
+ * interpolation kernel used to extract the slices. Volumes whose spectrum would not fit in MAX_SPECTRUM_BYTES even
+ * unpadded are not rendered; see canRender().
+ */
+class FourierSliceRenderer
+{
+    // ********************************************************************************************************
+    // *** Basic methods **************************************************************************************
+public:
+    /// Default constructor
+    FourierSliceRenderer() : m_volume(NULL), m_spectrumIsValid(false)
+    {
+        m_gridSize[0] = m_gridSize[1] = m_gridSize[2] = 0;
+        m_center[0] = m_center[1] = m_center[2] = 0;
+    }
+
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    /// Set the volume to render. The 3D spectrum is computed on the first call to renderAverage().
+    void setVolume(const Volume *volume) {
+        m_volume = volume;
+        m_spectrumIsValid = false;
+        m_spectrum.clear();
+    }
+
+    /// Return true if the spectrum of the volume fits in MAX_SPECTRUM_BYTES. Otherwise renderAverage() must not be
+    /// called, and the X-ray image is left to the ray caster.
+    bool canRender() const {
+        return m_volume != NULL && spectrumBytes(1) <= MAX_SPECTRUM_BYTES;
+    }
+
+    /// Render the average intensity along parallel rays (the X-ray image) into image, which holds resX*resY
+    /// values stored row by row. The volume must be one that canRender().
+    ///
+    /// All vectors are in voxel coordinates: origin is the starting position of the ray of pixel (0,0), pixelRight
+    /// and pixelUp are the offsets between neighbouring pixels, and direction is the normalized projection vector.
+    /// Pixels whose ray misses the volume are set to -1.
+    void renderAverage(const float origin[3], const float pixelRight[3], const float pixelUp[3], const float direction[3],
+                       float *image, int resX, int resY) {
+        if (!m_spectrumIsValid) {
+            computeSpectrum();
+        }
+
+        // Orthonormal basis of the projection plane
+        float axisA[3];
+        float axisB[3];
+        normalized(pixelRight, axisA);
+        normalized(pixelUp, axisB);
+
+        vector<ComplexFloat> projection;
+        extractSlice(axisA, axisB, projection);
+        inverseTransform2d(projection);
+
+        const float dimensions[3] = { (float)m_volume->getWidth(), (float)m_volume->getHeight(), (float)m_volume->getDepth() };
+
+        #pragma omp parallel for
+        for (int y = 0 ; y < resY ; y++) {
+            for (int x = 0 ; x < resX ; x++) {
+                float rayStart[3];
+                float relative[3];
+                for (int i = 0 ; i < 3 ; i++) {
+                    rayStart[i] = origin[i] + pixelRight[i] * x + pixelUp[i] * y;
+                    relative[i] = rayStart[i] - m_center[i];
+                }
+
+                float chordLength = RayGeometry::boxChordLength(rayStart, direction, dimensions);
+
+                if (chordLength <= 0) {
+                    image[y * resX + x] = -1;
+                    continue;
+                }
+
+                // Position of this ray in the projection plane, relative to the volume center
+                float a = relative[0] * axisA[0] + relative[1] * axisA[1] + relative[2] * axisA[2];
+                float b = relative[0] * axisB[0] + relative[1] * axisB[1] + relative[2] * axisB[2];
+
+                float lineIntegral = sampleProjection(projection, a, b);
+
+                image[y * resX + x] = std::max(0.0f, std::min(lineIntegral / chordLength, 1.0f));
+            }
+        }
+    }
+
+    // ********************************************************************************************************
+    // *** Private methods ************************************************************************************
+private:
+    /// Compute the 3D Fourier transform of the padded, centered and pre-compensated volume
+    void computeSpectrum() {
+        const int dimensions[3] = { m_volume->getWidth(), m_volume->getHeight(), m_volume->getDepth() };
+
+        // Pad each axis to twice its size, unless that would use more than PADDED_SPECTRUM_BYTES
+        const int padding = (spectrumBytes(2) <= PADDED_SPECTRUM_BYTES) ? 2 : 1;
+        for (int i = 0 ; i < 3 ; i++) {
+            m_gridSize[i] = FourierTransform::nextPowerOfTwo(dimensions[i]) * padding;
+        }
+
+        std::cout << "Computing Fourier spectrum on a " << m_gridSize[0] << "x" << m_gridSize[1] << "x" << m_gridSize[2]
+                  << " grid." << std::endl;
+
+        const int nx = m_gridSize[0];
+        const int ny = m_gridSize[1];
+        const int nz = m_gridSize[2];
+
+        m_spectrum.assign((long)nx * ny * nz, ComplexFloat(0, 0));
+
+        for (int i = 0 ; i < 3 ; i++) {
+            m_center[i] = (float)(dimensions[i] / 2);
+        }
+
+        // Scatter the voxels into the grid so that the volume center lands on the grid origin (wrapping around),
+        // dividing by the spatial roll-off caused by trilinear interpolation of the spectrum
+        #pragma omp parallel for
+        for (int z = 0 ; z < dimensions[2] ; z++) {
+            int gz = wrap(z - (int)m_center[2], nz);
+            float rollOffZ = interpolationRollOff(z - m_center[2], nz);
+
+            for (int y = 0 ; y < dimensions[1] ; y++) {
+                int gy = wrap(y - (int)m_center[1], ny);
+                float rollOffY = interpolationRollOff(y - m_center[1], ny);
+
+                for (int x = 0 ; x < dimensions[0] ; x++) {
+                    int gx = wrap(x - (int)m_center[0], nx);
+                    float rollOff = interpolationRollOff(x - m_center[0], nx) * rollOffY * rollOffZ;
+
+                    m_spectrum[((long)gz * ny + gy) * nx + gx] = ComplexFloat(m_volume->getVoxel(x, y, z) / rollOff, 0);
+                }
+            }
+        }
+
+        // Transform along x, then y, then z
+        FourierTransform transformX(nx);
+        FourierTransform transformY(ny);
+        FourierTransform transformZ(nz);
+
+        #pragma omp parallel
+        {
+            vector<ComplexFloat> buffer(std::max(nx, std::max(ny, nz)));
+
+            #pragma omp for
+            for (int line = 0 ; line < ny * nz ; line++) {
+                transformX.transform(&m_spectrum[(long)line * nx], false);
+            }
+
+            #pragma omp for
+            for (int line = 0 ; line < nx * nz ; line++) {
+                int x = line % nx;
+                int z = line / nx;
+                transformY.transformStrided(&m_spectrum[(long)z * nx * ny + x], nx, &buffer[0], false);
+            }
+
+            #pragma omp for
+            for (int line = 0 ; line < nx * ny ; line++) {
+                transformZ.transformStrided(&m_spectrum[line], nx * ny, &buffer[0], false);
+            }
+        }
+
+        // The projection plane must cover the volume diagonal without wrapping around
+        float diagonal = sqrt((float)(dimensions[0]*dimensions[0] + dimensions[1]*dimensions[1] + dimensions[2]*dimensions[2]));
+        m_sliceSize = FourierTransform::nextPowerOfTwo((int)ceil(diagonal) + 2);
+
+        m_spectrumIsValid = true;
+    }
+
+    /// Extract the central slice of the spectrum spanned by the two (orthonormal) plane axes
+    void extractSlice(const float axisA[3], const float axisB[3], vector<ComplexFloat> &slice) const {
+        const int m = m_sliceSize;
+        slice.assign((long)m * m, ComplexFloat(0, 0));
+
+        #pragma omp parallel for
+        for (int row = 0 ; row < m ; row++) {
+            // Signed frequency index along the second axis
+            int kb = (row < m/2) ? row : row - m;
+
+            for (int column = 0 ; column < m ; column++) {
+                int ka = (column < m/2) ? column : column - m;
+
+                // Frequency in cycles per voxel
+                float frequency[3];
+                bool outsideBand = false;
+                for (int i = 0 ; i < 3 ; i++) {
+                    frequency[i] = (ka * axisA[i] + kb * axisB[i]) / m;
+                    if (fabs(frequency[i]) >= 0.5f) {
+                        outsideBand = true;
+                    }
+                }
+
+                if (!outsideBand) {
+                    slice[(long)row * m + column] = sampleSpectrum(frequency[0] * m_gridSize[0],
+                                                                   frequency[1] * m_gridSize[1],
+                                                                   frequency[2] * m_gridSize[2]);
+                }
+            }
+        }
+    }
+
+    /// Trilinearly interpolate the (periodic) spectrum at the given fractional grid position
+    ComplexFloat sampleSpectrum(float fx, float fy, float fz) const {
+        const int nx = m_gridSize[0];
+        const int ny = m_gridSize[1];
+        const int nz = m_gridSize[2];
+
+        int x0 = (int)floor(fx);
+        int y0 = (int)floor(fy);
+        int z0 = (int)floor(fz);
+
+        float xd = fx - x0;
+        float yd = fy - y0;
+        float zd = fz - z0;
+
+        int x1 = wrap(x0 + 1, nx);
+        int y1 = wrap(y0 + 1, ny);
+        int z1 = wrap(z0 + 1, nz);
+        x0 = wrap(x0, nx);
+        y0 = wrap(y0, ny);
+        z0 = wrap(z0, nz);
+
+        const ComplexFloat *data = &m_spectrum[0];
+
+        ComplexFloat c00 = data[((long)z0 * ny + y0) * nx + x0] * (1-xd) + data[((long)z0 * ny + y0) * nx + x1] * xd;
+        ComplexFloat c10 = data[((long)z0 * ny + y1) * nx + x0] * (1-xd) + data[((long)z0 * ny + y1) * nx + x1] * xd;
+        ComplexFloat c01 = data[((long)z1 * ny + y0) * nx + x0] * (1-xd) + data[((long)z1 * ny + y0) * nx + x1] * xd;
+        ComplexFloat c11 = data[((long)z1 * ny + y1) * nx + x0] * (1-xd) + data[((long)z1 * ny + y1) * nx + x1] * xd;
+
+        ComplexFloat c0 = c00 * (1-yd) + c10 * yd;
+        ComplexFloat c1 = c01 * (1-yd) + c11 * yd;
+
+        return c0 * (1-zd) + c1 * zd;
+    }
+
+    /// Inverse 2D transform of a square m x m grid, in place
+    void inverseTransform2d(vector<ComplexFloat> &grid) const {
+        const int m = m_sliceSize;
+        FourierTransform transform(m);
+
+        #pragma omp parallel
+        {
+            vector<ComplexFloat> buffer(m);
+
+            #pragma omp for
+            for (int row = 0 ; row < m ; row++) {
+                transform.transform(&grid[(long)row * m], true);
+            }
+
+            #pragma omp for
+            for (int column = 0 ; column < m ; column++) {
+                transform.transformStrided(&grid[column], m, &buffer[0], true);
+            }
+        }
+    }
+
+    /// Bilinearly sample the (real part of the) projection at plane coordinates (a, b) relative to the volume center
+    float sampleProjection(const vector<ComplexFloat> &projection, float a, float b) const {
+        const int m = m_sliceSize;
+
+        if (fabs(a) >= m/2 - 1 || fabs(b) >= m/2 - 1) {
+            return 0;
+        }
+
+        int a0 = (int)floor(a);
+        int b0 = (int)floor(b);
+        float ad = a - a0;
+        float bd = b - b0;
+
+        float p00 = projection[(long)wrap(b0, m) * m + wrap(a0, m)].real();
+        float p10 = projection[(long)wrap(b0, m) * m + wrap(a0 + 1, m)].real();
+        float p01 = projection[(long)wrap(b0 + 1, m) * m + wrap(a0, m)].real();
+        float p11 = projection[(long)wrap(b0 + 1, m) * m + wrap(a0 + 1, m)].real();
+
+        return (p00 * (1-ad) + p10 * ad) * (1-bd) + (p01 * (1-ad) + p11 * ad) * bd;
+    }
+
+    /// Spatial attenuation caused by trilinear interpolation of a spectrum sampled on a grid of size n:
+    /// sinc^2(x/n), the transform of the triangle (linear interpolation) kernel.
+    static float interpolationRollOff(float x, int n) {
+        if (x == 0) {
+            return 1.0f;
+        }
+
+        float argument = PI * x / n;
+        float sinc = sin(argument) / argument;
+        return sinc * sinc;
+    }
+
+    /// Copy v to result, normalized
+    static void normalized(const float v[3], float result[3]) {
+        float length = sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+        for (int i = 0 ; i < 3 ; i++) {
+            result[i] = (length > 0) ? v[i] / length : 0;
+        }
+    }
+
+    /// Wrap index i into [0, n)
+    static int wrap(int i, int n) {
+        int result = i % n;
+        return (result < 0) ? result + n : result;
+    }
+
+    /// Return the size in bytes of the spectrum of the volume, with each axis padded to its next power of two and
+    /// multiplied by padding
+    long long spectrumBytes(int padding) const {
+        long long bytes = sizeof(ComplexFloat);
+        bytes *= FourierTransform::nextPowerOfTwo(m_volume->getWidth()) * padding;
+        bytes *= FourierTransform::nextPowerOfTwo(m_volume->getHeight()) * padding;
+        bytes *= FourierTransform::nextPowerOfTwo(m_volume->getDepth()) * padding;
+        return bytes;
+    }
+
+    // ********************************************************************************************************
+    // *** Class members **************************************************************************************
+private:
+    static const long long PADDED_SPECTRUM_BYTES = 512LL * 1024 * 1024; // Largest spectrum padded to twice the size
+    static const long long MAX_SPECTRUM_BYTES = 1024LL * 1024 * 1024;   // Largest spectrum of any volume
+
+    const Volume *m_volume;
+    bool m_spectrumIsValid;
+
+    int m_gridSize[3];    // Size of the padded 3D grid along each axis
+    float m_center[3];    // Voxel position mapped to the origin of the grid
+    int m_sliceSize;      // Size of the square 2D projection grid
+
+    vector<ComplexFloat> m_spectrum; // 3D Fourier transform of the volume, x fastest
+
+}; /* FourierSliceRenderer */
+
+#endif // FOURIERSLICERENDERER_H
@@ -0,0 +1 @@
+#include "FourierTransform.h"
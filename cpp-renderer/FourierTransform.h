@@ -0,0 +1,131 @@
+#ifndef FOURIERTRANSFORM_H
+#define FOURIERTRANSFORM_H
+
+#include <cmath>
+#include <complex>
+#include <vector>
+
+#include "Matrix4d.h"
+
+using std::vector;
+
+typedef std::complex<float> ComplexFloat;
+
+/**
+ * In-place radix-2 fast Fourier transform of a fixed, power-of-two length.
+ * The twiddle factors and the bit reversal permutation are computed once in the constructor, so a single
+ * instance can be reused to transform all the lines of a 2D or 3D grid.
+ *
+ * The forward transform is unnormalized, the inverse transform divides by the length.
+ */
+class FourierTransform
+{
+    // ********************************************************************************************************
+    // *** Basic methods **************************************************************************************
+public:
+    /// Create a transform for sequences of length n. n must be a power of two.
+    FourierTransform(int n) : m_length(n), m_twiddles(n/2), m_bitReversed(n)
+    {
+        for (int i = 0 ; i < n/2 ; i++) {
+            double angle = -2.0 * PI * i / n;
+            m_twiddles[i] = ComplexFloat((float)cos(angle), (float)sin(angle));
+        }
+
+        int bits = 0;
+        while ((1 << bits) < n) {
+            bits++;
+        }
+
+        for (int i = 0 ; i < n ; i++) {
+            int reversed = 0;
+            for (int b = 0 ; b < bits ; b++) {
+                if (i & (1 << b)) {
+                    reversed |= 1 << (bits - 1 - b);
+                }
+            }
+            m_bitReversed[i] = reversed;
+        }
+    }
+
+    // ********************************************************************************************************
+    // *** Static methods *************************************************************************************
+public:
+    /// Return the smallest power of two that is greater than or equal to n
+    static int nextPowerOfTwo(int n) {
+        int result = 1;
+        while (result < n) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    /// Return the length of the sequences this transform operates on
+    int getLength() const { return m_length; }
+
+    /// Transform the sequence in place. inverse selects the inverse transform (including the 1/n normalization).
+    void transform(ComplexFloat *data, bool inverse) const {
+        const int n = m_length;
+
+        for (int i = 0 ; i < n ; i++) {
+            int j = m_bitReversed[i];
+            if (j > i) {
+                std::swap(data[i], data[j]);
+            }
+        }
+
+        // Butterflies, doubling the transform size at each pass
+        for (int size = 2 ; size <= n ; size <<= 1) {
+            int half = size / 2;
+            int twiddleStep = n / size;
+
+            for (int start = 0 ; start < n ; start += size) {
+                for (int k = 0 ; k < half ; k++) {
+                    ComplexFloat w = m_twiddles[k * twiddleStep];
+                    if (inverse) {
+                        w = std::conj(w);
+                    }
+
+                    ComplexFloat even = data[start + k];
+                    ComplexFloat odd = data[start + k + half] * w;
+
+                    data[start + k] = even + odd;
+                    data[start + k + half] = even - odd;
+                }
+            }
+        }
+
+        if (inverse) {
+            float normalization = 1.0f / n;
+            for (int i = 0 ; i < n ; i++) {
+                data[i] *= normalization;
+            }
+        }
+    }
+
+    /// Transform the sequence of length n found at data[0], data[stride], data[2*stride], ..., using buffer
+    /// (which must hold at least n elements) as scratch space.
+    void transformStrided(ComplexFloat *data, int stride, ComplexFloat *buffer, bool inverse) const {
+        for (int i = 0 ; i < m_length ; i++) {
+            buffer[i] = data[(long)i * stride];
+        }
+
+        transform(buffer, inverse);
+
+        for (int i = 0 ; i < m_length ; i++) {
+            data[(long)i * stride] = buffer[i];
+        }
+    }
+
+    // ********************************************************************************************************
+    // *** Class members **************************************************************************************
+private:
+    int m_length;
+    vector<ComplexFloat> m_twiddles; // exp(-2*pi*i*k/n) for k in [0, n/2)
+    vector<int> m_bitReversed;
+
+}; /* FourierTransform */
+
+#endif // FOURIERTRANSFORM_H
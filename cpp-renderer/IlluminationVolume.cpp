@@ -0,0 +1,5 @@
+#include "IlluminationVolume.h"
+
+/// Fraction of the light spread to each neighbour between two slices. The blur accumulates over the sweep, so
+/// shadows get softer further away from the occluder.
+const float IlluminationVolume::BLUR_WEIGHT = 0.05f;
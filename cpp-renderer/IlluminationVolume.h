@@ -0,0 +1,357 @@
+#ifndef ILLUMINATIONVOLUME_H
+#define ILLUMINATIONVOLUME_H
+
+#include <cmath>
+#include <vector>
+
+#include "Volume.h"
+#include "transfer_function.h"
+
+using std::vector;
+
+/**
+ * Precomputed light volume for shadowed DVR.
+ *
+ * Stores, on a grid of half the volume's resolution, the fraction of a directional light that reaches each point
+ * through the classified volume. It is computed by sweeping the slices perpendicular to the principal light axis
+ * in the direction the light travels: each slice receives the light transmitted by the previous one, sampled
+ * along the light direction and slightly blurred, which softens the shadows with distance. The slices are swept
+ * one after the other, and the points of a slice are computed in parallel. A shaded sample then only needs one
+ * extra trilinear fetch instead of a shadow ray.
+ *
+ * When only the transfer function changes, the slices before the first one containing a voxel whose opacity
+ * changed still receive the same light, and the sweep is resumed from there.
+ */
+class IlluminationVolume
+{
+    // ********************************************************************************************************
+    // *** Basic methods **************************************************************************************
+public:
+    /// Default constructor
+    IlluminationVolume() : m_volume(NULL), m_gridIsValid(false), m_width(0), m_height(0), m_depth(0), m_tfMode(-1),
+        m_step(0)
+    {
+        m_lightDirection[0] = m_lightDirection[1] = m_lightDirection[2] = 0;
+    }
+
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    /// Set the volume to illuminate. The volume is sampled, and the light computed, on the next call to update().
+    void setVolume(const Volume *volume) {
+        m_volume = volume;
+        m_gridIsValid = false;
+
+        m_alphaTable.clear();
+        m_tfMode = -1;
+    }
+
+    /// Bring the light up to date. lightDirection is the normalized direction the light travels in, in voxel
+    /// coordinates; tfMode selects the transfer function mode (0 is 1D, 1 is 1D with gradient-based transparency),
+    /// and rayCasterStep is the ray caster's step size in voxel units, which the opacities refer to.
+    void update(TransferFunction *transferFunction, int tfMode, const float lightDirection[3], float rayCasterStep) {
+        if (!m_gridIsValid) {
+            sampleVolume();
+            m_gridIsValid = true;
+        }
+
+        vector<float> alphaTable(ALPHA_TABLE_SIZE);
+        for (int i = 0 ; i < ALPHA_TABLE_SIZE ; i++) {
+            alphaTable[i] = transferFunction->GetAlpha((double)i / (ALPHA_TABLE_SIZE - 1));
+        }
+
+        bool lightChanged = tfMode != m_tfMode || rayCasterStep != m_step || m_alphaTable.empty();
+        for (int i = 0 ; i < 3 ; i++) {
+            lightChanged = lightChanged || lightDirection[i] != m_lightDirection[i];
+        }
+
+        // Coarse intensity ranges whose opacity changed
+        unsigned long long changedRanges = 0;
+        if (!lightChanged) {
+            for (int i = 0 ; i < ALPHA_TABLE_SIZE ; i++) {
+                if (alphaTable[i] != m_alphaTable[i]) {
+                    changedRanges |= rangeBit(i);
+                }
+            }
+
+            if (changedRanges == 0) {
+                return;
+            }
+        }
+
+        m_alphaTable = alphaTable;
+        m_tfMode = tfMode;
+        m_step = rayCasterStep;
+        for (int i = 0 ; i < 3 ; i++) {
+            m_lightDirection[i] = lightDirection[i];
+        }
+
+        sweep(changedRanges);
+    }
+
+    /// Return the fraction of the light that reaches the given position, in voxel coordinates. Valid after update().
+    float getIllumination(float x, float y, float z) const {
+        float gx = std::max(0.0f, std::min(x / GRID_SPACING, (float)(m_width - 1)));
+        float gy = std::max(0.0f, std::min(y / GRID_SPACING, (float)(m_height - 1)));
+        float gz = std::max(0.0f, std::min(z / GRID_SPACING, (float)(m_depth - 1)));
+
+        int x0 = std::max(0, std::min((int)gx, m_width - 2));
+        int y0 = std::max(0, std::min((int)gy, m_height - 2));
+        int z0 = std::max(0, std::min((int)gz, m_depth - 2));
+        int x1 = std::min(x0 + 1, m_width - 1);
+        int y1 = std::min(y0 + 1, m_height - 1);
+        int z1 = std::min(z0 + 1, m_depth - 1);
+
+        float xd = gx - x0;
+        float yd = gy - y0;
+        float zd = gz - z0;
+
+        float c00 = m_light[gridIndex(x0, y0, z0)] * (1-xd) + m_light[gridIndex(x1, y0, z0)] * xd;
+        float c10 = m_light[gridIndex(x0, y1, z0)] * (1-xd) + m_light[gridIndex(x1, y1, z0)] * xd;
+        float c01 = m_light[gridIndex(x0, y0, z1)] * (1-xd) + m_light[gridIndex(x1, y0, z1)] * xd;
+        float c11 = m_light[gridIndex(x0, y1, z1)] * (1-xd) + m_light[gridIndex(x1, y1, z1)] * xd;
+
+        float c0 = c00 * (1-yd) + c10 * yd;
+        float c1 = c01 * (1-yd) + c11 * yd;
+
+        return c0 * (1-zd) + c1 * zd;
+    }
+
+    // ********************************************************************************************************
+    // *** Private methods ************************************************************************************
+private:
+    /// Sample the volume on the grid, and find which coarse intensity ranges occur in each slice
+    void sampleVolume() {
+        m_width = (m_volume->getWidth() - 1) / GRID_SPACING + 1;
+        m_height = (m_volume->getHeight() - 1) / GRID_SPACING + 1;
+        m_depth = (m_volume->getDepth() - 1) / GRID_SPACING + 1;
+
+        m_values.resize(m_width * m_height * m_depth);
+        m_light.assign(m_width * m_height * m_depth, 1.0f);
+
+        #pragma omp parallel for
+        for (int z = 0 ; z < m_depth ; z++) {
+            for (int y = 0 ; y < m_height ; y++) {
+                for (int x = 0 ; x < m_width ; x++) {
+                    m_values[gridIndex(x, y, z)] = m_volume->getVoxel(x * GRID_SPACING, y * GRID_SPACING, z * GRID_SPACING);
+                }
+            }
+        }
+
+        // Which coarse intensity ranges occur in each slice, for every axis
+        const int dimensions[3] = { m_width, m_height, m_depth };
+        for (int axis = 0 ; axis < 3 ; axis++) {
+            m_sliceRanges[axis].assign(dimensions[axis], 0);
+        }
+
+        for (int z = 0 ; z < m_depth ; z++) {
+            for (int y = 0 ; y < m_height ; y++) {
+                for (int x = 0 ; x < m_width ; x++) {
+                    unsigned long long range = rangeBit(tableIndex(m_values[gridIndex(x, y, z)]));
+                    m_sliceRanges[0][x] |= range;
+                    m_sliceRanges[1][y] |= range;
+                    m_sliceRanges[2][z] |= range;
+                }
+            }
+        }
+    }
+
+    /// Propagate the light through the slices. If changedRanges is zero, every slice is recomputed; otherwise the
+    /// sweep starts after the first slice containing values in the changed ranges.
+    void sweep(unsigned long long changedRanges) {
+        const int dimensions[3] = { m_width, m_height, m_depth };
+
+        int axis = 0;
+        for (int i = 1 ; i < 3 ; i++) {
+            if (fabs(m_lightDirection[i]) > fabs(m_lightDirection[axis])) {
+                axis = i;
+            }
+        }
+
+        const int axisU = (axis + 1) % 3;
+        const int axisV = (axis + 2) % 3;
+        const int sliceCount = dimensions[axis];
+        const int sizeU = dimensions[axisU];
+        const int sizeV = dimensions[axisV];
+        const bool ascending = m_lightDirection[axis] > 0;
+
+        // Offset, in grid cells, from a point to where its light ray crosses the previous slice
+        const float offsetU = -m_lightDirection[axisU] / fabs(m_lightDirection[axis]);
+        const float offsetV = -m_lightDirection[axisV] / fabs(m_lightDirection[axis]);
+
+        // The light crosses this many voxels between two slices; the opacities hold for a ray caster step
+        const float exponent = GRID_SPACING / fabs(m_lightDirection[axis]) / m_step;
+
+        int first = 0;
+        if (changedRanges != 0) {
+            while (first < sliceCount && !(m_sliceRanges[axis][ascending ? first : sliceCount - 1 - first] & changedRanges)) {
+                first++;
+            }
+            first++; // The first changed slice still receives the same light
+        }
+
+        if (first >= sliceCount) {
+            return;
+        }
+
+        vector<float> transmitted(sizeU * sizeV);
+        vector<float> blurred(sizeU * sizeV);
+
+        for (int n = first ; n < sliceCount ; n++) {
+            const int k = ascending ? n : sliceCount - 1 - n;
+            const int previous = ascending ? k - 1 : k + 1;
+
+            if (n == 0) {
+                setSlice(axis, k, sizeU, sizeV, 1.0f);
+                continue;
+            }
+
+            // Light leaving the previous slice, blurred slightly
+            #pragma omp parallel for
+            for (int v = 0 ; v < sizeV ; v++) {
+                for (int u = 0 ; u < sizeU ; u++) {
+                    int index = sliceIndex(axis, previous, u, v);
+                    float alpha = opacity(index);
+                    transmitted[v * sizeU + u] = m_light[index] * pow(1 - alpha, exponent);
+                }
+            }
+
+            blur(transmitted, blurred, sizeU, sizeV);
+
+            #pragma omp parallel for
+            for (int v = 0 ; v < sizeV ; v++) {
+                for (int u = 0 ; u < sizeU ; u++) {
+                    m_light[sliceIndex(axis, k, u, v)] = sampleSlice(blurred, sizeU, sizeV, u + offsetU, v + offsetV);
+                }
+            }
+        }
+    }
+
+    /// Set the light of every point of a slice
+    void setSlice(int axis, int k, int sizeU, int sizeV, float light) {
+        for (int v = 0 ; v < sizeV ; v++) {
+            for (int u = 0 ; u < sizeU ; u++) {
+                m_light[sliceIndex(axis, k, u, v)] = light;
+            }
+        }
+    }
+
+    /// Return the opacity of a grid point for the current transfer function
+    float opacity(int index) const {
+        float value = m_values[index];
+        float alpha = m_alphaTable[tableIndex(value)];
+
+        // Gradient-based transparency, as in the ray caster
+        if (m_tfMode == 1 && alpha > 0) {
+            int x = index % m_width;
+            int y = (index / m_width) % m_height;
+            int z = index / (m_width * m_height);
+
+            double magnitude = m_volume->getGradientMagnitude((float)(x * GRID_SPACING), (float)(y * GRID_SPACING), (float)(z * GRID_SPACING));
+            alpha *= 1 - 1/log(exp(1.0) + magnitude);
+        }
+
+        return std::min(alpha, 1.0f);
+    }
+
+    /// Blur a slice with a narrow separable kernel
+    static void blur(vector<float> &slice, vector<float> &result, int sizeU, int sizeV) {
+        const float side = BLUR_WEIGHT;
+        const float center = 1 - 2 * BLUR_WEIGHT;
+
+        #pragma omp parallel for
+        for (int v = 0 ; v < sizeV ; v++) {
+            for (int u = 0 ; u < sizeU ; u++) {
+                int left = std::max(u - 1, 0);
+                int right = std::min(u + 1, sizeU - 1);
+                result[v * sizeU + u] = side * slice[v * sizeU + left] + center * slice[v * sizeU + u] + side * slice[v * sizeU + right];
+            }
+        }
+
+        #pragma omp parallel for
+        for (int v = 0 ; v < sizeV ; v++) {
+            int below = std::max(v - 1, 0);
+            int above = std::min(v + 1, sizeV - 1);
+            for (int u = 0 ; u < sizeU ; u++) {
+                slice[v * sizeU + u] = side * result[below * sizeU + u] + center * result[v * sizeU + u] + side * result[above * sizeU + u];
+            }
+        }
+
+        result.swap(slice);
+    }
+
+    /// Bilinearly sample a slice; light from outside the volume arrives unoccluded
+    static float sampleSlice(const vector<float> &slice, int sizeU, int sizeV, float u, float v) {
+        int u0 = (int)floor(u);
+        int v0 = (int)floor(v);
+        float ud = u - u0;
+        float vd = v - v0;
+
+        float result = 0;
+        for (int dv = 0 ; dv <= 1 ; dv++) {
+            for (int du = 0 ; du <= 1 ; du++) {
+                int pu = u0 + du;
+                int pv = v0 + dv;
+                float weight = (du ? ud : 1 - ud) * (dv ? vd : 1 - vd);
+
+                if (pu < 0 || pv < 0 || pu >= sizeU || pv >= sizeV) {
+                    result += weight;
+                } else {
+                    result += weight * slice[pv * sizeU + pu];
+                }
+            }
+        }
+
+        return result;
+    }
+
+    /// Return the entry of the opacity table a value is looked up in
+    static int tableIndex(float value) {
+        return std::max(0, std::min((int)(value * (ALPHA_TABLE_SIZE - 1) + 0.5f), ALPHA_TABLE_SIZE - 1));
+    }
+
+    /// Return the bit of the coarse intensity range containing an entry of the opacity table. The ranges are
+    /// runs of table entries rather than of values, so that a slice is marked for exactly the entries its values
+    /// are looked up in.
+    static unsigned long long rangeBit(int entry) {
+        return 1ULL << (entry * RANGE_COUNT / ALPHA_TABLE_SIZE);
+    }
+
+    int gridIndex(int x, int y, int z) const {
+        return (z * m_height + y) * m_width + x;
+    }
+
+    /// Index of the grid point at position (u, v) in slice k perpendicular to axis
+    int sliceIndex(int axis, int k, int u, int v) const {
+        int coordinates[3];
+        coordinates[axis] = k;
+        coordinates[(axis + 1) % 3] = u;
+        coordinates[(axis + 2) % 3] = v;
+        return gridIndex(coordinates[0], coordinates[1], coordinates[2]);
+    }
+
+    // ********************************************************************************************************
+    // *** Class members **************************************************************************************
+private:
+    static const int GRID_SPACING = 2;      // Voxels between grid points
+    static const int ALPHA_TABLE_SIZE = 1024;
+    static const int RANGE_COUNT = 64;      // Coarse intensity ranges, one per bit of the slice masks
+    static const float BLUR_WEIGHT;
+
+    const Volume *m_volume;
+    bool m_gridIsValid;                      // Whether the grid has been sampled from m_volume
+    int m_width, m_height, m_depth;          // Grid dimensions
+
+    vector<float> m_values;                  // Voxel value at each grid point
+    vector<float> m_light;                   // Fraction of the light reaching each grid point
+    vector<unsigned long long> m_sliceRanges[3]; // Per axis and slice, a bit per coarse intensity range present
+
+    // The settings the light was computed for
+    vector<float> m_alphaTable;
+    int m_tfMode;
+    float m_step;
+    float m_lightDirection[3];
+
+}; /* IlluminationVolume */
+
+#endif // ILLUMINATIONVOLUME_H
@@ -0,0 +1 @@
+#include "IsosurfaceRenderer.h"
@@ -0,0 +1,229 @@
+#ifndef ISOSURFACERENDERER_H
+#define ISOSURFACERENDERER_H
+
+#include <cmath>
+#include <vector>
+
+#include "MarchingCubes.h"
+#include "RayGeometry.h"
+#include "Volume.h"
+
+using std::vector;
+
+/**
+ * First-hit rendering by rasterizing an isosurface mesh, for parallel projection.
+ *
+ * The surface is extracted with marching cubes when the threshold changes, and each frame is rasterized on the
+ * CPU into a z-buffer, so rotating the view does not require marching any rays. The image is split into bands of
+ * rows that are rasterized in parallel; each band gets the list of triangles overlapping it.
+ *
+ * The renderer produces the interpolated surface normal of the nearest surface point of every pixel; shading is
+ * left to the caller, so it can be done exactly as for the ray caster.
+ */
+class IsosurfaceRenderer
+{
+    // ********************************************************************************************************
+    // *** Basic methods **************************************************************************************
+public:
+    /// Default constructor
+    IsosurfaceRenderer() : m_volume(NULL), m_blockRangesAreValid(false), m_threshold(-1)
+    {
+    }
+
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    /// What a pixel's ray hits
+    enum PixelStatus {
+        MISSES_VOLUME = 0,  ///< The ray does not intersect the volume's bounding box
+        MISSES_SURFACE = 1, ///< The ray crosses the volume without hitting the surface
+        HITS_SURFACE = 2    ///< The ray hits the surface
+    };
+
+    /// Set the volume to render. The value ranges of its blocks are computed, and the surface is extracted, on the
+    /// next call to render().
+    void setVolume(const Volume *volume) {
+        m_volume = volume;
+        m_blockRangesAreValid = false;
+        m_threshold = -1;
+    }
+
+    /// Return the current mesh
+    const IsosurfaceMesh& getMesh() const { return m_mesh; }
+
+    /// Rasterize the isosurface at the given threshold. For every pixel of the resX*resY image (stored row by row),
+    /// status receives a PixelStatus, and normals receives the surface normal (three floats) where the surface is hit.
+    ///
+    /// All vectors are in voxel coordinates: origin is the starting position of the ray of pixel (0,0), pixelRight
+    /// and pixelUp are the offsets between neighbouring pixels, and direction is the normalized projection vector.
+    /// These three vectors must be mutually orthogonal.
+    void render(float threshold, const float origin[3], const float pixelRight[3], const float pixelUp[3],
+                const float direction[3], unsigned char *status, float *normals, int resX, int resY) {
+        if (!m_blockRangesAreValid) {
+            m_marchingCubes.setVolume(m_volume);
+            m_blockRangesAreValid = true;
+        }
+
+        if (threshold != m_threshold) {
+            m_marchingCubes.extract(threshold, m_mesh);
+            m_threshold = threshold;
+        }
+
+        // Project the vertices to pixel coordinates and depth
+        const int vertexCount = m_mesh.getVertexCount();
+        const float rightScale = 1.0f / RayGeometry::dot(pixelRight, pixelRight);
+        const float upScale = 1.0f / RayGeometry::dot(pixelUp, pixelUp);
+
+        vector<float> projected(vertexCount * 3);
+
+        #pragma omp parallel for
+        for (int i = 0 ; i < vertexCount ; i++) {
+            float offset[3];
+            for (int c = 0 ; c < 3 ; c++) {
+                offset[c] = m_mesh.positions[i*3 + c] - origin[c];
+            }
+
+            projected[i*3 + 0] = RayGeometry::dot(offset, pixelRight) * rightScale;
+            projected[i*3 + 1] = RayGeometry::dot(offset, pixelUp) * upScale;
+            projected[i*3 + 2] = RayGeometry::dot(offset, direction);
+        }
+
+        vector<float> depth(resX * resY, 1e30f);
+        rasterize(projected, &depth[0], normals, resX, resY);
+
+        const float dimensions[3] = { (float)m_volume->getWidth(), (float)m_volume->getHeight(), (float)m_volume->getDepth() };
+
+        #pragma omp parallel for
+        for (int y = 0 ; y < resY ; y++) {
+            for (int x = 0 ; x < resX ; x++) {
+                float rayStart[3];
+                for (int i = 0 ; i < 3 ; i++) {
+                    rayStart[i] = origin[i] + pixelRight[i] * x + pixelUp[i] * y;
+                }
+
+                if (depth[y * resX + x] < 1e30f) {
+                    status[y * resX + x] = HITS_SURFACE;
+                } else if (RayGeometry::rayHitsBox(rayStart, direction, dimensions)) {
+                    status[y * resX + x] = MISSES_SURFACE;
+                } else {
+                    status[y * resX + x] = MISSES_VOLUME;
+                }
+            }
+        }
+    }
+
+    // ********************************************************************************************************
+    // *** Private methods ************************************************************************************
+private:
+    /// Rasterize the triangles of the mesh, given the projected vertices (pixel x, pixel y, depth), keeping the
+    /// nearest depth and the normal at that depth for every pixel center
+    void rasterize(const vector<float> &projected, float *depth, float *normals, int resX, int resY) const {
+        const int triangleCount = m_mesh.getTriangleCount();
+
+        // Bin the triangles into bands of rows
+        const int bandCount = (resY + BAND_HEIGHT - 1) / BAND_HEIGHT;
+        vector<vector<int> > bandTriangles(bandCount);
+
+        for (int t = 0 ; t < triangleCount ; t++) {
+            float minimumY, maximumY, minimumX, maximumX;
+            triangleBounds(projected, t, minimumX, maximumX, minimumY, maximumY);
+
+            int top = std::max((int)ceil(minimumY), 0);
+            int bottom = std::min((int)floor(maximumY), resY - 1);
+            if (top > bottom || maximumX < 0 || minimumX > resX - 1) {
+                continue;
+            }
+
+            for (int band = top / BAND_HEIGHT ; band <= bottom / BAND_HEIGHT ; band++) {
+                bandTriangles[band].push_back(t);
+            }
+        }
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int band = 0 ; band < bandCount ; band++) {
+            const int bandTop = band * BAND_HEIGHT;
+            const int bandBottom = std::min(bandTop + BAND_HEIGHT, resY) - 1;
+
+            for (int n = 0 ; n < (int)bandTriangles[band].size() ; n++) {
+                const int t = bandTriangles[band][n];
+                const int *corners = &m_mesh.indices[t * 3];
+
+                const float *p0 = &projected[corners[0] * 3];
+                const float *p1 = &projected[corners[1] * 3];
+                const float *p2 = &projected[corners[2] * 3];
+
+                // Twice the signed area; degenerate triangles cover no pixel centers
+                float area = (p1[0] - p0[0]) * (p2[1] - p0[1]) - (p2[0] - p0[0]) * (p1[1] - p0[1]);
+                if (area == 0) {
+                    continue;
+                }
+                float inverseArea = 1.0f / area;
+
+                float minimumY, maximumY, minimumX, maximumX;
+                triangleBounds(projected, t, minimumX, maximumX, minimumY, maximumY);
+
+                int top = std::max((int)ceil(minimumY), bandTop);
+                int bottom = std::min((int)floor(maximumY), bandBottom);
+                int left = std::max((int)ceil(minimumX), 0);
+                int right = std::min((int)floor(maximumX), resX - 1);
+
+                for (int y = top ; y <= bottom ; y++) {
+                    for (int x = left ; x <= right ; x++) {
+                        // Barycentric coordinates of the pixel center
+                        float w0 = ((p1[0] - x) * (p2[1] - y) - (p2[0] - x) * (p1[1] - y)) * inverseArea;
+                        float w1 = ((p2[0] - x) * (p0[1] - y) - (p0[0] - x) * (p2[1] - y)) * inverseArea;
+                        float w2 = 1 - w0 - w1;
+
+                        if (w0 < 0 || w1 < 0 || w2 < 0) {
+                            continue;
+                        }
+
+                        float pixelDepth = w0 * p0[2] + w1 * p1[2] + w2 * p2[2];
+                        int pixel = y * resX + x;
+
+                        if (pixelDepth < depth[pixel]) {
+                            depth[pixel] = pixelDepth;
+
+                            for (int c = 0 ; c < 3 ; c++) {
+                                normals[pixel*3 + c] = w0 * m_mesh.normals[corners[0]*3 + c] +
+                                                       w1 * m_mesh.normals[corners[1]*3 + c] +
+                                                       w2 * m_mesh.normals[corners[2]*3 + c];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /// Compute the screen space bounding box of a triangle
+    void triangleBounds(const vector<float> &projected, int t, float &minimumX, float &maximumX,
+                        float &minimumY, float &maximumY) const {
+        const int *corners = &m_mesh.indices[t * 3];
+
+        minimumX = maximumX = projected[corners[0] * 3 + 0];
+        minimumY = maximumY = projected[corners[0] * 3 + 1];
+
+        for (int i = 1 ; i < 3 ; i++) {
+            minimumX = std::min(minimumX, projected[corners[i] * 3 + 0]);
+            maximumX = std::max(maximumX, projected[corners[i] * 3 + 0]);
+            minimumY = std::min(minimumY, projected[corners[i] * 3 + 1]);
+            maximumY = std::max(maximumY, projected[corners[i] * 3 + 1]);
+        }
+    }
+
+    // ********************************************************************************************************
+    // *** Class members **************************************************************************************
+private:
+    static const int BAND_HEIGHT = 16; // Rows per rasterization band
+
+    const Volume *m_volume;
+    MarchingCubes m_marchingCubes;
+    bool m_blockRangesAreValid; // Whether m_marchingCubes has been set up for m_volume
+
+    IsosurfaceMesh m_mesh;
+    float m_threshold; // Threshold of the current mesh, negative if none has been extracted
+
+}; /* IsosurfaceRenderer */
+
+#endif // ISOSURFACERENDERER_H
@@ -0,0 +1 @@
+#include "LiveVolume.h"
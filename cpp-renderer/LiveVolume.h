@@ -0,0 +1,286 @@
+#ifndef LIVEVOLUME_H
+#define LIVEVOLUME_H
+
+#include <iostream>
+#include <string>
+#include <QMutex>
+#include <QObject>
+#include <QThread>
+#include <QWaitCondition>
+
+#include "SharedVolumeRing.h"
+#include "Volume.h"
+
+/**
+ * Volume fed live by another process, such as a running simulation, through a SharedVolumeRing. An ingest thread
+ * waits for the producer to publish frames, and converts the newest one from the shared memory into the volume
+ * that is not shown, where it also updates the derived data. Only the gradients around the slices that changed
+ * since that volume last held a frame are calculated again. The volume is then handed to the renderers with
+ * frameChanged(), and the ingest thread waits for the next frame.
+ *
+ * Frames that the producer publishes faster than they can be shown are skipped: the newest frame is always read
+ * next. The ingest thread never touches the volume that is shown; it stays valid until the next frameChanged() or
+ * close().
+ */
+class LiveVolume : public QObject
+{
+    Q_OBJECT
+
+    // ********************************************************************************************************
+    // *** Basic methods **************************************************************************************
+public:
+    /// Constructor; the volume is empty until open() is called
+    explicit LiveVolume(QObject *parent = NULL) : QObject(parent), m_ring(NULL),
+        m_gradientPolicy(Volume::PRECOMPUTED_GRADIENTS), m_shown(-1), m_frame(-1), m_backFrame(-1),
+        m_backReady(false), m_ingestedFrame(-1), m_droppedFrames(0), m_ingest(NULL), m_stopping(false)
+    {
+        m_volumes[0] = m_volumes[1] = NULL;
+
+        // Emitted by the ingest thread, and handled in the thread of the renderers
+        connect(this, SIGNAL(frameIngested()), this, SLOT(showIngestedFrame()), Qt::QueuedConnection);
+    }
+
+    /// Destructor
+    ~LiveVolume()
+    {
+        close();
+    }
+
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    static const int FIRST_FRAME_TIMEOUT_MS = 5000; ///< How long open() waits for the producer's first frame
+    static const int POLL_INTERVAL_MS = 5;          ///< How often the ingest thread looks for a new frame
+
+    /// Attach to the shared volume ring of a producer, and show its newest frame, waiting for the first one if
+    /// the producer has just started. The gradients are provided according to policy. Return false, keeping the
+    /// previous ring, if there is no ring under that name or no frame arrives.
+    bool open(const std::string &name, Volume::GradientPolicy policy) {
+        SharedVolumeRing *ring = new SharedVolumeRing();
+        if (!ring->attach(name)) {
+            delete ring;
+            return false;
+        }
+
+        for (int waited = 0 ; ring->getPublishedFrame() < 0 && waited < FIRST_FRAME_TIMEOUT_MS ; waited += POLL_INTERVAL_MS) {
+            Sleeper::sleep(POLL_INTERVAL_MS);
+        }
+
+        Volume *first = new Volume(ring->getWidth(), ring->getHeight(), ring->getDepth());
+        const qint64 frame = readNewestFrame(*ring, first, policy);
+        if (frame < 0) {
+            std::cerr << "+ No frame has arrived from \"" << name << "\"." << std::endl;
+            delete first;
+            delete ring;
+            return false;
+        }
+
+        close();
+
+        std::cout << "- Receiving " << ring->getWidth() << "x" << ring->getHeight() << "x" << ring->getDepth()
+                  << " voxels from \"" << name << "\"." << std::endl;
+
+        m_ring = ring;
+        m_gradientPolicy = policy;
+        m_volumes[0] = first;
+        m_volumes[1] = new Volume(ring->getWidth(), ring->getHeight(), ring->getDepth());
+        m_shown = 0;
+        m_frame = frame;
+        m_backFrame = -1;
+        m_backReady = false;
+        m_ingestedFrame = frame;
+        m_droppedFrames = 0;
+
+        m_stopping = false;
+        m_ingest = new IngestThread(this);
+        m_ingest->start();
+
+        return true;
+    }
+
+    /// Stop ingesting, detach from the ring and free the volumes
+    void close() {
+        if (m_ingest != NULL) {
+            m_mutex.lock();
+            m_stopping = true;
+            m_wakeIngest.wakeAll();
+            m_mutex.unlock();
+
+            m_ingest->wait();
+            delete m_ingest;
+            m_ingest = NULL;
+        }
+
+        delete m_ring;
+        m_ring = NULL;
+        delete m_volumes[0];
+        delete m_volumes[1];
+        m_volumes[0] = m_volumes[1] = NULL;
+
+        m_shown = -1;
+        m_frame = -1;
+    }
+
+    /// Return true while attached to a ring
+    bool isOpen() const { return m_shown >= 0; }
+
+    /// Return the producer's number of the frame shown, and the number of frames skipped so far
+    qint64 getCurrentFrame() const { return m_frame; }
+    qint64 getDroppedFrames() const { return m_droppedFrames; }
+
+    /// Return the volume of the frame shown, or NULL if not open
+    Volume* getCurrentVolume() { return isOpen() ? m_volumes[m_shown] : NULL; }
+
+    // ********************************************************************************************************
+    // *** Public slots ***************************************************************************************
+public slots:
+    /// Provide the gradients of the frames according to another policy (as a Volume::GradientPolicy). The frame
+    /// shown is left to the renderer that changed its policy.
+    void setGradientPolicy(int policy) {
+        QMutexLocker locker(&m_mutex);
+
+        m_gradientPolicy = (Volume::GradientPolicy)policy;
+
+        // A frame waiting to be shown is idle, and would otherwise be shown with the previous policy
+        if (m_backReady) {
+            m_volumes[1 - m_shown]->setGradientPolicy(m_gradientPolicy);
+        }
+    }
+
+    // ********************************************************************************************************
+    // *** Signals ********************************************************************************************
+signals:
+    /// A new frame is shown in volume
+    void frameChanged(Volume *volume);
+
+    /// The producer's number of the frame shown has changed
+    void frameNumberChanged(int frame);
+
+    /// The ingest thread has read a frame (emitted from the ingest thread)
+    void frameIngested();
+
+    // ********************************************************************************************************
+    // *** Private slots **************************************************************************************
+private slots:
+    /// Show the frame that the ingest thread has read, and let it read the next one into the previous volume
+    void showIngestedFrame() {
+        m_mutex.lock();
+        if (!isOpen() || !m_backReady) {
+            m_mutex.unlock();
+            return;
+        }
+
+        m_shown = 1 - m_shown;
+        m_frame = m_backFrame;
+        m_backReady = false;
+        m_wakeIngest.wakeAll();
+
+        Volume *volume = m_volumes[m_shown];
+        m_mutex.unlock();
+
+        emit frameChanged(volume);
+        emit frameNumberChanged((int)m_frame);
+    }
+
+    // ********************************************************************************************************
+    // *** Private types **************************************************************************************
+private:
+    /// Thread reading the frames as the producer publishes them
+    class IngestThread : public QThread
+    {
+    public:
+        explicit IngestThread(LiveVolume *live) : m_live(live) {}
+
+    protected:
+        void run() { m_live->ingestFrames(); }
+
+    private:
+        LiveVolume *m_live;
+    };
+
+    /// Access to the protected sleep of QThread
+    class Sleeper : public QThread
+    {
+    public:
+        static void sleep(int ms) { QThread::msleep(ms); }
+    };
+
+    // ********************************************************************************************************
+    // *** Private methods ************************************************************************************
+private:
+    /// Body of the ingest thread: read each new frame into the volume that is not shown, once the previous one
+    /// has been shown
+    void ingestFrames() {
+        QMutexLocker locker(&m_mutex);
+
+        while (!m_stopping) {
+            if (m_backReady || m_ring->getPublishedFrame() <= m_ingestedFrame) {
+                m_wakeIngest.wait(&m_mutex, POLL_INTERVAL_MS);
+                continue;
+            }
+
+            Volume *volume = m_volumes[1 - m_shown];
+            const Volume::GradientPolicy policy = m_gradientPolicy;
+
+            locker.unlock();
+            const qint64 frame = readNewestFrame(*m_ring, volume, policy);
+            locker.relock();
+
+            if (frame < 0) {
+                continue;
+            }
+
+            m_droppedFrames += frame - m_ingestedFrame - 1;
+            m_ingestedFrame = frame;
+            m_backFrame = frame;
+            m_backReady = true;
+            emit frameIngested();
+        }
+    }
+
+    /// Read the newest frame of a ring into a volume, with its derived data. Frames overwritten while they are
+    /// read are read again from the newest one. Return the number of the frame read, or -1 if there is none.
+    static qint64 readNewestFrame(const SharedVolumeRing &ring, Volume *volume, Volume::GradientPolicy policy) {
+        for (int attempt = 0 ; attempt < ring.getSlotCount() ; attempt++) {
+            const qint64 frame = ring.getPublishedFrame();
+            const unsigned char *data = ring.getFrame(frame);
+            if (data == NULL) {
+                continue;
+            }
+
+            // The voxels are converted straight from the shared memory, and checked before deriving from them
+            if (volume->setVoxelsFromDat(data, (size_t)ring.getFrameBytes(), policy, false) && ring.isFrameIntact(frame)) {
+                volume->computeDerivedData();
+                return frame;
+            }
+        }
+
+        return -1;
+    }
+
+    // Not copyable
+    LiveVolume(const LiveVolume&);
+    LiveVolume& operator=(const LiveVolume&);
+
+    // ********************************************************************************************************
+    // *** Class members **************************************************************************************
+private:
+    SharedVolumeRing *m_ring;
+    Volume::GradientPolicy m_gradientPolicy;
+
+    Volume *m_volumes[2];               // The volume shown, and the one the next frame is read into
+    int m_shown;                        // Index of the volume shown, or -1 if not open
+    qint64 m_frame;                     // Frame shown
+    qint64 m_backFrame;                 // Frame in the other volume, once read
+    bool m_backReady;                   // Whether the other volume holds a frame waiting to be shown
+    qint64 m_ingestedFrame;             // Newest frame read
+    qint64 m_droppedFrames;             // Frames published but never read
+
+    IngestThread *m_ingest;
+    QMutex m_mutex;                     // Guards the volumes, the frames and the policy
+    QWaitCondition m_wakeIngest;        // Signalled when the ingest thread may read the next frame
+    bool m_stopping;
+
+}; /* LiveVolume */
+
+#endif // LIVEVOLUME_H
@@ -0,0 +1 @@
+#include "LzCodec.h"
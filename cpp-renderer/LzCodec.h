@@ -0,0 +1,173 @@
+#ifndef LZCODEC_H
+#define LZCODEC_H
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+using std::vector;
+
+/**
+ * Lossless LZ77 compression of blocks of bytes, in the manner of LZ4: the output is a series of sequences, each
+ * a run of literal bytes followed by a match that copies earlier output. Matches are found through a hash table
+ * of the last position at which each 4-byte prefix was seen, which trades some compression for speed;
+ * decompression is a loop of copies.
+ *
+ * A sequence starts with a token whose high four bits give the number of literals and low four bits the match
+ * length minus MIN_MATCH; a value of 15 is continued in the following bytes, each adding up to 255. The literals
+ * follow, then the match offset as two bytes, little endian, then the match length continuation. The last sequence
+ * has only literals.
+ */
+class LzCodec
+{
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    /// Append the compressed form of size bytes to out
+    static void compress(const unsigned char *in, int size, vector<unsigned char> &out) {
+        vector<int> table(1 << HASH_BITS, -1); // Last position of each hashed 4-byte prefix
+
+        int anchor = 0; // Start of the pending literals
+        int position = 0;
+
+        while (position + MIN_MATCH <= size) {
+            const unsigned int prefix = read32(in + position);
+            const unsigned int hash = (prefix * 2654435761U) >> (32 - HASH_BITS);
+            const int candidate = table[hash];
+            table[hash] = position;
+
+            if (candidate < 0 || position - candidate > MAX_OFFSET || read32(in + candidate) != prefix) {
+                position++;
+                continue;
+            }
+
+            int length = MIN_MATCH;
+            while (position + length < size && in[candidate + length] == in[position + length]) {
+                length++;
+            }
+
+            writeSequence(in + anchor, position - anchor, position - candidate, length, out);
+
+            position += length;
+            anchor = position;
+        }
+
+        writeSequence(in + anchor, size - anchor, 0, 0, out);
+    }
+
+    /// Decompress inSize bytes of compressed data into outSize bytes at out. Return false if the data is corrupt
+    /// or does not decompress to exactly outSize bytes.
+    static bool decompress(const unsigned char *in, int inSize, unsigned char *out, int outSize) {
+        const unsigned char *inEnd = in + inSize;
+        unsigned char *outBegin = out;
+        unsigned char *outEnd = out + outSize;
+
+        while (in < inEnd) {
+            const int token = *in++;
+
+            int literals = token >> 4;
+            if (literals == 15 && !readLength(in, inEnd, (int)(outEnd - out), literals)) {
+                return false;
+            }
+            if (literals > inEnd - in || literals > outEnd - out) {
+                return false;
+            }
+            memcpy(out, in, literals);
+            in += literals;
+            out += literals;
+
+            if (in == inEnd) { // The last sequence has no match
+                break;
+            }
+
+            if (inEnd - in < 2) {
+                return false;
+            }
+            const int offset = in[0] | (in[1] << 8);
+            in += 2;
+
+            int length = token & 15;
+            if (length == 15 && !readLength(in, inEnd, (int)(outEnd - out) - MIN_MATCH, length)) {
+                return false;
+            }
+            length += MIN_MATCH;
+
+            if (offset == 0 || offset > out - outBegin || length > outEnd - out) {
+                return false;
+            }
+
+            // The match may overlap the bytes it produces, so copy it byte by byte
+            const unsigned char *match = out - offset;
+            for (int i = 0 ; i < length ; i++) {
+                out[i] = match[i];
+            }
+            out += length;
+        }
+
+        return out == outEnd;
+    }
+
+    // ********************************************************************************************************
+    // *** Private methods ************************************************************************************
+private:
+    static const int MIN_MATCH = 4;      // Shortest match worth encoding
+    static const int MAX_OFFSET = 65535; // Farthest match, limited by the two bytes of the offset
+    static const int HASH_BITS = 14;     // Size of the hash table
+
+    /// Read four bytes, in any alignment
+    static unsigned int read32(const unsigned char *p) {
+        unsigned int value;
+        memcpy(&value, p, 4);
+        return value;
+    }
+
+    /// Write a sequence of literals, followed by a match of the given offset and length unless length is zero
+    static void writeSequence(const unsigned char *literals, int literalCount, int offset, int length,
+                              vector<unsigned char> &out) {
+        const int matchCode = (length > 0) ? length - MIN_MATCH : 0;
+
+        out.push_back((unsigned char)((std::min(literalCount, 15) << 4) | std::min(matchCode, 15)));
+        if (literalCount >= 15) {
+            writeLength(literalCount - 15, out);
+        }
+        out.insert(out.end(), literals, literals + literalCount);
+
+        if (length > 0) {
+            out.push_back((unsigned char)(offset & 255));
+            out.push_back((unsigned char)(offset >> 8));
+            if (matchCode >= 15) {
+                writeLength(matchCode - 15, out);
+            }
+        }
+    }
+
+    /// Write the continuation of a length of 15 or more
+    static void writeLength(int remainder, vector<unsigned char> &out) {
+        while (remainder >= 255) {
+            out.push_back(255);
+            remainder -= 255;
+        }
+        out.push_back((unsigned char)remainder);
+    }
+
+    /// Add the continuation of a length to length. Return false if the data ends first, or the length would exceed
+    /// limit, which keeps corrupt data from overflowing it.
+    static bool readLength(const unsigned char *&in, const unsigned char *inEnd, int limit, int &length) {
+        for (;;) {
+            if (in == inEnd) {
+                return false;
+            }
+            const int byte = *in++;
+            if (byte > limit - length) {
+                return false;
+            }
+            length += byte;
+            if (byte != 255) {
+                return true;
+            }
+        }
+    }
+
+}; /* LzCodec */
+
+#endif // LZCODEC_H
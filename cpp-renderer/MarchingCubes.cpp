@@ -0,0 +1 @@
+#include "MarchingCubes.h"
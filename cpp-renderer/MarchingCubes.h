@@ -0,0 +1,283 @@
+#ifndef MARCHINGCUBES_H
+#define MARCHINGCUBES_H
+
+#include <algorithm>
+#include <vector>
+
+#include "MinMaxGrid.h"
+#include "Volume.h"
+
+using std::vector;
+
+/// Indexed triangle mesh in voxel coordinates
+struct IsosurfaceMesh {
+    vector<float> positions; // x, y, z per vertex
+    vector<float> normals;   // Negated volume gradient per vertex, not normalized (as used for shading in castRay)
+    vector<int> indices;     // Three vertex indices per triangle
+
+    int getVertexCount() const { return positions.size() / 3; }
+    int getTriangleCount() const { return indices.size() / 3; }
+};
+
+/**
+ * Marching cubes isosurface extraction (Lorensen & Cline, "Marching Cubes: A High Resolution 3D Surface
+ * Construction Algorithm").
+ *
+ * The cells of the volume are processed in parallel, block by block; blocks whose value range (from a MinMaxGrid)
+ * does not contain the threshold are skipped. Every vertex lies on a grid edge, so vertices are identified by
+ * a global edge key and the mesh is deduplicated by sorting the keys of all triangle corners. Vertex normals are
+ * interpolated from the volume's precomputed gradients.
+ *
+ * The case table is not typed in, but derived in the constructor by tracing the contour segments on the faces
+ * of the cube. Ambiguous faces always separate the corners that are above the threshold, so neighbouring cells
+ * agree on their shared face and the surface has no cracks.
+ */
+class MarchingCubes
+{
+    // ********************************************************************************************************
+    // *** Basic methods **************************************************************************************
+public:
+    /// Default constructor
+    MarchingCubes() : m_volume(NULL)
+    {
+        buildCaseTable();
+    }
+
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    /// Set the volume to extract isosurfaces from, and compute its block ranges
+    void setVolume(const Volume *volume) {
+        m_volume = volume;
+        m_blockRanges.build(*volume);
+    }
+
+    /// Extract the surface separating voxel values above the threshold from those at or below it
+    void extract(float threshold, IsosurfaceMesh &mesh) const {
+        mesh.positions.clear();
+        mesh.normals.clear();
+        mesh.indices.clear();
+
+        if (m_volume == NULL || m_volume->getWidth() < 2 || m_volume->getHeight() < 2 || m_volume->getDepth() < 2) {
+            return;
+        }
+
+        // Blocks the surface may pass through
+        vector<int> activeBlocks;
+        for (int bz = 0 ; bz < m_blockRanges.getBlocksZ() ; bz++) {
+            for (int by = 0 ; by < m_blockRanges.getBlocksY() ; by++) {
+                for (int bx = 0 ; bx < m_blockRanges.getBlocksX() ; bx++) {
+                    if (m_blockRanges.mayContain(bx, by, bz, threshold)) {
+                        activeBlocks.push_back((bz * m_blockRanges.getBlocksY() + by) * m_blockRanges.getBlocksX() + bx);
+                    }
+                }
+            }
+        }
+
+        // Triangles as edge keys, per block
+        vector<vector<long long> > blockTriangles(activeBlocks.size());
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int n = 0 ; n < (int)activeBlocks.size() ; n++) {
+            extractBlock(activeBlocks[n], threshold, blockTriangles[n]);
+        }
+
+        vector<long long> cornerKeys;
+        for (int n = 0 ; n < (int)blockTriangles.size() ; n++) {
+            cornerKeys.insert(cornerKeys.end(), blockTriangles[n].begin(), blockTriangles[n].end());
+        }
+
+        // Every distinct edge key becomes one vertex
+        vector<long long> vertexKeys(cornerKeys);
+        std::sort(vertexKeys.begin(), vertexKeys.end());
+        vertexKeys.erase(std::unique(vertexKeys.begin(), vertexKeys.end()), vertexKeys.end());
+
+        const int vertexCount = vertexKeys.size();
+        const int cornerCount = cornerKeys.size();
+
+        mesh.positions.resize(vertexCount * 3);
+        mesh.normals.resize(vertexCount * 3);
+        mesh.indices.resize(cornerCount);
+
+        #pragma omp parallel for
+        for (int i = 0 ; i < vertexCount ; i++) {
+            computeVertex(vertexKeys[i], threshold, &mesh.positions[i*3], &mesh.normals[i*3]);
+        }
+
+        #pragma omp parallel for
+        for (int i = 0 ; i < cornerCount ; i++) {
+            mesh.indices[i] = std::lower_bound(vertexKeys.begin(), vertexKeys.end(), cornerKeys[i]) - vertexKeys.begin();
+        }
+    }
+
+    // ********************************************************************************************************
+    // *** Private methods ************************************************************************************
+private:
+    /// Derive the triangulation of all 256 corner configurations.
+    ///
+    /// Corner c of a cell is at offset (c&1, (c>>1)&1, (c>>2)&1). On every face of the cube, walking the corners
+    /// counter-clockwise (seen from outside), the surface enters the region above the threshold at one crossed
+    /// edge and leaves it at the next; these pairs form the contour segments. Each crossed edge starts a segment on
+    /// one of its two faces and ends one on the other, so the segments link into closed loops, which are split
+    /// into triangle fans.
+    void buildCaseTable() {
+        int edgeIndex[8][3];
+        int edgeCount = 0;
+        for (int axis = 0 ; axis < 3 ; axis++) {
+            for (int corner = 0 ; corner < 8 ; corner++) {
+                if (!(corner & (1 << axis))) {
+                    m_edgeCorner[edgeCount] = corner;
+                    m_edgeAxis[edgeCount] = axis;
+                    edgeIndex[corner][axis] = edgeCount++;
+                }
+            }
+        }
+
+        int faces[6][4];
+        for (int axis = 0 ; axis < 3 ; axis++) {
+            int u = 1 << ((axis + 1) % 3);
+            int v = 1 << ((axis + 2) % 3);
+
+            for (int side = 0 ; side < 2 ; side++) {
+                int base = side << axis;
+                int corners[4] = { base, base | u, base | u | v, base | v };
+
+                // Counter-clockwise around +axis; the face at the low side is seen from the other direction
+                for (int k = 0 ; k < 4 ; k++) {
+                    faces[axis*2 + side][k] = side ? corners[k] : corners[3 - k];
+                }
+            }
+        }
+
+        for (int caseIndex = 0 ; caseIndex < 256 ; caseIndex++) {
+            int next[12];
+            std::fill(next, next + 12, -1);
+
+            for (int f = 0 ; f < 6 ; f++) {
+                int crossingEdge[4];
+                bool crossingEnters[4];
+                int crossings = 0;
+
+                for (int k = 0 ; k < 4 ; k++) {
+                    int from = faces[f][k];
+                    int to = faces[f][(k + 1) % 4];
+                    bool fromInside = (caseIndex >> from) & 1;
+                    bool toInside = (caseIndex >> to) & 1;
+
+                    if (fromInside != toInside) {
+                        int axis = ((from ^ to) == 1) ? 0 : (((from ^ to) == 2) ? 1 : 2);
+                        crossingEdge[crossings] = edgeIndex[from & to][axis];
+                        crossingEnters[crossings] = toInside;
+                        crossings++;
+                    }
+                }
+
+                // Entries and exits alternate; pairing each entry with the following exit keeps the corners
+                // above the threshold apart on ambiguous faces
+                for (int i = 0 ; i < crossings ; i++) {
+                    if (crossingEnters[i]) {
+                        next[crossingEdge[i]] = crossingEdge[(i + 1) % crossings];
+                    }
+                }
+            }
+
+            bool visited[12] = { false };
+            for (int e = 0 ; e < 12 ; e++) {
+                if (next[e] < 0 || visited[e]) {
+                    continue;
+                }
+
+                vector<int> loop;
+                for (int edge = e ; !visited[edge] ; edge = next[edge]) {
+                    visited[edge] = true;
+                    loop.push_back(edge);
+                }
+
+                for (int i = 1 ; i + 1 < (int)loop.size() ; i++) {
+                    m_caseTriangles[caseIndex].push_back(loop[0]);
+                    m_caseTriangles[caseIndex].push_back(loop[i]);
+                    m_caseTriangles[caseIndex].push_back(loop[i + 1]);
+                }
+            }
+        }
+    }
+
+    /// Extract the triangles of the cells in one block, appending the edge keys of their corners to triangles
+    void extractBlock(int block, float threshold, vector<long long> &triangles) const {
+        const int blocksX = m_blockRanges.getBlocksX();
+        const int blocksY = m_blockRanges.getBlocksY();
+        const int size = MinMaxGrid::BLOCK_SIZE;
+
+        const int startX = (block % blocksX) * size;
+        const int startY = ((block / blocksX) % blocksY) * size;
+        const int startZ = (block / (blocksX * blocksY)) * size;
+
+        const int endX = std::min(startX + size, m_volume->getWidth() - 1);
+        const int endY = std::min(startY + size, m_volume->getHeight() - 1);
+        const int endZ = std::min(startZ + size, m_volume->getDepth() - 1);
+
+        for (int z = startZ ; z < endZ ; z++) {
+            for (int y = startY ; y < endY ; y++) {
+                for (int x = startX ; x < endX ; x++) {
+                    int caseIndex = 0;
+                    for (int corner = 0 ; corner < 8 ; corner++) {
+                        if (m_volume->getVoxel(x + (corner & 1), y + ((corner >> 1) & 1), z + ((corner >> 2) & 1)) > threshold) {
+                            caseIndex |= 1 << corner;
+                        }
+                    }
+
+                    const vector<int> &caseTriangles = m_caseTriangles[caseIndex];
+                    for (int i = 0 ; i < (int)caseTriangles.size() ; i++) {
+                        int corner = m_edgeCorner[caseTriangles[i]];
+                        triangles.push_back(edgeKey(x + (corner & 1), y + ((corner >> 1) & 1), z + ((corner >> 2) & 1),
+                                                    m_edgeAxis[caseTriangles[i]]));
+                    }
+                }
+            }
+        }
+    }
+
+    /// Return the global key of the grid edge from voxel (x,y,z) to its neighbour along axis
+    long long edgeKey(int x, int y, int z, int axis) const {
+        return ((((long long)z * m_volume->getHeight() + y) * m_volume->getWidth() + x) * 3) + axis;
+    }
+
+    /// Compute the position and normal of the surface vertex on the grid edge with the given key
+    void computeVertex(long long key, float threshold, float position[3], float normal[3]) const {
+        const int axis = key % 3;
+        const long long voxel = key / 3;
+
+        int start[3];
+        start[0] = voxel % m_volume->getWidth();
+        start[1] = (voxel / m_volume->getWidth()) % m_volume->getHeight();
+        start[2] = voxel / ((long long)m_volume->getWidth() * m_volume->getHeight());
+
+        int end[3] = { start[0], start[1], start[2] };
+        end[axis]++;
+
+        float startValue = m_volume->getVoxel(start[0], start[1], start[2]);
+        float endValue = m_volume->getVoxel(end[0], end[1], end[2]);
+        float t = (threshold - startValue) / (endValue - startValue); // The edge crosses, so the values differ
+
+        const Vector3d &startGradient = m_volume->getGradient(start[0], start[1], start[2]);
+        const Vector3d &endGradient = m_volume->getGradient(end[0], end[1], end[2]);
+
+        for (int i = 0 ; i < 3 ; i++) {
+            position[i] = start[i] + ((i == axis) ? t : 0);
+            normal[i] = -(startGradient[i] * (1 - t) + endGradient[i] * t);
+        }
+    }
+
+    // ********************************************************************************************************
+    // *** Class members **************************************************************************************
+private:
+    const Volume *m_volume;
+    MinMaxGrid m_blockRanges;
+
+    int m_edgeCorner[12];            // Lower corner of each cube edge
+    int m_edgeAxis[12];              // Axis each cube edge runs along
+    vector<int> m_caseTriangles[256]; // Three cube edges per triangle, for every corner configuration
+
+}; /* MarchingCubes */
+
+#endif // MARCHINGCUBES_H
@@ -0,0 +1 @@
+#include "MinMaxGrid.h"
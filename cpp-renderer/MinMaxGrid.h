@@ -0,0 +1,108 @@
+#ifndef MINMAXGRID_H
+#define MINMAXGRID_H
+
+#include <algorithm>
+#include <vector>
+
+#include "Volume.h"
+
+using std::vector;
+
+/**
+ * Coarse grid holding the minimum and maximum voxel value of every block of BLOCK_SIZE^3 cells of a volume.
+ *
+ * A cell spans the eight voxels from (x,y,z) to (x+1,y+1,z+1), so the range of a block includes the voxels one
+ * past its last cell. Any function interpolated inside the block's cells then stays within [minimum, maximum], and
+ * a block can be skipped whenever the value of interest lies outside that range.
+ */
+class MinMaxGrid
+{
+    // ********************************************************************************************************
+    // *** Basic methods **************************************************************************************
+public:
+    /// Default constructor; the grid is empty until build() is called
+    MinMaxGrid() : m_blocksX(0), m_blocksY(0), m_blocksZ(0)
+    {
+    }
+
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    /// Compute the block ranges of the given volume
+    void build(const Volume &volume) {
+        const int cellsX = std::max(volume.getWidth() - 1, 1);
+        const int cellsY = std::max(volume.getHeight() - 1, 1);
+        const int cellsZ = std::max(volume.getDepth() - 1, 1);
+
+        m_blocksX = (cellsX + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        m_blocksY = (cellsY + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        m_blocksZ = (cellsZ + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+        m_minimum.resize(m_blocksX * m_blocksY * m_blocksZ);
+        m_maximum.resize(m_blocksX * m_blocksY * m_blocksZ);
+
+        #pragma omp parallel for
+        for (int bz = 0 ; bz < m_blocksZ ; bz++) {
+            for (int by = 0 ; by < m_blocksY ; by++) {
+                for (int bx = 0 ; bx < m_blocksX ; bx++) {
+                    float minimum = volume.getVoxel(bx * BLOCK_SIZE, by * BLOCK_SIZE, bz * BLOCK_SIZE);
+                    float maximum = minimum;
+
+                    int endX = std::min((bx + 1) * BLOCK_SIZE, volume.getWidth() - 1);
+                    int endY = std::min((by + 1) * BLOCK_SIZE, volume.getHeight() - 1);
+                    int endZ = std::min((bz + 1) * BLOCK_SIZE, volume.getDepth() - 1);
+
+                    for (int z = bz * BLOCK_SIZE ; z <= endZ ; z++) {
+                        for (int y = by * BLOCK_SIZE ; y <= endY ; y++) {
+                            for (int x = bx * BLOCK_SIZE ; x <= endX ; x++) {
+                                float value = volume.getVoxel(x, y, z);
+                                minimum = std::min(minimum, value);
+                                maximum = std::max(maximum, value);
+                            }
+                        }
+                    }
+
+                    m_minimum[blockIndex(bx, by, bz)] = minimum;
+                    m_maximum[blockIndex(bx, by, bz)] = maximum;
+                }
+            }
+        }
+    }
+
+    int getBlocksX() const { return m_blocksX; }
+    int getBlocksY() const { return m_blocksY; }
+    int getBlocksZ() const { return m_blocksZ; }
+
+    /// Return the smallest voxel value in the cells of a block
+    float getMinimum(int bx, int by, int bz) const { return m_minimum[blockIndex(bx, by, bz)]; }
+
+    /// Return the largest voxel value in the cells of a block
+    float getMaximum(int bx, int by, int bz) const { return m_maximum[blockIndex(bx, by, bz)]; }
+
+    /// Return true if the cells of the block contain values on both sides of the threshold, i.e. if the
+    /// isosurface at that threshold may pass through the block
+    bool mayContain(int bx, int by, int bz, float threshold) const {
+        int index = blockIndex(bx, by, bz);
+        return m_minimum[index] <= threshold && m_maximum[index] > threshold;
+    }
+
+    // ********************************************************************************************************
+    // *** Private methods ************************************************************************************
+private:
+    int blockIndex(int bx, int by, int bz) const {
+        return (bz * m_blocksY + by) * m_blocksX + bx;
+    }
+
+    // ********************************************************************************************************
+    // *** Class members **************************************************************************************
+public:
+    static const int BLOCK_SIZE = 8; // Cells per block along each axis
+
+private:
+    int m_blocksX, m_blocksY, m_blocksZ;
+    vector<float> m_minimum;
+    vector<float> m_maximum;
+
+}; /* MinMaxGrid */
+
+#endif // MINMAXGRID_H
@@ -0,0 +1 @@
+#include "OutOfCoreVolume.h"
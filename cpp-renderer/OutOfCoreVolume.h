@@ -0,0 +1,462 @@
+#ifndef OUTOFCOREVOLUME_H
+#define OUTOFCOREVOLUME_H
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <QFile>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+
+#include "AtomicAccess.h"
+#include "Volume.h"
+
+using std::vector;
+
+/**
+ * Volume that stays on disk, for datasets too large to load into memory. The voxels are read from the DAT file in
+ * bricks of BRICK_SIZE^3 voxels when the ray caster first samples them, and kept in a cache limited to a memory
+ * budget, from which the least recently used bricks are evicted. Bricks are stored as the 16-bit values of the file
+ * and include one voxel of the neighbouring bricks, so that each trilinear sample reads from a single brick.
+ *
+ * Bricks are read by a pool of loader threads. The ray caster requests the bricks along each ray, in the order
+ * the ray traverses them, before sampling it; each frame replaces the requests of the previous one, so the
+ * loaders always work on what is in view. Until a brick has arrived, its samples are taken from a coarse volume
+ * that is kept in memory: a downsampled copy of the dataset loaded with Volume::loadVolumeDat() and a stride.
+ * bricksArrived() is emitted when the loaders have caught up, to render the frame again with the new bricks.
+ *
+ * Samples may be taken from several threads at once. Bricks are only evicted in endFrame(), so beginFrame() and
+ * endFrame() must be called around the sampling of each frame, from the thread that renders.
+ */
+class OutOfCoreVolume : public QObject
+{
+    Q_OBJECT
+
+    // ********************************************************************************************************
+    // *** Basic methods **************************************************************************************
+public:
+    /// Constructor; the volume is empty until open() is called
+    explicit OutOfCoreVolume(QObject *parent = NULL) : QObject(parent),
+        m_width(0), m_height(0), m_depth(0), m_bricksX(0), m_bricksY(0), m_bricksZ(0), m_coarse(NULL),
+        m_coarseStride(1), m_capacity(0), m_resident(0), m_inFlight(0), m_frame(0), m_stopping(false)
+    {
+    }
+
+    /// Destructor
+    ~OutOfCoreVolume()
+    {
+        close();
+    }
+
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    /// Stream the voxels of a DAT file, caching at most memoryBudget bytes of bricks. coarse is a downsampled copy
+    /// of the file loaded with the given stride; it must be kept until close(). Return false if the file cannot
+    /// be read.
+    bool open(const std::string &filename, const Volume *coarse, int coarseStride, qint64 memoryBudget) {
+        close();
+
+        if (!Volume::readDatDimensions(filename, m_width, m_height, m_depth)) {
+            std::cerr << "+ Error opening the file." << std::endl;
+            return false;
+        }
+
+        m_filename = filename;
+        m_coarse = coarse;
+        m_coarseStride = std::max(coarseStride, 1);
+
+        m_bricksX = (m_width + BRICK_SIZE - 1) / BRICK_SIZE;
+        m_bricksY = (m_height + BRICK_SIZE - 1) / BRICK_SIZE;
+        m_bricksZ = (m_depth + BRICK_SIZE - 1) / BRICK_SIZE;
+
+        const int brickCount = m_bricksX * m_bricksY * m_bricksZ;
+        m_bricks.assign(brickCount, (unsigned short*)NULL);
+        m_brickState.assign(brickCount, (char)ABSENT);
+        m_lastUsed.assign(brickCount, 0);
+
+        m_capacity = (int)std::max((qint64)1, memoryBudget / (qint64)(BRICK_VOXELS * sizeof(unsigned short)));
+        m_resident = 0;
+        m_inFlight = 0;
+        m_refused.clear();
+        m_frame = 0;
+
+        std::cout << "- Streaming " << m_width << "x" << m_height << "x" << m_depth << " voxels from disk, in "
+                  << brickCount << " bricks of which " << std::min(m_capacity, brickCount) << " fit in memory."
+                  << std::endl;
+
+        m_stopping = false;
+        const int loaderCount = std::max(2, QThread::idealThreadCount());
+        for (int i = 0 ; i < loaderCount ; i++) {
+            m_loaders.push_back(new BrickLoader(this));
+            m_loaders.back()->start(QThread::LowPriority);
+        }
+
+        return true;
+    }
+
+    /// Stop the loaders and free the bricks
+    void close() {
+        m_mutex.lock();
+        m_stopping = true;
+        m_wakeLoaders.wakeAll();
+        m_mutex.unlock();
+
+        for (int i = 0 ; i < (int)m_loaders.size() ; i++) {
+            m_loaders[i]->wait();
+            delete m_loaders[i];
+        }
+        m_loaders.clear();
+
+        for (int i = 0 ; i < (int)m_bricks.size() ; i++) {
+            delete [] m_bricks[i];
+        }
+        m_bricks.clear();
+        m_brickState.clear();
+        m_lastUsed.clear();
+        m_requests.clear();
+        m_refused.clear();
+
+        m_width = m_height = m_depth = 0;
+        m_coarse = NULL;
+    }
+
+    /// Return true if a file is being streamed
+    bool isOpen() const { return m_coarse != NULL; }
+
+    /// Return the dimensions of the full resolution
+    int getWidth() const { return m_width; }
+    int getHeight() const { return m_height; }
+    int getDepth() const { return m_depth; }
+
+    /// Return the stride of the coarse volume: voxel i of the coarse volume is voxel i * stride of the file
+    int getCoarseStride() const { return m_coarseStride; }
+
+    /// Return the number of bricks in memory
+    int getResidentBricks() const { return m_resident; }
+
+    /// Start rendering a frame: forget the requests of the previous frame that the loaders have not started on
+    void beginFrame() {
+        QMutexLocker locker(&m_mutex);
+
+        m_frame++;
+
+        for (int i = 0 ; i < (int)m_requests.size() ; i++) {
+            m_brickState[m_requests[i]] = ABSENT;
+        }
+        m_inFlight -= (int)m_requests.size();
+        m_requests.clear();
+
+        for (int i = 0 ; i < (int)m_refused.size() ; i++) {
+            m_brickState[m_refused[i]] = ABSENT;
+        }
+        m_refused.clear();
+    }
+
+    /// Finish rendering a frame: evict the least recently used bricks to make room for those that the frame
+    /// requested beyond the memory budget. Bricks sampled in this frame are kept, so a view that needs more bricks
+    /// than the budget shows the rest at the coarse resolution.
+    void endFrame() {
+        QMutexLocker locker(&m_mutex);
+
+        const int excess = m_resident + m_inFlight + (int)m_refused.size() - m_capacity;
+        if (m_refused.empty() || excess <= 0) {
+            return;
+        }
+
+        vector<std::pair<int, int> > candidates; // Frame of last use, brick
+        for (int i = 0 ; i < (int)m_bricks.size() ; i++) {
+            if (m_brickState[i] == RESIDENT && m_lastUsed[i] < m_frame) {
+                candidates.push_back(std::make_pair(m_lastUsed[i], i));
+            }
+        }
+
+        const int evicted = std::min(excess, (int)candidates.size());
+        std::partial_sort(candidates.begin(), candidates.begin() + evicted, candidates.end());
+
+        for (int i = 0 ; i < evicted ; i++) {
+            const int brick = candidates[i].second;
+            delete [] m_bricks[brick];
+            AtomicAccess::storeRelease(m_bricks[brick], (unsigned short*)NULL);
+            m_brickState[brick] = ABSENT;
+            m_resident--;
+        }
+
+        if (evicted > 0) {
+            emit bricksArrived(); // Render again to request the bricks there was no room for
+        }
+    }
+
+    /// Request the bricks along the segment from entry to exit, in voxel coordinates of the full resolution, in
+    /// the order from entry to exit
+    void prefetchRay(const float entry[3], const float exit[3]) {
+        const float dx = exit[0] - entry[0];
+        const float dy = exit[1] - entry[1];
+        const float dz = exit[2] - entry[2];
+
+        // Step half a brick at a time, which visits every brick the segment passes through more than marginally
+        const float length = sqrt(dx*dx + dy*dy + dz*dz);
+        const int steps = (int)(length / (BRICK_SIZE / 2)) + 1;
+
+        int previous = -1;
+        for (int i = 0 ; i <= steps ; i++) {
+            const float t = (float)i / steps;
+            const int brick = brickAt(entry[0] + dx*t, entry[1] + dy*t, entry[2] + dz*t);
+            if (brick != previous) {
+                request(brick);
+                previous = brick;
+            }
+        }
+    }
+
+    /// Get the voxel value at a position in voxel coordinates of the full resolution using trilinear
+    /// interpolation, from the coarse volume if the brick is not in memory. Same results as
+    /// Volume::getVoxelTrilinear() of the full resolution.
+    float getVoxelTrilinear(float x, float y, float z) {
+        x = std::min(std::max(x, 0.0f), (float)(m_width - 1));
+        y = std::min(std::max(y, 0.0f), (float)(m_height - 1));
+        z = std::min(std::max(z, 0.0f), (float)(m_depth - 1));
+
+        const int brick = brickAt(x, y, z);
+        const unsigned short *data = AtomicAccess::loadAcquire(m_bricks[brick]);
+        if (data == NULL) {
+            request(brick);
+            return m_coarse->getVoxelTrilinear(x / m_coarseStride, y / m_coarseStride, z / m_coarseStride);
+        }
+        m_lastUsed[brick] = m_frame;
+
+        // Position within the brick
+        const float bx = x - (brick % m_bricksX) * BRICK_SIZE;
+        const float by = y - ((brick / m_bricksX) % m_bricksY) * BRICK_SIZE;
+        const float bz = z - (brick / (m_bricksX * m_bricksY)) * BRICK_SIZE;
+
+        const int x0 = (int)bx;
+        const int y0 = (int)by;
+        const int z0 = (int)bz;
+        const float xd = bx - x0;
+        const float yd = by - y0;
+        const float zd = bz - z0;
+
+        const unsigned short *p = data + (z0 * BRICK_SPAN + y0) * BRICK_SPAN + x0;
+        const int dy = BRICK_SPAN;
+        const int dz = BRICK_SPAN * BRICK_SPAN;
+
+        const float c00 = p[0] * (1-xd) + p[1] * xd;
+        const float c10 = p[dy] * (1-xd) + p[dy + 1] * xd;
+        const float c01 = p[dz] * (1-xd) + p[dz + 1] * xd;
+        const float c11 = p[dz + dy] * (1-xd) + p[dz + dy + 1] * xd;
+
+        const float c0 = c00 * (1-yd) + c10 * yd;
+        const float c1 = c01 * (1-yd) + c11 * yd;
+
+        return (c0 * (1-zd) + c1 * zd) / 4095.0f; // Scaling to [0,1].
+    }
+
+    /// Get the closest voxel to a position in voxel coordinates of the full resolution, from the coarse volume if
+    /// the brick is not in memory
+    float getVoxelClosest(float x, float y, float z) {
+        const int xVal = std::min(std::max((int)floor(x + 0.5), 0), m_width - 1);
+        const int yVal = std::min(std::max((int)floor(y + 0.5), 0), m_height - 1);
+        const int zVal = std::min(std::max((int)floor(z + 0.5), 0), m_depth - 1);
+
+        const int brick = brickAt(xVal, yVal, zVal);
+        const unsigned short *data = AtomicAccess::loadAcquire(m_bricks[brick]);
+        if (data == NULL) {
+            request(brick);
+            return m_coarse->getVoxelClosest(x / m_coarseStride, y / m_coarseStride, z / m_coarseStride);
+        }
+        m_lastUsed[brick] = m_frame;
+
+        const int offset = ((zVal % BRICK_SIZE) * BRICK_SPAN + yVal % BRICK_SIZE) * BRICK_SPAN + xVal % BRICK_SIZE;
+        return data[offset] / 4095.0f; // Scaling to [0,1].
+    }
+
+    // ********************************************************************************************************
+    // *** Signals ********************************************************************************************
+signals:
+    /// Bricks requested by the last frame have arrived, or room has been made for more; emitted from the loader
+    /// threads as well as from endFrame()
+    void bricksArrived();
+
+    // ********************************************************************************************************
+    // *** Private types **************************************************************************************
+private:
+    static const int BRICK_SIZE = 32;                // Voxels of a brick along each axis,
+    static const int BRICK_SPAN = BRICK_SIZE + 1;    // plus one voxel of the next brick
+    static const int BRICK_VOXELS = BRICK_SPAN * BRICK_SPAN * BRICK_SPAN;
+
+    /// State of a brick
+    enum BrickState {
+        ABSENT,   // On disk only
+        QUEUED,   // Requested or being read
+        RESIDENT, // In memory
+        REFUSED   // Requested in this frame, but beyond the memory budget
+    };
+
+    /// Thread of the loader pool, reading requested bricks until the volume is closed
+    class BrickLoader : public QThread
+    {
+    public:
+        explicit BrickLoader(OutOfCoreVolume *volume) : m_volume(volume) {}
+
+    protected:
+        void run() { m_volume->loadBricks(); }
+
+    private:
+        OutOfCoreVolume *m_volume;
+    };
+
+    // ********************************************************************************************************
+    // *** Private methods ************************************************************************************
+private:
+    /// Return the brick containing a position in voxel coordinates, which must be inside the volume
+    int brickAt(float x, float y, float z) const {
+        const int bx = std::min(std::max((int)x / BRICK_SIZE, 0), m_bricksX - 1);
+        const int by = std::min(std::max((int)y / BRICK_SIZE, 0), m_bricksY - 1);
+        const int bz = std::min(std::max((int)z / BRICK_SIZE, 0), m_bricksZ - 1);
+        return (bz * m_bricksY + by) * m_bricksX + bx;
+    }
+
+    /// Queue a brick for the loaders, unless it is in memory or on its way. When the memory budget is taken by
+    /// other bricks, the request is refused and made again in the next frame, after endFrame() made room.
+    void request(int brick) {
+        if (m_brickState[brick] != ABSENT) { // Checked again below; this spares the lock for most samples
+            return;
+        }
+
+        QMutexLocker locker(&m_mutex);
+
+        if (m_brickState[brick] != ABSENT) {
+            return;
+        }
+        if (m_resident + m_inFlight >= m_capacity) {
+            m_brickState[brick] = REFUSED;
+            m_refused.push_back(brick);
+            return;
+        }
+
+        m_brickState[brick] = QUEUED;
+        m_requests.push_back(brick);
+        m_inFlight++;
+        m_wakeLoaders.wakeOne();
+    }
+
+    /// Body of the loader threads: read requested bricks into memory until the volume is closed
+    void loadBricks() {
+        QFile file(QString::fromStdString(m_filename));
+        const bool opened = file.open(QIODevice::ReadOnly);
+
+        vector<char> row(BRICK_SPAN * 2);
+
+        m_mutex.lock();
+        for (;;) {
+            while (m_requests.empty() && !m_stopping) {
+                m_wakeLoaders.wait(&m_mutex);
+            }
+            if (m_stopping) {
+                break;
+            }
+
+            const int brick = m_requests.front();
+            m_requests.pop_front();
+            m_mutex.unlock();
+
+            unsigned short *data = new unsigned short[BRICK_VOXELS];
+            if (!opened || !readBrick(file, brick, data, &row[0])) {
+                memset(data, 0, BRICK_VOXELS * sizeof(unsigned short));
+            }
+
+            m_mutex.lock();
+            AtomicAccess::storeRelease(m_bricks[brick], data); // Render threads test it without the lock
+            m_brickState[brick] = RESIDENT;
+            m_resident++;
+            m_inFlight--;
+
+            if (m_inFlight == 0) {
+                emit bricksArrived();
+            }
+        }
+        m_mutex.unlock();
+    }
+
+    /// Read a brick, including the voxels it shares with the next bricks, from the file. Past the borders of the
+    /// volume the last voxel is repeated. Return false if the file ends prematurely.
+    bool readBrick(QFile &file, int brick, unsigned short *data, char *row) const {
+        const int startX = (brick % m_bricksX) * BRICK_SIZE;
+        const int startY = ((brick / m_bricksX) % m_bricksY) * BRICK_SIZE;
+        const int startZ = (brick / (m_bricksX * m_bricksY)) * BRICK_SIZE;
+        const int columns = std::min((int)BRICK_SPAN, m_width - startX);
+
+        for (int z = 0 ; z < BRICK_SPAN ; z++) {
+            for (int y = 0 ; y < BRICK_SPAN ; y++) {
+                unsigned short *voxels = data + (z * BRICK_SPAN + y) * BRICK_SPAN;
+
+                if (startZ + z >= m_depth) { // Repeat the last slice
+                    memcpy(voxels, voxels - BRICK_SPAN * BRICK_SPAN, BRICK_SPAN * sizeof(unsigned short));
+                    continue;
+                }
+                if (startY + y >= m_height) { // Repeat the last row
+                    memcpy(voxels, voxels - BRICK_SPAN, BRICK_SPAN * sizeof(unsigned short));
+                    continue;
+                }
+
+                const qint64 offset = ((qint64)(startZ + z) * m_height + startY + y) * m_width + startX;
+                if (!file.seek(HEADER_BYTES + offset * 2) || file.read(row, columns * 2) != columns * 2) {
+                    return false;
+                }
+
+                for (int x = 0 ; x < columns ; x++) {
+                    voxels[x] = BYTE2INT(row[2*x], row[2*x + 1]);
+                }
+                for (int x = columns ; x < BRICK_SPAN ; x++) {
+                    voxels[x] = voxels[columns - 1];
+                }
+            }
+        }
+
+        return true;
+    }
+
+    // Not copyable
+    OutOfCoreVolume(const OutOfCoreVolume&);
+    OutOfCoreVolume& operator=(const OutOfCoreVolume&);
+
+    // ********************************************************************************************************
+    // *** Class members **************************************************************************************
+private:
+    static const int HEADER_BYTES = 6; // Width, height and depth at the start of a DAT file
+
+    std::string m_filename;
+    int m_width, m_height, m_depth;
+    int m_bricksX, m_bricksY, m_bricksZ;
+
+    const Volume *m_coarse; // Samples of bricks that are not in memory
+    int m_coarseStride;
+
+    vector<unsigned short*> m_bricks; // Voxels of the resident bricks, NULL for the others
+    vector<char> m_brickState;        // BrickState of each brick
+    vector<int> m_lastUsed;           // Frame in which each brick was last sampled
+
+    // Guarded by m_mutex; the brick states are also read without it, as a hint
+    QMutex m_mutex;
+    QWaitCondition m_wakeLoaders;
+    std::deque<int> m_requests; // Bricks waiting for a loader, in the order they were requested
+    int m_capacity;             // Number of bricks that fit in the memory budget
+    int m_resident;             // Number of bricks in memory
+    int m_inFlight;             // Number of bricks requested or being read
+    vector<int> m_refused;      // Bricks requested in this frame beyond the memory budget
+    int m_frame;
+    bool m_stopping;            // Tells the loaders to finish
+
+    vector<BrickLoader*> m_loaders;
+
+}; /* OutOfCoreVolume */
+
+#endif // OUTOFCOREVOLUME_H
@@ -0,0 +1 @@
+#include "RayGeometry.h"
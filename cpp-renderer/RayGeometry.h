@@ -0,0 +1,61 @@
+#ifndef RAYGEOMETRY_H
+#define RAYGEOMETRY_H
+
+#include <algorithm>
+
+/**
+ * Geometry of the rays of the rendering engines, in voxel coordinates: where a ray crosses the bounding box of the
+ * volume, the box [0,dimensions]. The vectors are arrays of three floats, as the engines pass them.
+ */
+class RayGeometry
+{
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    /// Return the dot product of two vectors
+    static float dot(const float a[3], const float b[3]) {
+        return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+    }
+
+    /// Find the parameters t of rayStart + t*direction where the line of the ray enters and leaves the box
+    /// [0,dimensions]. Return false if the ray misses the box, or the box lies behind rayStart.
+    static bool clipToBox(const float rayStart[3], const float direction[3], const float dimensions[3],
+                          float &tNear, float &tFar) {
+        tNear = -1e30f;
+        tFar = 1e30f;
+
+        for (int i = 0 ; i < 3 ; i++) {
+            if (direction[i] == 0) {
+                if (rayStart[i] < 0 || rayStart[i] > dimensions[i]) {
+                    return false;
+                }
+            } else {
+                float t1 = (0 - rayStart[i]) / direction[i];
+                float t2 = (dimensions[i] - rayStart[i]) / direction[i];
+                if (t1 > t2) {
+                    std::swap(t1, t2);
+                }
+                tNear = std::max(tNear, t1);
+                tFar = std::min(tFar, t2);
+            }
+        }
+
+        return tNear <= tFar && tFar >= 0;
+    }
+
+    /// Return true if the ray intersects the box [0,dimensions]
+    static bool rayHitsBox(const float rayStart[3], const float direction[3], const float dimensions[3]) {
+        float tNear, tFar;
+        return clipToBox(rayStart, direction, dimensions, tNear, tFar);
+    }
+
+    /// Return the length of the segment of the line of the ray inside the box [0,dimensions], or 0 if the ray
+    /// misses it. The length is in units of direction.
+    static float boxChordLength(const float rayStart[3], const float direction[3], const float dimensions[3]) {
+        float tNear, tFar;
+        return clipToBox(rayStart, direction, dimensions, tNear, tFar) ? tFar - tNear : 0;
+    }
+
+}; /* RayGeometry */
+
+#endif // RAYGEOMETRY_H
@@ -0,0 +1 @@
+#include "ShadingContext.h"
@@ -0,0 +1,164 @@
+#ifndef SHADINGCONTEXT_H
+#define SHADINGCONTEXT_H
+
+#include <cmath>
+#include <vector>
+
+#include "SimdMath.h"
+#include "Vector3d.h"
+
+using std::vector;
+
+/**
+ * Phong shading with everything that is constant during a frame computed once, in begin().
+ *
+ * A sample with base color c and normal n is shaded as min(c * k_d|L.n| + k_s|H.n|^b, 1) per color channel,
+ * where L is the light vector and H the normalized halfway vector between the light and the eye, for white light.
+ * L and H are set up once per frame, and the specular power is read from a table with linear interpolation
+ * instead of evaluating pow() per sample.
+ *
+ * The normals are the (negated) volume gradients without normalization, so weak gradients shade darker. Central
+ * differences of values in [0,1] have a magnitude of at most sqrt(3)/2, so the specular base |H.n| always lies in
+ * the range of the table; larger values fall back to pow().
+ *
+ * shadeBatch() shades many samples at once, four at a time with SSE where available. The isosurface engine uses
+ * it for the hits of a whole frame; the ray caster shades one sample at a time with shade().
+ */
+class ShadingContext
+{
+    // ********************************************************************************************************
+    // *** Basic methods **************************************************************************************
+public:
+    /// Default constructor; call begin() before shading
+    ShadingContext() : m_diffuse(0), m_specular(0), m_exponent(-1)
+    {
+        for (int i = 0 ; i < 3 ; i++) {
+            m_light[i] = 0;
+            m_halfway[i] = 0;
+        }
+    }
+
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    /// Set up the shading of a frame. L is the light vector, eyeDirection the normalized direction from the
+    /// samples towards the eye, k_d and k_s the diffuse and specular coefficients and b the specular exponent.
+    void begin(const Vector3d &L, const Vector3d &eyeDirection, float k_d, float k_s, float b) {
+        Vector3d H = -L - eyeDirection; // Halfway vector between light direction and eye direction
+        H.normalize();
+
+        for (int i = 0 ; i < 3 ; i++) {
+            m_light[i] = L[i];
+            m_halfway[i] = H[i];
+        }
+
+        m_diffuse = k_d;
+        m_specular = k_s;
+
+        if (b != m_exponent) {
+            m_exponent = b;
+            m_powerTable.resize(POWER_TABLE_SIZE + 2);
+            for (int i = 0 ; i <= POWER_TABLE_SIZE ; i++) {
+                m_powerTable[i] = pow((float)i / POWER_TABLE_SIZE, b);
+            }
+            m_powerTable[POWER_TABLE_SIZE + 1] = m_powerTable[POWER_TABLE_SIZE]; // Lets interpolation read one past 1
+        }
+    }
+
+    /// Shade a single sample with the given base color and normal
+    Vector3d shade(const Vector3d &color, const Vector3d &normal) const {
+        float nx = normal.GetX();
+        float ny = normal.GetY();
+        float nz = normal.GetZ();
+
+        float s_d = m_diffuse * fabs(m_light[0]*nx + m_light[1]*ny + m_light[2]*nz);
+        float s_s = m_specular * power(fabs(m_halfway[0]*nx + m_halfway[1]*ny + m_halfway[2]*nz));
+
+        return Vector3d(std::min(color.GetX() * s_d + s_s, 1.0),
+                        std::min(color.GetY() * s_d + s_s, 1.0),
+                        std::min(color.GetZ() * s_d + s_s, 1.0));
+    }
+
+    /// Shade count samples given as separate arrays of normal components and base colors, writing the shaded
+    /// colors to red, green and blue (which may be the same arrays as r, g and b).
+    void shadeBatch(const float *nx, const float *ny, const float *nz, const float *r, const float *g, const float *b,
+                    float *red, float *green, float *blue, int count) const {
+        int i = 0;
+
+#ifdef SIMDMATH_SSE
+        const __m128 lightX = _mm_set1_ps(m_light[0]);
+        const __m128 lightY = _mm_set1_ps(m_light[1]);
+        const __m128 lightZ = _mm_set1_ps(m_light[2]);
+        const __m128 halfwayX = _mm_set1_ps(m_halfway[0]);
+        const __m128 halfwayY = _mm_set1_ps(m_halfway[1]);
+        const __m128 halfwayZ = _mm_set1_ps(m_halfway[2]);
+        const __m128 diffuse = _mm_set1_ps(m_diffuse);
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+
+        for ( ; i + 4 <= count ; i += 4) {
+            __m128 x = _mm_loadu_ps(nx + i);
+            __m128 y = _mm_loadu_ps(ny + i);
+            __m128 z = _mm_loadu_ps(nz + i);
+
+            __m128 lightDot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lightX, x), _mm_mul_ps(lightY, y)), _mm_mul_ps(lightZ, z));
+            __m128 halfwayDot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(halfwayX, x), _mm_mul_ps(halfwayY, y)), _mm_mul_ps(halfwayZ, z));
+
+            __m128 s_d = _mm_mul_ps(diffuse, _mm_andnot_ps(signMask, lightDot));
+
+            // The table lookup is scalar
+            float bases[4];
+            float s_s[4];
+            _mm_storeu_ps(bases, _mm_andnot_ps(signMask, halfwayDot));
+            for (int k = 0 ; k < 4 ; k++) {
+                s_s[k] = m_specular * power(bases[k]);
+            }
+            __m128 specular = _mm_loadu_ps(s_s);
+
+            _mm_storeu_ps(red + i, _mm_min_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(r + i), s_d), specular), one));
+            _mm_storeu_ps(green + i, _mm_min_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(g + i), s_d), specular), one));
+            _mm_storeu_ps(blue + i, _mm_min_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(b + i), s_d), specular), one));
+        }
+#endif
+
+        for ( ; i < count ; i++) {
+            float s_d = m_diffuse * fabs(m_light[0]*nx[i] + m_light[1]*ny[i] + m_light[2]*nz[i]);
+            float s_s = m_specular * power(fabs(m_halfway[0]*nx[i] + m_halfway[1]*ny[i] + m_halfway[2]*nz[i]));
+
+            red[i] = std::min(r[i] * s_d + s_s, 1.0f);
+            green[i] = std::min(g[i] * s_d + s_s, 1.0f);
+            blue[i] = std::min(b[i] * s_d + s_s, 1.0f);
+        }
+    }
+
+    // ********************************************************************************************************
+    // *** Private methods ************************************************************************************
+private:
+    /// Return base^b for a non-negative base, from the table when base is at most 1
+    float power(float base) const {
+        if (base > 1.0f) {
+            return pow(base, m_exponent);
+        }
+
+        float position = base * POWER_TABLE_SIZE;
+        int index = (int)position;
+        float fraction = position - index;
+
+        return m_powerTable[index] * (1 - fraction) + m_powerTable[index + 1] * fraction;
+    }
+
+    // ********************************************************************************************************
+    // *** Class members **************************************************************************************
+private:
+    static const int POWER_TABLE_SIZE = 1024;
+
+    float m_light[3];
+    float m_halfway[3];
+    float m_diffuse;
+    float m_specular;
+    float m_exponent;
+    vector<float> m_powerTable; // x^exponent for x in [0,1]
+
+}; /* ShadingContext */
+
+#endif // SHADINGCONTEXT_H
@@ -0,0 +1 @@
+#include "SharedVolumeCache.h"
@@ -0,0 +1,316 @@
+#ifndef SHAREDVOLUMECACHE_H
+#define SHAREDVOLUMECACHE_H
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QString>
+
+#ifndef Q_OS_WIN
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "DerivedDataCache.h"
+#include "Volume.h"
+
+using std::vector;
+
+/**
+ * Cache of loaded datasets in shared memory, so that several VolViz processes showing the same dataset share one
+ * copy of it. The first process to load a dataset publishes its voxels, histogram, value range and, with
+ * PRECOMPUTED_GRADIENTS, its gradients and gradient magnitudes in a POSIX shared memory segment; the processes
+ * that open the dataset later map the segment read-only instead of loading it, and so start at once. The publisher
+ * also switches to the shared copy, so each dataset is in memory once however many processes show it.
+ *
+ * A segment is named after the dataset's absolute path, size and modification time, so the name is its own index:
+ * finding the segment of a dataset takes a single shm_open(). The arrays are stored exactly as Volume keeps them.
+ *
+ * Each process holds a shared flock() on the segments it maps, and the publisher an exclusive one while it writes,
+ * which attaching processes wait for. The last process to release a segment removes it; since the locks of a
+ * process that dies are released too, a segment never outlives the processes using it (except where the last of
+ * them may not remove the segments of another user). A segment left incomplete by a publisher that died is removed
+ * by the next process that finds it.
+ */
+class SharedVolumeCache
+{
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    /// Give the volume the voxels and derived data of datasetFile, mapped from the segment another process has
+    /// published. Without gradients in the segment for a volume with PRECOMPUTED_GRADIENTS, only the voxels and
+    /// the histogram are adopted, and computeDerivedData() must be called. Return false if there is no segment of
+    /// the dataset.
+    static bool attach(Volume *volume, const QString &datasetFile) {
+#ifndef Q_OS_WIN
+        const std::string name = segmentName(datasetFile);
+        const int descriptor = shm_open(name.c_str(), O_RDONLY, 0);
+        if (descriptor < 0) {
+            return false;
+        }
+
+        // Waits for a publisher that is still writing the segment
+        struct stat status;
+        if (flock(descriptor, LOCK_SH) != 0 || fstat(descriptor, &status) != 0 || status.st_size < (off_t)sizeof(Header)) {
+            ::close(descriptor);
+            return false;
+        }
+
+        Header header;
+        if (pread(descriptor, &header, sizeof(Header), 0) != (ssize_t)sizeof(Header) ||
+            !matches(header, makeHeader(datasetFile)) || header.totalSize > status.st_size) {
+            std::cout << "Shared copy of " << datasetFile.toStdString() << " is stale." << std::endl;
+            removeIfUnused(descriptor, name);
+            return false;
+        }
+
+        // The voxels and the gradients are mapped separately, each keeping the segment locked while it is used
+        Segment *voxelSegment = Segment::map(descriptor, name, header.voxelOffset, header.gradientOffset - header.voxelOffset);
+        if (voxelSegment == NULL) {
+            removeIfUnused(descriptor, name);
+            return false;
+        }
+
+        vector<float> histogram(header.histogramSize);
+        if (!histogram.empty() && pread(descriptor, &histogram[0], histogram.size() * sizeof(float), header.histogramOffset) !=
+                                  (ssize_t)(histogram.size() * sizeof(float))) {
+            delete voxelSegment;
+            return false;
+        }
+
+        volume->adoptVoxels(voxelSegment, (const float*)voxelSegment->data(), header.width, header.height, header.depth);
+
+        const bool needGradients = volume->getGradientPolicy() == Volume::PRECOMPUTED_GRADIENTS;
+        if (needGradients && header.hasGradients) {
+            const int gradientDescriptor = shm_open(name.c_str(), O_RDONLY, 0);
+            Segment *gradientSegment = (gradientDescriptor >= 0 && flock(gradientDescriptor, LOCK_SH) == 0) ?
+                Segment::map(gradientDescriptor, name, header.gradientOffset, header.totalSize - header.gradientOffset) : NULL;
+
+            if (gradientSegment != NULL) {
+                const uchar *gradients = gradientSegment->data();
+                volume->adoptDerivedData(gradientSegment, (const Vector3d*)gradients,
+                                         (const double*)(gradients + header.magnitudeOffset - header.gradientOffset),
+                                         histogram, header.minimumValue, header.maximumValue);
+            } else if (gradientDescriptor >= 0) {
+                ::close(gradientDescriptor);
+            }
+        } else if (!needGradients) {
+            volume->adoptDerivedData(NULL, NULL, NULL, histogram, header.minimumValue, header.maximumValue);
+        }
+
+        std::cout << "Mapped the shared copy of " << datasetFile.toStdString() << "." << std::endl;
+        return true;
+#else
+        Q_UNUSED(volume);
+        Q_UNUSED(datasetFile);
+        return false;
+#endif
+    } /* attach() */
+
+    /// Publish the voxels and derived data of the volume, which has been loaded from datasetFile and whose derived
+    /// data is ready, and let the volume use the published copy instead of its own. If another process has
+    /// published the dataset meanwhile, its copy is used instead. Return false if the volume keeps its own copy.
+    static bool publish(Volume *volume, const QString &datasetFile) {
+#ifndef Q_OS_WIN
+        if (volume->hasAdoptedVoxels() || !volume->isHistogramReady() || !volume->areGradientsReady()) {
+            return false;
+        }
+
+        const std::string name = segmentName(datasetFile);
+        const int descriptor = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (descriptor < 0) {
+            return attach(volume, datasetFile);
+        }
+
+        // Readable by the other users of the workstation, whatever the umask
+        fchmod(descriptor, 0644);
+        flock(descriptor, LOCK_EX);
+
+        const vector<float> histogram = volume->GetHistogram();
+        const Vector3d *gradients = volume->getGradientData();
+        const double *magnitudes = volume->getGradientMagnitudeData();
+        const qint64 voxels = volume->getVoxelNum();
+
+        Header header = makeHeader(datasetFile);
+        header.width = volume->getWidth();
+        header.height = volume->getHeight();
+        header.depth = volume->getDepth();
+        header.hasGradients = (gradients != NULL) ? 1 : 0;
+        header.minimumValue = volume->getMinimumValue();
+        header.maximumValue = volume->getMaximumValue();
+        header.histogramSize = (qint32)histogram.size();
+        header.histogramOffset = sizeof(Header);
+        header.voxelOffset = align(header.histogramOffset + header.histogramSize * sizeof(float));
+        header.gradientOffset = align(header.voxelOffset + voxels * sizeof(float));
+        header.magnitudeOffset = header.gradientOffset + (header.hasGradients ? voxels * sizeof(Vector3d) : 0);
+        header.totalSize = align(header.magnitudeOffset + (header.hasGradients ? voxels * sizeof(double) : 0));
+
+        uchar *data = reserve(descriptor, header.totalSize) ? (uchar*)mmap(NULL, (size_t)header.totalSize,
+            PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0) : (uchar*)MAP_FAILED;
+        if (data == (uchar*)MAP_FAILED) {
+            std::cout << "Cannot publish " << datasetFile.toStdString() << " in shared memory." << std::endl;
+            shm_unlink(name.c_str());
+            ::close(descriptor);
+            return false;
+        }
+
+        // The segment is complete, and attachable, once the header is written last
+        if (!histogram.empty()) {
+            memcpy(data + header.histogramOffset, &histogram[0], histogram.size() * sizeof(float));
+        }
+        memcpy(data + header.voxelOffset, volume->getData(), voxels * sizeof(float));
+        if (header.hasGradients) {
+            memcpy(data + header.gradientOffset, gradients, voxels * sizeof(Vector3d));
+            memcpy(data + header.magnitudeOffset, magnitudes, voxels * sizeof(double));
+        }
+        memcpy(data, &header, sizeof(Header));
+        munmap(data, (size_t)header.totalSize);
+
+        std::cout << "Published " << datasetFile.toStdString() << " in shared memory." << std::endl;
+
+        // Switch to the shared copy, which the lock keeps alive until the volume holds its own locks on it
+        flock(descriptor, LOCK_SH);
+        const bool attached = attach(volume, datasetFile);
+        ::close(descriptor);
+
+        return attached;
+#else
+        Q_UNUSED(volume);
+        Q_UNUSED(datasetFile);
+        return false;
+#endif
+    } /* publish() */
+
+    // ********************************************************************************************************
+    // *** Private types **************************************************************************************
+private:
+    /// Increase when the layout of a segment or the computation of the derived data changes
+    static const quint32 CACHE_VERSION = 1;
+
+    /// Alignment of the arrays in a segment, which allows mapping them separately on any page size
+    static const qint64 ALIGNMENT = 1 << 16;
+
+    /// Beginning of a segment
+    struct Header {
+        char magic[8];             // "VVSHARE"
+        quint32 version;           // CACHE_VERSION
+        quint32 vectorSize;        // sizeof(Vector3d), which the stored gradients were written with
+        quint64 pathHash;          // Key: hash of the dataset's absolute path,
+        qint64 fileSize;           //      its size in bytes,
+        qint64 modified;           //      and its modification time in seconds since the epoch
+        qint32 width, height, depth;
+        qint32 hasGradients;       // Whether the gradient arrays are present
+        float minimumValue;
+        float maximumValue;
+        qint32 histogramSize;      // Number of histogram bins
+        qint32 reserved;
+        qint64 histogramOffset;    // Offsets of the arrays from the start of the segment
+        qint64 voxelOffset;
+        qint64 gradientOffset;
+        qint64 magnitudeOffset;
+        qint64 totalSize;
+    };
+
+#ifndef Q_OS_WIN
+    /// Part of a segment mapped read-only for a volume, which holds a shared lock on the segment
+    class Segment : public Volume::DerivedDataStorage
+    {
+    public:
+        /// Map size bytes from offset of the segment open as descriptor, taking over the descriptor. Return NULL,
+        /// leaving the descriptor open, if the segment cannot be mapped.
+        static Segment* map(int descriptor, const std::string &name, qint64 offset, qint64 size) {
+            void *address = mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, descriptor, (off_t)offset);
+            return (address != MAP_FAILED) ? new Segment(descriptor, name, address, size) : NULL;
+        }
+
+        ~Segment() {
+            munmap(m_address, (size_t)m_size);
+            removeIfUnused(m_descriptor, m_name);
+        }
+
+        const uchar* data() const { return (const uchar*)m_address; }
+
+    private:
+        Segment(int descriptor, const std::string &name, void *address, qint64 size) :
+            m_descriptor(descriptor), m_name(name), m_address(address), m_size(size) {}
+
+        int m_descriptor;
+        std::string m_name;
+        void *m_address;
+        qint64 m_size;
+    };
+#endif
+
+    // ********************************************************************************************************
+    // *** Private methods ************************************************************************************
+private:
+    /// Return the shared memory name of the segment of a dataset
+    static std::string segmentName(const QString &datasetFile) {
+        const Header key = makeHeader(datasetFile);
+        const quint64 hash = DerivedDataCache::hash((const uchar*)&key.pathHash, 3 * sizeof(qint64), 0);
+
+        char name[32];
+        sprintf(name, "/volviz-%016llx", (unsigned long long)hash);
+        return name;
+    }
+
+    /// Return a header with the identification of a dataset filled in
+    static Header makeHeader(const QString &datasetFile) {
+        Header header;
+        memset(&header, 0, sizeof(Header));
+
+        memcpy(header.magic, "VVSHARE", 8);
+        header.version = CACHE_VERSION;
+        header.vectorSize = sizeof(Vector3d);
+
+        QFileInfo info(datasetFile);
+        const QByteArray path = info.absoluteFilePath().toUtf8();
+        header.pathHash = DerivedDataCache::hash((const uchar*)path.constData(), path.size(), 0);
+        header.fileSize = info.size();
+        header.modified = info.lastModified().toTime_t();
+
+        return header;
+    }
+
+    /// Return true if a segment header identifies the same dataset, and was written by this version
+    static bool matches(const Header &shared, const Header &expected) {
+        return memcmp(shared.magic, expected.magic, 8) == 0 && shared.version == expected.version &&
+               shared.vectorSize == expected.vectorSize && shared.pathHash == expected.pathHash &&
+               shared.fileSize == expected.fileSize && shared.modified == expected.modified;
+    }
+
+#ifndef Q_OS_WIN
+    /// Give a new segment its size. On Linux the memory is allocated at once, so that a full /dev/shm fails here
+    /// rather than with a bus error while the segment is written.
+    static bool reserve(int descriptor, qint64 size) {
+#ifdef Q_OS_LINUX
+        return posix_fallocate(descriptor, 0, (off_t)size) == 0;
+#else
+        return ftruncate(descriptor, (off_t)size) == 0;
+#endif
+    }
+
+    /// Release a segment open as descriptor, and remove it if no other process holds it
+    static void removeIfUnused(int descriptor, const std::string &name) {
+        if (flock(descriptor, LOCK_EX | LOCK_NB) == 0) {
+            shm_unlink(name.c_str());
+        }
+        ::close(descriptor);
+    }
+#endif
+
+    /// Round an offset up to the alignment of the arrays
+    static qint64 align(qint64 offset) {
+        return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+
+}; /* SharedVolumeCache */
+
+#endif // SHAREDVOLUMECACHE_H
@@ -0,0 +1 @@
+#include "SharedVolumeRing.h"
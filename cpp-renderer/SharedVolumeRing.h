@@ -0,0 +1,286 @@
+#ifndef SHAREDVOLUMERING_H
+#define SHAREDVOLUMERING_H
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <QtGlobal>
+
+#include "AtomicAccess.h"
+
+#ifndef Q_OS_WIN
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Ring of volume frames in POSIX shared memory, through which another process, such as a running simulation, hands
+ * volumes to VolViz as it produces them. The producer creates the ring with create() and writes each frame in
+ * place between beginWrite() and endWrite(); VolViz attaches to it by name with attach() and reads the frames
+ * straight from the shared memory, without copying them.
+ *
+ * Each slot holds a whole frame in the format of a DAT file (the three 16-bit dimensions, then 16-bit voxels), so a
+ * frame is read like a mapped DAT file. Frame n is written to slot n % getSlotCount(). The producer never waits
+ * for the reader: each slot is stamped with the frame it holds, and -1 while it is being written, so a reader
+ * checks with isFrameIntact() after reading a frame that it was not overwritten meanwhile, and then reads the
+ * newest frame instead.
+ */
+class SharedVolumeRing
+{
+    // ********************************************************************************************************
+    // *** Basic methods **************************************************************************************
+public:
+    /// Default constructor; the ring is closed until create() or attach() is called
+    SharedVolumeRing() : m_header(NULL), m_mappedBytes(0), m_owner(false)
+    {
+    }
+
+    /// Destructor
+    ~SharedVolumeRing()
+    {
+        close();
+    }
+
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    static const int MAX_SLOTS = 16; ///< Largest number of frames in the ring
+
+    /// Create a ring of slotCount frames of the given dimensions under a shared memory name (such as "/volviz"),
+    /// replacing any ring left under that name. The ring is removed again when it is closed. Return false if the
+    /// shared memory cannot be created.
+    bool create(const std::string &name, int width, int height, int depth, int slotCount) {
+        close();
+
+#ifndef Q_OS_WIN
+        if (slotCount < 2 || slotCount > MAX_SLOTS || width <= 0 || height <= 0 || depth <= 0 ||
+            width > 65535 || height > 65535 || depth > 65535) {
+            std::cerr << "+ Invalid dimensions of the shared volume ring." << std::endl;
+            return false;
+        }
+
+        // A reader still attached to a previous ring keeps it until it detaches
+        shm_unlink(name.c_str());
+
+        const qint64 slotBytes = alignUp(DAT_HEADER_BYTES + (qint64)width * height * depth * 2);
+        const qint64 bytes = alignUp(sizeof(Header)) + slotBytes * slotCount;
+        if (!map(name, O_RDWR | O_CREAT | O_EXCL, bytes)) {
+            return false;
+        }
+
+        m_name = name;
+        m_owner = true;
+
+        m_header->version = VERSION;
+        m_header->width = width;
+        m_header->height = height;
+        m_header->depth = depth;
+        m_header->slotCount = slotCount;
+        m_header->slotBytes = slotBytes;
+        m_header->published = -1;
+        m_header->producerClosed = 0;
+        for (int slot = 0 ; slot < MAX_SLOTS ; slot++) {
+            m_header->slotFrames[slot] = -1;
+        }
+
+        // Each slot starts with the header of a DAT file, which stays the same
+        for (int slot = 0 ; slot < slotCount ; slot++) {
+            unsigned char *frame = slotData(slot);
+            const int dimensions[3] = { width, height, depth };
+            for (int i = 0 ; i < 3 ; i++) {
+                frame[2*i] = dimensions[i] & 0xff;
+                frame[2*i + 1] = dimensions[i] >> 8;
+            }
+        }
+
+        AtomicAccess::storeRelease(m_header->magic, MAGIC);
+        return true;
+#else
+        std::cerr << "+ Shared volume rings are not supported on this platform." << std::endl;
+        return false;
+#endif
+    } /* create() */
+
+    /// Attach to the ring created under a shared memory name by another process. Return false if there is no ring
+    /// under that name.
+    bool attach(const std::string &name) {
+        close();
+
+#ifndef Q_OS_WIN
+        if (!map(name, O_RDONLY, 0)) {
+            return false;
+        }
+
+        if (AtomicAccess::loadAcquire(m_header->magic) != MAGIC || m_header->version != VERSION ||
+            m_header->slotCount < 2 || m_header->slotCount > MAX_SLOTS ||
+            alignUp(sizeof(Header)) + m_header->slotBytes * m_header->slotCount > m_mappedBytes) {
+            std::cerr << "+ \"" << name << "\" is not a shared volume ring." << std::endl;
+            close();
+            return false;
+        }
+
+        m_name = name;
+        return true;
+#else
+        std::cerr << "+ Shared volume rings are not supported on this platform." << std::endl;
+        return false;
+#endif
+    }
+
+    /// Detach from the ring; the process that created it also removes it, telling the readers that no more frames
+    /// will come
+    void close() {
+#ifndef Q_OS_WIN
+        if (m_header == NULL) {
+            return;
+        }
+
+        if (m_owner) {
+            AtomicAccess::storeRelease(m_header->producerClosed, (qint32)1);
+            shm_unlink(m_name.c_str());
+        }
+
+        munmap(m_header, (size_t)m_mappedBytes);
+#endif
+        m_header = NULL;
+        m_mappedBytes = 0;
+        m_owner = false;
+        m_name.clear();
+    }
+
+    /// Return true if the ring is created or attached
+    bool isOpen() const { return m_header != NULL; }
+
+    /// Return the dimensions of the frames, the number of frames in the ring, and the size of a frame in bytes
+    int getWidth() const { return m_header->width; }
+    int getHeight() const { return m_header->height; }
+    int getDepth() const { return m_header->depth; }
+    int getSlotCount() const { return m_header->slotCount; }
+    qint64 getFrameBytes() const { return DAT_HEADER_BYTES + (qint64)getWidth() * getHeight() * getDepth() * 2; }
+
+    /// Return the voxels of the next frame, to be written in the order of z, y and x as 16-bit little-endian
+    /// values of which the lower 12 bits are used. Call endWrite() when they are written.
+    unsigned char* beginWrite() {
+        const qint64 frame = m_header->published + 1;
+        const int slot = (int)(frame % getSlotCount());
+
+        // A reader must not see any of the new voxels without seeing that the slot is being written
+        AtomicAccess::storeRelease(m_header->slotFrames[slot], (qint64)-1);
+        AtomicAccess::releaseFence();
+        return slotData(slot) + DAT_HEADER_BYTES;
+    }
+
+    /// Publish the frame written since beginWrite(), and return its number
+    qint64 endWrite() {
+        const qint64 frame = m_header->published + 1;
+        const int slot = (int)(frame % getSlotCount());
+
+        AtomicAccess::storeRelease(m_header->slotFrames[slot], frame);
+        AtomicAccess::storeRelease(m_header->published, frame);
+        return frame;
+    }
+
+    /// Return the number of the newest frame that has been published, or -1 if there is none yet
+    qint64 getPublishedFrame() const {
+        return AtomicAccess::loadAcquire(m_header->published);
+    }
+
+    /// Return true once the producer has closed the ring
+    bool isProducerClosed() const {
+        return AtomicAccess::loadAcquire(m_header->producerClosed) != 0;
+    }
+
+    /// Return a published frame as a DAT file of getFrameBytes() bytes, or NULL if it has been overwritten. Check
+    /// with isFrameIntact() after reading it.
+    const unsigned char* getFrame(qint64 frame) const {
+        const int slot = (int)(frame % getSlotCount());
+
+        return (frame >= 0 && AtomicAccess::loadAcquire(m_header->slotFrames[slot]) == frame) ? slotData(slot) : NULL;
+    }
+
+    /// Return true if a frame read through getFrame() is still in its slot, so that what was read is the frame
+    bool isFrameIntact(qint64 frame) const {
+        // The voxels read must not be read after the stamp of the slot is checked
+        AtomicAccess::acquireFence();
+        return getFrame(frame) != NULL;
+    }
+
+    // ********************************************************************************************************
+    // *** Private methods ************************************************************************************
+private:
+    static const quint32 MAGIC = 0x52535656; // "VVSR"
+    static const quint32 VERSION = 1;
+    static const int DAT_HEADER_BYTES = 6;
+    static const int ALIGNMENT = 4096; // The slots start on pages of their own
+
+    /// Start of the shared memory. The fields written by one process while another reads them are volatile, and
+    /// are written and read through AtomicAccess.
+    struct Header
+    {
+        volatile quint32 magic;       // MAGIC once the producer has set up the ring
+        quint32 version;
+        qint32 width, height, depth;
+        qint32 slotCount;
+        qint64 slotBytes;             // Distance between the slots
+        volatile qint64 published;    // Newest frame that has been published, or -1
+        volatile qint32 producerClosed;
+        volatile qint64 slotFrames[MAX_SLOTS]; // Frame held by each slot, or -1 while it is being written
+    };
+
+    static qint64 alignUp(qint64 bytes) { return (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT; }
+
+    unsigned char* slotData(int slot) const {
+        return (unsigned char*)m_header + alignUp(sizeof(Header)) + m_header->slotBytes * slot;
+    }
+
+#ifndef Q_OS_WIN
+    /// Open and map the shared memory, read-only if opened so; with bytes above zero, it is created with that size
+    bool map(const std::string &name, int flags, qint64 bytes) {
+        const int descriptor = shm_open(name.c_str(), flags, 0600);
+        if (descriptor < 0) {
+            std::cerr << "+ Error opening the shared memory \"" << name << "\"." << std::endl;
+            return false;
+        }
+
+        struct stat status;
+        const bool sized = (bytes > 0) ? ftruncate(descriptor, (off_t)bytes) == 0 : fstat(descriptor, &status) == 0;
+        if (bytes <= 0 && sized) {
+            bytes = status.st_size;
+        }
+
+        const int protection = ((flags & O_ACCMODE) == O_RDONLY) ? PROT_READ : PROT_READ | PROT_WRITE;
+        void *address = (sized && bytes >= (qint64)sizeof(Header)) ?
+            mmap(NULL, (size_t)bytes, protection, MAP_SHARED, descriptor, 0) : MAP_FAILED;
+        ::close(descriptor);
+
+        if (address == MAP_FAILED) {
+            std::cerr << "+ Error mapping the shared memory \"" << name << "\"." << std::endl;
+            if (flags & O_CREAT) {
+                shm_unlink(name.c_str());
+            }
+            return false;
+        }
+
+        m_header = (Header*)address;
+        m_mappedBytes = bytes;
+        return true;
+    }
+#endif
+
+    // Not copyable
+    SharedVolumeRing(const SharedVolumeRing&);
+    SharedVolumeRing& operator=(const SharedVolumeRing&);
+
+    // ********************************************************************************************************
+    // *** Class members **************************************************************************************
+private:
+    Header *m_header;       // Start of the mapped shared memory, or NULL when closed
+    qint64 m_mappedBytes;
+    bool m_owner;           // Whether this process created the ring
+    std::string m_name;
+
+}; /* SharedVolumeRing */
+
+#endif // SHAREDVOLUMERING_H
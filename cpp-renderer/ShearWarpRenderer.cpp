@@ -0,0 +1,4 @@
+#include "ShearWarpRenderer.h"
+
+/// Accumulated opacity above which intermediate image pixels are no longer composited
+const float ShearWarpRenderer::OPAQUE_THRESHOLD = 0.99f;
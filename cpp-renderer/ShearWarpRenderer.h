@@ -0,0 +1,453 @@
+#ifndef SHEARWARPRENDERER_H
+#define SHEARWARPRENDERER_H
+
+#include <cmath>
+#include <vector>
+
+#include "RayGeometry.h"
+#include "Volume.h"
+#include "transfer_function.h"
+
+using std::vector;
+
+/**
+ * Shear-warp factorization renderer for parallel projection (Lacroute & Levoy, "Fast Volume Rendering Using a
+ * Shear-Warp Factorization of the Viewing Transformation").
+ *
+ * The viewing transformation is split into a shear of the volume slices perpendicular to the principal viewing
+ * axis, and a 2D warp of the resulting intermediate image. The slices are composited front to back in object
+ * order, so voxels are read sequentially along scanlines, and every voxel scanline is run-length encoded into
+ * transparent and non-transparent runs for the current transfer function so that transparent voxels are skipped
+ * entirely. One encoding is kept per principal axis, and the encodings are rebuilt only when the transfer function
+ * (or the transfer function mode) changes.
+ *
+ * The opacity of each composited sample is corrected for the distance between slices along the ray, so the image
+ * is comparable to the one produced by the ray caster for a given step size.
+ */
+class ShearWarpRenderer
+{
+    // ********************************************************************************************************
+    // *** Basic methods **************************************************************************************
+public:
+    /// Default constructor
+    ShearWarpRenderer() : m_volume(NULL), m_classifiedTfMode(-1)
+    {
+    }
+
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    /// Set the volume to render. The run-length encodings are built on the next call to renderDvr().
+    void setVolume(const Volume *volume) {
+        m_volume = volume;
+        invalidateClassification();
+    }
+
+    /// Direct volume render the volume into image, which holds resX*resY RGB triplets stored row by row.
+    ///
+    /// All vectors are in voxel coordinates: origin is the starting position of the ray of pixel (0,0), pixelRight
+    /// and pixelUp are the offsets between neighbouring pixels, and direction is the normalized projection vector.
+    /// tfMode selects the transfer function mode (0 is 1D, 1 is 1D with gradient-based transparency), and
+    /// rayCasterStep is the ray caster's step size in voxel units, used for opacity correction.
+    void renderDvr(const float origin[3], const float pixelRight[3], const float pixelUp[3], const float direction[3],
+                   TransferFunction *transferFunction, int tfMode, float rayCasterStep,
+                   float *image, int resX, int resY) {
+        classify(transferFunction, tfMode);
+
+        // Principal viewing axis: the axis most parallel to the viewing direction
+        int axis = 0;
+        for (int i = 1 ; i < 3 ; i++) {
+            if (fabs(direction[i]) > fabs(direction[axis])) {
+                axis = i;
+            }
+        }
+
+        const RunLengthVolume &encoding = m_encodings[axis];
+
+        const int axisI = (axis + 1) % 3;
+        const int axisJ = (axis + 2) % 3;
+
+        // Shear coefficients and translation that keep all slice offsets positive
+        const float shearI = -direction[axisI] / direction[axis];
+        const float shearJ = -direction[axisJ] / direction[axis];
+        const float translateI = (shearI < 0) ? -shearI * (encoding.sizeK - 1) : 0;
+        const float translateJ = (shearJ < 0) ? -shearJ * (encoding.sizeK - 1) : 0;
+
+        IntermediateImage intermediate;
+        intermediate.width = encoding.sizeI + (int)ceil(fabs(shearI) * (encoding.sizeK - 1)) + 2;
+        intermediate.height = encoding.sizeJ + (int)ceil(fabs(shearJ) * (encoding.sizeK - 1)) + 2;
+        intermediate.pixels.assign(intermediate.width * intermediate.height * 4, 0.0f);
+
+        buildOpacityCorrection((1.0f / fabs(direction[axis])) / rayCasterStep);
+
+        composite(encoding, direction[axis] > 0, shearI, shearJ, translateI, translateJ, intermediate);
+
+        warp(intermediate, axis, translateI, translateJ, origin, pixelRight, pixelUp, direction, image, resX, resY);
+    }
+
+    // ********************************************************************************************************
+    // *** Private types **************************************************************************************
+private:
+    /// A classified voxel: color premultiplied by opacity, and opacity
+    struct ClassifiedVoxel {
+        float r, g, b, a;
+    };
+
+    /// Run-length encoded classified volume for one principal axis. Scanlines run along the i axis; scanline
+    /// (j, k) is found at index k*sizeJ + j. Each scanline is a sequence of (transparent, non-transparent) run
+    /// length pairs covering sizeI voxels, and its non-transparent voxels are stored consecutively.
+    struct RunLengthVolume {
+        int sizeI, sizeJ, sizeK;
+        vector<int> runStart;     // Index of the first run of each scanline, plus one past the end
+        vector<int> voxelStart;   // Index of the first non-transparent voxel of each scanline
+        vector<int> runs;
+        vector<ClassifiedVoxel> voxels;
+    };
+
+    /// Premultiplied RGBA image in sheared object space
+    struct IntermediateImage {
+        int width, height;
+        vector<float> pixels;
+    };
+
+    // ********************************************************************************************************
+    // *** Private methods ************************************************************************************
+private:
+    /// Forget the current run-length encodings
+    void invalidateClassification() {
+        m_classifiedTable.clear();
+        m_classifiedTfMode = -1;
+    }
+
+    /// Build the run-length encodings for all three principal axes, unless the transfer function is unchanged
+    void classify(TransferFunction *transferFunction, int tfMode) {
+        // Tabulate the transfer function; comparing the tables detects transfer function changes
+        vector<float> table(CLASSIFICATION_TABLE_SIZE * 4);
+        for (int i = 0 ; i < CLASSIFICATION_TABLE_SIZE ; i++) {
+            double sample = (double)i / (CLASSIFICATION_TABLE_SIZE - 1);
+            Vector3d color = transferFunction->GetColor(sample);
+            double alpha = transferFunction->GetAlpha(sample);
+
+            table[i*4 + 0] = color.GetX() * alpha;
+            table[i*4 + 1] = color.GetY() * alpha;
+            table[i*4 + 2] = color.GetZ() * alpha;
+            table[i*4 + 3] = alpha;
+        }
+
+        if (table == m_classifiedTable && tfMode == m_classifiedTfMode) {
+            return;
+        }
+
+        m_classifiedTable = table;
+        m_classifiedTfMode = tfMode;
+
+        for (int axis = 0 ; axis < 3 ; axis++) {
+            encode(axis, m_encodings[axis]);
+        }
+    }
+
+    /// Classify a single voxel
+    ClassifiedVoxel classifyVoxel(int x, int y, int z) const {
+        float value = m_volume->getVoxel(x, y, z);
+        int index = std::max(0, std::min((int)(value * (CLASSIFICATION_TABLE_SIZE - 1) + 0.5f), CLASSIFICATION_TABLE_SIZE - 1));
+
+        ClassifiedVoxel voxel;
+        voxel.r = m_classifiedTable[index*4 + 0];
+        voxel.g = m_classifiedTable[index*4 + 1];
+        voxel.b = m_classifiedTable[index*4 + 2];
+        voxel.a = m_classifiedTable[index*4 + 3];
+
+        // Gradient-based transparency, as in the ray caster
+        if (m_classifiedTfMode == 1 && voxel.a > 0) {
+            double magnitude = m_volume->getGradientMagnitude((float)x, (float)y, (float)z);
+            float factor = 1 - 1/log(exp(1.0) + magnitude);
+
+            voxel.r *= factor;
+            voxel.g *= factor;
+            voxel.b *= factor;
+            voxel.a *= factor;
+        }
+
+        return voxel;
+    }
+
+    /// Run-length encode the classified volume with scanlines perpendicular to the given principal axis
+    void encode(int axis, RunLengthVolume &encoding) const {
+        const int dimensions[3] = { m_volume->getWidth(), m_volume->getHeight(), m_volume->getDepth() };
+        const int axisI = (axis + 1) % 3;
+        const int axisJ = (axis + 2) % 3;
+
+        encoding.sizeI = dimensions[axisI];
+        encoding.sizeJ = dimensions[axisJ];
+        encoding.sizeK = dimensions[axis];
+
+        const int sliceCount = encoding.sizeK;
+
+        // Encode every slice independently, then concatenate
+        vector<vector<int> > sliceRuns(sliceCount);
+        vector<vector<int> > sliceRunCounts(sliceCount);
+        vector<vector<ClassifiedVoxel> > sliceVoxels(sliceCount);
+
+        #pragma omp parallel for
+        for (int k = 0 ; k < sliceCount ; k++) {
+            int coordinates[3];
+            coordinates[axis] = k;
+
+            for (int j = 0 ; j < encoding.sizeJ ; j++) {
+                coordinates[axisJ] = j;
+
+                int runsBefore = sliceRuns[k].size();
+                int i = 0;
+
+                while (i < encoding.sizeI) {
+                    int transparentRun = 0;
+                    while (i < encoding.sizeI) {
+                        coordinates[axisI] = i;
+                        ClassifiedVoxel voxel = classifyVoxel(coordinates[0], coordinates[1], coordinates[2]);
+                        if (voxel.a > 0) {
+                            break;
+                        }
+                        transparentRun++;
+                        i++;
+                    }
+
+                    int opaqueRun = 0;
+                    while (i < encoding.sizeI) {
+                        coordinates[axisI] = i;
+                        ClassifiedVoxel voxel = classifyVoxel(coordinates[0], coordinates[1], coordinates[2]);
+                        if (voxel.a <= 0) {
+                            break;
+                        }
+                        sliceVoxels[k].push_back(voxel);
+                        opaqueRun++;
+                        i++;
+                    }
+
+                    sliceRuns[k].push_back(transparentRun);
+                    sliceRuns[k].push_back(opaqueRun);
+                }
+
+                sliceRunCounts[k].push_back(sliceRuns[k].size() - runsBefore);
+            }
+        }
+
+        encoding.runStart.clear();
+        encoding.voxelStart.clear();
+        encoding.runs.clear();
+        encoding.voxels.clear();
+
+        for (int k = 0 ; k < sliceCount ; k++) {
+            int voxelIndex = encoding.voxels.size();
+            int runIndex = encoding.runs.size();
+            int sliceRunIndex = 0;
+
+            for (int j = 0 ; j < encoding.sizeJ ; j++) {
+                encoding.runStart.push_back(runIndex + sliceRunIndex);
+                encoding.voxelStart.push_back(voxelIndex);
+
+                // Advance past this scanline's runs and non-transparent voxels
+                for (int r = 0 ; r < sliceRunCounts[k][j] ; r += 2) {
+                    voxelIndex += sliceRuns[k][sliceRunIndex + r + 1];
+                }
+                sliceRunIndex += sliceRunCounts[k][j];
+            }
+
+            encoding.runs.insert(encoding.runs.end(), sliceRuns[k].begin(), sliceRuns[k].end());
+            encoding.voxels.insert(encoding.voxels.end(), sliceVoxels[k].begin(), sliceVoxels[k].end());
+        }
+        encoding.runStart.push_back(encoding.runs.size());
+    }
+
+    /// Tabulate the opacity correction alpha' = 1 - (1 - alpha)^exponent
+    void buildOpacityCorrection(float exponent) {
+        m_opacityCorrection.resize(OPACITY_TABLE_SIZE + 1);
+        for (int i = 0 ; i <= OPACITY_TABLE_SIZE ; i++) {
+            float alpha = (float)i / OPACITY_TABLE_SIZE;
+            m_opacityCorrection[i] = 1 - pow(1 - alpha, exponent);
+        }
+    }
+
+    /// Composite the sheared slices front to back into the intermediate image
+    void composite(const RunLengthVolume &encoding, bool ascending, float shearI, float shearJ,
+                   float translateI, float translateJ, IntermediateImage &intermediate) const {
+        // Resampled voxel row, indexed by the intermediate image column minus the slice's integer offset
+        vector<ClassifiedVoxel> rowBuffer(encoding.sizeI + 1);
+        ClassifiedVoxel empty = { 0, 0, 0, 0 };
+        std::fill(rowBuffer.begin(), rowBuffer.end(), empty);
+
+        for (int n = 0 ; n < encoding.sizeK ; n++) {
+            const int k = ascending ? n : encoding.sizeK - 1 - n;
+
+            float offsetI = shearI * k + translateI;
+            float offsetJ = shearJ * k + translateJ;
+            int floorI = (int)floor(offsetI);
+            int floorJ = (int)floor(offsetJ);
+
+            // Bilinear weights are the same for the whole slice
+            float fractionI = offsetI - floorI;
+            float fractionJ = offsetJ - floorJ;
+
+            for (int jj = 0 ; jj <= encoding.sizeJ ; jj++) {
+                int touchedBegin = encoding.sizeI + 1;
+                int touchedEnd = 0;
+
+                // Intermediate row jj + floorJ is a blend of voxel rows jj-1 and jj
+                if (jj > 0) {
+                    splatScanline(encoding, jj - 1, k, fractionJ, fractionI, rowBuffer, touchedBegin, touchedEnd);
+                }
+                if (jj < encoding.sizeJ) {
+                    splatScanline(encoding, jj, k, 1 - fractionJ, fractionI, rowBuffer, touchedBegin, touchedEnd);
+                }
+
+                if (touchedBegin >= touchedEnd) {
+                    continue;
+                }
+
+                float *row = &intermediate.pixels[((jj + floorJ) * intermediate.width + floorI) * 4];
+
+                for (int ii = touchedBegin ; ii < touchedEnd ; ii++) {
+                    ClassifiedVoxel &sample = rowBuffer[ii];
+                    float *pixel = row + ii * 4;
+
+                    // Skip pixels that are already (nearly) opaque: early ray termination
+                    if (sample.a > 0 && pixel[3] < OPAQUE_THRESHOLD) {
+                        float correctedAlpha = m_opacityCorrection[(int)(std::min(sample.a, 1.0f) * OPACITY_TABLE_SIZE)];
+                        float weight = (1 - pixel[3]) * correctedAlpha / sample.a;
+
+                        pixel[0] += weight * sample.r;
+                        pixel[1] += weight * sample.g;
+                        pixel[2] += weight * sample.b;
+                        pixel[3] += (1 - pixel[3]) * correctedAlpha;
+                    }
+
+                    sample = empty;
+                }
+            }
+        }
+    }
+
+    /// Resample the non-transparent voxels of scanline (j, k) into the row buffer with the given row weight
+    void splatScanline(const RunLengthVolume &encoding, int j, int k, float rowWeight, float fractionI,
+                       vector<ClassifiedVoxel> &rowBuffer, int &touchedBegin, int &touchedEnd) const {
+        int scanline = k * encoding.sizeJ + j;
+        int runEnd = encoding.runStart[scanline + 1];
+        const ClassifiedVoxel *voxel = &encoding.voxels[0] + encoding.voxelStart[scanline];
+
+        float weightHere = rowWeight * (1 - fractionI);
+        float weightNext = rowWeight * fractionI;
+
+        int i = 0;
+        for (int r = encoding.runStart[scanline] ; r < runEnd ; r += 2) {
+            i += encoding.runs[r]; // Skip the transparent run
+
+            int opaqueRun = encoding.runs[r + 1];
+            if (opaqueRun > 0) {
+                touchedBegin = std::min(touchedBegin, i);
+                touchedEnd = std::max(touchedEnd, i + opaqueRun + 1);
+            }
+
+            // Voxel i contributes to columns i (weight 1-fraction) and i+1 (weight fraction)
+            for (int n = 0 ; n < opaqueRun ; n++, i++, voxel++) {
+                ClassifiedVoxel &here = rowBuffer[i];
+                here.r += voxel->r * weightHere;
+                here.g += voxel->g * weightHere;
+                here.b += voxel->b * weightHere;
+                here.a += voxel->a * weightHere;
+
+                ClassifiedVoxel &next = rowBuffer[i + 1];
+                next.r += voxel->r * weightNext;
+                next.g += voxel->g * weightNext;
+                next.b += voxel->b * weightNext;
+                next.a += voxel->a * weightNext;
+            }
+        }
+    }
+
+    /// Warp the intermediate image to the final image
+    void warp(const IntermediateImage &intermediate, int axis, float translateI, float translateJ,
+              const float origin[3], const float pixelRight[3], const float pixelUp[3], const float direction[3],
+              float *image, int resX, int resY) const {
+        const int axisI = (axis + 1) % 3;
+        const int axisJ = (axis + 2) % 3;
+        const float dimensions[3] = { (float)m_volume->getWidth(), (float)m_volume->getHeight(), (float)m_volume->getDepth() };
+
+        #pragma omp parallel for
+        for (int y = 0 ; y < resY ; y++) {
+            for (int x = 0 ; x < resX ; x++) {
+                float *pixel = &image[(y * resX + x) * 3];
+
+                float rayStart[3];
+                for (int i = 0 ; i < 3 ; i++) {
+                    rayStart[i] = origin[i] + pixelRight[i] * x + pixelUp[i] * y;
+                }
+
+                if (!RayGeometry::rayHitsBox(rayStart, direction, dimensions)) {
+                    // Same background as the ray caster
+                    pixel[0] = pixel[1] = pixel[2] = 0.3f;
+                    continue;
+                }
+
+                // Where the ray crosses slice 0 in sheared object space. Every ray maps to a single
+                // intermediate image position, whichever slice it crosses.
+                float t = -rayStart[axis] / direction[axis];
+                float u = rayStart[axisI] + t * direction[axisI] + translateI;
+                float v = rayStart[axisJ] + t * direction[axisJ] + translateJ;
+
+                float color[4];
+                sampleIntermediate(intermediate, u, v, color);
+
+                pixel[0] = std::min(color[0], 1.0f);
+                pixel[1] = std::min(color[1], 1.0f);
+                pixel[2] = std::min(color[2], 1.0f);
+            }
+        }
+    }
+
+    /// Bilinearly sample the intermediate image, treating everything outside it as transparent black
+    static void sampleIntermediate(const IntermediateImage &intermediate, float u, float v, float color[4]) {
+        int u0 = (int)floor(u);
+        int v0 = (int)floor(v);
+        float ud = u - u0;
+        float vd = v - v0;
+
+        for (int c = 0 ; c < 4 ; c++) {
+            color[c] = 0;
+        }
+
+        for (int dv = 0 ; dv <= 1 ; dv++) {
+            for (int du = 0 ; du <= 1 ; du++) {
+                int pu = u0 + du;
+                int pv = v0 + dv;
+
+                if (pu < 0 || pv < 0 || pu >= intermediate.width || pv >= intermediate.height) {
+                    continue;
+                }
+
+                float weight = (du ? ud : 1 - ud) * (dv ? vd : 1 - vd);
+                const float *pixel = &intermediate.pixels[(pv * intermediate.width + pu) * 4];
+
+                for (int c = 0 ; c < 4 ; c++) {
+                    color[c] += weight * pixel[c];
+                }
+            }
+        }
+    }
+
+    // ********************************************************************************************************
+    // *** Class members **************************************************************************************
+private:
+    static const int CLASSIFICATION_TABLE_SIZE = 1024;
+    static const int OPACITY_TABLE_SIZE = 1024;
+    static const float OPAQUE_THRESHOLD;
+
+    const Volume *m_volume;
+
+    vector<float> m_classifiedTable; // Premultiplied RGBA per intensity, for the encoded transfer function
+    int m_classifiedTfMode;
+    RunLengthVolume m_encodings[3];  // One encoding per principal axis
+
+    vector<float> m_opacityCorrection;
+
+}; /* ShearWarpRenderer */
+
+#endif // SHEARWARPRENDERER_H
@@ -0,0 +1 @@
+#include "SimdMath.h"
@@ -0,0 +1,241 @@
+#ifndef SIMDMATH_H
+#define SIMDMATH_H
+
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SIMDMATH_SSE
+#endif
+
+#include "Vector3d.h"
+
+/**
+ * Single precision vector math for the inner rendering loops.
+ *
+ * Vector3d is double precision with bounds checking, which is convenient for the user interface and the view
+ * setup, but costly per ray sample. Vec3f and Vec4f hold floats in one SSE register per vector, so that an
+ * addition or a scaling is a single instruction. Without SSE the same classes fall back to plain float arrays.
+ * Vec3f converts to and from Vector3d, so the double precision type remains the interface everywhere outside the
+ * hot paths.
+ *
+ * The SSE versions need 16-byte alignment, which local variables and members always get; the heap allocations
+ * of 64-bit builds are aligned as well.
+ */
+
+/// A 4D float vector
+class Vec4f
+{
+    // ********************************************************************************************************
+    // *** Basic methods **************************************************************************************
+public:
+    /// Zero vector
+    Vec4f() {
+#ifdef SIMDMATH_SSE
+        m_value = _mm_setzero_ps();
+#else
+        m_value[0] = m_value[1] = m_value[2] = m_value[3] = 0;
+#endif
+    }
+
+    /// Vector with the specified components
+    Vec4f(float x, float y, float z, float w) {
+#ifdef SIMDMATH_SSE
+        m_value = _mm_set_ps(w, z, y, x);
+#else
+        m_value[0] = x; m_value[1] = y; m_value[2] = z; m_value[3] = w;
+#endif
+    }
+
+    /// Vector with all components set to value
+    explicit Vec4f(float value) {
+#ifdef SIMDMATH_SSE
+        m_value = _mm_set1_ps(value);
+#else
+        m_value[0] = m_value[1] = m_value[2] = m_value[3] = value;
+#endif
+    }
+
+#ifdef SIMDMATH_SSE
+    explicit Vec4f(__m128 value) : m_value(value) {}
+    __m128 get() const { return m_value; }
+#endif
+
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    float x() const { return component<0>(); }
+    float y() const { return component<1>(); }
+    float z() const { return component<2>(); }
+    float w() const { return component<3>(); }
+
+    /// Return component i. To read several components, store() them instead.
+    float operator[](int i) const {
+        switch (i) {
+        case 0:  return x();
+        case 1:  return y();
+        case 2:  return z();
+        default: return w();
+        }
+    }
+
+    /// Write the four components to values
+    void store(float values[4]) const {
+#ifdef SIMDMATH_SSE
+        _mm_storeu_ps(values, m_value);
+#else
+        for (int i = 0 ; i < 4 ; i++) values[i] = m_value[i];
+#endif
+    }
+
+    Vec4f operator+(const Vec4f &other) const { return binary(other, ADD); }
+    Vec4f operator-(const Vec4f &other) const { return binary(other, SUBTRACT); }
+    Vec4f operator*(const Vec4f &other) const { return binary(other, MULTIPLY); }
+    Vec4f operator*(float factor) const { return binary(Vec4f(factor), MULTIPLY); }
+
+    Vec4f& operator+=(const Vec4f &other) { *this = *this + other; return *this; }
+    Vec4f& operator-=(const Vec4f &other) { *this = *this - other; return *this; }
+    Vec4f& operator*=(float factor) { *this = *this * factor; return *this; }
+
+    /// Component-wise minimum and maximum
+    static Vec4f min(const Vec4f &a, const Vec4f &b) { return a.binary(b, MINIMUM); }
+    static Vec4f max(const Vec4f &a, const Vec4f &b) { return a.binary(b, MAXIMUM); }
+
+    /// Return the sum of the four components
+    float sum() const {
+        float values[4];
+        store(values);
+        return (values[0] + values[1]) + (values[2] + values[3]);
+    }
+
+    /// Return the dot product of two vectors
+    static float dot(const Vec4f &a, const Vec4f &b) { return (a * b).sum(); }
+
+    // ********************************************************************************************************
+    // *** Private methods ************************************************************************************
+private:
+    enum Operation { ADD, SUBTRACT, MULTIPLY, MINIMUM, MAXIMUM };
+
+    /// Return component I, moved to the lowest lane of the register rather than through memory
+    template <int I>
+    float component() const {
+#ifdef SIMDMATH_SSE
+        return _mm_cvtss_f32(_mm_shuffle_ps(m_value, m_value, _MM_SHUFFLE(I, I, I, I)));
+#else
+        return m_value[I];
+#endif
+    }
+
+    /// Apply a component-wise operation; the switch is resolved at compile time after inlining
+    Vec4f binary(const Vec4f &other, Operation operation) const {
+#ifdef SIMDMATH_SSE
+        switch (operation) {
+        case ADD:      return Vec4f(_mm_add_ps(m_value, other.m_value));
+        case SUBTRACT: return Vec4f(_mm_sub_ps(m_value, other.m_value));
+        case MULTIPLY: return Vec4f(_mm_mul_ps(m_value, other.m_value));
+        case MINIMUM:  return Vec4f(_mm_min_ps(m_value, other.m_value));
+        default:       return Vec4f(_mm_max_ps(m_value, other.m_value));
+        }
+#else
+        Vec4f result;
+        for (int i = 0 ; i < 4 ; i++) {
+            switch (operation) {
+            case ADD:      result.m_value[i] = m_value[i] + other.m_value[i]; break;
+            case SUBTRACT: result.m_value[i] = m_value[i] - other.m_value[i]; break;
+            case MULTIPLY: result.m_value[i] = m_value[i] * other.m_value[i]; break;
+            case MINIMUM:  result.m_value[i] = std::min(m_value[i], other.m_value[i]); break;
+            default:       result.m_value[i] = std::max(m_value[i], other.m_value[i]); break;
+            }
+        }
+        return result;
+#endif
+    }
+
+    // ********************************************************************************************************
+    // *** Class members **************************************************************************************
+private:
+#ifdef SIMDMATH_SSE
+    __m128 m_value;
+#else
+    float m_value[4];
+#endif
+
+}; /* Vec4f */
+
+
+/// A 3D float vector, stored as a Vec4f whose last component is zero
+class Vec3f
+{
+    // ********************************************************************************************************
+    // *** Basic methods **************************************************************************************
+public:
+    /// Zero vector
+    Vec3f() {}
+
+    /// Vector with the specified components
+    Vec3f(float x, float y, float z) : m_value(x, y, z, 0) {}
+
+    /// Convert from the double precision vector
+    explicit Vec3f(const Vector3d &vector) : m_value((float)vector.GetX(), (float)vector.GetY(), (float)vector.GetZ(), 0) {}
+
+    /// Use the first three components of a Vec4f
+    explicit Vec3f(const Vec4f &vector) : m_value(vector * Vec4f(1, 1, 1, 0)) {}
+
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    float x() const { return m_value[0]; }
+    float y() const { return m_value[1]; }
+    float z() const { return m_value[2]; }
+    float operator[](int i) const { return m_value[i]; }
+
+    /// Write the three components to values
+    void store(float values[3]) const {
+        float all[4];
+        m_value.store(all);
+        values[0] = all[0];
+        values[1] = all[1];
+        values[2] = all[2];
+    }
+
+    /// Convert to the double precision vector
+    Vector3d toVector3d() const {
+        float values[4];
+        m_value.store(values);
+        return Vector3d(values[0], values[1], values[2]);
+    }
+
+    Vec3f operator+(const Vec3f &other) const { return Vec3f(m_value + other.m_value, true); }
+    Vec3f operator-(const Vec3f &other) const { return Vec3f(m_value - other.m_value, true); }
+    Vec3f operator-() const { return Vec3f(Vec4f() - m_value, true); }
+    Vec3f operator*(const Vec3f &other) const { return Vec3f(m_value * other.m_value, true); }
+    Vec3f operator*(float factor) const { return Vec3f(m_value * factor, true); }
+
+    Vec3f& operator+=(const Vec3f &other) { m_value += other.m_value; return *this; }
+    Vec3f& operator-=(const Vec3f &other) { m_value -= other.m_value; return *this; }
+    Vec3f& operator*=(float factor) { m_value *= factor; return *this; }
+
+    /// Component-wise minimum and maximum
+    static Vec3f min(const Vec3f &a, const Vec3f &b) { return Vec3f(Vec4f::min(a.m_value, b.m_value), true); }
+    static Vec3f max(const Vec3f &a, const Vec3f &b) { return Vec3f(Vec4f::max(a.m_value, b.m_value), true); }
+
+    /// Clamp every component to the range given by the components of lower and upper
+    Vec3f clamped(const Vec3f &lower, const Vec3f &upper) const { return min(max(*this, lower), upper); }
+
+    /// Return the dot product of two vectors
+    static float dot(const Vec3f &a, const Vec3f &b) { return (a.m_value * b.m_value).sum(); }
+
+    // ********************************************************************************************************
+    // *** Private methods ************************************************************************************
+private:
+    /// Wrap a Vec4f that is known to have a zero last component
+    Vec3f(const Vec4f &value, bool) : m_value(value) {}
+
+    // ********************************************************************************************************
+    // *** Class members **************************************************************************************
+private:
+    Vec4f m_value;
+
+}; /* Vec3f */
+
+#endif // SIMDMATH_H
@@ -0,0 +1 @@
+#include "SparseTileTree.h"
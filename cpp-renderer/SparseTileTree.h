@@ -0,0 +1,257 @@
+#ifndef SPARSETILETREE_H
+#define SPARSETILETREE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <math.h>
+#include <vector>
+
+using std::vector;
+
+/**
+ * Sparse hierarchy of the active tiles of a volume, in the manner of VDB: a dense root grid of internal nodes,
+ * each covering NODE_SIZE^3 leaf tiles of TILE_SIZE^3 voxels. A tile is active when one of its voxels is above a
+ * background threshold, and only active tiles carry a payload of CHANNELS floats per voxel. A node without active
+ * tiles stores nothing at all, so the memory grows with the occupied part of the volume rather than its size.
+ *
+ * Activity is decided per cell, like the ranges of MinMaxGrid: a cell spans the eight voxels from (x,y,z) to
+ * (x+1,y+1,z+1), and a tile is inactive only if all voxels of its cells are at or below the threshold. Any value
+ * interpolated inside an inactive tile is then at or below the threshold too, which emptySteps() relies on to
+ * skip the empty space along a ray.
+ */
+class SparseTileTree
+{
+    // ********************************************************************************************************
+    // *** Basic methods **************************************************************************************
+public:
+    /// Default constructor; the tree is empty until build() is called
+    SparseTileTree() : m_width(0), m_height(0), m_depth(0), m_tilesX(0), m_tilesY(0), m_tilesZ(0),
+        m_nodesX(0), m_nodesY(0), m_nodesZ(0)
+    {
+    }
+
+    /// Destructor
+    ~SparseTileTree()
+    {
+        clear();
+    }
+
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    static const int TILE_SIZE = 8; ///< Cells (and voxels of payload) along each side of a leaf tile
+    static const int NODE_SIZE = 8; ///< Tiles along each side of an internal node
+    static const int CHANNELS = 4;  ///< Floats of payload per voxel of an active tile
+
+    /// Index of a voxel, the same type as Volume::VoxelIndex (Volume.h includes this header, so it is repeated here)
+    typedef ptrdiff_t VoxelIndex;
+
+    /// Find the active tiles of a volume with the given voxels and dimensions, and allocate their payload. The
+    /// payload is left uninitialized; fill it in through getTilePayload(). The memory of the previous payload is
+    /// reused where it suffices.
+    void build(const float *voxels, int width, int height, int depth, float threshold) {
+        clearNodes();
+
+        m_width = width;
+        m_height = height;
+        m_depth = depth;
+
+        m_tilesX = (std::max(width - 1, 1) + TILE_SIZE - 1) / TILE_SIZE;
+        m_tilesY = (std::max(height - 1, 1) + TILE_SIZE - 1) / TILE_SIZE;
+        m_tilesZ = (std::max(depth - 1, 1) + TILE_SIZE - 1) / TILE_SIZE;
+
+        m_nodesX = (m_tilesX + NODE_SIZE - 1) / NODE_SIZE;
+        m_nodesY = (m_tilesY + NODE_SIZE - 1) / NODE_SIZE;
+        m_nodesZ = (m_tilesZ + NODE_SIZE - 1) / NODE_SIZE;
+
+        // Background-threshold pass: mark the tiles with a voxel above the threshold, in parallel
+        vector<char> active(m_tilesX * m_tilesY * m_tilesZ, 0);
+        const VoxelIndex sliceSize = (VoxelIndex)width * height;
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int tz = 0 ; tz < m_tilesZ ; tz++) {
+            for (int ty = 0 ; ty < m_tilesY ; ty++) {
+                for (int tx = 0 ; tx < m_tilesX ; tx++) {
+                    const int endX = std::min((tx + 1) * TILE_SIZE, width - 1);
+                    const int endY = std::min((ty + 1) * TILE_SIZE, height - 1);
+                    const int endZ = std::min((tz + 1) * TILE_SIZE, depth - 1);
+
+                    bool above = false;
+                    for (int z = tz * TILE_SIZE ; z <= endZ && !above ; z++) {
+                        for (int y = ty * TILE_SIZE ; y <= endY && !above ; y++) {
+                            const float *row = voxels + z * sliceSize + (VoxelIndex)y * width;
+                            for (int x = tx * TILE_SIZE ; x <= endX ; x++) {
+                                if (row[x] > threshold) {
+                                    above = true;
+                                    break;
+                                }
+                            }
+                        }
+                    }
+
+                    active[(tz * m_tilesY + ty) * m_tilesX + tx] = above;
+                }
+            }
+        }
+
+        // Give the nodes with active tiles a table of tile indices, and number the active tiles
+        m_nodes.assign(m_nodesX * m_nodesY * m_nodesZ, (int*)NULL);
+
+        for (int tz = 0 ; tz < m_tilesZ ; tz++) {
+            for (int ty = 0 ; ty < m_tilesY ; ty++) {
+                for (int tx = 0 ; tx < m_tilesX ; tx++) {
+                    if (!active[(tz * m_tilesY + ty) * m_tilesX + tx]) {
+                        continue;
+                    }
+
+                    int *&node = m_nodes[((tz / NODE_SIZE) * m_nodesY + ty / NODE_SIZE) * m_nodesX + tx / NODE_SIZE];
+                    if (node == NULL) {
+                        node = new int[NODE_SIZE * NODE_SIZE * NODE_SIZE];
+                        std::fill(node, node + NODE_SIZE * NODE_SIZE * NODE_SIZE, -1);
+                    }
+
+                    node[tileInNode(tx, ty, tz)] = (int)m_tileOrigins.size() / 3;
+                    m_tileOrigins.push_back(tx * TILE_SIZE);
+                    m_tileOrigins.push_back(ty * TILE_SIZE);
+                    m_tileOrigins.push_back(tz * TILE_SIZE);
+                }
+            }
+        }
+
+        m_payload.resize((size_t)getActiveTileCount() * TILE_VOXELS * CHANNELS);
+    } /* build() */
+
+    /// Free the tiles
+    void clear() {
+        clearNodes();
+        vector<float>().swap(m_payload);
+    }
+
+    /// Exchange the contents of two trees
+    void swap(SparseTileTree &other) {
+        std::swap(m_width, other.m_width);
+        std::swap(m_height, other.m_height);
+        std::swap(m_depth, other.m_depth);
+        std::swap(m_tilesX, other.m_tilesX);
+        std::swap(m_tilesY, other.m_tilesY);
+        std::swap(m_tilesZ, other.m_tilesZ);
+        std::swap(m_nodesX, other.m_nodesX);
+        std::swap(m_nodesY, other.m_nodesY);
+        std::swap(m_nodesZ, other.m_nodesZ);
+        m_nodes.swap(other.m_nodes);
+        m_tileOrigins.swap(other.m_tileOrigins);
+        m_payload.swap(other.m_payload);
+    }
+
+    /// Return the number of active tiles, and the number of tiles in all
+    int getActiveTileCount() const { return (int)m_tileOrigins.size() / 3; }
+    int getTileCount() const { return m_tilesX * m_tilesY * m_tilesZ; }
+
+    /// Return the first voxel of an active tile, and its payload: CHANNELS floats per voxel, in order of z, y and
+    /// x within the tile. The tiles on the upper borders extend past the volume.
+    const int* getTileOrigin(int tile) const { return &m_tileOrigins[tile * 3]; }
+    float* getTilePayload(int tile) { return &m_payload[(size_t)tile * TILE_VOXELS * CHANNELS]; }
+
+    /// Return the payload of a voxel, or NULL if its tile is not active
+    const float* getVoxelPayload(int x, int y, int z) const {
+        const int tx = x / TILE_SIZE;
+        const int ty = y / TILE_SIZE;
+        const int tz = z / TILE_SIZE;
+
+        // The voxels on the upper borders may lie past the last tile of cells
+        if (tx >= m_tilesX || ty >= m_tilesY || tz >= m_tilesZ) {
+            return NULL;
+        }
+
+        const int *node = m_nodes[((tz / NODE_SIZE) * m_nodesY + ty / NODE_SIZE) * m_nodesX + tx / NODE_SIZE];
+        const int tile = (node != NULL) ? node[tileInNode(tx, ty, tz)] : -1;
+        if (tile < 0) {
+            return NULL;
+        }
+
+        const int offset = ((z % TILE_SIZE) * TILE_SIZE + y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE;
+        return &m_payload[((size_t)tile * TILE_VOXELS + offset) * CHANNELS];
+    }
+
+    /// Return how many steps a ray can take from position (in voxel coordinates) in the direction of step without
+    /// leaving empty space: the samples at position + k * step for k below the returned count all lie in cells of
+    /// inactive tiles. Whole empty nodes are crossed at once. Return 0 if position is in an active tile.
+    int emptySteps(const float position[3], const float step[3]) const {
+        const int cellCounts[3] = { m_tilesX * TILE_SIZE, m_tilesY * TILE_SIZE, m_tilesZ * TILE_SIZE };
+        const int cellLimits[3] = { m_width - 1, m_height - 1, m_depth - 1 };
+
+        int cell[3];
+        for (int i = 0 ; i < 3 ; i++) {
+            if (!(position[i] >= 0) || position[i] >= cellLimits[i]) { // Also fails for NaN
+                return 0;
+            }
+            cell[i] = (int)position[i];
+        }
+
+        const int tx = cell[0] / TILE_SIZE;
+        const int ty = cell[1] / TILE_SIZE;
+        const int tz = cell[2] / TILE_SIZE;
+        const int *node = m_nodes[((tz / NODE_SIZE) * m_nodesY + ty / NODE_SIZE) * m_nodesX + tx / NODE_SIZE];
+
+        // The empty box around the position: the whole node if it has no active tiles, otherwise the tile
+        int size;
+        if (node == NULL) {
+            size = TILE_SIZE * NODE_SIZE;
+        } else if (node[tileInNode(tx, ty, tz)] < 0) {
+            size = TILE_SIZE;
+        } else {
+            return 0;
+        }
+
+        float exit = 1e30f; // Number of steps to the box's border
+        for (int i = 0 ; i < 3 ; i++) {
+            const int lower = cell[i] / size * size;
+            const int upper = std::min(lower + size, std::min(cellCounts[i], cellLimits[i]));
+
+            if (step[i] > 0) {
+                exit = std::min(exit, (upper - position[i]) / step[i]);
+            } else if (step[i] < 0) {
+                exit = std::min(exit, (lower - position[i]) / step[i]);
+            }
+        }
+
+        return (exit < 1e9f) ? (int)exit : 0;
+    }
+
+    // ********************************************************************************************************
+    // *** Private methods ************************************************************************************
+private:
+    static const int TILE_VOXELS = TILE_SIZE * TILE_SIZE * TILE_SIZE;
+
+    /// Free the nodes and forget the active tiles, keeping the memory of their payload
+    void clearNodes() {
+        for (int i = 0 ; i < (int)m_nodes.size() ; i++) {
+            delete [] m_nodes[i];
+        }
+        m_nodes.clear();
+        m_tileOrigins.clear();
+    }
+
+    /// Return the position of a tile in the index table of its node
+    static int tileInNode(int tx, int ty, int tz) {
+        return ((tz % NODE_SIZE) * NODE_SIZE + ty % NODE_SIZE) * NODE_SIZE + tx % NODE_SIZE;
+    }
+
+    // Not copyable
+    SparseTileTree(const SparseTileTree&);
+    SparseTileTree& operator=(const SparseTileTree&);
+
+    // ********************************************************************************************************
+    // *** Class members **************************************************************************************
+private:
+    int m_width, m_height, m_depth;
+    int m_tilesX, m_tilesY, m_tilesZ;
+    int m_nodesX, m_nodesY, m_nodesZ;
+
+    vector<int*> m_nodes;       // Root grid: per node, the index of each of its tiles (-1 if inactive), or NULL
+    vector<int> m_tileOrigins;  // First voxel of each active tile
+    vector<float> m_payload;    // CHANNELS floats per voxel of each active tile
+
+}; /* SparseTileTree */
+
+#endif // SPARSETILETREE_H
@@ -0,0 +1,14 @@
+#include "SplatRenderer.h"
+
+/// Squared Mahalanobis distance from the splat center where the footprint is cut off
+const float SplatRenderer::FOOTPRINT_CUTOFF = 4.0f;
+
+/// Variance of the Gaussian reconstruction kernel, in voxels squared. Neighbouring kernels then sum to an
+/// almost constant value over a plane of voxels.
+const float SplatRenderer::RECONSTRUCTION_VARIANCE = 0.36f;
+
+/// Variance of the screen space low-pass filter, in pixels squared
+const float SplatRenderer::LOW_PASS_VARIANCE = 1.0f;
+
+/// Accumulated opacity above which pixels are no longer composited
+const float SplatRenderer::OPAQUE_THRESHOLD = 0.99f;
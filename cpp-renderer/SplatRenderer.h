@@ -0,0 +1,386 @@
+#ifndef SPLATRENDERER_H
+#define SPLATRENDERER_H
+
+#include <cmath>
+#include <vector>
+
+#include "Matrix4d.h"
+#include "RayGeometry.h"
+#include "Volume.h"
+#include "transfer_function.h"
+
+using std::vector;
+
+/**
+ * Object-order splatting renderer for parallel projection, using elliptical weighted average (EWA) footprints
+ * (Zwicker, Pfister, van Baar & Gross, "EWA Volume Splatting").
+ *
+ * Instead of marching rays through the whole volume, only the voxels that the transfer function makes
+ * non-transparent are visited. They are extracted once per transfer function, and every frame they are sorted by
+ * view depth and composited front to back. Each voxel is reconstructed with a Gaussian kernel; under parallel
+ * projection its footprint is a 2D Gaussian, which is convolved with a one-pixel Gaussian low-pass filter to avoid
+ * aliasing when the volume is seen from afar. For mostly empty volumes (segmentations, vessel trees) this is much
+ * faster than ray casting, since the cost scales with the number of visible voxels rather than with the volume.
+ *
+ * The opacity of each voxel is corrected for the ray caster's step size, so the image is comparable to the one
+ * produced by the ray caster.
+ */
+class SplatRenderer
+{
+    // ********************************************************************************************************
+    // *** Basic methods **************************************************************************************
+public:
+    /// Default constructor
+    SplatRenderer() : m_volume(NULL), m_classifiedTfMode(-1)
+    {
+        // Tabulate the Gaussian footprint exp(-r^2/2) for r^2 in [0, FOOTPRINT_CUTOFF]
+        m_footprint.resize(FOOTPRINT_TABLE_SIZE + 1);
+        for (int i = 0 ; i <= FOOTPRINT_TABLE_SIZE ; i++) {
+            m_footprint[i] = exp(-0.5 * FOOTPRINT_CUTOFF * i / FOOTPRINT_TABLE_SIZE);
+        }
+    }
+
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    /// Set the volume to render. The splats are extracted on the next call to renderDvr().
+    void setVolume(const Volume *volume) {
+        m_volume = volume;
+        m_classifiedTable.clear();
+        m_classifiedTfMode = -1;
+        m_splats.clear();
+    }
+
+    /// Return the number of non-transparent voxels for the transfer function of the last rendering
+    int getSplatCount() const { return m_splats.size(); }
+
+    /// Direct volume render the volume into image, which holds resX*resY RGB triplets stored row by row.
+    ///
+    /// All vectors are in voxel coordinates: origin is the starting position of the ray of pixel (0,0), pixelRight
+    /// and pixelUp are the offsets between neighbouring pixels, and direction is the normalized projection vector.
+    /// These three vectors must be mutually orthogonal. tfMode selects the transfer function mode (0 is 1D, 1 is 1D
+    /// with gradient-based transparency), and rayCasterStep is the ray caster's step size in voxel units, used for
+    /// opacity correction.
+    void renderDvr(const float origin[3], const float pixelRight[3], const float pixelUp[3], const float direction[3],
+                   TransferFunction *transferFunction, int tfMode, float rayCasterStep,
+                   float *image, int resX, int resY) {
+        classify(transferFunction, tfMode);
+
+        // Every voxel covers a unit length of the rays crossing it, where the ray caster takes 1/step samples
+        buildOpacityCorrection(1.0f / rayCasterStep);
+
+        vector<ScreenSplat> screenSplats;
+        project(origin, pixelRight, pixelUp, direction, screenSplats);
+
+        vector<int> order;
+        sortByDepth(screenSplats, order);
+
+        vector<float> accumulated(resX * resY * 4, 0.0f);
+        rasterize(screenSplats, order, 1.0f / sqrt(RayGeometry::dot(pixelRight, pixelRight)),
+                  1.0f / sqrt(RayGeometry::dot(pixelUp, pixelUp)), &accumulated[0], resX, resY);
+
+        const float dimensions[3] = { (float)m_volume->getWidth(), (float)m_volume->getHeight(), (float)m_volume->getDepth() };
+
+        #pragma omp parallel for
+        for (int y = 0 ; y < resY ; y++) {
+            for (int x = 0 ; x < resX ; x++) {
+                float *pixel = &image[(y * resX + x) * 3];
+                const float *color = &accumulated[(y * resX + x) * 4];
+
+                float rayStart[3];
+                for (int i = 0 ; i < 3 ; i++) {
+                    rayStart[i] = origin[i] + pixelRight[i] * x + pixelUp[i] * y;
+                }
+
+                if (!RayGeometry::rayHitsBox(rayStart, direction, dimensions)) {
+                    // Same background as the ray caster
+                    pixel[0] = pixel[1] = pixel[2] = 0.3f;
+                    continue;
+                }
+
+                // Clamp to [0,1] like the colors of the ray caster
+                for (int i = 0 ; i < 3 ; i++) {
+                    pixel[i] = std::max(0.0f, std::min(color[i], 1.0f));
+                }
+            }
+        }
+    }
+
+    // ********************************************************************************************************
+    // *** Private types **************************************************************************************
+private:
+    /// A non-transparent voxel: its position in voxel coordinates, its color premultiplied by opacity, and opacity
+    struct Splat {
+        float position[3];
+        float r, g, b, a;
+    };
+
+    /// A splat projected to the image: pixel coordinates of its center and its depth along the viewing direction
+    struct ScreenSplat {
+        float x, y;
+        float depth;
+    };
+
+    // ********************************************************************************************************
+    // *** Private methods ************************************************************************************
+private:
+    /// Extract the non-transparent voxels, unless the transfer function is unchanged
+    void classify(TransferFunction *transferFunction, int tfMode) {
+        // Tabulate the transfer function; comparing the tables detects transfer function changes
+        vector<float> table(CLASSIFICATION_TABLE_SIZE * 4);
+        for (int i = 0 ; i < CLASSIFICATION_TABLE_SIZE ; i++) {
+            double sample = (double)i / (CLASSIFICATION_TABLE_SIZE - 1);
+            Vector3d color = transferFunction->GetColor(sample);
+            double alpha = transferFunction->GetAlpha(sample);
+
+            table[i*4 + 0] = color.GetX() * alpha;
+            table[i*4 + 1] = color.GetY() * alpha;
+            table[i*4 + 2] = color.GetZ() * alpha;
+            table[i*4 + 3] = alpha;
+        }
+
+        if (table == m_classifiedTable && tfMode == m_classifiedTfMode) {
+            return;
+        }
+
+        m_classifiedTable = table;
+        m_classifiedTfMode = tfMode;
+
+        extract();
+    }
+
+    /// Collect the non-transparent voxels of every slice in parallel, then concatenate them
+    void extract() {
+        const int width = m_volume->getWidth();
+        const int height = m_volume->getHeight();
+        const int depth = m_volume->getDepth();
+        const float e = exp(1.0f);
+
+        vector<vector<Splat> > sliceSplats(depth);
+
+        #pragma omp parallel for
+        for (int z = 0 ; z < depth ; z++) {
+            for (int y = 0 ; y < height ; y++) {
+                for (int x = 0 ; x < width ; x++) {
+                    float value = m_volume->getVoxel(x, y, z);
+                    int index = std::max(0, std::min((int)(value * (CLASSIFICATION_TABLE_SIZE - 1) + 0.5f), CLASSIFICATION_TABLE_SIZE - 1));
+
+                    float alpha = m_classifiedTable[index*4 + 3];
+                    if (alpha <= 0) {
+                        continue;
+                    }
+
+                    Splat splat;
+                    splat.position[0] = x;
+                    splat.position[1] = y;
+                    splat.position[2] = z;
+                    splat.r = m_classifiedTable[index*4 + 0];
+                    splat.g = m_classifiedTable[index*4 + 1];
+                    splat.b = m_classifiedTable[index*4 + 2];
+                    splat.a = alpha;
+
+                    // Gradient-based transparency, as in the ray caster
+                    if (m_classifiedTfMode == 1) {
+                        double magnitude = m_volume->getGradientMagnitude((float)x, (float)y, (float)z);
+                        float factor = 1 - 1/log(e + magnitude);
+
+                        splat.r *= factor;
+                        splat.g *= factor;
+                        splat.b *= factor;
+                        splat.a *= factor;
+
+                        if (splat.a <= 0) {
+                            continue;
+                        }
+                    }
+
+                    sliceSplats[z].push_back(splat);
+                }
+            }
+        }
+
+        m_splats.clear();
+        for (int z = 0 ; z < depth ; z++) {
+            m_splats.insert(m_splats.end(), sliceSplats[z].begin(), sliceSplats[z].end());
+        }
+    }
+
+    /// Tabulate the opacity correction alpha' = 1 - (1 - alpha)^exponent
+    void buildOpacityCorrection(float exponent) {
+        m_opacityCorrection.resize(OPACITY_TABLE_SIZE + 1);
+        for (int i = 0 ; i <= OPACITY_TABLE_SIZE ; i++) {
+            float alpha = (float)i / OPACITY_TABLE_SIZE;
+            m_opacityCorrection[i] = 1 - pow(1 - alpha, exponent);
+        }
+    }
+
+    /// Compute the pixel coordinates and view depth of every splat
+    void project(const float origin[3], const float pixelRight[3], const float pixelUp[3], const float direction[3],
+                 vector<ScreenSplat> &screenSplats) const {
+        // With orthogonal view vectors, the pixel coordinates are projections onto the pixel axes
+        float rightScale = 1.0f / RayGeometry::dot(pixelRight, pixelRight);
+        float upScale = 1.0f / RayGeometry::dot(pixelUp, pixelUp);
+
+        const int count = m_splats.size();
+        screenSplats.resize(count);
+
+        #pragma omp parallel for
+        for (int i = 0 ; i < count ; i++) {
+            float offset[3];
+            for (int c = 0 ; c < 3 ; c++) {
+                offset[c] = m_splats[i].position[c] - origin[c];
+            }
+
+            screenSplats[i].x = RayGeometry::dot(offset, pixelRight) * rightScale;
+            screenSplats[i].y = RayGeometry::dot(offset, pixelUp) * upScale;
+            screenSplats[i].depth = RayGeometry::dot(offset, direction);
+        }
+    }
+
+    /// Order the splats front to back. A counting sort on the depth quantized to DEPTH_RESOLUTION of a voxel keeps
+    /// the sort linear in the number of splats; splats in the same bucket keep their (slice) order.
+    void sortByDepth(const vector<ScreenSplat> &screenSplats, vector<int> &order) const {
+        const int count = screenSplats.size();
+        order.resize(count);
+        if (count == 0) {
+            return;
+        }
+
+        float minimumDepth = screenSplats[0].depth;
+        float maximumDepth = screenSplats[0].depth;
+        for (int i = 1 ; i < count ; i++) {
+            minimumDepth = std::min(minimumDepth, screenSplats[i].depth);
+            maximumDepth = std::max(maximumDepth, screenSplats[i].depth);
+        }
+
+        const int bucketCount = (int)((maximumDepth - minimumDepth) * DEPTH_RESOLUTION) + 1;
+        vector<int> bucketStart(bucketCount + 1, 0);
+
+        vector<int> bucket(count);
+        for (int i = 0 ; i < count ; i++) {
+            bucket[i] = (int)((screenSplats[i].depth - minimumDepth) * DEPTH_RESOLUTION);
+            bucketStart[bucket[i] + 1]++;
+        }
+
+        for (int b = 0 ; b < bucketCount ; b++) {
+            bucketStart[b + 1] += bucketStart[b];
+        }
+
+        for (int i = 0 ; i < count ; i++) {
+            order[bucketStart[bucket[i]]++] = i;
+        }
+    }
+
+    /// Composite the footprints of the splats, in the given order, front to back into accumulated (premultiplied
+    /// RGBA). pixelsPerVoxelX and pixelsPerVoxelY give the image scale. The image is split into bands of rows that
+    /// are rasterized in parallel; each band gets the list of splats overlapping it, in depth order.
+    void rasterize(const vector<ScreenSplat> &screenSplats, const vector<int> &order, float pixelsPerVoxelX,
+                   float pixelsPerVoxelY, float *accumulated, int resX, int resY) const {
+        // Footprint covariance in pixels: the projected reconstruction kernel plus the low-pass filter. The view
+        // vectors are orthogonal, so the covariance is diagonal.
+        const float varianceX = RECONSTRUCTION_VARIANCE * pixelsPerVoxelX * pixelsPerVoxelX + LOW_PASS_VARIANCE;
+        const float varianceY = RECONSTRUCTION_VARIANCE * pixelsPerVoxelY * pixelsPerVoxelY + LOW_PASS_VARIANCE;
+        const float inverseX = 1.0f / varianceX;
+        const float inverseY = 1.0f / varianceY;
+
+        // Scale the footprints so that those of a plane of voxels add up to one
+        const float normalization = pixelsPerVoxelX * pixelsPerVoxelY / (2 * PI * sqrt(varianceX * varianceY));
+
+        const float radiusX = sqrt(FOOTPRINT_CUTOFF * varianceX);
+        const float radiusY = sqrt(FOOTPRINT_CUTOFF * varianceY);
+        const float tableScale = FOOTPRINT_TABLE_SIZE / FOOTPRINT_CUTOFF;
+
+        // Bin the splats into bands of rows, keeping the depth order within each band
+        const int bandCount = (resY + BAND_HEIGHT - 1) / BAND_HEIGHT;
+        vector<vector<int> > bandSplats(bandCount);
+
+        for (int n = 0 ; n < (int)order.size() ; n++) {
+            const ScreenSplat &splat = screenSplats[order[n]];
+
+            int top = std::max((int)ceil(splat.y - radiusY), 0);
+            int bottom = std::min((int)floor(splat.y + radiusY), resY - 1);
+            if (top > bottom || splat.x + radiusX < 0 || splat.x - radiusX > resX - 1) {
+                continue;
+            }
+
+            for (int band = top / BAND_HEIGHT ; band <= bottom / BAND_HEIGHT ; band++) {
+                bandSplats[band].push_back(order[n]);
+            }
+        }
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int band = 0 ; band < bandCount ; band++) {
+            const int bandTop = band * BAND_HEIGHT;
+            const int bandBottom = std::min(bandTop + BAND_HEIGHT, resY) - 1;
+
+            for (int n = 0 ; n < (int)bandSplats[band].size() ; n++) {
+                const int index = bandSplats[band][n];
+                const ScreenSplat &screenSplat = screenSplats[index];
+                const Splat &splat = m_splats[index];
+
+                const float correctedAlpha = m_opacityCorrection[(int)(std::min(splat.a, 1.0f) * OPACITY_TABLE_SIZE)];
+                const float colorScale = 1.0f / splat.a; // Turns the premultiplied color back into the color
+
+                int top = std::max((int)ceil(screenSplat.y - radiusY), bandTop);
+                int bottom = std::min((int)floor(screenSplat.y + radiusY), bandBottom);
+                int left = std::max((int)ceil(screenSplat.x - radiusX), 0);
+                int right = std::min((int)floor(screenSplat.x + radiusX), resX - 1);
+
+                for (int y = top ; y <= bottom ; y++) {
+                    float dy = y - screenSplat.y;
+                    float distanceY = dy * dy * inverseY;
+
+                    for (int x = left ; x <= right ; x++) {
+                        float dx = x - screenSplat.x;
+                        float distance = dx * dx * inverseX + distanceY;
+                        if (distance >= FOOTPRINT_CUTOFF) {
+                            continue;
+                        }
+
+                        float *pixel = &accumulated[(y * resX + x) * 4];
+
+                        // Skip pixels that are already (nearly) opaque: early ray termination
+                        if (pixel[3] >= OPAQUE_THRESHOLD) {
+                            continue;
+                        }
+
+                        float weight = normalization * m_footprint[(int)(distance * tableScale)];
+                        float alpha = std::min(correctedAlpha * weight, 1.0f);
+                        float transmittance = 1 - pixel[3];
+
+                        // Weight the color by the clamped opacity, as the ray caster does
+                        pixel[0] += transmittance * alpha * splat.r * colorScale;
+                        pixel[1] += transmittance * alpha * splat.g * colorScale;
+                        pixel[2] += transmittance * alpha * splat.b * colorScale;
+                        pixel[3] += transmittance * alpha;
+                    }
+                }
+            }
+        }
+    }
+
+    // ********************************************************************************************************
+    // *** Class members **************************************************************************************
+private:
+    static const int CLASSIFICATION_TABLE_SIZE = 1024;
+    static const int OPACITY_TABLE_SIZE = 1024;
+    static const int FOOTPRINT_TABLE_SIZE = 256;
+    static const int DEPTH_RESOLUTION = 8;    // Depth buckets per voxel
+    static const int BAND_HEIGHT = 16;        // Rows per rasterization band
+    static const float FOOTPRINT_CUTOFF;
+    static const float RECONSTRUCTION_VARIANCE;
+    static const float LOW_PASS_VARIANCE;
+    static const float OPAQUE_THRESHOLD;
+
+    const Volume *m_volume;
+
+    vector<float> m_classifiedTable; // Premultiplied RGBA per intensity, for the extracted transfer function
+    int m_classifiedTfMode;
+    vector<Splat> m_splats;
+
+    vector<float> m_opacityCorrection;
+    vector<float> m_footprint;
+
+}; /* SplatRenderer */
+
+#endif // SPLATRENDERER_H
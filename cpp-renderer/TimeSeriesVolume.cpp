@@ -0,0 +1 @@
+#include "TimeSeriesVolume.h"
@@ -0,0 +1,400 @@
+#ifndef TIMESERIESVOLUME_H
+#define TIMESERIESVOLUME_H
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <QFile>
+#include <QMutex>
+#include <QObject>
+#include <QStringList>
+#include <QThread>
+#include <QTimer>
+#include <QWaitCondition>
+
+#include "Volume.h"
+
+using std::vector;
+
+/**
+ * Time-varying volume: a sequence of DAT files of the same dimensions, one per timestep, played back at a steady
+ * frame rate. Only a few timesteps are in memory at once, in a ring of volumes: the one shown, and the next
+ * PREFETCH_FRAMES, which a loader thread reads ahead of playback. A timestep is read by memory-mapping its file and
+ * converting the mapped voxels into a volume of the ring, and its gradients and histogram are computed there too.
+ * The volumes of the ring keep their buffers of voxels and of derived data from timestep to timestep.
+ *
+ * frameChanged() hands each new timestep to the renderers, at every tick of the frame rate. When the next timestep
+ * has not arrived in time, the tick is skipped rather than waited for, so that playback never blocks on the disk.
+ * The loader never touches the volume that is shown; it stays valid until the next frameChanged() or close().
+ */
+class TimeSeriesVolume : public QObject
+{
+    Q_OBJECT
+
+    // ********************************************************************************************************
+    // *** Basic methods **************************************************************************************
+public:
+    /// Constructor; the series is empty until open() is called
+    explicit TimeSeriesVolume(QObject *parent = NULL) : QObject(parent),
+        m_gradientPolicy(Volume::PRECOMPUTED_GRADIENTS), m_shown(-1), m_frame(0), m_seekFrame(-1),
+        m_frameRate(DEFAULT_FRAME_RATE), m_loader(NULL), m_stopping(false)
+    {
+        connect(&m_timer, SIGNAL(timeout()), this, SLOT(advance()));
+
+        // Emitted by the loader thread, and handled in the thread of the renderers
+        connect(this, SIGNAL(frameLoaded()), this, SLOT(showSoughtFrame()), Qt::QueuedConnection);
+    }
+
+    /// Destructor
+    ~TimeSeriesVolume()
+    {
+        close();
+    }
+
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    static const int PREFETCH_FRAMES = 2;     ///< Timesteps read ahead of the one shown
+    static const int DEFAULT_FRAME_RATE = 10; ///< Timesteps per second
+
+    /// Open a series of DAT files, one per timestep in the given order, and show the first timestep. The gradients
+    /// of the timesteps are provided according to policy. Return false, keeping the previous series, if a file
+    /// cannot be read or its dimensions differ from those of the first.
+    bool open(const QStringList &files, Volume::GradientPolicy policy) {
+        if (files.isEmpty()) {
+            return false;
+        }
+
+        int width, height, depth;
+        if (!Volume::readDatDimensions(files[0].toStdString(), width, height, depth)) {
+            std::cerr << "+ Error opening the file " << files[0].toStdString() << "." << std::endl;
+            return false;
+        }
+
+        const qint64 frameBytes = DAT_HEADER_BYTES + (qint64)width * height * depth * 2;
+        for (int i = 1 ; i < files.size() ; i++) {
+            int frameWidth, frameHeight, frameDepth;
+            if (!Volume::readDatDimensions(files[i].toStdString(), frameWidth, frameHeight, frameDepth) ||
+                frameWidth != width || frameHeight != height || frameDepth != depth || QFile(files[i]).size() < frameBytes) {
+                std::cerr << "+ Timestep " << files[i].toStdString() << " is not a " << width << "x" << height << "x"
+                          << depth << " dataset." << std::endl;
+                return false;
+            }
+        }
+
+        close();
+
+        m_files = files;
+        m_gradientPolicy = policy;
+
+        const int slotCount = std::min(PREFETCH_FRAMES + 1, (int)files.size());
+        for (int i = 0 ; i < slotCount ; i++) {
+            m_slots.push_back(new Volume(width, height, depth));
+        }
+        m_slotFrame.assign(slotCount, -1);
+        m_slotReady.assign(slotCount, (char)false);
+
+        std::cout << "- Playing " << files.size() << " timesteps of " << width << "x" << height << "x" << depth
+                  << " voxels, " << PREFETCH_FRAMES << " read ahead." << std::endl;
+
+        readFrame(files[0], m_slots[0], policy);
+        m_slotFrame[0] = 0;
+        m_slotReady[0] = true;
+        m_shown = 0;
+        m_frame = 0;
+        m_seekFrame = -1;
+
+        m_stopping = false;
+        m_loader = new FrameLoader(this);
+        m_loader->start(QThread::LowPriority);
+
+        return true;
+    }
+
+    /// Stop playback and the loader, and free the timesteps
+    void close() {
+        m_timer.stop();
+
+        if (m_loader != NULL) {
+            m_mutex.lock();
+            m_stopping = true;
+            m_wakeLoader.wakeAll();
+            m_mutex.unlock();
+
+            m_loader->wait();
+            delete m_loader;
+            m_loader = NULL;
+        }
+
+        for (int i = 0 ; i < (int)m_slots.size() ; i++) {
+            delete m_slots[i];
+        }
+        m_slots.clear();
+        m_slotFrame.clear();
+        m_slotReady.clear();
+        m_files.clear();
+
+        m_shown = -1;
+        m_frame = 0;
+        m_seekFrame = -1;
+    }
+
+    /// Return true if a series is open
+    bool isOpen() const { return m_shown >= 0; }
+
+    /// Return the number of timesteps, and the timestep shown
+    int getFrameCount() const { return m_files.size(); }
+    int getCurrentFrame() const { return m_frame; }
+
+    /// Return the volume of the timestep shown, or NULL if no series is open
+    Volume* getCurrentVolume() { return isOpen() ? m_slots[m_shown] : NULL; }
+
+    /// Return true while playing
+    bool isPlaying() const { return m_timer.isActive(); }
+
+    // ********************************************************************************************************
+    // *** Public slots ***************************************************************************************
+public slots:
+    /// Start or stop playback, which loops at the end of the series
+    void setPlaying(bool playing) {
+        if (playing && isOpen()) {
+            m_timer.start(1000 / m_frameRate);
+        } else {
+            m_timer.stop();
+        }
+    }
+
+    /// Set the number of timesteps shown per second
+    void setFrameRate(int framesPerSecond) {
+        m_frameRate = std::max(framesPerSecond, 1);
+        if (m_timer.isActive()) {
+            m_timer.start(1000 / m_frameRate);
+        }
+    }
+
+    /// Show a timestep as soon as it has been read
+    void showFrame(int frame) {
+        if (!isOpen()) {
+            return;
+        }
+
+        m_mutex.lock();
+        m_seekFrame = std::min(std::max(frame, 0), getFrameCount() - 1);
+        m_wakeLoader.wakeAll();
+        m_mutex.unlock();
+
+        showSoughtFrame();
+    }
+
+    /// Show the next or the previous timestep
+    void nextFrame() { showFrame((m_frame + 1) % std::max(getFrameCount(), 1)); }
+    void previousFrame() { showFrame((m_frame + getFrameCount() - 1) % std::max(getFrameCount(), 1)); }
+
+    /// Provide the gradients of the timesteps according to another policy (as a Volume::GradientPolicy). The
+    /// timesteps read ahead are read again; the one shown is left to the renderer that changed its policy.
+    void setGradientPolicy(int policy) {
+        QMutexLocker locker(&m_mutex);
+
+        m_gradientPolicy = (Volume::GradientPolicy)policy;
+        for (int i = 0 ; i < (int)m_slots.size() ; i++) {
+            if (i != m_shown) {
+                m_slotFrame[i] = -1;
+                m_slotReady[i] = false;
+            }
+        }
+        m_wakeLoader.wakeAll();
+    }
+
+    // ********************************************************************************************************
+    // *** Signals ********************************************************************************************
+signals:
+    /// The timestep shown has changed to volume
+    void frameChanged(Volume *volume);
+
+    /// The number of the timestep shown has changed
+    void frameNumberChanged(int frame);
+
+    /// The loader has read a timestep (emitted from the loader thread)
+    void frameLoaded();
+
+    // ********************************************************************************************************
+    // *** Private slots **************************************************************************************
+private slots:
+    /// Playback tick: show the next timestep (or the one sought) if it has arrived
+    void advance() {
+        if (isOpen()) {
+            showIfRead((m_seekFrame >= 0) ? m_seekFrame : (m_frame + 1) % getFrameCount());
+        }
+    }
+
+    /// Show the timestep sought with showFrame() if it has arrived
+    void showSoughtFrame() {
+        if (isOpen() && m_seekFrame >= 0) {
+            showIfRead(m_seekFrame);
+        }
+    }
+
+    // ********************************************************************************************************
+    // *** Private types **************************************************************************************
+private:
+    /// Thread reading the timesteps ahead of playback
+    class FrameLoader : public QThread
+    {
+    public:
+        explicit FrameLoader(TimeSeriesVolume *series) : m_series(series) {}
+
+    protected:
+        void run() { m_series->loadFrames(); }
+
+    private:
+        TimeSeriesVolume *m_series;
+    };
+
+    // ********************************************************************************************************
+    // *** Private methods ************************************************************************************
+private:
+    static const int DAT_HEADER_BYTES = 6;
+
+    /// Body of the loader thread: fill the volumes of the ring that are not shown with the timesteps that follow
+    /// the next one to be shown, nearest first
+    void loadFrames() {
+        QMutexLocker locker(&m_mutex);
+
+        while (!m_stopping) {
+            int frame, slot;
+            if (!findFrameToLoad(frame, slot)) {
+                m_wakeLoader.wait(&m_mutex);
+                continue;
+            }
+
+            m_slotFrame[slot] = frame;
+            m_slotReady[slot] = false;
+            const QString file = m_files[frame];
+            const Volume::GradientPolicy policy = m_gradientPolicy;
+
+            locker.unlock();
+            readFrame(file, m_slots[slot], policy);
+            locker.relock();
+
+            // The volume may have been claimed for another timestep meanwhile, by setGradientPolicy()
+            if (m_slotFrame[slot] == frame) {
+                m_slotReady[slot] = true;
+                emit frameLoaded();
+            }
+        }
+    }
+
+    /// Find the nearest timestep after the next one to be shown that is not in the ring, and a volume of the ring
+    /// to read it into. Return false if all are in the ring. Call with the mutex locked.
+    bool findFrameToLoad(int &frame, int &slot) const {
+        const int frameCount = getFrameCount();
+        const int target = (m_seekFrame >= 0) ? m_seekFrame : (m_frame + 1) % frameCount;
+
+        for (int ahead = 0 ; ahead < std::min((int)PREFETCH_FRAMES, frameCount) ; ahead++) {
+            frame = (target + ahead) % frameCount;
+            if (std::find(m_slotFrame.begin(), m_slotFrame.end(), frame) != m_slotFrame.end()) {
+                continue;
+            }
+
+            // Any volume that is not shown and holds no timestep wanted ahead
+            for (slot = 0 ; slot < (int)m_slots.size() ; slot++) {
+                const int holding = m_slotFrame[slot];
+                if (slot != m_shown && (holding < 0 || (holding - target + frameCount) % frameCount >= PREFETCH_FRAMES)) {
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    /// Return the volume of the ring holding a timestep that has been read, or -1. Call with the mutex locked.
+    int readySlot(int frame) const {
+        for (int slot = 0 ; slot < (int)m_slots.size() ; slot++) {
+            if (m_slotFrame[slot] == frame && m_slotReady[slot]) {
+                return slot;
+            }
+        }
+        return -1;
+    }
+
+    /// Show a timestep if it has been read, and hand it to the renderers
+    void showIfRead(int frame) {
+        m_mutex.lock();
+        const int slot = readySlot(frame);
+        const bool changed = slot >= 0 && slot != m_shown;
+        if (slot >= 0) {
+            show(slot);
+        }
+        m_mutex.unlock();
+
+        if (changed) {
+            emit frameChanged(m_slots[slot]);
+            emit frameNumberChanged(m_frame);
+        }
+    }
+
+    /// Make a volume of the ring the one shown, and let the loader reuse the previous one. Call with the mutex
+    /// locked.
+    void show(int slot) {
+        m_shown = slot;
+        m_frame = m_slotFrame[slot];
+        m_seekFrame = -1;
+        m_wakeLoader.wakeAll();
+    }
+
+    /// Read a timestep into a volume of the ring. The file is mapped where possible, and read otherwise.
+    void readFrame(const QString &filename, Volume *volume, Volume::GradientPolicy policy) {
+        QFile file(filename);
+        if (!file.open(QIODevice::ReadOnly)) {
+            std::cerr << "+ Error opening the file " << filename.toStdString() << "." << std::endl;
+            return;
+        }
+
+        const qint64 size = file.size();
+        bool read;
+
+        uchar *data = file.map(0, size);
+        if (data != NULL) {
+            read = volume->setVoxelsFromDat(data, (size_t)size, policy);
+            file.unmap(data);
+        } else {
+            m_readBuffer.resize((size_t)size);
+            read = file.read((char*)&m_readBuffer[0], size) == size &&
+                   volume->setVoxelsFromDat(&m_readBuffer[0], (size_t)size, policy);
+        }
+
+        if (!read) {
+            std::cerr << "+ Error reading the timestep " << filename.toStdString() << "." << std::endl;
+        }
+    }
+
+    // Not copyable
+    TimeSeriesVolume(const TimeSeriesVolume&);
+    TimeSeriesVolume& operator=(const TimeSeriesVolume&);
+
+    // ********************************************************************************************************
+    // *** Class members **************************************************************************************
+private:
+    QStringList m_files;                    // DAT file of each timestep
+    Volume::GradientPolicy m_gradientPolicy;
+
+    vector<Volume*> m_slots;                // The ring of volumes
+    vector<int> m_slotFrame;                // Timestep held by each volume of the ring, or -1
+    vector<char> m_slotReady;               // Whether that timestep has been read
+    int m_shown;                            // Volume of the ring that is shown, or -1 if no series is open
+    int m_frame;                            // Timestep shown
+    int m_seekFrame;                        // Timestep to show as soon as it is read, or -1 to play on
+
+    QTimer m_timer;                         // Ticks at the frame rate while playing
+    int m_frameRate;
+
+    FrameLoader *m_loader;
+    QMutex m_mutex;                         // Guards the ring, the timestep shown and the sought timestep
+    QWaitCondition m_wakeLoader;            // Signalled when the loader may find work
+    bool m_stopping;
+    vector<unsigned char> m_readBuffer;     // Timestep read when its file cannot be mapped
+
+}; /* TimeSeriesVolume */
+
+#endif // TIMESERIESVOLUME_H
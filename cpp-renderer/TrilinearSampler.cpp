@@ -0,0 +1 @@
+#include "TrilinearSampler.h"
@@ -0,0 +1,300 @@
+#ifndef TRILINEARSAMPLER_H
+#define TRILINEARSAMPLER_H
+
+#include <algorithm>
+#include <cmath>
+
+#include "SimdMath.h"
+#include "Volume.h"
+
+/**
+ * Trilinear interpolation of the voxel values, gradients and gradient magnitudes of a volume, for the inner loops
+ * of the renderers.
+ *
+ * Gives the same results as Volume::getVoxelTrilinear(), getGradientTrilinear() and
+ * getGradientMagnitudeTrilinear(), which clamp with six branches and recompute floor() and ceil() and the index
+ * of every corner. Here a position is clamped with one vector min/max, the lower corner is found by truncation,
+ * and the eight corners are addressed from that base index with strides computed once per volume. The lower corner
+ * is kept one voxel inside the upper border, so positions on the border interpolate with a fraction of one instead
+ * of needing a special case.
+ *
+ * sample() returns the value, gradient and gradient magnitude at once, sharing the corner index and the eight
+ * interpolation weights.
+ *
+ * The gradients follow the volume's gradient policy. With ON_THE_FLY_GRADIENTS, the central differences of the
+ * eight corners are computed from one fetch of the 4x4x4 voxels around the cell, which also gives sample() the
+ * corner values. The same is done with every policy while the volume's gradients are still being set up.
+ */
+class TrilinearSampler
+{
+    // ********************************************************************************************************
+    // *** Basic methods **************************************************************************************
+public:
+    /// Default constructor; call setVolume() before sampling
+    TrilinearSampler() : m_volume(NULL), m_width(0), m_sliceSize(0), m_lastCellX(0), m_lastCellY(0), m_lastCellZ(0)
+    {
+        for (int i = 0 ; i < 8 ; i++) {
+            m_cornerOffsets[i] = 0;
+        }
+    }
+
+    /// Create a sampler for the given volume
+    explicit TrilinearSampler(const Volume *volume) : m_volume(NULL)
+    {
+        setVolume(volume);
+    }
+
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    /// Set the volume to sample. Call again if the volume's gradients are recomputed.
+    void setVolume(const Volume *volume) {
+        m_volume = volume;
+
+        const int width = volume->getWidth();
+        const int height = volume->getHeight();
+        const int depth = volume->getDepth();
+
+        m_upperBound = Vec3f(width - 1, height - 1, depth - 1);
+
+        // Highest lower corner along each axis; a dimension of one voxel has no upper corner
+        m_lastCellX = std::max(width - 2, 0);
+        m_lastCellY = std::max(height - 2, 0);
+        m_lastCellZ = std::max(depth - 2, 0);
+
+        m_width = width;
+        m_sliceSize = (Volume::VoxelIndex)width * height;
+
+        const int strideX = (width > 1) ? 1 : 0;
+        const int strideY = (height > 1) ? width : 0;
+        const Volume::VoxelIndex strideZ = (depth > 1) ? m_sliceSize : 0;
+
+        for (int corner = 0 ; corner < 8 ; corner++) {
+            m_cornerOffsets[corner] = ((corner & 1) ? strideX : 0) + ((corner & 2) ? strideY : 0) + ((corner & 4) ? strideZ : 0);
+        }
+    }
+
+    /// Return the interpolated voxel value at a position in voxel coordinates
+    float value(const Vec3f &position) const {
+        Cell cell;
+        locate(position, cell);
+
+        return interpolate(m_volume->getData() + cell.base, cell.weights);
+    }
+
+    /// Return the interpolated gradient at a position in voxel coordinates
+    Vec3f gradient(const Vec3f &position) const {
+        float value, magnitude;
+        Vec3f gradient;
+        sample(position, value, gradient, magnitude, GRADIENT);
+        return gradient;
+    }
+
+    /// Return the interpolated gradient magnitude at a position in voxel coordinates
+    float gradientMagnitude(const Vec3f &position) const {
+        float value, magnitude;
+        Vec3f gradient;
+        sample(position, value, gradient, magnitude, MAGNITUDE);
+        return magnitude;
+    }
+
+    /// Return the interpolated value, gradient and gradient magnitude at a position in voxel coordinates
+    void sample(const Vec3f &position, float &value, Vec3f &gradient, float &magnitude) const {
+        sample(position, value, gradient, magnitude, VALUE | GRADIENT | MAGNITUDE);
+    }
+
+    // ********************************************************************************************************
+    // *** Private types **************************************************************************************
+private:
+    /// The cell containing a position
+    struct Cell {
+        int x, y, z;             // Lower corner
+        Volume::VoxelIndex base; // Index of the lower corner
+        float weights[8];        // Interpolation weights of the corners
+    };
+
+    /// What sample() computes
+    enum Quantity { VALUE = 1, GRADIENT = 2, MAGNITUDE = 4 };
+
+    // ********************************************************************************************************
+    // *** Private methods ************************************************************************************
+private:
+    /// Interpolate the requested quantities (a combination of Quantity flags)
+    void sample(const Vec3f &position, float &value, Vec3f &gradient, float &magnitude, int quantities) const {
+        Cell cell;
+        locate(position, cell);
+
+        // Until the volume has set up its gradients, they are computed on the fly
+        const Volume::GradientPolicy policy = m_volume->areGradientsReady() ? m_volume->getGradientPolicy() : Volume::ON_THE_FLY_GRADIENTS;
+
+        if (policy == Volume::PRECOMPUTED_GRADIENTS) {
+            if (quantities & VALUE) {
+                value = interpolate(m_volume->getData() + cell.base, cell.weights);
+            }
+            if (quantities & GRADIENT) {
+                gradient = interpolateGradient(m_volume->getGradientData() + cell.base, cell.weights);
+            }
+            if (quantities & MAGNITUDE) {
+                magnitude = interpolate(m_volume->getGradientMagnitudeData() + cell.base, cell.weights);
+            }
+            return;
+        }
+
+        float values[8];
+        float gradients[8][3];
+        float magnitudes[8];
+
+        if (policy == Volume::ON_THE_FLY_GRADIENTS) {
+            neighbourhoodGradients(cell, values, gradients, magnitudes);
+        } else {
+            for (int corner = 0 ; corner < 8 ; corner++) {
+                const int x = std::min(cell.x + (corner & 1), m_volume->getWidth() - 1);
+                const int y = std::min(cell.y + ((corner >> 1) & 1), m_volume->getHeight() - 1);
+                const int z = std::min(cell.z + ((corner >> 2) & 1), m_volume->getDepth() - 1);
+
+                Vector3d cornerGradient = m_volume->getGradient(x, y, z);
+                values[corner] = m_volume->getData()[cell.base + m_cornerOffsets[corner]];
+                gradients[corner][0] = cornerGradient.GetX();
+                gradients[corner][1] = cornerGradient.GetY();
+                gradients[corner][2] = cornerGradient.GetZ();
+                magnitudes[corner] = m_volume->getGradientMagnitude(x, y, z);
+            }
+        }
+
+        float x = 0, y = 0, z = 0;
+        value = magnitude = 0;
+        for (int corner = 0 ; corner < 8 ; corner++) {
+            value += values[corner] * cell.weights[corner];
+            x += gradients[corner][0] * cell.weights[corner];
+            y += gradients[corner][1] * cell.weights[corner];
+            z += gradients[corner][2] * cell.weights[corner];
+            magnitude += magnitudes[corner] * cell.weights[corner];
+        }
+        gradient = Vec3f(x, y, z);
+    }
+
+    /// Compute the values, central difference gradients and gradient magnitudes of the eight corners of a cell from
+    /// one fetch of the 4x4x4 voxels from one before the cell to one after it. As in Volume, the gradients of
+    /// voxels on the border of the volume are zero.
+    void neighbourhoodGradients(const Cell &cell, float values[8], float gradients[8][3], float magnitudes[8]) const {
+        const int width = m_volume->getWidth();
+        const int height = m_volume->getHeight();
+        const int depth = m_volume->getDepth();
+
+        // Clamped offsets of the four voxels along each axis
+        int offsetX[4];
+        Volume::VoxelIndex offsetY[4], offsetZ[4];
+        for (int i = 0 ; i < 4 ; i++) {
+            offsetX[i] = std::min(std::max(cell.x - 1 + i, 0), width - 1);
+            offsetY[i] = (Volume::VoxelIndex)std::min(std::max(cell.y - 1 + i, 0), height - 1) * m_width;
+            offsetZ[i] = std::min(std::max(cell.z - 1 + i, 0), depth - 1) * m_sliceSize;
+        }
+
+        const float *data = m_volume->getData();
+        float block[4][4][4];
+        for (int z = 0 ; z < 4 ; z++) {
+            for (int y = 0 ; y < 4 ; y++) {
+                for (int x = 0 ; x < 4 ; x++) {
+                    block[z][y][x] = data[offsetZ[z] + offsetY[y] + offsetX[x]];
+                }
+            }
+        }
+
+        for (int corner = 0 ; corner < 8 ; corner++) {
+            const int x = 1 + (corner & 1);
+            const int y = 1 + ((corner >> 1) & 1);
+            const int z = 1 + ((corner >> 2) & 1);
+
+            const int voxelX = cell.x + x - 1;
+            const int voxelY = cell.y + y - 1;
+            const int voxelZ = cell.z + z - 1;
+
+            values[corner] = block[z][y][x];
+
+            if (voxelX <= 0 || voxelY <= 0 || voxelZ <= 0 || voxelX >= width - 1 || voxelY >= height - 1 || voxelZ >= depth - 1) {
+                gradients[corner][0] = gradients[corner][1] = gradients[corner][2] = 0;
+                magnitudes[corner] = 0;
+            } else {
+                gradients[corner][0] = (block[z][y][x + 1] - block[z][y][x - 1]) * 0.5f;
+                gradients[corner][1] = (block[z][y + 1][x] - block[z][y - 1][x]) * 0.5f;
+                gradients[corner][2] = (block[z + 1][y][x] - block[z - 1][y][x]) * 0.5f;
+                magnitudes[corner] = sqrt((double)gradients[corner][0] * gradients[corner][0] +
+                                          (double)gradients[corner][1] * gradients[corner][1] +
+                                          (double)gradients[corner][2] * gradients[corner][2]);
+            }
+        }
+    }
+
+    /// Find the cell containing position and the interpolation weights of its eight corners (corner i is offset
+    /// by one voxel along x, y and z where bits 0, 1 and 2 of i are set)
+    void locate(const Vec3f &position, Cell &cell) const {
+        float coordinates[3];
+        position.clamped(Vec3f(0, 0, 0), m_upperBound).store(coordinates);
+
+        // The coordinates are non-negative, so truncation is floor()
+        const int x = std::min((int)coordinates[0], m_lastCellX);
+        const int y = std::min((int)coordinates[1], m_lastCellY);
+        const int z = std::min((int)coordinates[2], m_lastCellZ);
+
+        cell.x = x;
+        cell.y = y;
+        cell.z = z;
+        cell.base = z * m_sliceSize + (Volume::VoxelIndex)y * m_width + x;
+
+        const float xd = coordinates[0] - x;
+        const float yd = coordinates[1] - y;
+        const float zd = coordinates[2] - z;
+
+        const float y0z0 = (1 - yd) * (1 - zd);
+        const float y1z0 = yd * (1 - zd);
+        const float y0z1 = (1 - yd) * zd;
+        const float y1z1 = yd * zd;
+
+        cell.weights[0] = (1 - xd) * y0z0;
+        cell.weights[1] = xd * y0z0;
+        cell.weights[2] = (1 - xd) * y1z0;
+        cell.weights[3] = xd * y1z0;
+        cell.weights[4] = (1 - xd) * y0z1;
+        cell.weights[5] = xd * y0z1;
+        cell.weights[6] = (1 - xd) * y1z1;
+        cell.weights[7] = xd * y1z1;
+    }
+
+    /// Weighted sum of the eight corners of a cell of scalars
+    template <typename T>
+    float interpolate(const T *cell, const float weights[8]) const {
+        float result = 0;
+        for (int corner = 0 ; corner < 8 ; corner++) {
+            result += (float)cell[m_cornerOffsets[corner]] * weights[corner];
+        }
+        return result;
+    }
+
+    /// Weighted sum of the eight corners of a cell of gradients
+    Vec3f interpolateGradient(const Vector3d *cell, const float weights[8]) const {
+        float x = 0, y = 0, z = 0;
+        for (int corner = 0 ; corner < 8 ; corner++) {
+            const Vector3d &gradient = cell[m_cornerOffsets[corner]];
+            x += (float)gradient.GetX() * weights[corner];
+            y += (float)gradient.GetY() * weights[corner];
+            z += (float)gradient.GetZ() * weights[corner];
+        }
+        return Vec3f(x, y, z);
+    }
+
+    // ********************************************************************************************************
+    // *** Class members **************************************************************************************
+private:
+    const Volume *m_volume;
+    int m_width;
+    Volume::VoxelIndex m_sliceSize;
+
+    Vec3f m_upperBound;     // Largest valid coordinate along each axis
+    int m_lastCellX;        // Largest lower corner index along each axis
+    int m_lastCellY;
+    int m_lastCellZ;
+    Volume::VoxelIndex m_cornerOffsets[8]; // Index offsets of the corners of a cell from its lower corner
+
+}; /* TrilinearSampler */
+
+#endif // TRILINEARSAMPLER_H
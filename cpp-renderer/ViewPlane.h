@@ -5,6 +5,7 @@
 
 #include "Vector3d.h"
 #include "Matrix4d.h"
+#include "SimdMath.h"
 
 /// Represents the viewing plane
 class ViewPlane
@@ -110,6 +111,12 @@ public:
         return lightPosition;
     }
 
+    /// Return the starting position of the ray through the point (u,v) of the plane, where (0,0) is the lower
+    /// left corner and (1,1) the upper right. Single precision, for setting up many rays per frame.
+    Vec3f getRayStart(float u, float v) const {
+        return rayOrigin + rayRight * u + rayUp * v;
+    }
+
     // ********************************************************************************************************
     // *** Class members **************************************************************************************
 private:
@@ -136,6 +143,10 @@ private:
         // Recalculate projection vector
         projectionDirection = rightDirection.Cross(upDirection);
         projectionDirection.normalize(); // Normalize the result; we want a fixed length for the projection vector.
+
+        rayOrigin = Vec3f(lowerLeft);
+        rayRight = Vec3f(rightDirection);
+        rayUp = Vec3f(upDirection);
     }
 
     Vector3d projectionDirection; // The projection vector, updated whenever the plane moves.
@@ -147,6 +158,11 @@ private:
     Vector3d upperRight;
     Vector3d upperLeft;
 
+    // Single precision copies of the plane's frame, for getRayStart()
+    Vec3f rayOrigin;
+    Vec3f rayRight;
+    Vec3f rayUp;
+
     // Transformation matrices for the view plane
     Matrix4d translationMatrix;
     Matrix4d rotationMatrix;
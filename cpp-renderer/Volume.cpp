@@ -1,2 +1 @@
 #include "Volume.h"
-
@@ -2,6 +2,8 @@
 #define __VOLUME_H__
 
 #include <algorithm>
+#include <climits>
+#include <cstddef>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -9,9 +11,18 @@
 #include <math.h>
 #include <vector>
 #include <Vector3d.h>
+#include "AtomicAccess.h"
+#include "SparseTileTree.h"
 
 #include <memory.h>
 
+// The gather paths of Volume::sampleTrilinear() are compiled for AVX2 and AVX-512 whatever instruction set the build
+// targets, and chosen at run time by what the processor supports
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define VOLUME_GATHER
+#include <immintrin.h>
+#endif
+
 using std::vector;
 
 /// Define how to groups of bytes should be interpreted
@@ -41,29 +52,50 @@ class Volume
 public:
     /// Default constructor.
     Volume() :
-        m_width(0), m_height(0), m_depth(0), m_sliceSize(0), m_voxelNum(0), m_voxelData(NULL), m_gradients(NULL), m_gradientMagnitudes(NULL) {
+        m_width(0), m_height(0), m_depth(0), m_sliceSize(0), m_voxelNum(0), m_voxelData(NULL), m_gradients(NULL), m_gradientMagnitudes(NULL),
+        m_gradientPolicy(PRECOMPUTED_GRADIENTS), m_bricksX(0), m_bricksY(0), m_bricksZ(0),
+        m_backgroundThreshold(defaultBackgroundThreshold()),
+        m_minimumValue(0), m_maximumValue(0), m_derivedDataStorage(NULL), m_voxelStorage(NULL), m_gradientsReady(false), m_histogramReady(false) {
     }
 
     /// Create a Volume loading data from the specified file
     Volume(const std::string &strFilename) :
-        m_width(0), m_height(0), m_depth(0), m_sliceSize(0), m_voxelNum(0), m_voxelData(NULL), m_gradients(NULL), m_gradientMagnitudes(NULL) {
+        m_width(0), m_height(0), m_depth(0), m_sliceSize(0), m_voxelNum(0), m_voxelData(NULL), m_gradients(NULL), m_gradientMagnitudes(NULL),
+        m_gradientPolicy(PRECOMPUTED_GRADIENTS), m_bricksX(0), m_bricksY(0), m_bricksZ(0),
+        m_backgroundThreshold(defaultBackgroundThreshold()),
+        m_minimumValue(0), m_maximumValue(0), m_derivedDataStorage(NULL), m_voxelStorage(NULL), m_gradientsReady(false), m_histogramReady(false) {
 		loadVolumeDat(strFilename);
     }
 
+    /// Create a volume of the specified dimensions with all voxels zero, to be filled in through getData(). Call
+    /// computeDerivedData() when the voxels are set.
+    Volume(int width, int height, int depth) :
+        m_width(width), m_height(height), m_depth(depth), m_sliceSize((VoxelIndex)width * height),
+        m_voxelNum((VoxelIndex)width * height * depth), m_voxelData(new float[m_voxelNum]), m_gradients(NULL), m_gradientMagnitudes(NULL),
+        m_gradientPolicy(PRECOMPUTED_GRADIENTS), m_bricksX(0), m_bricksY(0), m_bricksZ(0),
+        m_backgroundThreshold(defaultBackgroundThreshold()),
+        m_minimumValue(0), m_maximumValue(0), m_derivedDataStorage(NULL), m_voxelStorage(NULL), m_gradientsReady(false), m_histogramReady(false) {
+        memset(m_voxelData, 0, m_voxelNum * sizeof(float));
+    }
+
     /// Copy constructor
     Volume(const Volume& other) :
-        // TODO: This copy constructor does not consider gradients and gradient magnitude, so these should be implemented
-        // if you ever want to use the copy constructor.
+        // The gradients are not copied, but prepared anew according to the gradient policy
         m_width(other.m_width), m_height(other.m_height), m_depth(other.m_depth),
         m_sliceSize(other.m_sliceSize), m_voxelNum(other.m_voxelNum),
-        m_voxelData(new float[other.m_voxelNum]) {
+        m_voxelData(new float[other.m_voxelNum]), m_gradients(NULL), m_gradientMagnitudes(NULL),
+        m_gradientPolicy(other.m_gradientPolicy), m_bricksX(0), m_bricksY(0), m_bricksZ(0),
+        m_backgroundThreshold(other.m_backgroundThreshold),
+        m_minimumValue(0), m_maximumValue(0), m_derivedDataStorage(NULL), m_voxelStorage(NULL), m_gradientsReady(false), m_histogramReady(false) {
         memcpy(m_voxelData, other.m_voxelData, m_voxelNum * sizeof(float));
+        computeDerivedData();
     }
 
     /// Assignment operator
     Volume& operator=(const Volume& other) {
         Volume tmp(other);
         this->swap(tmp);
+        return *this;
     }
 
     /// Swap
@@ -76,12 +108,33 @@ public:
         std::swap(m_voxelData, other.m_voxelData); // Just swap the pointers, not the whole data!
         std::swap(m_gradients, other.m_gradients);
         std::swap(m_gradientMagnitudes, other.m_gradientMagnitudes);
+        m_histogram.swap(other.m_histogram);
+        std::swap(m_gradientPolicy, other.m_gradientPolicy);
+        m_gradientBricks.swap(other.m_gradientBricks);
+        std::swap(m_bricksX, other.m_bricksX);
+        std::swap(m_bricksY, other.m_bricksY);
+        std::swap(m_bricksZ, other.m_bricksZ);
+        m_sparseTiles.swap(other.m_sparseTiles);
+        std::swap(m_backgroundThreshold, other.m_backgroundThreshold);
+        std::swap(m_minimumValue, other.m_minimumValue);
+        std::swap(m_maximumValue, other.m_maximumValue);
+        std::swap(m_derivedDataStorage, other.m_derivedDataStorage);
+        m_staleSlices.swap(other.m_staleSlices);
+        std::swap(m_voxelStorage, other.m_voxelStorage);
+
+        const bool gradientsReady = areGradientsReady();
+        setGradientsReady(other.areGradientsReady());
+        other.setGradientsReady(gradientsReady);
+
+        const bool histogramReady = isHistogramReady();
+        setHistogramReady(other.isHistogramReady());
+        other.setHistogramReady(histogramReady);
     }
 
     /// Destructor
     ~Volume(void) {
-        delete [] m_voxelData;
-        delete[] m_gradientMagnitudes;
+        releaseVoxels();
+        releaseGradients();
     }
 
     // ********************************************************************************************************
@@ -96,8 +149,84 @@ public:
     /// Return volume's depth.
     int getDepth() const { return m_depth; }
 
+    /// Index of a voxel in the arrays of voxels and gradients. As wide as a pointer, since a volume may have more
+    /// than 2^31 voxels.
+    typedef ptrdiff_t VoxelIndex;
+
     /// Return the total number of voxels.
-    int getVoxelNum() const { return m_voxelNum; }
+    VoxelIndex getVoxelNum() const { return m_voxelNum; }
+
+    /// Return the precomputed gradients, in the same order as the voxel values. NULL unless the gradient policy
+    /// is PRECOMPUTED_GRADIENTS and the gradients are ready.
+    const Vector3d* getGradientData() const { return areGradientsReady() ? m_gradients : NULL; }
+
+    /// Return the precomputed gradient magnitudes, in the same order as the voxel values. NULL unless the gradient
+    /// policy is PRECOMPUTED_GRADIENTS and the gradients are ready.
+    const double* getGradientMagnitudeData() const { return areGradientsReady() ? m_gradientMagnitudes : NULL; }
+
+    /// Return true when the gradients have been set up for the gradient policy. Until then, the gradient accessors
+    /// compute central differences on the fly, which gives the same values.
+    bool areGradientsReady() const { return AtomicAccess::loadAcquire(m_gradientsReady); }
+
+    /// Return true when the histogram and the value range have been calculated. Until then, GetHistogram()
+    /// returns an empty histogram.
+    bool isHistogramReady() const { return AtomicAccess::loadAcquire(m_histogramReady); }
+
+    /// Return the smallest voxel value; valid when isHistogramReady()
+    float getMinimumValue() const { return m_minimumValue; }
+
+    /// Return the largest voxel value; valid when isHistogramReady()
+    float getMaximumValue() const { return m_maximumValue; }
+
+    /// How the gradients are provided. All gradient accessors give the same values with every policy.
+    enum GradientPolicy {
+        PRECOMPUTED_GRADIENTS = 0, ///< Computed for all voxels on loading; fastest, but uses 8 times the memory of the voxels
+        ON_THE_FLY_GRADIENTS = 1,  ///< Central differences computed on every access; no memory besides the voxels
+        LAZY_GRADIENT_BRICKS = 2,  ///< Computed for a brick of voxels when it is first accessed, then kept
+        SPARSE_GRADIENTS = 3       ///< Computed on loading for the tiles above the background threshold only, and on
+                                   ///< the fly in the empty space; the tiles also let the ray casters skip that space
+    };
+
+    /// Select how the gradients are provided, releasing the memory of the previous policy
+    void setGradientPolicy(GradientPolicy policy) {
+        if (policy == m_gradientPolicy) {
+            return;
+        }
+
+        setGradientsReady(false);
+        releaseGradients();
+        m_gradientPolicy = policy;
+        prepareGradients();
+        setGradientsReady(true);
+    }
+
+    /// Return how the gradients are provided
+    GradientPolicy getGradientPolicy() const { return m_gradientPolicy; }
+
+    /// Set the value at or below which voxels count as empty space for SPARSE_GRADIENTS, rebuilding the tiles if
+    /// that policy is in use
+    void setBackgroundThreshold(float threshold) {
+        if (threshold == m_backgroundThreshold) {
+            return;
+        }
+
+        m_backgroundThreshold = threshold;
+        if (m_gradientPolicy == SPARSE_GRADIENTS && areGradientsReady()) {
+            setGradientsReady(false);
+            releaseGradients();
+            prepareGradients();
+            setGradientsReady(true);
+        }
+    }
+
+    /// Return the value at or below which voxels count as empty space
+    float getBackgroundThreshold() const { return m_backgroundThreshold; }
+
+    /// Return the tiles of the voxels above the background threshold; every value interpolated outside them is at
+    /// or below the threshold. NULL unless the gradient policy is SPARSE_GRADIENTS and the gradients are ready.
+    const SparseTileTree* getSparseTiles() const {
+        return (areGradientsReady() && m_gradientPolicy == SPARSE_GRADIENTS) ? &m_sparseTiles : NULL;
+    }
 
     /// Examine the dimensions of the dataset and return the factor the dataset must be scaled by to make the longest
     /// dimension equal to 1.0
@@ -121,12 +250,12 @@ public:
     /** Return a reference to the value of the voxel at the specified position
      *  NOTE: you are not supposed to modify the original data! */
     float& getVoxel(int x, int y, int z) {
-        return m_voxelData[m_sliceSize * z + m_width * y + x];
+        return m_voxelData[voxelIndex(x, y, z)];
     }
 
     /// Return the value of the voxel at the specified position
     const float& getVoxel(int x, int y, int z) const {
-        return m_voxelData[m_sliceSize * z + m_width * y + x];
+        return m_voxelData[voxelIndex(x, y, z)];
     }
 
     /** Return a pointer to the voxel values
@@ -137,8 +266,67 @@ public:
     const float *getData() const { return m_voxelData; }
 
 
+    /// Part of a dataset to load: along each axis, the voxels from begin up to (not including) end, of which every
+    /// stride-th one is taken, starting with the one at begin. Bounds past the dataset are clipped to it.
+    struct Region
+    {
+        int begin[3];
+        int end[3];
+        int stride;
+
+        /// The whole dataset, with a stride of one
+        Region() : stride(1) {
+            for (int axis = 0 ; axis < 3 ; axis++) {
+                begin[axis] = 0;
+                end[axis] = INT_MAX;
+            }
+        }
+
+        /// The voxels from (x0, y0, z0) up to (x1, y1, z1), taking every stride-th one
+        Region(int x0, int y0, int z0, int x1, int y1, int z1, int stride = 1) : stride(std::max(stride, 1)) {
+            begin[0] = x0; begin[1] = y0; begin[2] = z0;
+            end[0] = x1; end[1] = y1; end[2] = z1;
+        }
+
+        /// Return the number of voxels taken along an axis
+        int getSize(int axis) const { return std::max(end[axis] - begin[axis] + stride - 1, 0) / stride; }
+
+        /// Return the region clipped to a dataset of the specified dimensions
+        Region clippedTo(int width, int height, int depth) const {
+            const int dimensions[3] = { width, height, depth };
+            Region clipped(*this);
+            for (int axis = 0 ; axis < 3 ; axis++) {
+                clipped.begin[axis] = std::max(begin[axis], 0);
+                clipped.end[axis] = std::min(end[axis], dimensions[axis]);
+            }
+            return clipped;
+        }
+
+        /// Return true if the region covers a dataset of the specified dimensions, with a stride of one
+        bool isWhole(int width, int height, int depth) const {
+            const Region clipped = clippedTo(width, height, depth);
+            return stride == 1 && clipped.getSize(0) == width && clipped.getSize(1) == height &&
+                   clipped.getSize(2) == depth;
+        }
+    };
+
     /// Load a dataset from the specified file. Return true if the dataset has been loaded successfully.
-    bool loadVolumeDat(const std::string & strFilename) {
+    /// With deriveData false, only the voxels are read, and computeDerivedData() must be called afterwards (for
+    /// instance from a background thread) to set up the gradients and the histogram.
+    /// With a stride above one, only every stride-th voxel along each axis is loaded, which gives a downsampled
+    /// preview of the dataset and reads only the rows of the file that hold those voxels.
+    bool loadVolumeDat(const std::string & strFilename, bool deriveData = true, int stride = 1) {
+        Region region;
+        region.stride = std::max(stride, 1);
+        return loadVolumeDat(strFilename, region, deriveData);
+    }
+
+    /// Load a region of a dataset from the specified file, such as a cropped part of a large scan or a downsampled
+    /// copy of it, as a volume of its own. Only the rows of the file that hold voxels of the region are read, so
+    /// the time and the memory needed scale with the region rather than with the dataset. The derived data is
+    /// that of the region, as for loadVolumeDat() above. Return false if the file cannot be read, or if the region
+    /// holds no voxels of the dataset.
+    bool loadVolumeDat(const std::string & strFilename, const Region &region, bool deriveData = true) {
 
         std::cout << "- Loading file \"" << strFilename << "\" ... " << std::endl;
 
@@ -151,61 +339,176 @@ public:
 
         // Read the header
         std::cout << "- Reading file's header ..." << std::endl;
-        char buffer[2];
+        int fileWidth, fileHeight, fileDepth;
+        readDatHeader(fileIn, fileWidth, fileHeight, fileDepth);
+
+        const bool whole = region.isWhole(fileWidth, fileHeight, fileDepth);
+        const Region clipped = region.clippedTo(fileWidth, fileHeight, fileDepth);
+        if (clipped.getSize(0) == 0 || clipped.getSize(1) == 0 || clipped.getSize(2) == 0) {
+            std::cerr << "+ The region holds no voxels of the " << fileWidth << "x" << fileHeight << "x" << fileDepth
+                      << " dataset." << std::endl;
+            return false;
+        }
 
-        fileIn.read(buffer, 2);
-        m_width = BYTE2INT(buffer[0], buffer[1]);
-        fileIn.read(buffer, 2);
-        m_height = BYTE2INT(buffer[0], buffer[1]);
-        fileIn.read(buffer, 2);
-        m_depth = BYTE2INT(buffer[0], buffer[1]);
+        // A region is read after the dataset is replaced, so check beforehand that the file holds all of it
+        if (!whole) {
+            const std::streamoff lastVoxel = ((std::streamoff)(clipped.begin[2] + (clipped.getSize(2) - 1) * clipped.stride) * fileHeight +
+                clipped.begin[1] + (clipped.getSize(1) - 1) * clipped.stride) * fileWidth +
+                clipped.begin[0] + (clipped.getSize(0) - 1) * clipped.stride;
+            fileIn.seekg(0, std::ios::end);
+            if ((std::streamoff)fileIn.tellg() < DAT_HEADER_BYTES + (lastVoxel + 1) * 2) {
+                std::cerr << "+ The file ends before the region." << std::endl;
+                return false;
+            }
+        }
+
+        m_width = clipped.getSize(0);
+        m_height = clipped.getSize(1);
+        m_depth = clipped.getSize(2);
 
-        m_sliceSize = m_width * m_height;
+        m_sliceSize = (VoxelIndex)m_width * m_height;
         m_voxelNum = m_sliceSize * m_depth;
 
         std::cout << "- Dataset dimensions: " << m_width << "x" << m_height << "x" << m_depth << std::endl;
 
+        // The derived data of the previous dataset is no longer valid
+        setGradientsReady(false);
+        setHistogramReady(false);
+        releaseGradients();
+
         // Allocate memory to store the dataset values
-        if (m_voxelData) // If previous data is present, get rid of it
-            delete m_voxelData;
+        releaseVoxels(); // If previous data is present, get rid of it
         m_voxelData = new float[m_voxelNum];
 
         // Read the rest of the file
         std::cout << "- Reading voxel values ..." << std::endl;
 
-        // Scan in voxel data from dataset
-        for (int z = 0 ; z < m_depth; z++) {
-            for (int y = 0 ; y < m_height; y++) {
-                for (int x = 0 ; x < m_width; x++) {
+        if (whole) {
+            if (!readVoxelsPipelined(fileIn, deriveData)) {
+                return false;
+            }
+        } else {
+            fileIn.close();
+            if (!readVoxelsRegion(strFilename, fileWidth, fileHeight, clipped)) {
+                return false;
+            }
+            if (deriveData) {
+                computeDerivedData();
+            }
+        }
+
+        std::cout << "Done parsing data file." << std::endl << std::endl;
 
-                    if (fileIn.eof()) {
-                        printf("Reached end of data file prematurely. Dataset may be corrupted. End reached at coordinates (%d, %d, %d).\n",
-                               x, y, z);
-                        return false;
-                    }
 
-                    fileIn.read(buffer, 2);
-                    int thisVoxel = BYTE2INT(buffer[0], buffer[1]);
-                    m_voxelData[m_sliceSize * z + m_width * y + x] = thisVoxel / 4095.0; // Add voxel data to array, scaling to [0,1].
 
-                }
-            }
+        fileIn.close();
+
+        return true;
+    } /* loadVolumeDat() */
+
+    /// Replace the voxels with zeroed voxels of the specified dimensions, keeping the gradient policy, to be filled
+    /// in through getData(). Call computeDerivedData() when the voxels are set.
+    void allocateVoxels(int width, int height, int depth) {
+        setGradientsReady(false);
+        setHistogramReady(false);
+        releaseGradients();
+
+        m_width = width;
+        m_height = height;
+        m_depth = depth;
+        m_sliceSize = (VoxelIndex)m_width * m_height;
+        m_voxelNum = m_sliceSize * m_depth;
+
+        releaseVoxels();
+        m_voxelData = new float[m_voxelNum];
+        memset(m_voxelData, 0, m_voxelNum * sizeof(float));
+    }
+
+    /// Replace the voxel values with those of a DAT file held in memory, such as a mapped file, and compute the
+    /// derived data for the specified gradient policy. The file must have the dimensions of the volume; the
+    /// buffers of the voxels and of the derived data are reused, so a sequence of files of the same dimensions can
+    /// be shown without allocating. The precomputed gradients and lazy gradient bricks are only recomputed around
+    /// the slices whose voxels changed. With deriveData false, call computeDerivedData() afterwards. Return false
+    /// if the data is not a DAT file of these dimensions.
+    bool setVoxelsFromDat(const unsigned char *data, size_t size, GradientPolicy policy, bool deriveData = true) {
+        if (size < DAT_HEADER_BYTES || (size - DAT_HEADER_BYTES) / 2 < (size_t)m_voxelNum) {
+            return false;
         }
 
-        std::cout << "Calculating gradients." << std::endl << std::endl;
+        std::istringstream header(std::string((const char*)data, DAT_HEADER_BYTES));
+        int width, height, depth;
+        readDatHeader(header, width, height, depth);
+        if (width != m_width || height != m_height || depth != m_depth) {
+            return false;
+        }
 
-        calculateGradients(0);
+        setGradientsReady(false);
+        setHistogramReady(false);
 
-        calculateHistogram();
+        // Adopted voxels may be read-only, so take a copy to change
+        if (m_voxelStorage != NULL) {
+            float *voxels = new float[m_voxelNum];
+            memcpy(voxels, m_voxelData, m_voxelNum * sizeof(float));
+            releaseVoxels();
+            m_voxelData = voxels;
+        }
 
-        std::cout << "Done parsing data file." << std::endl << std::endl;
+        if (policy != m_gradientPolicy) {
+            releaseGradients();
+            m_gradientPolicy = policy;
+        }
 
+        const unsigned char *raw = data + DAT_HEADER_BYTES;
+        const bool tracking = m_staleSlices.size() == (size_t)m_depth;
 
+        #pragma omp parallel for schedule(static)
+        for (int z = 0 ; z < m_depth ; z++) {
+            bool changed = false;
+            for (VoxelIndex i = z * m_sliceSize ; i < (z + 1) * m_sliceSize ; i++) {
+                int thisVoxel = BYTE2INT(raw[2*i], raw[2*i + 1]);
+                const float value = thisVoxel / 4095.0; // Scaling to [0,1].
+                if (value != m_voxelData[i]) {
+                    m_voxelData[i] = value;
+                    changed = true;
+                }
+            }
 
-        fileIn.close();
+            if (tracking && changed) {
+                m_staleSlices[z] = true;
+            }
+        }
 
+        if (deriveData) {
+            computeDerivedData();
+        }
         return true;
-    } /* loadVolumeDat() */
+    }
+
+    /// Return the smallest stride for loadVolumeDat() that loads at most maxVoxels voxels of the specified file, or
+    /// 1 if the file cannot be read
+    static int previewStride(const std::string &strFilename, int maxVoxels) {
+        int width, height, depth;
+        if (!readDatDimensions(strFilename, width, height, depth)) {
+            return 1;
+        }
+
+        int stride = 1;
+        while ((double)((width + stride - 1) / stride) * ((height + stride - 1) / stride) * ((depth + stride - 1) / stride) > maxVoxels) {
+            stride++;
+        }
+        return stride;
+    }
+
+    /// Read the dimensions of the dataset in a DAT file without loading it. Return false if the file cannot be read.
+    static bool readDatDimensions(const std::string &strFilename, int &width, int &height, int &depth) {
+        std::fstream fileIn(strFilename.c_str(), std::ifstream::in | std::ifstream::binary);
+        if (!fileIn.is_open()) {
+            return false;
+        }
+
+        readDatHeader(fileIn, width, height, depth);
+        return !fileIn.fail();
+    }
 
 
     /* Utility methods for interpolation etc. */
@@ -236,11 +539,12 @@ public:
 
         //std::cout << "Outputting voxel at " << xVal << ", " << yVal << ", " << zVal << std::endl;
 
-        return m_voxelData[m_sliceSize * zVal + m_width * yVal + xVal]; // Unsure if this is right. Is it?
+        return m_voxelData[voxelIndex(xVal, yVal, zVal)]; // Unsure if this is right. Is it?
     }
 
-    /// Gets a voxel value for the specified coordinates, using trilinear interpolation
-    const float& getVoxelTrilinear(float x, float y, float z) const {
+    /// Gets a voxel value for the specified coordinates, using trilinear interpolation.
+    /// For sampling in inner loops, TrilinearSampler is faster.
+    float getVoxelTrilinear(float x, float y, float z) const {
         // Handle out of bounds errors (usually just off-by-one, occurrence indicates imprecise programming elsewhere)
         // Should really attack the program to ensure this type of error recovery isn't necessary.
         if (x >= m_width-1) {
@@ -298,8 +602,130 @@ public:
         return c;
     }
 
-    vector<float> GetHistogram() {
-        return m_histogram;
+    /// Gets the voxel values at count positions using trilinear interpolation. The coordinates of position i are
+    /// xs[i], ys[i] and zs[i], and its value is written to out[i]. Same results as getVoxelTrilinear().
+    ///
+    /// Amortizes the clamping and indexing over many positions. On processors with AVX-512 or AVX2, 16 or 8
+    /// positions are interpolated at once, fetching their corners with gather instructions so that many memory
+    /// accesses are in flight together.
+    void sampleTrilinear(const float *xs, const float *ys, const float *zs, float *out, int count) const {
+        // The lower corner of a cell is kept one voxel inside the upper border, so that the upper corner is always
+        // one stride away; positions on the border then get a fraction of one
+        const int lastX = std::max(m_width - 2, 0);
+        const int lastY = std::max(m_height - 2, 0);
+        const int lastZ = std::max(m_depth - 2, 0);
+
+        const int strideX = (m_width > 1) ? 1 : 0;
+        const int strideY = (m_height > 1) ? m_width : 0;
+        const VoxelIndex strideZ = (m_depth > 1) ? m_sliceSize : 0;
+
+        int i = 0;
+
+#ifdef VOLUME_GATHER
+        // The gather instructions take 32-bit indices, so larger volumes are interpolated one position at a time
+        if (m_voxelNum <= INT_MAX) {
+            if (cpuSupportsAvx512()) {
+                i = sampleTrilinearAvx512(xs, ys, zs, out, count);
+            } else if (cpuSupportsAvx2()) {
+                i = sampleTrilinearAvx2(xs, ys, zs, out, count);
+            }
+        }
+#endif
+
+        for ( ; i < count ; i++) {
+            const float x = std::min(std::max(xs[i], 0.0f), (float)(m_width - 1));
+            const float y = std::min(std::max(ys[i], 0.0f), (float)(m_height - 1));
+            const float z = std::min(std::max(zs[i], 0.0f), (float)(m_depth - 1));
+
+            const int cellX = std::min((int)x, lastX);
+            const int cellY = std::min((int)y, lastY);
+            const int cellZ = std::min((int)z, lastZ);
+
+            const float xd = x - cellX;
+            const float yd = y - cellY;
+            const float zd = z - cellZ;
+
+            const float *p = &m_voxelData[voxelIndex(cellX, cellY, cellZ)];
+
+            float c00 = p[0]*(1-xd) + p[strideX] * xd;
+            float c10 = p[strideY]*(1-xd) + p[strideY + strideX] * xd;
+            float c01 = p[strideZ]*(1-xd) + p[strideZ + strideX] * xd;
+            float c11 = p[strideZ + strideY]*(1-xd) + p[strideZ + strideY + strideX] * xd;
+
+            float c0 = c00 * (1-yd) + c10 * yd;
+            float c1 = c01 * (1-yd) + c11 * yd;
+
+            out[i] = c0 * (1-zd) + c1 * zd;
+        }
+    }
+
+    /// Set up the gradients for the gradient policy and calculate the histogram of the loaded voxels. The voxels
+    /// may be sampled while this runs; the readiness flags are set only when each part is complete.
+    void computeDerivedData() {
+        prepareGradients();
+        setGradientsReady(true);
+
+        calculateHistogram();
+        setHistogramReady(true);
+    }
+
+    /// Memory holding voxels or derived data on behalf of a volume, such as a mapped cache file or shared memory.
+    /// Deleting it releases the memory.
+    class DerivedDataStorage
+    {
+    public:
+        virtual ~DerivedDataStorage() {}
+    };
+
+    /// Use derived data that was computed earlier instead of computing it: the histogram and the value range, and
+    /// with PRECOMPUTED_GRADIENTS the gradients and the gradient magnitudes, which must have been computed from
+    /// the same voxels. The volume takes ownership of storage, which holds the gradients, and deletes it when the
+    /// gradients are released. Like computeDerivedData(), this may run on a background thread.
+    void adoptDerivedData(DerivedDataStorage *storage, const Vector3d *gradients, const double *gradientMagnitudes,
+                          const vector<float> &histogram, float minimumValue, float maximumValue) {
+        if (m_gradientPolicy == PRECOMPUTED_GRADIENTS) {
+            releaseGradients();
+
+            // The gradients are only read, so they can stay in read-only memory
+            m_derivedDataStorage = storage;
+            m_gradients = const_cast<Vector3d*>(gradients);
+            m_gradientMagnitudes = const_cast<double*>(gradientMagnitudes);
+        } else {
+            delete storage;
+            prepareGradients();
+        }
+        setGradientsReady(true);
+
+        m_histogram = histogram;
+        m_minimumValue = minimumValue;
+        m_maximumValue = maximumValue;
+        setHistogramReady(true);
+    }
+
+    /// Use voxels held by storage, such as shared memory, instead of voxels of its own. The voxels are only read,
+    /// and the volume deletes storage when it no longer uses them. Call computeDerivedData() or
+    /// adoptDerivedData() afterwards.
+    void adoptVoxels(DerivedDataStorage *storage, const float *voxels, int width, int height, int depth) {
+        setGradientsReady(false);
+        setHistogramReady(false);
+        releaseGradients();
+
+        m_width = width;
+        m_height = height;
+        m_depth = depth;
+        m_sliceSize = (VoxelIndex)m_width * m_height;
+        m_voxelNum = m_sliceSize * m_depth;
+
+        releaseVoxels();
+        m_voxelStorage = storage;
+        m_voxelData = const_cast<float*>(voxels);
+    }
+
+    /// Return true if the voxels are held by storage given to adoptVoxels()
+    bool hasAdoptedVoxels() const { return m_voxelStorage != NULL; }
+
+    vector<float> GetHistogram() const {
+        return isHistogramReady() ? m_histogram : vector<float>();
     }
 
     /// Precomputes the gradients for the volume. Assumes that the volume has been loaded.
@@ -307,38 +733,53 @@ public:
     /// calculationMethod = 1: Next neighbor approximation (not implemented)
     void calculateGradients(int calculationMethod) {
         // Initialize gradient array, deleting old data if present
-        if (m_gradients) {
-            delete [] m_gradients;
+        if (m_derivedDataStorage) {
+            // Adopted gradients are not ours to delete
+            delete m_derivedDataStorage;
+            m_derivedDataStorage = NULL;
+            m_gradients = NULL;
+            m_gradientMagnitudes = NULL;
         }
 
+        // Arrays left from earlier voxels are reused: the dimensions only change after releaseGradients()
+        if (m_gradients == NULL) {
+            m_gradients = new Vector3d[m_voxelNum];
+        }
 
-        if (m_gradientMagnitudes) {
-            delete [] m_gradientMagnitudes;
+        if (m_gradientMagnitudes == NULL) {
+            m_gradientMagnitudes = new double[m_voxelNum];
         }
 
-        m_gradients = new Vector3d[m_voxelNum];
-        m_gradientMagnitudes = new double[m_voxelNum];
+        if (calculationMethod != 0 && calculationMethod != 1) {
+            // Illegal argument, crash (before the parallel region, which an exception must not leave)
+            throw -1;
+        }
 
+        // Each slice only writes its own gradients, so the slices are calculated in parallel, as when loading
+        #pragma omp parallel for schedule(dynamic)
+        for (int z = 0 ; z < m_depth ; z++) {
+            calculateGradientSlices(z, z + 1, calculationMethod);
+        }
+    }
+
+    /// Calculates the gradients and gradient magnitudes of the slices from zBegin up to (not including) zEnd, into
+    /// the arrays allocated by calculateGradients(). Needs the voxels of the slices on either side.
+    void calculateGradientSlices(int zBegin, int zEnd, int calculationMethod) {
         // Calculate gradients and gradient magnitudes.
 
-        for (int z = 0 ; z < m_depth ; z++) {
+        for (int z = zBegin ; z < zEnd ; z++) {
             for (int y = 0 ; y < m_height ; y++) {
                 for (int x = 0 ; x < m_width ; x++) {
                     // std::cout << "Calculating voxel at " << x << "," << y << "," << z << std::endl;
+                    const VoxelIndex index = voxelIndex(x, y, z);
+
                     if (x == 0 || y == 0 || z == 0 ||
                         x == m_width-1 || y == m_height-1 || z == m_depth-1) {
                         // Edge or corner voxel, gradient is not defined. Set to null vector.
-                        m_gradients[m_sliceSize * z + m_width * y + x] = Vector3d(0,0,0);
+                        m_gradients[index] = Vector3d(0,0,0);
                     } else if (calculationMethod == 0){
                         // Calculate gradient using central differences approximation
-
-                        float xDifference = (getVoxel(x+1, y, z) - getVoxel(x-1, y, z)) * 0.5;
-                        float yDifference = (getVoxel(x, y+1, z) - getVoxel(x, y-1, z)) * 0.5;
-                        float zDifference = (getVoxel(x, y, z+1) - getVoxel(x, y, z-1)) * 0.5;
-
-                        Vector3d eachVector(xDifference, yDifference, zDifference);
-
-                        m_gradients[m_sliceSize * z + m_width * y + x] = eachVector;
+                        m_gradients[index] = centralDifference(x, y, z);
 
                         // std::cout << "Set gradient vector to " << xDifference << ", " << yDifference << ", " << zDifference << std::endl;
 
@@ -351,21 +792,49 @@ public:
                     }
 
                     // Precompute gradient magnitude
-                    m_gradientMagnitudes[m_sliceSize * z + m_width * y + x] = m_gradients[m_sliceSize * z + m_width * y + x].GetMagnitude();
+                    m_gradientMagnitudes[index] = m_gradients[index].GetMagnitude();
 
-                    // std::cout << "Gradient magnitude is " << m_gradientMagnitudes[m_sliceSize * z + m_width * y + x] << std::endl;
+                    // std::cout << "Gradient magnitude is " << m_gradientMagnitudes[index] << std::endl;
                 }
             }
         }
     }
 
     /// Get the gradient at a certain point in the dataset
-    const Vector3d& getGradient(int x, int y, int z) const {
-        return m_gradients[m_sliceSize * z + m_width * y + x];
+    Vector3d getGradient(int x, int y, int z) const {
+        if (!areGradientsReady()) {
+            return centralDifference(x, y, z);
+        } else if (m_gradientPolicy == PRECOMPUTED_GRADIENTS) {
+            return m_gradients[voxelIndex(x, y, z)];
+        } else if (m_gradientPolicy == ON_THE_FLY_GRADIENTS) {
+            return centralDifference(x, y, z);
+        } else if (m_gradientPolicy == SPARSE_GRADIENTS) {
+            const float *gradient = m_sparseTiles.getVoxelPayload(x, y, z);
+            return gradient ? Vector3d(gradient[0], gradient[1], gradient[2]) : centralDifference(x, y, z);
+        } else {
+            const float *gradient = getGradientBrickVoxel(x, y, z);
+            return Vector3d(gradient[0], gradient[1], gradient[2]);
+        }
+    }
+
+    /// Get the gradient magnitude at a certain point in the dataset
+    double getGradientMagnitude(int x, int y, int z) const {
+        if (!areGradientsReady()) {
+            return centralDifference(x, y, z).GetMagnitude();
+        } else if (m_gradientPolicy == PRECOMPUTED_GRADIENTS) {
+            return m_gradientMagnitudes[voxelIndex(x, y, z)];
+        } else if (m_gradientPolicy == ON_THE_FLY_GRADIENTS) {
+            return centralDifference(x, y, z).GetMagnitude();
+        } else if (m_gradientPolicy == SPARSE_GRADIENTS) {
+            const float *gradient = m_sparseTiles.getVoxelPayload(x, y, z);
+            return gradient ? gradient[3] : centralDifference(x, y, z).GetMagnitude();
+        } else {
+            return getGradientBrickVoxel(x, y, z)[3];
+        }
     }
 
     /// Get the gradient at a certain point in the dataset (floating point argument)
-    const Vector3d& getGradient(float x, float y, float z) const {
+    Vector3d getGradient(float x, float y, float z) const {
         if (x >= m_width-1) {
             //std::cout << "Handled out of bounds error in X: " << x << "," << y << "," << z << std::endl;
             x = m_width-1;
@@ -388,11 +857,11 @@ public:
             z = 0;
         }
 
-        return m_gradients[m_sliceSize * (int)z + m_width * (int)y + (int)x];
+        return getGradient((int)x, (int)y, (int)z);
     }
 
     /// Get the gradient at a certain point in the dataset, using trilinear interpolation.
-    const Vector3d& getGradientTrilinear(float x, float y, float z) const {
+    Vector3d getGradientTrilinear(float x, float y, float z) const {
         if (x >= m_width-1) {
             //std::cout << "Handled out of bounds error in X: " << x << "," << y << "," << z << std::endl;
             x = m_width-1;
@@ -417,15 +886,15 @@ public:
 
         Vector3d result;
 
-        Vector3d v000 = m_gradients[m_sliceSize * (int)floor(z) + m_width * (int)floor(y) + (int)floor(x)];
-        Vector3d v100 = m_gradients[m_sliceSize * (int)floor(z) + m_width * (int)floor(y) + (int)ceil(x)];
-        Vector3d v101 = m_gradients[m_sliceSize * (int)ceil(z) + m_width * (int)floor(y) + (int)ceil(x)];
-        Vector3d v001 = m_gradients[m_sliceSize * (int)ceil(z) + m_width * (int)floor(y) + (int)floor(x)];
+        Vector3d v000 = getGradient((int)floor(x), (int)floor(y), (int)floor(z));
+        Vector3d v100 = getGradient((int)ceil(x), (int)floor(y), (int)floor(z));
+        Vector3d v101 = getGradient((int)ceil(x), (int)floor(y), (int)ceil(z));
+        Vector3d v001 = getGradient((int)floor(x), (int)floor(y), (int)ceil(z));
 
-        Vector3d v010 = m_gradients[m_sliceSize * (int)floor(z) + m_width * (int)ceil(y) + (int)floor(x)];
-        Vector3d v110 = m_gradients[m_sliceSize * (int)floor(z) + m_width * (int)ceil(y) + (int)ceil(x)];
-        Vector3d v111 = m_gradients[m_sliceSize * (int)ceil(z) + m_width * (int)ceil(y) + (int)ceil(x)];
-        Vector3d v011 = m_gradients[m_sliceSize * (int)ceil(z) + m_width * (int)ceil(y) + (int)floor(x)];
+        Vector3d v010 = getGradient((int)floor(x), (int)ceil(y), (int)floor(z));
+        Vector3d v110 = getGradient((int)ceil(x), (int)ceil(y), (int)floor(z));
+        Vector3d v111 = getGradient((int)ceil(x), (int)ceil(y), (int)ceil(z));
+        Vector3d v011 = getGradient((int)floor(x), (int)ceil(y), (int)ceil(z));
 
         // Trilinearly interpolate.
         // See http://en.wikipedia.org/wiki/Trilinear_interpolation#Method
@@ -507,7 +976,7 @@ public:
 
 
     /// Get the gradient magnitude at a certain point in the dataset
-    const double& getGradientMagnitude(float x, float y, float z) const {
+    double getGradientMagnitude(float x, float y, float z) const {
         // Handle out of bounds errors (usually just off-by-one, occurrence indicates imprecise programming elsewhere)
         if (x >= m_width-1) {
             //std::cout << "Handled out of bounds error in X: " << x << "," << y << "," << z << std::endl;
@@ -531,11 +1000,11 @@ public:
             z = 0;
         }
 
-        return m_gradientMagnitudes[m_sliceSize * (int)z + m_width * (int)y + (int)x];
+        return getGradientMagnitude((int)x, (int)y, (int)z);
     }
 
     /// Get the gradient magnitude at a certain point in the dataset, using trilinear interpolation.
-    const double& getGradientMagnitudeTrilinear(float x, float y, float z) const {
+    double getGradientMagnitudeTrilinear(float x, float y, float z) const {
         // Handle out of bounds errors (usually just off-by-one, occurrence indicates imprecise programming elsewhere)
         if (x >= m_width-1) {
             //std::cout << "Handled out of bounds error in X: " << x << "," << y << "," << z << std::endl;
@@ -560,15 +1029,15 @@ public:
         }
 
         // Define corner values for interpolation.
-        float p000 = m_gradientMagnitudes[m_sliceSize * (int)floor(z) + m_width * (int)floor(y) + (int)floor(x)];
-        float p100 = m_gradientMagnitudes[m_sliceSize * (int)floor(z) + m_width * (int)floor(y) + (int)ceil(x)];
-        float p101 = m_gradientMagnitudes[m_sliceSize * (int)ceil(z) + m_width * (int)floor(y) + (int)ceil(x)];
-        float p001 = m_gradientMagnitudes[m_sliceSize * (int)ceil(z) + m_width * (int)floor(y) + (int)floor(x)];
+        float p000 = getGradientMagnitude((int)floor(x), (int)floor(y), (int)floor(z));
+        float p100 = getGradientMagnitude((int)ceil(x), (int)floor(y), (int)floor(z));
+        float p101 = getGradientMagnitude((int)ceil(x), (int)floor(y), (int)ceil(z));
+        float p001 = getGradientMagnitude((int)floor(x), (int)floor(y), (int)ceil(z));
 
-        float p010 = m_gradientMagnitudes[m_sliceSize * (int)floor(z) + m_width * (int)ceil(y) + (int)floor(x)];
-        float p110 = m_gradientMagnitudes[m_sliceSize * (int)floor(z) + m_width * (int)ceil(y) + (int)ceil(x)];
-        float p111 = m_gradientMagnitudes[m_sliceSize * (int)ceil(z) + m_width * (int)ceil(y) + (int)ceil(x)];
-        float p011 = m_gradientMagnitudes[m_sliceSize * (int)ceil(z) + m_width * (int)ceil(y) + (int)floor(x)];
+        float p010 = getGradientMagnitude((int)floor(x), (int)ceil(y), (int)floor(z));
+        float p110 = getGradientMagnitude((int)ceil(x), (int)ceil(y), (int)floor(z));
+        float p111 = getGradientMagnitude((int)ceil(x), (int)ceil(y), (int)ceil(z));
+        float p011 = getGradientMagnitude((int)floor(x), (int)ceil(y), (int)ceil(z));
 
         // Trilinearly interpolate.
         // See http://en.wikipedia.org/wiki/Trilinear_interpolation#Method
@@ -596,8 +1065,8 @@ private:
 	int m_width;
 	int m_height;
 	int m_depth;
-	int m_sliceSize;
-    int m_voxelNum;
+	VoxelIndex m_sliceSize;
+    VoxelIndex m_voxelNum;
 	float *m_voxelData;
 
     Vector3d *m_gradients; // Array of gradient vectors
@@ -605,9 +1074,207 @@ private:
 
     vector<float> m_histogram;
 
+    static const int DAT_HEADER_BYTES = 6; // The three 16-bit dimensions that precede the voxels of a DAT file
+    static const int PIPELINE_SLAB_BYTES = 4 << 20; // Size of the slabs read from a file at a time
+    static const int GRADIENT_BRICK_SIZE = 16; // Voxels along each side of a lazily computed gradient brick
+
+    GradientPolicy m_gradientPolicy;
+    mutable vector<float*> m_gradientBricks; // Gradient x, y, z and magnitude per voxel of each brick; NULL until used
+    int m_bricksX; // Number of gradient bricks along each axis
+    int m_bricksY;
+    int m_bricksZ;
+
+    /// Return the background threshold of a new volume: voxels at or below it are empty space, and most air is below
+    /// it. A function rather than a constant, so that tools built from this header alone link.
+    static float defaultBackgroundThreshold() { return 0.05f; }
+
+    SparseTileTree m_sparseTiles; // Gradient x, y, z and magnitude per voxel of the tiles above the threshold
+    float m_backgroundThreshold;
+
+    float m_minimumValue; // Range of the voxel values, calculated with the histogram
+    float m_maximumValue;
+
+    DerivedDataStorage *m_derivedDataStorage; // Holds the gradients when they were adopted; NULL if they are owned
+    DerivedDataStorage *m_voxelStorage;       // Holds the voxels when they were adopted; NULL if they are owned
+
+    vector<char> m_staleSlices; // Per slice, whether its voxels changed since the gradients were prepared by
+                                // prepareGradients(); empty when the gradients are not known to match any voxels
+
+    volatile bool m_gradientsReady;  // Set when the gradients for the policy have been set up; see setGradientsReady()
+    volatile bool m_histogramReady;  // Set when the histogram has been calculated; see setHistogramReady()
+
+    /// Set whether the gradients are ready. Set it once they are complete: a thread that then sees it set with
+    /// areGradientsReady() also sees the gradients.
+    void setGradientsReady(bool ready) { AtomicAccess::storeRelease(m_gradientsReady, ready); }
+
+    /// Set whether the histogram and the value range are ready, once they are complete
+    void setHistogramReady(bool ready) { AtomicAccess::storeRelease(m_histogramReady, ready); }
+
+#ifdef VOLUME_GATHER
+    /// Return true if the processor can run sampleTrilinearAvx512() or sampleTrilinearAvx2()
+    static bool cpuSupportsAvx512() {
+        static const bool supported = __builtin_cpu_supports("avx512f");
+        return supported;
+    }
+    static bool cpuSupportsAvx2() {
+        static const bool supported = __builtin_cpu_supports("avx2");
+        return supported;
+    }
+
+    /// Interpolate the positions of sampleTrilinear() 16 at a time with AVX-512, as far as there are 16 left, and
+    /// return the number interpolated. The volume must have at most INT_MAX voxels.
+    __attribute__((target("avx512f")))
+    int sampleTrilinearAvx512(const float *xs, const float *ys, const float *zs, float *out, int count) const {
+        const int lastX = std::max(m_width - 2, 0);
+        const int lastY = std::max(m_height - 2, 0);
+        const int lastZ = std::max(m_depth - 2, 0);
+
+        const int strideX = (m_width > 1) ? 1 : 0;
+        const int strideY = (m_height > 1) ? m_width : 0;
+        const VoxelIndex strideZ = (m_depth > 1) ? m_sliceSize : 0;
+
+        int i = 0;
+
+        const __m512 zero = _mm512_setzero_ps();
+        const __m512 one = _mm512_set1_ps(1.0f);
+        const __m512 upperX = _mm512_set1_ps(m_width - 1);
+        const __m512 upperY = _mm512_set1_ps(m_height - 1);
+        const __m512 upperZ = _mm512_set1_ps(m_depth - 1);
+        const __m512i lastCellX = _mm512_set1_epi32(lastX);
+        const __m512i lastCellY = _mm512_set1_epi32(lastY);
+        const __m512i lastCellZ = _mm512_set1_epi32(lastZ);
+        const __m512i width = _mm512_set1_epi32(m_width);
+        const __m512i sliceSize = _mm512_set1_epi32((int)m_sliceSize);
+        const __m512i offsetX = _mm512_set1_epi32(strideX);
+        const __m512i offsetY = _mm512_set1_epi32(strideY);
+        const __m512i offsetZ = _mm512_set1_epi32((int)strideZ);
+
+        for ( ; i + 16 <= count ; i += 16) {
+            __m512 x = _mm512_min_ps(_mm512_max_ps(_mm512_loadu_ps(xs + i), zero), upperX);
+            __m512 y = _mm512_min_ps(_mm512_max_ps(_mm512_loadu_ps(ys + i), zero), upperY);
+            __m512 z = _mm512_min_ps(_mm512_max_ps(_mm512_loadu_ps(zs + i), zero), upperZ);
+
+            // The coordinates are non-negative, so truncation is floor()
+            __m512i cellX = _mm512_min_epi32(_mm512_cvttps_epi32(x), lastCellX);
+            __m512i cellY = _mm512_min_epi32(_mm512_cvttps_epi32(y), lastCellY);
+            __m512i cellZ = _mm512_min_epi32(_mm512_cvttps_epi32(z), lastCellZ);
+
+            __m512 xd = _mm512_sub_ps(x, _mm512_cvtepi32_ps(cellX));
+            __m512 yd = _mm512_sub_ps(y, _mm512_cvtepi32_ps(cellY));
+            __m512 zd = _mm512_sub_ps(z, _mm512_cvtepi32_ps(cellZ));
+
+            __m512i i000 = _mm512_add_epi32(cellX, _mm512_add_epi32(_mm512_mullo_epi32(cellY, width), _mm512_mullo_epi32(cellZ, sliceSize)));
+            __m512i i010 = _mm512_add_epi32(i000, offsetY);
+            __m512i i001 = _mm512_add_epi32(i000, offsetZ);
+            __m512i i011 = _mm512_add_epi32(i010, offsetZ);
+
+            __m512 p000 = _mm512_i32gather_ps(i000, m_voxelData, 4);
+            __m512 p100 = _mm512_i32gather_ps(_mm512_add_epi32(i000, offsetX), m_voxelData, 4);
+            __m512 p010 = _mm512_i32gather_ps(i010, m_voxelData, 4);
+            __m512 p110 = _mm512_i32gather_ps(_mm512_add_epi32(i010, offsetX), m_voxelData, 4);
+            __m512 p001 = _mm512_i32gather_ps(i001, m_voxelData, 4);
+            __m512 p101 = _mm512_i32gather_ps(_mm512_add_epi32(i001, offsetX), m_voxelData, 4);
+            __m512 p011 = _mm512_i32gather_ps(i011, m_voxelData, 4);
+            __m512 p111 = _mm512_i32gather_ps(_mm512_add_epi32(i011, offsetX), m_voxelData, 4);
+
+            __m512 xd1 = _mm512_sub_ps(one, xd);
+            __m512 c00 = _mm512_add_ps(_mm512_mul_ps(p000, xd1), _mm512_mul_ps(p100, xd));
+            __m512 c10 = _mm512_add_ps(_mm512_mul_ps(p010, xd1), _mm512_mul_ps(p110, xd));
+            __m512 c01 = _mm512_add_ps(_mm512_mul_ps(p001, xd1), _mm512_mul_ps(p101, xd));
+            __m512 c11 = _mm512_add_ps(_mm512_mul_ps(p011, xd1), _mm512_mul_ps(p111, xd));
+
+            __m512 yd1 = _mm512_sub_ps(one, yd);
+            __m512 c0 = _mm512_add_ps(_mm512_mul_ps(c00, yd1), _mm512_mul_ps(c10, yd));
+            __m512 c1 = _mm512_add_ps(_mm512_mul_ps(c01, yd1), _mm512_mul_ps(c11, yd));
+
+            _mm512_storeu_ps(out + i, _mm512_add_ps(_mm512_mul_ps(c0, _mm512_sub_ps(one, zd)), _mm512_mul_ps(c1, zd)));
+        }
+
+        return i;
+    }
+
+    /// Interpolate the positions of sampleTrilinear() 8 at a time with AVX2, as far as there are 8 left, and return
+    /// the number interpolated. The volume must have at most INT_MAX voxels.
+    __attribute__((target("avx2")))
+    int sampleTrilinearAvx2(const float *xs, const float *ys, const float *zs, float *out, int count) const {
+        const int lastX = std::max(m_width - 2, 0);
+        const int lastY = std::max(m_height - 2, 0);
+        const int lastZ = std::max(m_depth - 2, 0);
+
+        const int strideX = (m_width > 1) ? 1 : 0;
+        const int strideY = (m_height > 1) ? m_width : 0;
+        const VoxelIndex strideZ = (m_depth > 1) ? m_sliceSize : 0;
+
+        int i = 0;
+
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 upperX = _mm256_set1_ps(m_width - 1);
+        const __m256 upperY = _mm256_set1_ps(m_height - 1);
+        const __m256 upperZ = _mm256_set1_ps(m_depth - 1);
+        const __m256i lastCellX = _mm256_set1_epi32(lastX);
+        const __m256i lastCellY = _mm256_set1_epi32(lastY);
+        const __m256i lastCellZ = _mm256_set1_epi32(lastZ);
+        const __m256i width = _mm256_set1_epi32(m_width);
+        const __m256i sliceSize = _mm256_set1_epi32((int)m_sliceSize);
+        const __m256i offsetX = _mm256_set1_epi32(strideX);
+        const __m256i offsetY = _mm256_set1_epi32(strideY);
+        const __m256i offsetZ = _mm256_set1_epi32((int)strideZ);
+
+        for ( ; i + 8 <= count ; i += 8) {
+            __m256 x = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(xs + i), zero), upperX);
+            __m256 y = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(ys + i), zero), upperY);
+            __m256 z = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(zs + i), zero), upperZ);
+
+            __m256i cellX = _mm256_min_epi32(_mm256_cvttps_epi32(x), lastCellX);
+            __m256i cellY = _mm256_min_epi32(_mm256_cvttps_epi32(y), lastCellY);
+            __m256i cellZ = _mm256_min_epi32(_mm256_cvttps_epi32(z), lastCellZ);
+
+            __m256 xd = _mm256_sub_ps(x, _mm256_cvtepi32_ps(cellX));
+            __m256 yd = _mm256_sub_ps(y, _mm256_cvtepi32_ps(cellY));
+            __m256 zd = _mm256_sub_ps(z, _mm256_cvtepi32_ps(cellZ));
+
+            __m256i i000 = _mm256_add_epi32(cellX, _mm256_add_epi32(_mm256_mullo_epi32(cellY, width), _mm256_mullo_epi32(cellZ, sliceSize)));
+            __m256i i010 = _mm256_add_epi32(i000, offsetY);
+            __m256i i001 = _mm256_add_epi32(i000, offsetZ);
+            __m256i i011 = _mm256_add_epi32(i010, offsetZ);
+
+            __m256 p000 = _mm256_i32gather_ps(m_voxelData, i000, 4);
+            __m256 p100 = _mm256_i32gather_ps(m_voxelData, _mm256_add_epi32(i000, offsetX), 4);
+            __m256 p010 = _mm256_i32gather_ps(m_voxelData, i010, 4);
+            __m256 p110 = _mm256_i32gather_ps(m_voxelData, _mm256_add_epi32(i010, offsetX), 4);
+            __m256 p001 = _mm256_i32gather_ps(m_voxelData, i001, 4);
+            __m256 p101 = _mm256_i32gather_ps(m_voxelData, _mm256_add_epi32(i001, offsetX), 4);
+            __m256 p011 = _mm256_i32gather_ps(m_voxelData, i011, 4);
+            __m256 p111 = _mm256_i32gather_ps(m_voxelData, _mm256_add_epi32(i011, offsetX), 4);
+
+            __m256 xd1 = _mm256_sub_ps(one, xd);
+            __m256 c00 = _mm256_add_ps(_mm256_mul_ps(p000, xd1), _mm256_mul_ps(p100, xd));
+            __m256 c10 = _mm256_add_ps(_mm256_mul_ps(p010, xd1), _mm256_mul_ps(p110, xd));
+            __m256 c01 = _mm256_add_ps(_mm256_mul_ps(p001, xd1), _mm256_mul_ps(p101, xd));
+            __m256 c11 = _mm256_add_ps(_mm256_mul_ps(p011, xd1), _mm256_mul_ps(p111, xd));
+
+            __m256 yd1 = _mm256_sub_ps(one, yd);
+            __m256 c0 = _mm256_add_ps(_mm256_mul_ps(c00, yd1), _mm256_mul_ps(c10, yd));
+            __m256 c1 = _mm256_add_ps(_mm256_mul_ps(c01, yd1), _mm256_mul_ps(c11, yd));
+
+            _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_mul_ps(c0, _mm256_sub_ps(one, zd)), _mm256_mul_ps(c1, zd)));
+        }
+
+        return i;
+    }
+#endif
+
     /// Calculates the histogram for this volume: An array of voxel value occurence by voxel value.
     /// Assumes voxel data has been loaded when called.
     void calculateHistogram() {
+        beginHistogram();
+        addToHistogram(0, m_depth);
+        finishHistogram();
+    }
+
+    /// Clear the histogram and the value range, before adding the voxels to them with addToHistogram()
+    void beginHistogram() {
         m_histogram = vector<float>(0);
 
 
@@ -616,8 +1283,22 @@ private:
             m_histogram.push_back(0);
         }
 
+        m_minimumValue = 1;
+        m_maximumValue = 0;
+    }
+
+    /// Add the voxels of the slices from zBegin up to (not including) zEnd to the histogram and the value range
+    void addToHistogram(int zBegin, int zEnd) {
+        const VoxelIndex end = zEnd * m_sliceSize;
+
+        // Count in integers: a float count stops growing at 2^24 voxels
+        vector<VoxelIndex> counts(m_histogram.size(), 0);
+
         // Calculate histogram
-        for (int i = 0 ; i < m_voxelNum ; i++) {
+        for (VoxelIndex i = zBegin * m_sliceSize ; i < end ; i++) {
+            m_minimumValue = std::min(m_minimumValue, m_voxelData[i]);
+            m_maximumValue = std::max(m_maximumValue, m_voxelData[i]);
+
             float sampleValue = m_voxelData[i]*200;
 
             // sampleValue is [0, 100], we want to index the array in the range [0, 199].
@@ -629,12 +1310,19 @@ private:
 
             // Ignore zero values
             //if (index != 0) {
-                m_histogram[index]++;
+                counts[index]++;
             //}
 
 
         }
 
+        for (int i = 0 ; i < (int)counts.size() ; i++) {
+            m_histogram[i] += counts[i];
+        }
+    }
+
+    /// Scale the counts of the histogram for display, after all voxels have been added
+    void finishHistogram() {
 
         for (int i = 0 ; i < m_histogram.size() ; i++) {
             // Logarithmically scale histogram - there are often very sharp peaks in the histogram, and we want to dampen these.
@@ -649,6 +1337,393 @@ private:
         }
 
     }
+
+    /// Read the dimensions from the header of a DAT file
+    static void readDatHeader(std::istream &fileIn, int &width, int &height, int &depth) {
+        char buffer[2];
+
+        fileIn.read(buffer, 2);
+        width = BYTE2INT(buffer[0], buffer[1]);
+        fileIn.read(buffer, 2);
+        height = BYTE2INT(buffer[0], buffer[1]);
+        fileIn.read(buffer, 2);
+        depth = BYTE2INT(buffer[0], buffer[1]);
+    }
+
+    /// Read the voxels of a region, clipped to the dataset, from a DAT file with the given slice dimensions. Only
+    /// the rows that hold voxels of the region are read, with a positioned read each; rows next to each other are
+    /// read at once, unless most of what lies between them would be skipped. The slices are divided among the
+    /// threads, which read them through streams of their own. Return false if the file ends prematurely.
+    bool readVoxelsRegion(const std::string &strFilename, int fileWidth, int fileHeight, const Region &region) {
+        const int stride = region.stride;
+        const std::streamoff fileRowBytes = (std::streamoff)fileWidth * 2;
+        const std::streamoff fileSliceBytes = fileRowBytes * fileHeight;
+        const std::streamoff rowBytes = ((std::streamoff)(m_width - 1) * stride + 1) * 2; // Read of one row
+        const bool adjacentRows = stride == 1 && rowBytes * 2 >= fileRowBytes;
+        const std::streamoff readBytes = adjacentRows ? (m_height - 1) * fileRowBytes + rowBytes : rowBytes;
+        bool succeeded = true;
+
+        #pragma omp parallel
+        {
+            std::ifstream fileIn(strFilename.c_str(), std::ifstream::in | std::ifstream::binary);
+            vector<char> buffer(readBytes);
+            int failedSlice = fileIn.is_open() ? -1 : 0;
+
+            #pragma omp for schedule(static)
+            for (int z = 0 ; z < m_depth ; z++) {
+                if (failedSlice >= 0) {
+                    continue;
+                }
+
+                const std::streamoff sliceStart = DAT_HEADER_BYTES +
+                    (std::streamoff)(region.begin[2] + z * stride) * fileSliceBytes + (std::streamoff)region.begin[0] * 2;
+
+                for (int y = 0 ; y < m_height ; y++) {
+                    const std::streamoff rowInBuffer = adjacentRows ? y * fileRowBytes : 0;
+                    if (!adjacentRows || y == 0) {
+                        fileIn.seekg(sliceStart + (std::streamoff)(region.begin[1] + y * stride) * fileRowBytes);
+                        fileIn.read(&buffer[0], readBytes);
+                        if (fileIn.gcount() < readBytes) {
+                            failedSlice = region.begin[2] + z * stride;
+                            break;
+                        }
+                    }
+
+                    const char *row = &buffer[rowInBuffer];
+                    float *voxels = m_voxelData + voxelIndex(0, y, z);
+                    for (int x = 0 ; x < m_width ; x++) {
+                        int thisVoxel = BYTE2INT(row[x * stride * 2], row[x * stride * 2 + 1]);
+                        voxels[x] = thisVoxel / 4095.0; // Scaling to [0,1].
+                    }
+                }
+            }
+
+            if (failedSlice >= 0) {
+                #pragma omp critical
+                {
+                    if (succeeded) {
+                        printf("Reached end of data file prematurely. Dataset may be corrupted. End reached at slice %d.\n", failedSlice);
+                    }
+                    succeeded = false;
+                }
+            }
+        }
+
+        return succeeded;
+    }
+
+    /// Read the voxel values that follow the header, in slabs of slices that go through a pipeline: while one
+    /// thread reads a slab from the file, the others convert the previously read slab to floats, and (with
+    /// deriveData) compute the gradients and the histogram of an earlier slab. The gradients of a slab need the
+    /// first slice of the next one, so that stage runs two slabs behind the conversion. Each step of the pipeline
+    /// is one parallel region in which the stages run at the same time; the region's barrier hands the slabs on
+    /// to the next stage. Return false if the file ends prematurely.
+    bool readVoxelsPipelined(std::fstream &fileIn, bool deriveData) {
+        const int slabSlices = (int)std::max((VoxelIndex)1, PIPELINE_SLAB_BYTES / std::max((VoxelIndex)1, m_sliceSize * 2));
+        const int slabCount = (m_depth + slabSlices - 1) / slabSlices;
+
+        // The file is read into one buffer while the other is converted
+        vector<char> rawSlabs[2];
+        rawSlabs[0].resize(slabSlices * m_sliceSize * 2);
+        rawSlabs[1].resize(slabSlices * m_sliceSize * 2);
+
+        const bool precomputeGradients = deriveData && m_gradientPolicy == PRECOMPUTED_GRADIENTS;
+        if (precomputeGradients) {
+            m_gradients = new Vector3d[m_voxelNum];
+            m_gradientMagnitudes = new double[m_voxelNum];
+        }
+        if (deriveData) {
+            beginHistogram();
+        }
+
+        int slicesRead = 0;
+        bool endOfFile = false;
+
+        // Step s reads slab s, converts slab s-1 and derives slab s-3
+        const int lastStep = deriveData ? slabCount + 2 : slabCount;
+        for (int step = 0 ; step <= lastStep ; step++) {
+            const int convertSlab = step - 1;
+            const int deriveSlab = step - 3;
+
+            const int convertBegin = convertSlab * slabSlices;
+            const int convertEnd = std::min(convertBegin + slabSlices, slicesRead);
+            const int deriveBegin = deriveSlab * slabSlices;
+            const int deriveEnd = std::min(deriveBegin + slabSlices, slicesRead);
+
+            const char *convertBuffer = &rawSlabs[(step + 1) % 2][0];
+
+            #pragma omp parallel
+            {
+                #pragma omp single nowait
+                {
+                    if (step < slabCount && !endOfFile) {
+                        const int slices = std::min(slabSlices, m_depth - step * slabSlices);
+                        fileIn.read(&rawSlabs[step % 2][0], (std::streamsize)slices * m_sliceSize * 2);
+
+                        // Only whole slices are used
+                        const int completeSlices = (int)(fileIn.gcount() / (m_sliceSize * 2));
+                        slicesRead += completeSlices;
+                        endOfFile = completeSlices < slices;
+                    }
+                }
+
+                if (deriveData && deriveSlab >= 0) {
+                    #pragma omp single nowait
+                    addToHistogram(deriveBegin, deriveEnd);
+                }
+
+                if (convertSlab >= 0) {
+                    #pragma omp for schedule(dynamic) nowait
+                    for (int z = convertBegin ; z < convertEnd ; z++) {
+                        const char *raw = convertBuffer + (z - convertBegin) * m_sliceSize * 2;
+                        float *voxels = m_voxelData + z * m_sliceSize;
+
+                        for (VoxelIndex i = 0 ; i < m_sliceSize ; i++) {
+                            int thisVoxel = BYTE2INT(raw[2*i], raw[2*i + 1]);
+                            voxels[i] = thisVoxel / 4095.0; // Scaling to [0,1].
+                        }
+                    }
+                }
+
+                if (precomputeGradients && deriveSlab >= 0) {
+                    #pragma omp for schedule(dynamic) nowait
+                    for (int z = deriveBegin ; z < deriveEnd ; z++) {
+                        calculateGradientSlices(z, z + 1, 0);
+                    }
+                }
+            }
+        }
+
+        if (endOfFile) {
+            printf("Reached end of data file prematurely. Dataset may be corrupted. End reached at slice %d.\n", slicesRead);
+            releaseGradients();
+            return false;
+        }
+
+        if (deriveData) {
+            if (!precomputeGradients) {
+                prepareGradients();
+            }
+            setGradientsReady(true);
+
+            finishHistogram();
+            setHistogramReady(true);
+        }
+
+        return true;
+    }
+
+    /// Index of the voxel at the specified position
+    VoxelIndex voxelIndex(int x, int y, int z) const {
+        return m_sliceSize * z + (VoxelIndex)m_width * y + x;
+    }
+
+    /// Gradient of a voxel by central differences; zero for voxels on the border of the volume, as in
+    /// calculateGradients()
+    Vector3d centralDifference(int x, int y, int z) const {
+        if (x == 0 || y == 0 || z == 0 || x == m_width-1 || y == m_height-1 || z == m_depth-1) {
+            return Vector3d(0,0,0);
+        }
+
+        const float *voxel = &m_voxelData[voxelIndex(x, y, z)];
+
+        float xDifference = (voxel[1] - voxel[-1]) * 0.5;
+        float yDifference = (voxel[m_width] - voxel[-m_width]) * 0.5;
+        float zDifference = (voxel[m_sliceSize] - voxel[-m_sliceSize]) * 0.5;
+
+        return Vector3d(xDifference, yDifference, zDifference);
+    }
+
+    /// Set up the gradients of the loaded voxels for the current gradient policy
+    void prepareGradients() {
+        if (m_voxelData == NULL) {
+            return;
+        }
+
+        // Only the gradients around the slices that changed since they were calculated need calculating again
+        const bool incremental = m_staleSlices.size() == (size_t)m_depth;
+
+        if (m_gradientPolicy == PRECOMPUTED_GRADIENTS && incremental && m_gradients != NULL && m_derivedDataStorage == NULL) {
+            updateGradientSlices();
+        } else if (m_gradientPolicy == PRECOMPUTED_GRADIENTS) {
+            std::cout << "Calculating gradients." << std::endl << std::endl;
+            calculateGradients(0);
+        } else if (m_gradientPolicy == LAZY_GRADIENT_BRICKS && incremental && !m_gradientBricks.empty()) {
+            dropStaleGradientBricks();
+        } else if (m_gradientPolicy == LAZY_GRADIENT_BRICKS) {
+            m_bricksX = (m_width + GRADIENT_BRICK_SIZE - 1) / GRADIENT_BRICK_SIZE;
+            m_bricksY = (m_height + GRADIENT_BRICK_SIZE - 1) / GRADIENT_BRICK_SIZE;
+            m_bricksZ = (m_depth + GRADIENT_BRICK_SIZE - 1) / GRADIENT_BRICK_SIZE;
+
+            // Bricks of earlier voxels are stale
+            for (int i = 0 ; i < (int)m_gradientBricks.size() ; i++) {
+                delete [] m_gradientBricks[i];
+            }
+            m_gradientBricks.assign(m_bricksX * m_bricksY * m_bricksZ, (float*)NULL);
+        } else if (m_gradientPolicy == SPARSE_GRADIENTS) {
+            m_sparseTiles.build(m_voxelData, m_width, m_height, m_depth, m_backgroundThreshold);
+            std::cout << "Calculating gradients of " << m_sparseTiles.getActiveTileCount() << " of "
+                      << m_sparseTiles.getTileCount() << " tiles." << std::endl << std::endl;
+
+            #pragma omp parallel for schedule(dynamic)
+            for (int tile = 0 ; tile < m_sparseTiles.getActiveTileCount() ; tile++) {
+                computeGradientTile(m_sparseTiles.getTileOrigin(tile), m_sparseTiles.getTilePayload(tile));
+            }
+        }
+
+        m_staleSlices.assign(m_depth, (char)false);
+    }
+
+    /// Return true if the gradient of a slice depends on a voxel that changed since the gradients were calculated
+    bool gradientSliceStale(int z) const {
+        return m_staleSlices[z] || (z > 0 && m_staleSlices[z - 1]) || (z + 1 < m_depth && m_staleSlices[z + 1]);
+    }
+
+    /// Calculate the precomputed gradients again around the stale slices
+    void updateGradientSlices() {
+        vector<int> slices;
+        for (int z = 0 ; z < m_depth ; z++) {
+            if (gradientSliceStale(z)) {
+                slices.push_back(z);
+            }
+        }
+
+        std::cout << "Updating gradients of " << slices.size() << " of " << m_depth << " slices." << std::endl << std::endl;
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int i = 0 ; i < (int)slices.size() ; i++) {
+            calculateGradientSlices(slices[i], slices[i] + 1, 0);
+        }
+    }
+
+    /// Free the lazy gradient bricks that overlap the stale slices, to be computed again when used
+    void dropStaleGradientBricks() {
+        for (int bz = 0 ; bz < m_bricksZ ; bz++) {
+            bool stale = false;
+            for (int z = bz * GRADIENT_BRICK_SIZE ; z < std::min((bz + 1) * GRADIENT_BRICK_SIZE, m_depth) ; z++) {
+                stale = stale || gradientSliceStale(z);
+            }
+            if (!stale) {
+                continue;
+            }
+
+            for (int brick = bz * m_bricksX * m_bricksY ; brick < (bz + 1) * m_bricksX * m_bricksY ; brick++) {
+                delete [] m_gradientBricks[brick];
+                m_gradientBricks[brick] = NULL;
+            }
+        }
+    }
+
+    /// Free the voxels, or release the storage holding them if they were adopted
+    void releaseVoxels() {
+        if (m_voxelStorage) {
+            delete m_voxelStorage;
+            m_voxelStorage = NULL;
+        } else {
+            delete [] m_voxelData;
+        }
+        m_voxelData = NULL;
+    }
+
+    /// Free the memory held by the gradients of any policy
+    void releaseGradients() {
+        if (m_derivedDataStorage) {
+            // The gradients belong to the storage
+            delete m_derivedDataStorage;
+            m_derivedDataStorage = NULL;
+        } else {
+            delete [] m_gradients;
+            delete [] m_gradientMagnitudes;
+        }
+        m_gradients = NULL;
+        m_gradientMagnitudes = NULL;
+
+        for (int i = 0 ; i < (int)m_gradientBricks.size() ; i++) {
+            delete [] m_gradientBricks[i];
+        }
+        m_gradientBricks.clear();
+
+        m_sparseTiles.clear();
+        m_staleSlices.clear();
+    }
+
+    /// Return the gradient x, y, z and magnitude of a voxel, computing the brick containing it if this is the first
+    /// access. Bricks may be requested from several threads at once, so they are computed in a critical section.
+    const float* getGradientBrickVoxel(int x, int y, int z) const {
+        const int brick = ((z / GRADIENT_BRICK_SIZE) * m_bricksY + y / GRADIENT_BRICK_SIZE) * m_bricksX + x / GRADIENT_BRICK_SIZE;
+
+        float *data = AtomicAccess::loadAcquire(m_gradientBricks[brick]);
+        if (data == NULL) {
+            #pragma omp critical(volumeGradientBricks)
+            {
+                data = m_gradientBricks[brick];
+                if (data == NULL) {
+                    data = computeGradientBrick(brick);
+                    AtomicAccess::storeRelease(m_gradientBricks[brick], data);
+                }
+            }
+        }
+
+        const int offset = ((z % GRADIENT_BRICK_SIZE) * GRADIENT_BRICK_SIZE + y % GRADIENT_BRICK_SIZE) * GRADIENT_BRICK_SIZE + x % GRADIENT_BRICK_SIZE;
+        return data + offset * 4;
+    }
+
+    /// Compute the gradients and gradient magnitudes of one brick
+    float* computeGradientBrick(int brick) const {
+        const int size = GRADIENT_BRICK_SIZE;
+        const int startX = (brick % m_bricksX) * size;
+        const int startY = ((brick / m_bricksX) % m_bricksY) * size;
+        const int startZ = (brick / (m_bricksX * m_bricksY)) * size;
+
+        float *data = new float[size * size * size * 4];
+
+        for (int z = 0 ; z < size ; z++) {
+            for (int y = 0 ; y < size ; y++) {
+                for (int x = 0 ; x < size ; x++) {
+                    float *voxel = data + ((z * size + y) * size + x) * 4;
+
+                    // The bricks on the upper borders extend past the volume
+                    if (startX + x >= m_width || startY + y >= m_height || startZ + z >= m_depth) {
+                        voxel[0] = voxel[1] = voxel[2] = voxel[3] = 0;
+                        continue;
+                    }
+
+                    Vector3d gradient = centralDifference(startX + x, startY + y, startZ + z);
+                    voxel[0] = gradient.GetX();
+                    voxel[1] = gradient.GetY();
+                    voxel[2] = gradient.GetZ();
+                    voxel[3] = gradient.GetMagnitude();
+                }
+            }
+        }
+
+        return data;
+    }
+
+    /// Compute the gradients and gradient magnitudes of one tile of the sparse tiles into its payload
+    void computeGradientTile(const int *origin, float *payload) const {
+        const int size = SparseTileTree::TILE_SIZE;
+
+        for (int z = 0 ; z < size ; z++) {
+            for (int y = 0 ; y < size ; y++) {
+                for (int x = 0 ; x < size ; x++) {
+                    float *voxel = payload + ((z * size + y) * size + x) * SparseTileTree::CHANNELS;
+
+                    // The tiles on the upper borders extend past the volume
+                    if (origin[0] + x >= m_width || origin[1] + y >= m_height || origin[2] + z >= m_depth) {
+                        voxel[0] = voxel[1] = voxel[2] = voxel[3] = 0;
+                        continue;
+                    }
+
+                    Vector3d gradient = centralDifference(origin[0] + x, origin[1] + y, origin[2] + z);
+                    voxel[0] = gradient.GetX();
+                    voxel[1] = gradient.GetY();
+                    voxel[2] = gradient.GetZ();
+                    voxel[3] = gradient.GetMagnitude();
+                }
+            }
+        }
+    }
 };
 
 #endif /* __VOLUME_H__ */
@@ -0,0 +1 @@
+#include "VolumeLoaderThread.h"
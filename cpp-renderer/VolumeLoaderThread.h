@@ -0,0 +1,67 @@
+#ifndef VOLUMELOADERTHREAD_H
+#define VOLUMELOADERTHREAD_H
+
+#include <string>
+#include <QThread>
+
+#include "Volume.h"
+
+/**
+ * Loads the voxels of a dataset into a volume on a background thread, while a preview of the dataset is shown.
+ * The gradients and the histogram are not computed; see DerivedDataThread.
+ *
+ * The finished() signal tells when the volume has been loaded, and succeeded() whether the file could be read. Do
+ * not use the volume before the thread has finished; wait() blocks until then. As finished() is queued to the
+ * receiver, it may arrive after the next load has started: compare getLoadNumber() with the number load()
+ * returned to tell which load it is about.
+ */
+class VolumeLoaderThread : public QThread
+{
+    // ********************************************************************************************************
+    // *** Basic methods **************************************************************************************
+public:
+    /// Constructor
+    explicit VolumeLoaderThread(QObject *parent = NULL) : QThread(parent), m_volume(NULL), m_succeeded(false),
+        m_loadNumber(0)
+    {
+    }
+
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    /// Start loading the voxels of the specified file into a volume, and return the number of this load (above 0)
+    int load(Volume *volume, const std::string &filename) {
+        wait();
+
+        m_volume = volume;
+        m_filename = filename;
+        m_succeeded = false;
+        m_loadNumber++;
+        start();
+        return m_loadNumber;
+    }
+
+    /// Return the number of the last load started
+    int getLoadNumber() const { return m_loadNumber; }
+
+    /// Return true if the last load read the whole file
+    bool succeeded() const { return m_succeeded; }
+
+    // ********************************************************************************************************
+    // *** Protected methods **********************************************************************************
+protected:
+    void run() {
+        m_succeeded = m_volume->loadVolumeDat(m_filename, false);
+    }
+
+    // ********************************************************************************************************
+    // *** Class members **************************************************************************************
+private:
+    Volume *m_volume;
+    std::string m_filename;
+    bool m_succeeded;
+    int m_loadNumber;
+
+}; /* VolumeLoaderThread */
+
+#endif // VOLUMELOADERTHREAD_H
@@ -0,0 +1 @@
+#include "VolumePyramid.h"
@@ -0,0 +1,144 @@
+#ifndef VOLUMEPYRAMID_H
+#define VOLUMEPYRAMID_H
+
+#include <algorithm>
+#include <vector>
+
+#include "Volume.h"
+
+using std::vector;
+
+/**
+ * Mipmap pyramid of a volume for level-of-detail rendering. Level 0 is the volume itself, and every further level
+ * halves the resolution along each axis by averaging blocks of 2x2x2 voxels of the level below (a box filter; at
+ * odd dimensions the last voxel is repeated).
+ *
+ * Voxel i of level L covers voxels i*2^L to (i+1)*2^L - 1 of the volume, so a position p in voxel coordinates of
+ * the volume is at (p + 0.5) / 2^L - 0.5 in level L. The coarse levels compute their gradients on the fly, in
+ * their own voxel units: divide them by 2^L to compare them to the gradients of the volume.
+ *
+ * Levels are built on first use, each in parallel over its slices, and freed when the volume changes.
+ */
+class VolumePyramid
+{
+    // ********************************************************************************************************
+    // *** Basic methods **************************************************************************************
+public:
+    /// Default constructor; the pyramid is empty until setVolume() is called
+    VolumePyramid() : m_volume(NULL)
+    {
+    }
+
+    /// Destructor
+    ~VolumePyramid()
+    {
+        clear();
+    }
+
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    /// Use the pyramid of another volume, or of the same volume after its voxels have changed
+    void setVolume(Volume *volume) {
+        clear();
+        m_volume = volume;
+    }
+
+    /// Return the number of levels, including the volume itself. The coarsest level is the first with a dimension
+    /// of at most MIN_DIMENSION voxels, or level MAX_LEVEL.
+    int levelCount() const {
+        if (m_volume == NULL) {
+            return 0;
+        }
+
+        int levels = 1;
+        int dimension = std::min(m_volume->getWidth(), std::min(m_volume->getHeight(), m_volume->getDepth()));
+        while (dimension > MIN_DIMENSION && levels <= MAX_LEVEL) {
+            dimension = (dimension + 1) / 2;
+            levels++;
+        }
+        return levels;
+    }
+
+    /// Return level of the pyramid, building it and the levels below if necessary. Levels beyond the coarsest
+    /// return the coarsest.
+    Volume* level(int level) {
+        level = std::min(std::max(level, 0), levelCount() - 1);
+        if (level <= 0) {
+            return m_volume;
+        }
+
+        while ((int)m_levels.size() < level) {
+            m_levels.push_back(downsample(m_levels.empty() ? *m_volume : *m_levels.back()));
+        }
+        return m_levels[level - 1];
+    }
+
+    // ********************************************************************************************************
+    // *** Private methods ************************************************************************************
+private:
+    /// Return a volume of half the resolution of source along each axis
+    static Volume* downsample(const Volume &source) {
+        const int width = source.getWidth();
+        const int height = source.getHeight();
+        const int depth = source.getDepth();
+
+        Volume *result = new Volume((width + 1) / 2, (height + 1) / 2, (depth + 1) / 2);
+        result->setGradientPolicy(Volume::ON_THE_FLY_GRADIENTS);
+
+        const float *in = source.getData();
+        float *out = result->getData();
+
+        const int resultWidth = result->getWidth();
+        const int resultHeight = result->getHeight();
+        const int resultDepth = result->getDepth();
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int z = 0 ; z < resultDepth ; z++) {
+            // Offsets of the two voxels along each axis; the second repeats the first past an odd dimension
+            const Volume::VoxelIndex z0 = (Volume::VoxelIndex)2*z * width * height;
+            const Volume::VoxelIndex z1 = (Volume::VoxelIndex)std::min(2*z + 1, depth - 1) * width * height;
+
+            for (int y = 0 ; y < resultHeight ; y++) {
+                const int y0 = 2*y * width;
+                const int y1 = std::min(2*y + 1, height - 1) * width;
+
+                for (int x = 0 ; x < resultWidth ; x++) {
+                    const int x0 = 2*x;
+                    const int x1 = std::min(2*x + 1, width - 1);
+
+                    out[((Volume::VoxelIndex)z * resultHeight + y) * resultWidth + x] =
+                        ((in[z0 + y0 + x0] + in[z0 + y0 + x1]) + (in[z0 + y1 + x0] + in[z0 + y1 + x1]) +
+                         (in[z1 + y0 + x0] + in[z1 + y0 + x1]) + (in[z1 + y1 + x0] + in[z1 + y1 + x1])) * 0.125f;
+                }
+            }
+        }
+
+        result->computeDerivedData();
+        return result;
+    }
+
+    /// Free the levels
+    void clear() {
+        for (int i = 0 ; i < (int)m_levels.size() ; i++) {
+            delete m_levels[i];
+        }
+        m_levels.clear();
+    }
+
+    // Not copyable
+    VolumePyramid(const VolumePyramid&);
+    VolumePyramid& operator=(const VolumePyramid&);
+
+    // ********************************************************************************************************
+    // *** Class members **************************************************************************************
+private:
+    static const int MIN_DIMENSION = 8; // Levels stop when a dimension gets this small
+    static const int MAX_LEVEL = 4;     // and after this many halvings
+
+    Volume *m_volume;
+    vector<Volume*> m_levels; // Levels 1 and up, as far as they have been built
+
+}; /* VolumePyramid */
+
+#endif // VOLUMEPYRAMID_H
@@ -0,0 +1,4 @@
+#include "VoxelTraversal.h"
+
+/// Magnitude below which a coefficient of the cubic along a trilinear segment counts as zero
+const float VoxelTraversal::EPSILON = 1e-7f;
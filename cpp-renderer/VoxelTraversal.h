@@ -0,0 +1,298 @@
+#ifndef VOXELTRAVERSAL_H
+#define VOXELTRAVERSAL_H
+
+#include <cmath>
+#include "Volume.h"
+
+/**
+ * Voxel-exact ray traversal (3D-DDA after Amanatides & Woo, "A Fast Voxel Traversal Algorithm for Ray Tracing").
+ *
+ * Instead of taking fixed steps along the ray, the traversal visits every cell the ray crosses exactly once
+ * and integrates analytically over the segment of the ray inside each cell:
+ *
+ *  - Nearest neighbour: a cell is the region around one voxel center, where the sampled value is constant.
+ *    X-ray integrates value * segment length, MIP takes the voxel value.
+ *  - Trilinear: a cell is the region between eight voxel centers. The trilinear function restricted to a line
+ *    is a cubic polynomial, so Simpson's rule integrates it exactly for the X-ray. MIP takes the largest value
+ *    of the cubic on the segment, at the entry, the exit or where its derivative is zero in between.
+ *
+ * All positions are given in voxel coordinates, i.e. the same coordinates accepted by Volume::getVoxelTrilinear.
+ * The cost scales with the number of voxels crossed rather than with the selected step size.
+ */
+class VoxelTraversal
+{
+    // ********************************************************************************************************
+    // *** Basic methods **************************************************************************************
+public:
+    /// Constructor. The volume must outlive the traversal object.
+    VoxelTraversal(const Volume &volume) : m_volume(volume)
+    {
+    }
+
+    // ********************************************************************************************************
+    // *** Public methods *************************************************************************************
+public:
+    /// Return the average intensity along the ray segment from entry to exit (the X-ray image value).
+    /// interpolationMode: 0 means nearest, 1 means trilinear
+    float averageIntensity(const float entry[3], const float exit[3], int interpolationMode) const {
+        IntegrateVisitor visitor(m_volume, entry, exit, interpolationMode);
+        traverse(entry, exit, interpolationMode, visitor);
+
+        if (visitor.length <= 0) {
+            return visitor.lastValue;
+        }
+
+        return clampUnit(visitor.integral / visitor.length);
+    }
+
+    /// Return the maximum intensity along the ray segment from entry to exit (the M.I.P image value).
+    /// interpolationMode: 0 means nearest, 1 means trilinear
+    float maximumIntensity(const float entry[3], const float exit[3], int interpolationMode) const {
+        MaximumVisitor visitor(m_volume, entry, exit, interpolationMode);
+        traverse(entry, exit, interpolationMode, visitor);
+
+        return clampUnit(visitor.maximum);
+    }
+
+    // ********************************************************************************************************
+    // *** Private methods ************************************************************************************
+private:
+    /// Accumulates the exact line integral of the interpolated volume along the visited cells
+    struct IntegrateVisitor {
+        IntegrateVisitor(const Volume &volume, const float entry[3], const float exit[3], int interpolationMode) :
+            volume(volume), interpolationMode(interpolationMode), integral(0), length(0), lastValue(0)
+        {
+            for (int i = 0 ; i < 3 ; i++) {
+                origin[i] = entry[i];
+                direction[i] = exit[i] - entry[i];
+            }
+        }
+
+        void visit(const int cell[3], float tEnter, float tExit, float segmentLength) {
+            if (interpolationMode == 0) {
+                lastValue = volume.getVoxel(cell[0], cell[1], cell[2]);
+                integral += lastValue * segmentLength;
+            } else {
+                float corners[8];
+                fetchCellCorners(volume, cell, corners);
+
+                // Simpson's rule is exact for the cubic that trilinear interpolation yields along a line
+                float tMiddle = (tEnter + tExit) * 0.5f;
+                float fEnter = evaluateCell(origin, direction, cell, corners, tEnter);
+                float fMiddle = evaluateCell(origin, direction, cell, corners, tMiddle);
+                float fExit = evaluateCell(origin, direction, cell, corners, tExit);
+
+                lastValue = fMiddle;
+                integral += segmentLength * (fEnter + 4 * fMiddle + fExit) / 6.0f;
+            }
+
+            length += segmentLength;
+        }
+
+        const Volume &volume;
+        int interpolationMode;
+        float origin[3];
+        float direction[3];
+
+        float integral;
+        float length;
+        float lastValue; // Used when the segment is degenerate (zero length)
+    };
+
+    /// Keeps track of the largest value found along the visited cells
+    struct MaximumVisitor {
+        MaximumVisitor(const Volume &volume, const float entry[3], const float exit[3], int interpolationMode) :
+            volume(volume), interpolationMode(interpolationMode), maximum(0)
+        {
+            for (int i = 0 ; i < 3 ; i++) {
+                origin[i] = entry[i];
+                direction[i] = exit[i] - entry[i];
+            }
+        }
+
+        void visit(const int cell[3], float tEnter, float tExit, float) {
+            if (interpolationMode == 0) {
+                maximum = std::max(maximum, volume.getVoxel(cell[0], cell[1], cell[2]));
+                return;
+            }
+
+            float corners[8];
+            fetchCellCorners(volume, cell, corners);
+
+            // The cubic along the segment, sampled at u = 0, 1, 2 and 3 for u = 3 * (t - tEnter) / (tExit - tEnter)
+            float f[4];
+            for (int i = 0 ; i < 4 ; i++) {
+                f[i] = evaluateCell(origin, direction, cell, corners, tEnter + (tExit - tEnter) * i / 3.0f);
+                maximum = std::max(maximum, f[i]);
+            }
+
+            // Its coefficients a3*u^3 + a2*u^2 + a1*u + f[0], from the forward differences of the samples
+            float d1 = f[1] - f[0];
+            float d2 = f[2] - 2*f[1] + f[0];
+            float d3 = f[3] - 3*f[2] + 3*f[1] - f[0];
+
+            float a3 = d3 / 6.0f;
+            float a2 = (d2 - d3) / 2.0f;
+            float a1 = d1 - d2 / 2.0f + d3 / 3.0f;
+
+            // An interior maximum lies where the derivative 3*a3*u^2 + 2*a2*u + a1 is zero
+            float roots[2];
+            int rootCount = 0;
+
+            if (fabs(a3) > EPSILON) {
+                float discriminant = a2*a2 - 3*a3*a1;
+                if (discriminant >= 0) {
+                    float root = sqrt(discriminant);
+                    roots[rootCount++] = (-a2 + root) / (3*a3);
+                    roots[rootCount++] = (-a2 - root) / (3*a3);
+                }
+            } else if (fabs(a2) > EPSILON) {
+                roots[rootCount++] = -a1 / (2*a2);
+            }
+
+            for (int i = 0 ; i < rootCount ; i++) {
+                if (roots[i] > 0 && roots[i] < 3) {
+                    float t = tEnter + (tExit - tEnter) * roots[i] / 3.0f;
+                    maximum = std::max(maximum, evaluateCell(origin, direction, cell, corners, t));
+                }
+            }
+        }
+
+        const Volume &volume;
+        int interpolationMode;
+        float origin[3];
+        float direction[3];
+
+        float maximum;
+    };
+
+    /// Evaluate the trilinear interpolant of a cell at parameter t of the ray from origin along direction
+    static float evaluateCell(const float origin[3], const float direction[3], const int cell[3], const float corners[8],
+                              float t) {
+        float xd = clampUnit(origin[0] + direction[0] * t - cell[0]);
+        float yd = clampUnit(origin[1] + direction[1] * t - cell[1]);
+        float zd = clampUnit(origin[2] + direction[2] * t - cell[2]);
+
+        float c00 = corners[0]*(1-xd) + corners[1] * xd;
+        float c10 = corners[2]*(1-xd) + corners[3] * xd;
+        float c01 = corners[4]*(1-xd) + corners[5] * xd;
+        float c11 = corners[6]*(1-xd) + corners[7] * xd;
+
+        float c0 = c00 * (1-yd) + c10 * yd;
+        float c1 = c01 * (1-yd) + c11 * yd;
+
+        return c0 * (1-zd) + c1 * zd;
+    }
+
+    /// Fetch the eight voxels spanning a trilinear cell, ordered x fastest, then y, then z.
+    /// Cells at the upper border are clamped the same way Volume::getVoxelTrilinear clamps its coordinates.
+    static void fetchCellCorners(const Volume &volume, const int cell[3], float corners[8]) {
+        int x1 = std::min(cell[0]+1, volume.getWidth()-1);
+        int y1 = std::min(cell[1]+1, volume.getHeight()-1);
+        int z1 = std::min(cell[2]+1, volume.getDepth()-1);
+
+        corners[0] = volume.getVoxel(cell[0], cell[1], cell[2]);
+        corners[1] = volume.getVoxel(x1, cell[1], cell[2]);
+        corners[2] = volume.getVoxel(cell[0], y1, cell[2]);
+        corners[3] = volume.getVoxel(x1, y1, cell[2]);
+        corners[4] = volume.getVoxel(cell[0], cell[1], z1);
+        corners[5] = volume.getVoxel(x1, cell[1], z1);
+        corners[6] = volume.getVoxel(cell[0], y1, z1);
+        corners[7] = volume.getVoxel(x1, y1, z1);
+    }
+
+    /// Walk the cells crossed by the segment from entry to exit, calling visitor.visit() once per cell with the
+    /// cell index, the ray parameters (in [0,1]) where the segment enters and leaves the cell, and the length of
+    /// the segment inside the cell in voxel units.
+    template <class Visitor>
+    void traverse(const float entry[3], const float exit[3], int interpolationMode, Visitor &visitor) const {
+        const int dimensions[3] = { m_volume.getWidth(), m_volume.getHeight(), m_volume.getDepth() };
+
+        // Nearest neighbour cells are centered on the voxels, trilinear cells start at them
+        const float cellOffset = (interpolationMode == 0) ? 0.5f : 0.0f;
+
+        // Highest valid cell index per axis. Trilinear cells need a neighbour in the positive direction.
+        int lastCell[3];
+        for (int i = 0 ; i < 3 ; i++) {
+            lastCell[i] = (interpolationMode == 0) ? dimensions[i]-1 : std::max(dimensions[i]-2, 0);
+        }
+
+        float direction[3];
+        for (int i = 0 ; i < 3 ; i++) {
+            direction[i] = exit[i] - entry[i];
+        }
+
+        float totalLength = std::sqrt(direction[0]*direction[0] + direction[1]*direction[1] + direction[2]*direction[2]);
+
+        int cell[3];
+        int step[3];
+        float tMax[3];   // Ray parameter at which the next cell boundary is crossed, per axis
+        float tDelta[3]; // Ray parameter needed to cross one full cell, per axis
+
+        for (int i = 0 ; i < 3 ; i++) {
+            float start = entry[i] + cellOffset;
+            cell[i] = (int)floor(start);
+
+            if (direction[i] > 0) {
+                step[i] = 1;
+                tDelta[i] = 1.0f / direction[i];
+                tMax[i] = (cell[i] + 1 - start) * tDelta[i];
+            } else if (direction[i] < 0) {
+                step[i] = -1;
+                tDelta[i] = -1.0f / direction[i];
+                tMax[i] = (start - cell[i]) * tDelta[i];
+            } else {
+                step[i] = 0;
+                tDelta[i] = 0;
+                tMax[i] = 2.0f; // Never crosses a boundary on this axis
+            }
+        }
+
+        // A ray can cross at most one cell per boundary plane, plus the cell it starts in
+        int maxIterations = dimensions[0] + dimensions[1] + dimensions[2] + 3;
+
+        float t = 0;
+        for (int iteration = 0 ; iteration < maxIterations ; iteration++) {
+            int axis = 0;
+            if (tMax[1] < tMax[axis]) {
+                axis = 1;
+            }
+            if (tMax[2] < tMax[axis]) {
+                axis = 2;
+            }
+
+            float tNext = std::min(tMax[axis], 1.0f);
+
+            // Clamp to the volume the same way the step-based samplers do at the borders
+            int clampedCell[3];
+            for (int i = 0 ; i < 3 ; i++) {
+                clampedCell[i] = std::max(0, std::min(cell[i], lastCell[i]));
+            }
+
+            visitor.visit(clampedCell, t, tNext, (tNext - t) * totalLength);
+
+            if (tMax[axis] >= 1.0f) {
+                break;
+            }
+
+            t = tNext;
+            cell[axis] += step[axis];
+            tMax[axis] += tDelta[axis];
+        }
+    }
+
+    /// Clamp a value to the [0,1] range
+    static float clampUnit(float value) {
+        return std::max(0.0f, std::min(value, 1.0f));
+    }
+
+    // ********************************************************************************************************
+    // *** Class members **************************************************************************************
+private:
+    static const float EPSILON;
+
+    const Volume &m_volume;
+
+}; /* VoxelTraversal */
+
+#endif // VOXELTRAVERSAL_H
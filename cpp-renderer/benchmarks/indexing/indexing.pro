@@ -0,0 +1,17 @@
+#-------------------------------------------------
+#
+# Microbenchmark of 64-bit against 32-bit voxel indexing
+#
+#-------------------------------------------------
+
+QT += core
+QT -= gui
+
+TARGET = indexing_benchmark
+CONFIG += console
+CONFIG -= app_bundle
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+SOURCES += main.cpp
@@ -0,0 +1,178 @@
+#include <QElapsedTimer>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include "TrilinearSampler.h"
+#include "Volume.h"
+
+/*
+ * Times the hot sampling paths of Volume and TrilinearSampler, which index the voxels with 64-bit
+ * Volume::VoxelIndex, against copies of the same interpolation that index with int as before, and checks that both
+ * give the same results. On volumes below 2^31 voxels the 64-bit indexing should cost nothing.
+ *
+ * Usage: indexing_benchmark [volume file] [number of samples]
+ */
+
+/// Nanoseconds per sample from the elapsed time of a timer
+static double nanosecondsPerSample(const QElapsedTimer &timer, int samples) {
+    return timer.nsecsElapsed() / (double)samples;
+}
+
+/// Trilinear interpolation as in Volume::sampleTrilinear(), with 32-bit indices
+static float trilinear32(const Volume &volume, float x, float y, float z) {
+    const int width = volume.getWidth();
+    const int height = volume.getHeight();
+    const int depth = volume.getDepth();
+    const int sliceSize = width * height;
+
+    x = std::min(std::max(x, 0.0f), (float)(width - 1));
+    y = std::min(std::max(y, 0.0f), (float)(height - 1));
+    z = std::min(std::max(z, 0.0f), (float)(depth - 1));
+
+    const int cellX = std::min((int)x, std::max(width - 2, 0));
+    const int cellY = std::min((int)y, std::max(height - 2, 0));
+    const int cellZ = std::min((int)z, std::max(depth - 2, 0));
+
+    const int strideX = (width > 1) ? 1 : 0;
+    const int strideY = (height > 1) ? width : 0;
+    const int strideZ = (depth > 1) ? sliceSize : 0;
+
+    const float xd = x - cellX;
+    const float yd = y - cellY;
+    const float zd = z - cellZ;
+
+    const float *p = &volume.getData()[sliceSize * cellZ + width * cellY + cellX];
+
+    float c00 = p[0]*(1-xd) + p[strideX] * xd;
+    float c10 = p[strideY]*(1-xd) + p[strideY + strideX] * xd;
+    float c01 = p[strideZ]*(1-xd) + p[strideZ + strideX] * xd;
+    float c11 = p[strideZ + strideY]*(1-xd) + p[strideZ + strideY + strideX] * xd;
+
+    float c0 = c00 * (1-yd) + c10 * yd;
+    float c1 = c01 * (1-yd) + c11 * yd;
+
+    return c0 * (1-zd) + c1 * zd;
+}
+
+/// Nearest voxel as in Volume::getVoxelClosest(), with 32-bit indices
+static float closest32(const Volume &volume, float x, float y, float z) {
+    const int xVal = std::min((int)floor(x + 0.5), volume.getWidth() - 1);
+    const int yVal = std::min((int)floor(y + 0.5), volume.getHeight() - 1);
+    const int zVal = std::min((int)floor(z + 0.5), volume.getDepth() - 1);
+
+    return volume.getData()[volume.getWidth() * volume.getHeight() * zVal + volume.getWidth() * yVal + xVal];
+}
+
+int main(int argc, char *argv[])
+{
+    const std::string filename = (argc > 1) ? argv[1] : "../../lobster.dat";
+    const int sampleCount = (argc > 2) ? atoi(argv[2]) : 4000000;
+
+    Volume volume(filename);
+    if (volume.getVoxelNum() == 0) {
+        std::cout << "Could not load " << filename << std::endl;
+        return 1;
+    }
+
+    TrilinearSampler sampler(&volume);
+
+    // Samples along rays with random starting points and directions, half a voxel apart, like the ray caster's.
+    // The nearest-voxel lookups do not clamp below zero, so the rays stay inside the volume.
+    const int samplesPerRay = 256;
+    const float dimensions[3] = { (float)volume.getWidth(), (float)volume.getHeight(), (float)volume.getDepth() };
+
+    std::vector<float> xs(sampleCount), ys(sampleCount), zs(sampleCount);
+    float position[3], step[3];
+    for (int i = 0 ; i < sampleCount ; i++) {
+        if (i % samplesPerRay == 0) {
+            for (int c = 0 ; c < 3 ; c++) {
+                position[c] = (float)rand() / RAND_MAX * (dimensions[c] - 1);
+                step[c] = (float)rand() / RAND_MAX - 0.5f;
+            }
+        }
+
+        xs[i] = position[0];
+        ys[i] = position[1];
+        zs[i] = position[2];
+
+        for (int c = 0 ; c < 3 ; c++) {
+            position[c] += step[c];
+
+            // Reflect at the borders, so that the rays stay in the volume
+            if (position[c] < 0 || position[c] > dimensions[c] - 1) {
+                step[c] = -step[c];
+                position[c] += 2 * step[c];
+            }
+        }
+    }
+
+    // The sums keep the compiler from removing the loops, and are compared between the indexings
+    QElapsedTimer timer;
+    double sums[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    double times[8];
+
+    timer.start();
+    for (int i = 0 ; i < sampleCount ; i++) {
+        sums[0] += volume.getVoxelClosest(xs[i], ys[i], zs[i]);
+    }
+    times[0] = nanosecondsPerSample(timer, sampleCount);
+
+    timer.start();
+    for (int i = 0 ; i < sampleCount ; i++) {
+        sums[1] += closest32(volume, xs[i], ys[i], zs[i]);
+    }
+    times[1] = nanosecondsPerSample(timer, sampleCount);
+
+    timer.start();
+    for (int i = 0 ; i < sampleCount ; i++) {
+        sums[2] += sampler.value(Vec3f(xs[i], ys[i], zs[i]));
+    }
+    times[2] = nanosecondsPerSample(timer, sampleCount);
+
+    timer.start();
+    for (int i = 0 ; i < sampleCount ; i++) {
+        sums[3] += trilinear32(volume, xs[i], ys[i], zs[i]);
+    }
+    times[3] = nanosecondsPerSample(timer, sampleCount);
+
+    std::vector<float> batch(sampleCount);
+    timer.start();
+    volume.sampleTrilinear(&xs[0], &ys[0], &zs[0], &batch[0], sampleCount);
+    times[4] = nanosecondsPerSample(timer, sampleCount);
+    for (int i = 0 ; i < sampleCount ; i++) {
+        sums[4] += batch[i];
+    }
+
+    timer.start();
+    for (int i = 0 ; i < sampleCount ; i++) {
+        float value, magnitude;
+        Vec3f gradient;
+        sampler.sample(Vec3f(xs[i], ys[i], zs[i]), value, gradient, magnitude);
+        sums[5] += value + gradient.x() + gradient.y() + gradient.z() + magnitude;
+    }
+    times[5] = nanosecondsPerSample(timer, sampleCount);
+
+    // Largest difference of individual samples
+    float maximumDifference = 0;
+    for (int i = 0 ; i < std::min(sampleCount, 100000) ; i++) {
+        const float reference = trilinear32(volume, xs[i], ys[i], zs[i]);
+        maximumDifference = std::max(maximumDifference, std::fabs(sampler.value(Vec3f(xs[i], ys[i], zs[i])) - reference));
+        maximumDifference = std::max(maximumDifference, std::fabs(batch[i] - reference));
+        maximumDifference = std::max(maximumDifference, std::fabs(volume.getVoxelClosest(xs[i], ys[i], zs[i]) -
+                                                                  closest32(volume, xs[i], ys[i], zs[i])));
+    }
+
+    std::cout << sampleCount << " samples of a " << volume.getWidth() << "x" << volume.getHeight() << "x"
+              << volume.getDepth() << " volume, in nanoseconds per sample:" << std::endl;
+    std::cout << "  Nearest voxel:          64-bit " << times[0] << ", 32-bit " << times[1] << std::endl;
+    std::cout << "  Trilinear value:        64-bit " << times[2] << " (TrilinearSampler), " << times[4]
+              << " (Volume::sampleTrilinear), 32-bit " << times[3] << std::endl;
+    std::cout << "  Value and gradients:    64-bit " << times[5] << " (TrilinearSampler::sample)" << std::endl;
+    std::cout << "Sums: " << sums[0] << " / " << sums[1] << ", " << sums[2] << " / " << sums[4] << " / " << sums[3]
+              << ", " << sums[5] << std::endl;
+    std::cout << "Largest difference of a sample: " << maximumDifference << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include <QElapsedTimer>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include "TrilinearSampler.h"
+#include "Volume.h"
+
+/*
+ * Times the trilinear sampling functions of Volume against TrilinearSampler, at positions along random rays through
+ * the volume (with a margin outside it, to exercise the clamping), and checks that both give the same results.
+ *
+ * Usage: trilinear_benchmark [volume file] [number of samples]
+ */
+
+/// Nanoseconds per sample from the elapsed time of a timer
+static double nanosecondsPerSample(const QElapsedTimer &timer, int samples) {
+    return timer.nsecsElapsed() / (double)samples;
+}
+
+int main(int argc, char *argv[])
+{
+    const std::string filename = (argc > 1) ? argv[1] : "../../lobster.dat";
+    const int sampleCount = (argc > 2) ? atoi(argv[2]) : 4000000;
+
+    Volume volume(filename);
+    if (volume.getVoxelNum() == 0) {
+        std::cout << "Could not load " << filename << std::endl;
+        return 1;
+    }
+
+    TrilinearSampler sampler(&volume);
+
+    // Samples along rays with random starting points and directions, half a voxel apart, like the ray caster's
+    const int samplesPerRay = 256;
+    const float dimensions[3] = { (float)volume.getWidth(), (float)volume.getHeight(), (float)volume.getDepth() };
+
+    std::vector<float> positions(sampleCount * 3);
+    float position[3], step[3];
+    for (int i = 0 ; i < sampleCount ; i++) {
+        if (i % samplesPerRay == 0) {
+            for (int c = 0 ; c < 3 ; c++) {
+                position[c] = (float)rand() / RAND_MAX * (dimensions[c] + 2) - 1;
+                step[c] = (float)rand() / RAND_MAX - 0.5f;
+            }
+        }
+
+        for (int c = 0 ; c < 3 ; c++) {
+            positions[i*3 + c] = position[c];
+            position[c] += step[c];
+
+            // Reflect at the borders, so that the rays stay in and around the volume
+            if (position[c] < -1 || position[c] > dimensions[c] + 1) {
+                step[c] = -step[c];
+            }
+        }
+    }
+
+    // The sums keep the compiler from removing the loops, and are compared between the implementations
+    QElapsedTimer timer;
+    double valueSum = 0, gradientSum = 0, magnitudeSum = 0;
+
+    timer.start();
+    for (int i = 0 ; i < sampleCount ; i++) {
+        valueSum += volume.getVoxelTrilinear(positions[i*3], positions[i*3 + 1], positions[i*3 + 2]);
+    }
+    double volumeValueTime = nanosecondsPerSample(timer, sampleCount);
+
+    timer.start();
+    for (int i = 0 ; i < sampleCount ; i++) {
+        Vector3d gradient = volume.getGradientTrilinear(positions[i*3], positions[i*3 + 1], positions[i*3 + 2]);
+        gradientSum += gradient.GetX() + gradient.GetY() + gradient.GetZ();
+        magnitudeSum += volume.getGradientMagnitudeTrilinear(positions[i*3], positions[i*3 + 1], positions[i*3 + 2]);
+    }
+    double volumeGradientTime = nanosecondsPerSample(timer, sampleCount);
+
+    double samplerValueSum = 0, samplerGradientSum = 0, samplerMagnitudeSum = 0;
+
+    timer.start();
+    for (int i = 0 ; i < sampleCount ; i++) {
+        samplerValueSum += sampler.value(Vec3f(positions[i*3], positions[i*3 + 1], positions[i*3 + 2]));
+    }
+    double samplerValueTime = nanosecondsPerSample(timer, sampleCount);
+
+    timer.start();
+    for (int i = 0 ; i < sampleCount ; i++) {
+        Vec3f position(positions[i*3], positions[i*3 + 1], positions[i*3 + 2]);
+        Vec3f gradient = sampler.gradient(position);
+        samplerGradientSum += gradient.x() + gradient.y() + gradient.z();
+        samplerMagnitudeSum += sampler.gradientMagnitude(position);
+    }
+    double samplerGradientTime = nanosecondsPerSample(timer, sampleCount);
+
+    double fusedSum = 0;
+
+    timer.start();
+    for (int i = 0 ; i < sampleCount ; i++) {
+        float value, magnitude;
+        Vec3f gradient;
+        sampler.sample(Vec3f(positions[i*3], positions[i*3 + 1], positions[i*3 + 2]), value, gradient, magnitude);
+        fusedSum += value + gradient.x() + gradient.y() + gradient.z() + magnitude;
+    }
+    double fusedTime = nanosecondsPerSample(timer, sampleCount);
+
+    // Largest difference of individual samples
+    float maximumDifference = 0;
+    for (int i = 0 ; i < std::min(sampleCount, 100000) ; i++) {
+        const float x = positions[i*3], y = positions[i*3 + 1], z = positions[i*3 + 2];
+        Vec3f position(x, y, z);
+        Vec3f gradient = sampler.gradient(position);
+        Vector3d reference = volume.getGradientTrilinear(x, y, z);
+
+        maximumDifference = std::max(maximumDifference, std::fabs(volume.getVoxelTrilinear(x, y, z) - sampler.value(position)));
+        maximumDifference = std::max(maximumDifference, std::fabs((float)volume.getGradientMagnitudeTrilinear(x, y, z) - sampler.gradientMagnitude(position)));
+        for (int c = 0 ; c < 3 ; c++) {
+            maximumDifference = std::max(maximumDifference, std::fabs((float)reference[c] - gradient[c]));
+        }
+    }
+
+    std::cout << sampleCount << " samples of a " << volume.getWidth() << "x" << volume.getHeight() << "x"
+              << volume.getDepth() << " volume, in nanoseconds per sample:" << std::endl;
+    std::cout << "  Value:                  Volume " << volumeValueTime << ", TrilinearSampler " << samplerValueTime << std::endl;
+    std::cout << "  Gradient and magnitude: Volume " << volumeGradientTime << ", TrilinearSampler " << samplerGradientTime << std::endl;
+    std::cout << "  All three:              Volume " << volumeValueTime + volumeGradientTime
+              << ", TrilinearSampler " << samplerValueTime + samplerGradientTime << ", fused " << fusedTime << std::endl;
+    std::cout << "Sums: " << valueSum + gradientSum + magnitudeSum << " / " << samplerValueSum + samplerGradientSum + samplerMagnitudeSum
+              << " / " << fusedSum << std::endl;
+    std::cout << "Largest difference of a sample: " << maximumDifference << std::endl;
+
+    return 0;
+}
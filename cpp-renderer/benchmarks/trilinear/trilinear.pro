@@ -0,0 +1,17 @@
+#-------------------------------------------------
+#
+# Microbenchmark of the trilinear samplers
+#
+#-------------------------------------------------
+
+QT += core
+QT -= gui
+
+TARGET = trilinear_benchmark
+CONFIG += console
+CONFIG -= app_bundle
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+SOURCES += main.cpp
@@ -11,6 +11,16 @@
 #include <stdio.h>
 #include "Volume.h"
 #include "ViewPlane.h"
+#include "VoxelTraversal.h"
+#include "FourierSliceRenderer.h"
+#include "ShearWarpRenderer.h"
+#include "SplatRenderer.h"
+#include "IsosurfaceRenderer.h"
+#include "IlluminationVolume.h"
+#include "ShadingContext.h"
+#include "TrilinearSampler.h"
+#include "VolumePyramid.h"
+#include "OutOfCoreVolume.h"
 
 #include <vector>
 
@@ -41,12 +51,21 @@ public:
         selectedRotationResolutionY = 16;
 
         selectedRenderingMode = 0;
+        selectedRenderingEngine = 0;
         selectedProjectionMode = 0;
         selectedInterpolationMode = 0;
         selectedTransferFunctionMode = 0;
         selectedShadingMode = 0;
         selectedFirstHitValue = 0;
         selectedGradientInterpolationMode = 0;
+        selectedLevelOfDetail = 0;
+
+        isRotating = false;
+        renderingLevel = 0;
+        levelVolume = NULL;
+        outOfCore = NULL;
+        streamingFrame = false;
+        emptySpace = NULL;
 
         curMouseX = 0;
         curMouseY = 0;
@@ -78,16 +97,14 @@ public slots:
     /// Set the volume to be visualized
     void setVolume(Volume *v)
     {
-        if (volumeIsSet) {
-            // Dispose old volume
-            delete m_volume;
-        }
-
+        // The volume is owned by the main window, which may set the same volume again after replacing its data
         m_volume = v;
         volumeIsSet = true;
 
         viewPlane = ViewPlane(m_volume->getHeight(), m_volume->getDepth(), m_volume->getScalingFactor());
 
+        bindRenderers();
+
         // Get dataset histogram
         histogram = v->GetHistogram();
         tf_dialog.SetHistogram(histogram);
@@ -103,6 +120,21 @@ public slots:
         }
     }
 
+    /// Show another timestep of a time series, a volume of the same dimensions as the current one. Unlike
+    /// setVolume(), the view and the histogram of the transfer function editor are kept.
+    void setTimestep(Volume *v)
+    {
+        m_volume = v;
+        volumeIsSet = true;
+
+        bindRenderers();
+
+        if (this->isVisible())
+        {
+            updateGL();
+        }
+    }
+
     /// User has selected a new resolution for volume rendering
     void setRes(int resolution) {
         if (resolution == 0) {
@@ -146,6 +178,14 @@ public slots:
         updateGL();
     }
 
+    /// Select how the ray caster trades detail for speed (0 lowers the image resolution while rotating, 1 samples
+    /// a coarser level of the volume while rotating, 2 also samples coarser levels when zoomed out so far that a
+    /// pixel covers several voxels)
+    void setLevelOfDetail(int levelOfDetail) {
+        selectedLevelOfDetail = levelOfDetail;
+        updateGL();
+    }
+
     /// User has selected a new resolution for rotation rendering
     void setResRotating(int resolution) {
         if (resolution == 0) {
@@ -163,12 +203,19 @@ public slots:
         }
     }
 
-    /// Select rendering mode (first-hit, MIP, average, DVR)
+    /// Select rendering mode (first-hit, MIP, average, DVR, DVR by splatting)
     void setRenderingMode(int renderingMode) {
         selectedRenderingMode = renderingMode;
         updateGL();
     }
 
+    /// Select rendering engine (0 is ray casting, 1 is voxel traversal, 2 is Fourier slice, 3 is shear-warp,
+    /// 4 is isosurface mesh)
+    void setRenderingEngine(int renderingEngine) {
+        selectedRenderingEngine = renderingEngine;
+        updateGL();
+    }
+
     /// Select interpolation mode for voxel values
     void setInterpolationMode(int interpolationMode) {
         selectedInterpolationMode = interpolationMode;
@@ -181,7 +228,41 @@ public slots:
         updateGL();
     }
 
-    /// Select shading mode
+    /// Select how the volume provides gradients (0 is precomputed, 1 is on the fly, 2 is lazily computed bricks, 3
+    /// is sparse tiles of the non-empty space, which DVR also uses to skip the empty space)
+    void setGradientPolicy(int policy) {
+        if (!volumeIsSet) {
+            return;
+        }
+
+        m_volume->setGradientPolicy((Volume::GradientPolicy)policy);
+        updateGL();
+    }
+
+    /// Sample the voxels from a volume streamed from disk, of which the volume set with setVolume() is the coarse
+    /// copy; NULL (or a closed volume) to sample the volume itself. The shading still uses the gradients of the
+    /// coarse copy, and the other renderers only see the coarse copy.
+    void setOutOfCoreVolume(OutOfCoreVolume *volume) {
+        outOfCore = (volume != NULL && volume->isOpen()) ? volume : NULL;
+    }
+
+    /// The gradients and the histogram of the volume have been computed in the background; until now the
+    /// gradients were computed on the fly and the histogram was empty
+    void updateDerivedData() {
+        if (!volumeIsSet) {
+            return;
+        }
+
+        histogram = m_volume->GetHistogram();
+        tf_dialog.SetHistogram(histogram);
+
+        if (this->isVisible())
+        {
+            updateGL();
+        }
+    }
+
+    /// Select shading mode (0 is none, 1 is Phong, 2 is Phong with shadows)
     void setShading(int shadingMode) {
         selectedShadingMode = shadingMode;
         updateGL();
@@ -192,6 +273,121 @@ public slots:
         selectedProjectionMode = projectionMode;
     }
 
+    /// Render the current view with the selected engine and with the ray caster, and print the time taken by
+    /// each and the difference between the two images.
+    void compareWithRayCaster() {
+        if (!volumeIsSet) {
+            return;
+        }
+
+        const int pixelCount = renderingResolutionX * renderingResolutionY;
+        vector<unsigned char> engineImage(pixelCount * 3);
+        vector<unsigned char> rayCasterImage(pixelCount * 3);
+
+        QElapsedTimer timer;
+        timer.start();
+        renderImage(&engineImage[0]);
+        qint64 engineTime = timer.restart();
+
+        int engine = selectedRenderingEngine;
+        int renderingMode = selectedRenderingMode;
+        selectedRenderingEngine = 0;
+        selectedRenderingMode = (renderingMode == 4) ? 3 : renderingMode;
+        renderImage(&rayCasterImage[0]);
+        qint64 rayCasterTime = timer.elapsed();
+        selectedRenderingEngine = engine;
+        selectedRenderingMode = renderingMode;
+
+        double squaredError = 0;
+        int maximumError = 0;
+        for (int i = 0 ; i < pixelCount * 3 ; i++) {
+            int difference = abs((int)engineImage[i] - (int)rayCasterImage[i]);
+            squaredError += difference * difference;
+            maximumError = std::max(maximumError, difference);
+        }
+
+        std::cout << "Engine " << engine << ": " << engineTime << " ms, ray caster: " << rayCasterTime << " ms at "
+                  << renderingResolutionX << "x" << renderingResolutionY << ". RMS difference "
+                  << sqrt(squaredError / (pixelCount * 3)) << ", maximum difference " << maximumError
+                  << " (of 255)." << std::endl;
+    }
+
+    /// Time splatting against ray casting for DVR with transfer functions that leave decreasing fractions of the
+    /// voxels non-transparent, using parallel projection without shading, and print the results.
+    void benchmarkSplatting() {
+        if (!volumeIsSet) {
+            return;
+        }
+
+        const int levelCount = 6;
+        const double fractions[levelCount] = { 1.0, 0.5, 0.2, 0.1, 0.05, 0.01 };
+
+        // Estimate the intensity quantiles from a subsample of the voxels
+        long voxelCount = (long)m_volume->getWidth() * m_volume->getHeight() * m_volume->getDepth();
+        int stride = std::max(1L, voxelCount / 1000000);
+
+        vector<float> values;
+        long index = 0;
+        for (int z = 0 ; z < m_volume->getDepth() ; z++) {
+            for (int y = 0 ; y < m_volume->getHeight() ; y++) {
+                for (int x = 0 ; x < m_volume->getWidth() ; x++, index++) {
+                    if (index % stride == 0) {
+                        values.push_back(m_volume->getVoxel(x, y, z));
+                    }
+                }
+            }
+        }
+
+        TransferFunction *transferFunction = m_transferFunction;
+        int renderingMode = selectedRenderingMode;
+        int engine = selectedRenderingEngine;
+        int projectionMode = selectedProjectionMode;
+        int shadingMode = selectedShadingMode;
+
+        selectedRenderingEngine = 0;
+        selectedProjectionMode = 0;
+        selectedShadingMode = 0;
+
+        vector<unsigned char> image(renderingResolutionX * renderingResolutionY * 3);
+        QElapsedTimer timer;
+
+        std::cout << "Splatting benchmark at " << renderingResolutionX << "x" << renderingResolutionY << ":" << std::endl;
+
+        for (int level = 0 ; level < levelCount ; level++) {
+            // Transparent below the threshold, then a gray ramp up to full opacity
+            int rank = std::min((int)((1 - fractions[level]) * values.size()), (int)values.size() - 1);
+            std::nth_element(values.begin(), values.begin() + rank, values.end());
+            double threshold = (fractions[level] >= 1.0) ? 0.0 : values[rank];
+
+            TransferFunction levelFunction;
+            if (threshold > 0 && threshold < 1) {
+                levelFunction.AddSample(threshold, threshold, threshold, threshold, 0.0);
+            }
+            m_transferFunction = &levelFunction;
+
+            selectedRenderingMode = 4;
+            timer.start();
+            renderImage(&image[0]); // Includes the extraction of the non-transparent voxels
+            qint64 extractionTime = timer.restart();
+            renderImage(&image[0]);
+            qint64 splattingTime = timer.restart();
+
+            selectedRenderingMode = 3;
+            renderImage(&image[0]);
+            qint64 rayCastingTime = timer.elapsed();
+
+            std::cout << "  " << 100.0 * splatRenderer.getSplatCount() / voxelCount << "% non-transparent: splatting "
+                      << splattingTime << " ms (first frame " << extractionTime << " ms), ray casting "
+                      << rayCastingTime << " ms." << std::endl;
+        }
+
+        m_transferFunction = transferFunction;
+        selectedRenderingMode = renderingMode;
+        selectedRenderingEngine = engine;
+        selectedProjectionMode = projectionMode;
+        selectedShadingMode = shadingMode;
+    }
+
     void openWindowingDialog() {
         std::cout << "Debug: creating transfer function widget" << std::endl;
 
@@ -253,32 +449,7 @@ protected:
             // Generate texture based on our dimension and slice selection
             textureBuffer = new unsigned char[texture_x*texture_y*3];
 
-            int i = 0;
-            for (int x = 0 ; x < texture_x ; x++) {
-                for (int y = 0 ; y < texture_y ; y++) {
-
-                    Vector3d pixelColor = castRay(x, y, selectedProjectionMode, selectedRenderingMode, selectedInterpolationMode);
-
-
-                    textureBuffer[(y * texture_x + x)*3 + 0] = (unsigned char)(pixelColor.GetX()*255);
-                    textureBuffer[(y * texture_x + x)*3 + 1] = (unsigned char)(pixelColor.GetY()*255);
-                    textureBuffer[(y * texture_x + x)*3 + 2] = (unsigned char)(pixelColor.GetZ()*255);
-
-
-                    /*
-                     // TODO: Funky addressing. I think mine might be wrong and this might be correct.
-                    textureBuffer[i*3 + 0] = (unsigned char)(pixelColor.GetX()*255);
-                    textureBuffer[i*3 + 1] = (unsigned char)(pixelColor.GetY()*255);
-                    textureBuffer[i*3 + 2] = (unsigned char)(pixelColor.GetZ()*255);
-                    */
-
-/*
-                    std::cout << "Color: " << (unsigned int)(pixelColor.GetX()*255) << ", " << (unsigned int)(pixelColor.GetY()*255) << ", " << (unsigned int)(pixelColor.GetZ()*255) << std::endl;
-                    std::cout << "Texbf: " << textureBuffer[i*3 + 0] << ", " << textureBuffer[i*3 + 1] << ", " << textureBuffer[i*3 + 2] << std::endl;
-*/
-                    i++;
-                }
-            }
+            renderImage(textureBuffer);
 
             // std::cout << "Finished filling texture buffer." << std::endl;
 
@@ -335,8 +506,13 @@ protected:
         curMouseX = event->x();
         curMouseY = event->y();
 
-        renderingResolutionX = selectedRotationResolutionX;
-        renderingResolutionY = selectedRotationResolutionY;
+        isRotating = true;
+
+        // With level of detail, the image keeps its resolution and the ray caster samples a coarser volume instead
+        if (selectedLevelOfDetail == 0) {
+            renderingResolutionX = selectedRotationResolutionX;
+            renderingResolutionY = selectedRotationResolutionY;
+        }
     }
 
     /// Called when the mouse moves
@@ -365,6 +541,8 @@ protected:
     /// Called when a mouse button is released
     void mouseReleaseEvent(QMouseEvent *event)
     {
+        isRotating = false;
+
         renderingResolutionX = selectedRenderingResolutionX;
         renderingResolutionY = selectedRenderingResolutionY;
 
@@ -385,19 +563,314 @@ protected:
         updateGL();
     }
 
+    /// Render the current view into an RGB buffer of renderingResolutionX*renderingResolutionY pixels, using the
+    /// selected rendering engine. Engines that do not support the current settings fall back to ray casting.
+    void renderImage(unsigned char* textureBuffer) {
+        const int texture_x = renderingResolutionX;
+        const int texture_y = renderingResolutionY;
+
+        beginShading();
+
+        // Fourier slice rendering computes the whole X-ray image at once, for parallel projection only, and for
+        // volumes whose spectrum fits in its memory budget
+        if (selectedRenderingEngine == 2 && selectedRenderingMode == 2 && selectedProjectionMode == 0 &&
+            fourierSliceRenderer.canRender()) {
+            float origin[3], pixelRight[3], pixelUp[3], direction[3];
+            getVoxelSpaceView(origin, pixelRight, pixelUp, direction);
+
+            vector<float> luminosity(texture_x*texture_y);
+            fourierSliceRenderer.renderAverage(origin, pixelRight, pixelUp, direction, &luminosity[0], texture_x, texture_y);
+
+            for (int i = 0 ; i < texture_x*texture_y ; i++) {
+                // Rays missing the volume get the same background as in castRay()
+                Vector3d pixelColor = (luminosity[i] < 0) ? Vector3d(0.3,0.3,0.3) : m_transferFunction->GetColor(luminosity[i]);
+
+                textureBuffer[i*3 + 0] = (unsigned char)(pixelColor.GetX()*255);
+                textureBuffer[i*3 + 1] = (unsigned char)(pixelColor.GetY()*255);
+                textureBuffer[i*3 + 2] = (unsigned char)(pixelColor.GetZ()*255);
+            }
+            return;
+        }
+
+        // Shear-warp composites the whole DVR image in object order, for parallel projection without shading
+        if (selectedRenderingEngine == 3 && selectedRenderingMode == 3 && selectedProjectionMode == 0 && selectedShadingMode == 0) {
+            float origin[3], pixelRight[3], pixelUp[3], direction[3];
+            getVoxelSpaceView(origin, pixelRight, pixelUp, direction);
+
+            vector<float> image(texture_x*texture_y*3);
+            shearWarpRenderer.renderDvr(origin, pixelRight, pixelUp, direction, m_transferFunction, selectedTransferFunctionMode,
+                                        stepSize * m_volume->getScalingFactor(), &image[0], texture_x, texture_y);
+
+            for (int i = 0 ; i < texture_x*texture_y*3 ; i++) {
+                textureBuffer[i] = (unsigned char)(image[i]*255);
+            }
+            return;
+        }
+
+        // The isosurface mesh is extracted once per threshold and rasterized, for first-hit with parallel projection
+        if (selectedRenderingEngine == 4 && selectedRenderingMode == 0 && selectedProjectionMode == 0) {
+            float origin[3], pixelRight[3], pixelUp[3], direction[3];
+            getVoxelSpaceView(origin, pixelRight, pixelUp, direction);
+
+            vector<unsigned char> status(texture_x*texture_y);
+            vector<float> normals(texture_x*texture_y*3);
+            isosurfaceRenderer.render(selectedFirstHitValue/100.0, origin, pixelRight, pixelUp, direction,
+                                      &status[0], &normals[0], texture_x, texture_y);
+
+            // Shade all hits in one batch, the same way castRay() shades a first hit
+            vector<int> hits;
+            for (int i = 0 ; i < texture_x*texture_y ; i++) {
+                if (status[i] == IsosurfaceRenderer::HITS_SURFACE) {
+                    hits.push_back(i);
+                }
+            }
+
+            const int hitCount = hits.size();
+            vector<float> shaded(std::max(hitCount, 1) * 4, 1.0f); // Normal components, then base color (white)
+            float *nx = &shaded[0];
+            float *ny = nx + hitCount;
+            float *nz = ny + hitCount;
+            float *white = nz + hitCount;
+
+            if (selectedShadingMode >= 1 && hitCount > 0) {
+                for (int n = 0 ; n < hitCount ; n++) {
+                    nx[n] = normals[hits[n]*3 + 0];
+                    ny[n] = normals[hits[n]*3 + 1];
+                    nz[n] = normals[hits[n]*3 + 2];
+                }
+
+                // The results overwrite the normals
+                firstHitShading.shadeBatch(nx, ny, nz, white, white, white, nx, ny, nz, hitCount);
+            }
+
+            for (int i = 0, n = 0 ; i < texture_x*texture_y ; i++) {
+                Vector3d pixelColor;
+
+                if (status[i] != IsosurfaceRenderer::HITS_SURFACE) {
+                    // Rays missing the surface get the same background as in castRay()
+                    pixelColor = Vector3d(0.3,0.3,0.3);
+                } else if (selectedShadingMode >= 1) {
+                    pixelColor = Vector3d(nx[n], ny[n], nz[n]);
+                    n++;
+                } else {
+                    pixelColor = m_transferFunction->GetColor(selectedFirstHitValue/100.0);
+                }
+
+                textureBuffer[i*3 + 0] = (unsigned char)(pixelColor.GetX()*255);
+                textureBuffer[i*3 + 1] = (unsigned char)(pixelColor.GetY()*255);
+                textureBuffer[i*3 + 2] = (unsigned char)(pixelColor.GetZ()*255);
+            }
+            return;
+        }
+
+        // Splatting composites only the non-transparent voxels, for parallel projection without shading
+        if (selectedRenderingMode == 4 && selectedProjectionMode == 0 && selectedShadingMode == 0) {
+            float origin[3], pixelRight[3], pixelUp[3], direction[3];
+            getVoxelSpaceView(origin, pixelRight, pixelUp, direction);
+
+            vector<float> image(texture_x*texture_y*3);
+            splatRenderer.renderDvr(origin, pixelRight, pixelUp, direction, m_transferFunction, selectedTransferFunctionMode,
+                                    stepSize * m_volume->getScalingFactor(), &image[0], texture_x, texture_y);
+
+            for (int i = 0 ; i < texture_x*texture_y*3 ; i++) {
+                textureBuffer[i] = (unsigned char)(image[i]*255);
+            }
+            return;
+        }
+
+        // Settings the splatting renderer does not support are ray cast as regular DVR
+        const int renderingMode = (selectedRenderingMode == 4) ? 3 : selectedRenderingMode;
+
+        if (renderingMode == 3 && selectedShadingMode == 2) {
+            updateIllumination();
+        }
+
+        selectRenderingLevel();
+
+        // The full resolution of a streamed volume is sampled at level 0; coarser levels come from the coarse copy
+        streamingFrame = (outOfCore != NULL && renderingLevel == 0);
+        if (streamingFrame) {
+            outOfCore->beginFrame();
+        }
+
+        // DVR may skip the empty space of a sparse volume while the transfer function makes it fully transparent
+        const SparseTileTree *tiles = m_volume->getSparseTiles();
+        emptySpace = (tiles != NULL && renderingMode == 3 && renderingLevel == 0 && !streamingFrame &&
+                      m_transferFunction->GetMaximumAlpha(m_volume->getBackgroundThreshold()) == 0) ? tiles : NULL;
+
+        for (int x = 0 ; x < texture_x ; x++) {
+            for (int y = 0 ; y < texture_y ; y++) {
+
+                Vector3d pixelColor = castRay(x, y, selectedProjectionMode, renderingMode, selectedInterpolationMode);
+
+                textureBuffer[(y * texture_x + x)*3 + 0] = (unsigned char)(pixelColor.GetX()*255);
+                textureBuffer[(y * texture_x + x)*3 + 1] = (unsigned char)(pixelColor.GetY()*255);
+                textureBuffer[(y * texture_x + x)*3 + 2] = (unsigned char)(pixelColor.GetZ()*255);
+            }
+        }
+
+        if (streamingFrame) {
+            outOfCore->endFrame();
+        }
+    }
+
+    /// Express the parallel projection of the view plane in voxel coordinates: the starting position of the ray of
+    /// pixel (0,0), the offsets between neighbouring pixels in x and y, and the normalized projection direction.
+    /// Matches the ray setup in castRay().
+    void getVoxelSpaceView(float origin[3], float pixelRight[3], float pixelUp[3], float direction[3]) {
+        float scalingFactor = m_volume->getScalingFactor();
+
+        Vector3d lowerLeft = *viewPlane.getLowerLeft() * scalingFactor;
+        Vector3d right = viewPlane.rightVector() * (scalingFactor / renderingResolutionX);
+        Vector3d up = viewPlane.upVector() * (scalingFactor / renderingResolutionY);
+        Vector3d projection = viewPlane.projectionVector();
+
+        for (int i = 0 ; i < 3 ; i++) {
+            origin[i] = lowerLeft[i];
+            pixelRight[i] = right[i];
+            pixelUp[i] = up[i];
+            direction[i] = projection[i];
+        }
+    }
+
+    /// Choose the level of the volume pyramid that the ray caster samples in this frame, and point the sampler at it
+    void selectRenderingLevel() {
+        int level = 0;
+
+        if (selectedLevelOfDetail == 2) {
+            // Mipmapping: the level whose voxels are as large as a pixel
+            float pixelSize = viewPlane.rightVector().GetMagnitude() * m_volume->getScalingFactor() / renderingResolutionX;
+            while (pixelSize >= 2.0f) {
+                pixelSize *= 0.5f;
+                level++;
+            }
+        }
+
+        if (selectedLevelOfDetail >= 1 && isRotating) {
+            level += ROTATION_LEVELS;
+        }
+
+        level = std::min(level, pyramid.levelCount() - 1);
+
+        renderingLevel = level;
+        levelVolume = pyramid.level(level);
+        sampler.setVolume(levelVolume);
+    }
+
+    /// Point the renderers at m_volume, dropping what they derived from the previous volume. Each derives it again
+    /// when it first renders the new volume, so playing a time series costs nothing for the engines not in use.
+    void bindRenderers() {
+        fourierSliceRenderer.setVolume(m_volume);
+        shearWarpRenderer.setVolume(m_volume);
+        splatRenderer.setVolume(m_volume);
+        isosurfaceRenderer.setVolume(m_volume);
+        illuminationVolume.setVolume(m_volume);
+        sampler.setVolume(m_volume);
+        pyramid.setVolume(m_volume);
+
+        renderingLevel = 0;
+        levelVolume = m_volume;
+    }
+
+    /// Convert a position in voxel coordinates of the volume to voxel coordinates of the rendering level
+    Vec3f toRenderingLevel(const float position[3]) const {
+        const float scale = 1.0f / (1 << renderingLevel);
+        return Vec3f((position[0] + 0.5f) * scale - 0.5f, (position[1] + 0.5f) * scale - 0.5f, (position[2] + 0.5f) * scale - 0.5f);
+    }
+
+    /// Set up the shading of the current frame: the light and eye directions only change with the view
+    void beginShading() {
+        Vector3d L = viewPlane.getLightVector(); // Vector pointing towards light source
+        Vector3d normalizedEyeDirection = -viewPlane.projectionVector();
+        normalizedEyeDirection.normalize();
+
+        firstHitShading.begin(L, normalizedEyeDirection, 1.3, 5, 1.7);
+        dvrShading.begin(L, normalizedEyeDirection, 7, 8, 1.7);
+    }
+
+    /// Bring the illumination volume up to date with the transfer function and the light, which travels along
+    /// the negated light vector used for Phong shading.
+    void updateIllumination() {
+        Vector3d L = viewPlane.getLightVector();
+        L.normalize();
+
+        float lightDirection[3] = { (float)-L.GetX(), (float)-L.GetY(), (float)-L.GetZ() };
+        illuminationVolume.update(m_transferFunction, selectedTransferFunctionMode, lightDirection,
+                                  stepSize * m_volume->getScalingFactor());
+    }
+
     /// Convenience function to perform volumetric interpolation against the selected volume
     /// data using the selected interpolation mode.
     float interpolateVoxel(float x, float y, float z, int interpolationMode) {
+        if (streamingFrame) {
+            const float stride = (float)outOfCore->getCoarseStride();
+            if (interpolationMode == 0) {
+                return outOfCore->getVoxelClosest(x * stride, y * stride, z * stride);
+            } else {
+                return outOfCore->getVoxelTrilinear(x * stride, y * stride, z * stride);
+            }
+        }
+
         if (interpolationMode == 0) {
-            return m_volume->getVoxelClosest(x, y, z);
+            return levelVolume->getVoxelClosest(x, y, z);
         } else if (interpolationMode == 1) {
-            return m_volume->getVoxelTrilinear(x, y, z);
+            return levelVolume->getVoxelTrilinear(x, y, z);
         } else {
             // Should never happen, crash
             throw -1;
         }
     }
 
+    /// As above, for a position in voxel coordinates given as a single precision vector
+    float interpolateVoxel(const Vec3f &position, int interpolationMode) {
+        if (streamingFrame) {
+            return interpolateVoxel(position.x(), position.y(), position.z(), interpolationMode);
+        }
+
+        if (interpolationMode == 0) {
+            return levelVolume->getVoxelClosest(position.x(), position.y(), position.z());
+        } else if (interpolationMode == 1) {
+            return sampler.value(position);
+        } else {
+            // Should never happen, crash
+            throw -1;
+        }
+    }
+
+    /// Take up to RAY_BATCH_SIZE samples along a ray, continuing while increment * stepLength < rayLength like the
+    /// sampling loops of castRay(). Advances position and increment past the samples taken, writes their values to
+    /// values and returns their number. Trilinear samples are interpolated together, with Volume::sampleTrilinear().
+    int sampleAlongRay(Vec3f &position, const Vec3f &step, double stepLength, int &increment, double rayLength,
+                       float *values, int interpolationMode) {
+        float xs[RAY_BATCH_SIZE];
+        float ys[RAY_BATCH_SIZE];
+        float zs[RAY_BATCH_SIZE];
+
+        int count = 0;
+        while (count < RAY_BATCH_SIZE && increment * stepLength < rayLength) {
+            float coordinates[3];
+            position.store(coordinates);
+
+            xs[count] = coordinates[0];
+            ys[count] = coordinates[1];
+            zs[count] = coordinates[2];
+
+            position += step;
+            increment++;
+            count++;
+        }
+
+        if (interpolationMode == 1 && !streamingFrame) {
+            levelVolume->sampleTrilinear(xs, ys, zs, values, count);
+        } else {
+            for (int i = 0 ; i < count ; i++) {
+                values[i] = interpolateVoxel(xs[i], ys[i], zs[i], interpolationMode);
+            }
+        }
+
+        return count;
+    }
+
     /// Casts a ray into the volume, returning the pixel color resulting from the operation.
     /// projectionMode: 0 means parallel, 1 means perspective. All other values are undefined.
     /// renderingMode: 0 means first-hit, 1 means M.I.P, 2 means average, 3 means D.V.R.
@@ -417,14 +890,10 @@ protected:
             //std::cout << "Raycasting projection vector: " << projectionVector.GetX() << "," << projectionVector.GetY() << "," << projectionVector.GetZ() << std::endl;
 
             // Start position for this ray cast is defined by lower left corner of the view plane and the x and y pixel selected for rendering
-            Vector3d startingPosition(*viewPlane.getLowerLeft());
-            startingPosition += (viewPlane.upVector()*y/RESOLUTION_Y);
-            startingPosition += (viewPlane.rightVector()*x/RESOLUTION_X);
+            Vector3d startingPosition = viewPlane.getRayStart((float)x/RESOLUTION_X, (float)y/RESOLUTION_Y).toVector3d();
 
             int increment = 0; // How far the vector has moved
 
-            Vector3d rayPosition; // Current position of the ray
-
             // Get factor to scale the volume by, this approach simplifies our vector math
             float scalingFactor = m_volume->getScalingFactor();
 
@@ -443,10 +912,6 @@ protected:
 
             if (!rayIntersectsVolume) {
                 return Vector3d(0.3,0.3,0.3);
-            } else {
-                rayPosition.SetX((double)*inX);
-                rayPosition.SetY((double)*inY);
-                rayPosition.SetZ((double)*inZ);
             }
 
             // Calculate the length that the view ray needs to travel before going through the volume
@@ -456,36 +921,68 @@ protected:
             // Suggestion from Helwig: Introduce jitter to smooth out artifacts due to
             rayLength -= (float)rand()/(float)RAND_MAX * stepSize;
 
+            // Entry and exit points in voxel coordinates, used by the voxel traversal engine
+            float voxelEntry[3] = { *inX * scalingFactor, *inY * scalingFactor, *inZ * scalingFactor };
+            float voxelExit[3] = { *outX * scalingFactor, *outY * scalingFactor, *outZ * scalingFactor };
+
             delete inX;
             delete inY;
             delete inZ;
 
-            if (selectedRenderingMode != 3) { // When doing DVR, we need to keep these values around a while longer
+            if (renderingMode != 3) { // When doing DVR, we need to keep these values around a while longer
                 delete outX;
                 delete outY;
                 delete outZ;
             }
 
+            // Current position of the ray. The sampling loops step in voxel coordinates of the rendering level, in
+            // single precision. A step spans the same number of voxels at every level, so the samples of coarser
+            // levels are further apart in the volume.
+            Vec3f samplePosition = toRenderingLevel(voxelEntry);
+            const Vec3f sampleStep = Vec3f(projectionVector) * (stepSize * scalingFactor);
+            const double levelStepSize = stepSize * (1 << renderingLevel);
+            const float levelGradientScale = 1.0f / (1 << renderingLevel); // Gradients of the level per voxel of the volume
+
+            if (streamingFrame) {
+                // Request the bricks of the full resolution in the order they will be sampled: back to front in DVR
+                const float stride = (float)outOfCore->getCoarseStride();
+                const float entry[3] = { voxelEntry[0] * stride, voxelEntry[1] * stride, voxelEntry[2] * stride };
+                const float exit[3] = { voxelExit[0] * stride, voxelExit[1] * stride, voxelExit[2] * stride };
+
+                if (renderingMode == 3) {
+                    outOfCore->prefetchRay(exit, entry);
+                } else {
+                    outOfCore->prefetchRay(entry, exit);
+                }
+            }
 
 
+            // The voxel traversal engine visits each cell along the ray exactly once and integrates it analytically,
+            // so M.I.P and average do not depend on the step size.
+            if (selectedRenderingEngine == 1 && (renderingMode == 1 || renderingMode == 2)) {
+                VoxelTraversal traversal(*m_volume);
+
+                if (renderingMode == 1) {
+                    return m_transferFunction->GetColor(traversal.maximumIntensity(voxelEntry, voxelExit, interpolationMode));
+                } else {
+                    return m_transferFunction->GetColor(traversal.averageIntensity(voxelEntry, voxelExit, interpolationMode));
+                }
+            }
+
             if (renderingMode == 0) { // First hit
                 float firstHitValue = 0;
 
-                double rayX;
-                double rayY;
-                double rayZ;
+                Vec3f hitPosition = samplePosition;
 
                 // Ray moves until it hits a sample brighter than the threshold value
-                while (firstHitValue <= selectedFirstHitValue/100.0 && increment * stepSize < rayLength) {
+                while (firstHitValue <= selectedFirstHitValue/100.0 && increment * levelStepSize < rayLength) {
 
-                    rayX = rayPosition.GetX();
-                    rayY = rayPosition.GetY();
-                    rayZ = rayPosition.GetZ();
+                    hitPosition = samplePosition;
 
                     // Get the voxel color by the chosen interpolation method
-                    firstHitValue = interpolateVoxel(rayX*scalingFactor, rayY*scalingFactor, rayZ*scalingFactor, interpolationMode);
+                    firstHitValue = interpolateVoxel(samplePosition, interpolationMode);
 
-                    rayPosition += projectionVector * stepSize;
+                    samplePosition += sampleStep;
                     increment++;
 
                 }
@@ -493,22 +990,18 @@ protected:
                 // return m_transferFunction->GetColor(firstHitValue);
 
 
-                if (selectedShadingMode == 1) { // Phong shading
-                    Vector3d L = viewPlane.getLightVector(); // Vector pointing towards light source
+                if (selectedShadingMode >= 1) { // Phong shading (shadows are only cast in DVR)
                     Vector3d g_n;
 
                     if (selectedGradientInterpolationMode == 0) {
-                        g_n = -m_volume->getGradient((float)rayX*scalingFactor, (float)rayY*scalingFactor, (float)rayZ*scalingFactor);
+                        g_n = -levelVolume->getGradient(hitPosition.x(), hitPosition.y(), hitPosition.z()) * levelGradientScale;
                     } else if (selectedGradientInterpolationMode == 1) {
-                        g_n = -m_volume->getGradientTrilinear((float)rayX*scalingFactor, (float)rayY*scalingFactor, (float)rayZ*scalingFactor);
+                        g_n = -(sampler.gradient(hitPosition) * levelGradientScale).toVector3d();
                     }
 
                     //Vector3d g_n = -m_volume->getGradient((float)rayX*scalingFactor, (float)rayY*scalingFactor, (float)rayZ*scalingFactor);
 
-                    Vector3d normalizedEyeDirection = -projectionVector;
-                    normalizedEyeDirection.normalize();
-
-                    Vector3d colorValue = phongShadeVoxel(Vector3d(1,1,1), L, g_n, normalizedEyeDirection, 1.3, 5, 1.7);
+                    Vector3d colorValue = firstHitShading.shade(Vector3d(1,1,1), g_n);
 
                     /*
                     if (colorValue.GetX() == 0 && colorValue.GetY() == 0 && colorValue.GetZ() == 0) {
@@ -534,23 +1027,18 @@ protected:
                 // TODO: M.I.P should really use preshading instead of postshading
 
                 float maxValue = 0;
-                while (increment * stepSize < rayLength) {
+                float voxelValues[RAY_BATCH_SIZE];
 
-                    // Get volume intensity at this position
-
-                    double rayX = rayPosition.GetX();
-                    double rayY = rayPosition.GetY();
-                    double rayZ = rayPosition.GetZ();
+                while (increment * levelStepSize < rayLength) {
 
-                    // Get the voxel color by the chosen interpolation method
-                    float voxelValue = interpolateVoxel(rayX*scalingFactor, rayY*scalingFactor, rayZ*scalingFactor, interpolationMode);
+                    // Get the voxel colors of the next batch of samples by the chosen interpolation method
+                    int count = sampleAlongRay(samplePosition, sampleStep, levelStepSize, increment, rayLength, voxelValues, interpolationMode);
 
-                    if (voxelValue > maxValue) {
-                        maxValue = voxelValue;
+                    for (int i = 0 ; i < count ; i++) {
+                        if (voxelValues[i] > maxValue) {
+                            maxValue = voxelValues[i];
+                        }
                     }
-
-                    rayPosition += projectionVector * stepSize;
-                    increment++;
                 }
                 return m_transferFunction->GetColor(maxValue);
 
@@ -558,24 +1046,18 @@ protected:
 
                 float sumOfIntensityValues = 0;
                 int numberOfSamples = 0;
+                float voxelValues[RAY_BATCH_SIZE];
 
-                while (increment * stepSize < rayLength) {
-
-                    // Get volume intensity at this position
-
-                    double rayX = rayPosition.GetX();
-                    double rayY = rayPosition.GetY();
-                    double rayZ = rayPosition.GetZ();
+                while (increment * levelStepSize < rayLength) {
 
-                    // Get the voxel color by the chosen interpolation method
-                    float voxelValue = interpolateVoxel(rayX*scalingFactor, rayY*scalingFactor, rayZ*scalingFactor, interpolationMode);
+                    // Get the voxel colors of the next batch of samples by the chosen interpolation method
+                    int count = sampleAlongRay(samplePosition, sampleStep, levelStepSize, increment, rayLength, voxelValues, interpolationMode);
 
                     // Sum up all sample values, then average at the end
-                    sumOfIntensityValues += voxelValue;
-                    numberOfSamples++;
-
-                    rayPosition += projectionVector * stepSize;
-                    increment++;
+                    for (int i = 0 ; i < count ; i++) {
+                        sumOfIntensityValues += voxelValues[i];
+                    }
+                    numberOfSamples += count;
                 }
 
                 float luminosity = 0;
@@ -590,9 +1072,7 @@ protected:
 
                 // Set ray position to back of volume, since we are compositing back to front
 
-                rayPosition.SetX(*outX);
-                rayPosition.SetY(*outY);
-                rayPosition.SetZ(*outZ);
+                samplePosition = toRenderingLevel(voxelExit);
 
                 // int numSteps = floor(rayLength/stepSize-0.0005);
 
@@ -602,43 +1082,82 @@ protected:
 
                 float e = exp((float)1);
 
-                while (increment * stepSize < rayLength) {
+                // With trilinear interpolation throughout, the value, gradient and gradient magnitude of a sample
+                // are interpolated from one lookup of the surrounding voxels (unless the values are streamed)
+                const bool fusedSampling = interpolationMode == 1 && selectedGradientInterpolationMode == 1 &&
+                                           (selectedShadingMode >= 1 || selectedTransferFunctionMode == 1) &&
+                                           !streamingFrame;
 
-                    // Get volume intensity at this position
-                    double rayX = rayPosition.GetX();
-                    double rayY = rayPosition.GetY();
-                    double rayZ = rayPosition.GetZ();
+                float backStep[3];
+                (-sampleStep).store(backStep);
 
-                    // Get the voxel color by the chosen interpolation method
-                    float voxelValue = interpolateVoxel(rayX*scalingFactor, rayY*scalingFactor, rayZ*scalingFactor, interpolationMode);
+                while (increment * levelStepSize < rayLength) {
+                    // The components of the position, read from the register once per sample
+                    float position[3];
+                    samplePosition.store(position);
+
+                    if (emptySpace != NULL) {
+                        // Samples in empty space are transparent and leave the composite as it is
+                        const int emptySteps = emptySpace->emptySteps(position, backStep);
+
+                        if (emptySteps > 0) {
+                            samplePosition -= sampleStep * (float)emptySteps;
+                            increment += emptySteps;
+                            continue;
+                        }
+                    }
+
+                    // Get volume intensity at this position
+                    const float sampleX = position[0];
+                    const float sampleY = position[1];
+                    const float sampleZ = position[2];
+
+                    float voxelValue;
+                    Vec3f gradient;
+                    float gradientMagnitude = 0;
+
+                    if (fusedSampling) {
+                        sampler.sample(samplePosition, voxelValue, gradient, gradientMagnitude);
+                    } else {
+                        // Get the voxel color by the chosen interpolation method
+                        voxelValue = interpolateVoxel(samplePosition, interpolationMode);
+                    }
 
                     Vector3d c_i = m_transferFunction->GetColor(voxelValue); // Color of this voxel
                     double alpha_i = m_transferFunction->GetAlpha(voxelValue); // Opacity of this voxel
 
-                    if (selectedShadingMode == 1) { // If Phong shading, modify voxel color according to Phong algorithm
-                        Vector3d L = viewPlane.getLightVector(); // Vector pointing towards light source
+                    if (renderingLevel > 0) {
+                        // One sample stands for 2^level samples of the volume
+                        alpha_i = 1 - pow(1 - alpha_i, (double)(1 << renderingLevel));
+                    }
+
+                    if (selectedShadingMode >= 1) { // If Phong shading, modify voxel color according to Phong algorithm
                         Vector3d g_n;
 
                         if (selectedGradientInterpolationMode == 0) {
-                            g_n = -m_volume->getGradient((float)rayX*scalingFactor, (float)rayY*scalingFactor, (float)rayZ*scalingFactor);
+                            g_n = -levelVolume->getGradient(sampleX, sampleY, sampleZ) * levelGradientScale;
                         } else if (selectedGradientInterpolationMode == 1) {
-                            g_n = -m_volume->getGradientTrilinear((float)rayX*scalingFactor, (float)rayY*scalingFactor, (float)rayZ*scalingFactor);
+                            g_n = -((fusedSampling ? gradient : sampler.gradient(samplePosition)) * levelGradientScale).toVector3d();
                         }
 
+                        c_i = dvrShading.shade(c_i, g_n);
 
-                        Vector3d normalizedEyeDirection = -projectionVector;
-                        normalizedEyeDirection.normalize();
-
-                        c_i = phongShadeVoxel(Vector3d(c_i.GetX(), c_i.GetY(), c_i.GetZ()), L, g_n, normalizedEyeDirection,  7, 8, 1.7);
+                        if (selectedShadingMode == 2) { // Shadows: attenuate by the light reaching this sample
+                            // The illumination volume has the resolution of the volume
+                            const float levelSize = (float)(1 << renderingLevel);
+                            c_i = c_i * illuminationVolume.getIllumination((sampleX + 0.5f) * levelSize - 0.5f,
+                                                                           (sampleY + 0.5f) * levelSize - 0.5f,
+                                                                           (sampleZ + 0.5f) * levelSize - 0.5f);
+                        }
                     }
 
                     // If gradient-based transfer function, modify alpha value according to gradient at this voxel
                     if (selectedTransferFunctionMode == 1) {
                         double magnitude;
                         if (selectedGradientInterpolationMode == 0) {
-                            magnitude = m_volume->getGradientMagnitude(rayX*scalingFactor, rayY*scalingFactor, rayZ*scalingFactor);
+                            magnitude = levelVolume->getGradientMagnitude(sampleX, sampleY, sampleZ) * levelGradientScale;
                         } else if (selectedGradientInterpolationMode == 1) {
-                            magnitude = m_volume->getGradientMagnitudeTrilinear(rayX*scalingFactor, rayY*scalingFactor, rayZ*scalingFactor);
+                            magnitude = (fusedSampling ? gradientMagnitude : sampler.gradientMagnitude(samplePosition)) * levelGradientScale;
                         }
 
                         // It turns out that the luminosiry when compositing when using the gradient is highly dependent on the step size.
@@ -649,7 +1168,7 @@ protected:
                     c_green_out = c_i.GetY() * alpha_i + (1-alpha_i)*c_green_out;
                     c_blue_out = c_i.GetZ() * alpha_i + (1-alpha_i)*c_blue_out;
 
-                    rayPosition -= projectionVector * stepSize; // When doing DVR, ray moves back-to-front
+                    samplePosition -= sampleStep; // When doing DVR, ray moves back-to-front
                     increment++;
                     }
 
@@ -664,39 +1183,6 @@ protected:
         }
     }
 
-    /// Return the resulting color when phong shading a particular voxel. Input vectors are assumed to be normalized.
-    ///
-    /// voxelColor - the color of the voxel to be shaded
-    /// normal - the normal or gradient to the voxel to be shaded
-    /// eyeDirection - direction from the voxel to be shaded to the eye point
-    /// k_d - scalar factor for diffuse shading
-    /// k_s - scalar factor for specular shading
-    /// b - exponent determining sharpness of specular shading
-    ///
-    /// The light in the shader is for now assumed to be white, (1,1,1).
-    ///
-    Vector3d phongShadeVoxel(Vector3d voxelColor, Vector3d L, Vector3d normal, Vector3d eyeDirection, float k_d, float k_s, float b) {
-        Vector3d H = -L -eyeDirection; // Halfway vector between light direction and eye direction (seen from target voxel)
-        H.normalize();
-
-        float s_d = k_d * abs(L.Dot(normal)); // Diffuse component
-        float s_s = k_s * pow((float)(abs((-H).Dot(normal))), b); // Specular component
-
-        Vector3d result = (voxelColor * s_d + Vector3d(1,1,1) * s_s);
-        // Prevent overflow in the case that the color intensity is saturated
-        if (result.GetX() > 1) {
-            result.SetX(1.0);
-        }
-        if (result.GetY() > 1) {
-            result.SetY(1.0);
-        }
-        if (result.GetZ() > 1) {
-            result.SetZ(1.0);
-        }
-
-        return result;
-    }
-
     /// Check ray-box intersection between ray at rayStart moving in rayDirection. Out parameters are pointers which show the coordinates
     /// where the ray enters the volume. These are modified only if the ray intersects the volume, and the function returns
     /// true only in the cases where it does.
@@ -820,7 +1306,10 @@ protected:
     // ************************************************************************************************************
     // *** Class members ******************************************************************************************
 private:
-    const Volume *m_volume; ///< pointer to the volume to be visualized
+    static const int RAY_BATCH_SIZE = 64; ///< Samples interpolated per call when sampling along a ray
+    static const int ROTATION_LEVELS = 1; ///< Levels coarser the ray caster samples while rotating, with level of detail
+
+    Volume *m_volume; ///< pointer to the volume to be visualized
 
     int m_uWidth;           ///< the width of the OpenGL context
     int m_uHeight;          ///< the height of the OpenGL context
@@ -841,18 +1330,39 @@ private:
     int selectedRenderingResolutionY;
 
     int selectedRenderingMode;
+    int selectedRenderingEngine; // 0 is ray casting, 1 is voxel traversal, 2 is Fourier slice, 3 is shear-warp, 4 is isosurface mesh
     int selectedProjectionMode;
     int selectedInterpolationMode; // 0 is nearest, 1 is trilinear
     int selectedTransferFunctionMode;
     int selectedShadingMode;
     int selectedFirstHitValue;
     int selectedGradientInterpolationMode;
+    int selectedLevelOfDetail; // 0 lowers the resolution while rotating, 1 samples a coarser level, 2 also when zoomed out
+
+    bool isRotating;      // A mouse button is down
+    int renderingLevel;   // Level of the pyramid sampled by the ray caster in the current frame
+    Volume *levelVolume;  // That level; m_volume at level 0
+
+    OutOfCoreVolume *outOfCore; // Full resolution of m_volume streamed from disk, or NULL
+    bool streamingFrame;        // The current frame samples outOfCore
+
+    const SparseTileTree *emptySpace; // Tiles of the volume outside which DVR skips samples this frame, or NULL
 
     ViewPlane viewPlane;     /// The viewing plane of this volume renderer
 
     int curMouseX;
     int curMouseY;
 
+    FourierSliceRenderer fourierSliceRenderer; ///< X-ray engine, holds the precomputed spectrum of the volume
+    ShearWarpRenderer shearWarpRenderer; ///< DVR engine, holds the run-length encoded classified volume
+    SplatRenderer splatRenderer; ///< DVR by splatting, holds the non-transparent voxels
+    IsosurfaceRenderer isosurfaceRenderer; ///< First-hit engine, holds the isosurface mesh of the current threshold
+    IlluminationVolume illuminationVolume; ///< Light reaching each point of the volume, for shadowed DVR
+    ShadingContext firstHitShading; ///< Phong shading of first hits, set up once per frame
+    ShadingContext dvrShading; ///< Phong shading of DVR samples, set up once per frame
+    TrilinearSampler sampler; ///< Trilinear interpolation of values and gradients for the ray caster, at the rendering level
+    VolumePyramid pyramid; ///< Coarser levels of the volume for level of detail
+
     TFDialog tf_dialog;
     TransferFunction* m_transferFunction;
 
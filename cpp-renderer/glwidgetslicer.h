@@ -77,6 +77,19 @@ public slots:
         }
     }
 
+    /// Show another timestep of a time series, a volume of the same dimensions as the current one, keeping the
+    /// slice, the zoom and the pan
+    void setTimestep(Volume *v)
+    {
+        m_volume = v;
+        volumeIsSet = true;
+
+        if (this->isVisible())
+        {
+            updateGL();
+        }
+    }
+
     /// Set the slice number
     void setSlice(int s)
     {
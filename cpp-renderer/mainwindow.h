@@ -1,10 +1,19 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include <sstream>
 #include <QMainWindow>
 #include "glwidgetslicer.h"
 #include "glwidgetdvr.h"
 #include "glwidgetcube.h"
+#include "CompressedVolumeFile.h"
+#include "DatasetCatalogDialog.h"
+#include "DerivedDataThread.h"
+#include "LiveVolume.h"
+#include "OutOfCoreVolume.h"
+#include "SharedVolumeCache.h"
+#include "TimeSeriesVolume.h"
+#include "VolumeLoaderThread.h"
 #include "Volume.h"
 
 // #include "gl_tf_editor.h"
@@ -39,20 +48,43 @@ class MainWindow : public QMainWindow
     // *** Basic methods ******************************************************************************************
 public:
     /// Default constructor
-    MainWindow(QWidget *parent = 0) : QMainWindow(parent)
+    MainWindow(QWidget *parent = 0) : QMainWindow(parent), m_currentLoad(0), m_currentRun(0)
     {
         // Set the window size
         this->resize(800,600);
         this->setWindowTitle(QApplication::translate("MainWindowClass", "MainWindow", 0, QApplication::UnicodeUTF8));
 
+        m_loaderThread = new VolumeLoaderThread(this);
+        m_derivedDataThread = new DerivedDataThread(this);
+        m_outOfCoreVolume = new OutOfCoreVolume(this);
+        m_timeSeries = new TimeSeriesVolume(this);
+        m_liveVolume = new LiveVolume(this);
+
         setupUi();
     }
 
     /// Destructor
     ~MainWindow()
     {
+        // The background threads use the volumes, so let them finish first
+        m_loaderThread->wait();
+        m_derivedDataThread->wait();
+        delete m_loaderThread;
+        delete m_derivedDataThread;
+        delete m_outOfCoreVolume;
+        delete m_timeSeries;
+        delete m_liveVolume;
+
         // Deallocate everything
         delete m_actionLoadDataset;
+        delete m_actionLoadRegion;
+        delete m_actionBrowseCatalog;
+        delete m_actionLoadTimeSeries;
+        delete m_actionConnectLiveVolume;
+        delete m_actionProgressiveLoading;
+        delete m_actionPlay;
+        delete m_actionNextFrame;
+        delete m_actionPreviousFrame;
 
         delete m_tabWidget;
         delete m_tabSlicer;
@@ -70,6 +102,8 @@ public:
         delete m_label6_Dvr;
         delete m_label7_Dvr;
         delete m_label8_Dvr;
+        delete m_label9_Dvr;
+        delete m_label10_Dvr;
 
         delete m_layoutSlicer;
         delete m_layoutSlicerControl;
@@ -84,11 +118,14 @@ public:
         delete m_combo_dvrInterpolationMethod;
         delete m_combo_dvrGradientInterpolationMethod;
         delete m_combo_dvrGradientMethod;
+        delete m_combo_dvrGradientStorage;
         delete m_combo_dvrProjection;
         delete m_combo_dvrShading;
         delete m_combo_dvrRenderingMethod;
+        delete m_combo_dvrRenderingEngine;
         delete m_combo_dvrRes;
         delete m_combo_dvrResRotating;
+        delete m_combo_dvrLevelOfDetail;
         delete m_combo_dvrTfMode;
 
         delete m_spacer1_Dvr;
@@ -104,10 +141,13 @@ public:
         delete m_check_slicerFree;
 
         delete m_push_dvrTf;
+        delete m_push_dvrCompare;
+        delete m_push_dvrBenchmarkSplatting;
         delete m_push_slicerTf;
 
         delete m_menubar;
         delete m_menuFile;
+        delete m_menuPlayback;
 
         delete m_glwidgetSlicer;
         delete m_glwidgetDvr;
@@ -122,14 +162,304 @@ public slots:
         QString fileName = QFileDialog::getOpenFileName(this,
             tr("Open Dataset"),
             "",
-            tr("DataSet (*.dat);;All Files (*)"));
+            tr("DataSet (*.dat *.cvol);;All Files (*)"));
+        openDataset(fileName);
+    }
+
+    /// Pick a dataset of a directory by the thumbnails of its datasets, and load it
+    void openCatalog() {
+        const QString directory = QFileDialog::getExistingDirectory(this, tr("Open Dataset Catalog"));
+        if (directory.isEmpty()) {
+            return;
+        }
+
+        DatasetCatalogDialog catalog(directory, this);
+        if (catalog.exec() == QDialog::Accepted) {
+            openDataset(catalog.getSelectedFile());
+        }
+    }
+
+    /// Load the dataset in the specified file (nothing if it is empty)
+    void openDataset(const QString &fileName) {
         if (!fileName.isEmpty()) {
-            m_volume.loadVolumeDat(fileName.toStdString());
-            emit newVolume(&m_volume);
+            // The previous dataset may still be loading, or its gradients and histogram computing
+            m_loaderThread->wait();
+            m_derivedDataThread->wait();
+
+            // The gradient storage cannot be changed until the gradients and the histogram are ready
+            m_combo_dvrGradientStorage->setEnabled(false);
+
+            // Stop streaming the previous dataset, whose coarse copy is about to be replaced
+            m_outOfCoreVolume->close();
+
+            const std::string file = fileName.toStdString();
+            const bool compressed = CompressedVolumeFile::isCompressedVolumeFile(file);
+            const int stride = compressed ? 1 : Volume::previewStride(file, PREVIEW_VOXELS);
+
+            bool loaded = true;
+            int width, height, depth;
+            const bool outOfCore = !compressed && Volume::readDatDimensions(file, width, height, depth) &&
+                                   (double)width * height * depth > OUT_OF_CORE_VOXELS;
+
+            if (!outOfCore && SharedVolumeCache::attach(&m_volume, fileName)) {
+                // Another VolViz process has published the dataset: map its copy instead of loading one
+                abandonBackgroundWork();
+                emit newVolume(&m_volume);
+
+                if (m_volume.areGradientsReady()) {
+                    m_combo_dvrGradientStorage->setEnabled(true);
+                } else {
+                    m_currentRun = m_derivedDataThread->computeFor(&m_volume, fileName);
+                }
+            } else if (compressed) {
+                // Decompress the bricks in parallel, and compute the gradients and the histogram in the background
+                CompressedVolumeFile compressedFile;
+                loaded = compressedFile.open(file) && compressedFile.load(m_volume);
+                if (loaded) {
+                    abandonBackgroundWork();
+                    emit newVolume(&m_volume);
+
+                    m_currentRun = m_derivedDataThread->computeFor(&m_volume, fileName);
+                }
+            } else if (outOfCore) {
+                // Too large to load: keep a downsampled copy in memory, and stream the full resolution from disk
+                loaded = m_volume.loadVolumeDat(file, true, stride);
+                if (loaded) {
+                    m_outOfCoreVolume->open(file, &m_volume, stride, (qint64)OUT_OF_CORE_BUDGET_MB << 20);
+                    abandonBackgroundWork();
+                    emit newVolume(&m_volume);
+
+                    m_combo_dvrGradientStorage->setEnabled(true);
+                }
+            } else if (m_actionProgressiveLoading->isChecked() && stride > 1) {
+                // Show a downsampled preview at once, and load the full resolution in the background
+                loaded = m_volume.loadVolumeDat(file, true, stride);
+                if (loaded) {
+                    abandonBackgroundWork();
+                    emit newVolume(&m_volume);
+
+                    m_loadingVolume.setGradientPolicy(m_volume.getGradientPolicy());
+                    m_currentLoad = m_loaderThread->load(&m_loadingVolume, file);
+                    m_loadingFile = fileName;
+                }
+            } else {
+                // Show the volume as soon as the voxels are read, and compute the gradients and the histogram in
+                // the background
+                loaded = m_volume.loadVolumeDat(file, false);
+                if (loaded) {
+                    abandonBackgroundWork();
+                    emit newVolume(&m_volume);
+
+                    m_currentRun = m_derivedDataThread->computeFor(&m_volume, fileName);
+                }
+            }
+
+            if (!loaded) {
+                // The previous volume stays, unless the file failed part way through: either way nothing is
+                // derived from the file, or cached and shared under its name
+                if (!m_timeSeries->isOpen() && !m_liveVolume->isOpen()) {
+                    emit newVolume(&m_volume);
+                }
+                m_combo_dvrGradientStorage->setEnabled(true);
+                QMessageBox::warning(this, tr("Open Dataset"), tr("%1 could not be loaded.").arg(fileName));
+            }
+
+            emit newOutOfCoreVolume(m_outOfCoreVolume);
+
+            // The renderers no longer show a time series or a live volume, if one was shown
+            if (loaded) {
+                closeTimeSeries();
+                closeLiveVolume();
+            }
         }
         resetDvrTab();
     }
 
+    /// Load a region of a dataset, cropped and downsampled with a stride, as a dataset of its own
+    void openRegion() {
+        QString fileName = QFileDialog::getOpenFileName(this,
+            tr("Open Region of Dataset"),
+            "",
+            tr("DataSet (*.dat);;All Files (*)"));
+        if (fileName.isEmpty()) {
+            return;
+        }
+
+        const std::string file = fileName.toStdString();
+        int width, height, depth;
+        if (!Volume::readDatDimensions(file, width, height, depth)) {
+            QMessageBox::warning(this, tr("Open Region of Dataset"), tr("%1 cannot be read.").arg(fileName));
+            return;
+        }
+
+        bool accepted;
+        const QString bounds = QInputDialog::getText(this, tr("Open Region of Dataset"),
+            tr("The dataset has %1x%2x%3 voxels. First voxel (x y z), end (x y z) and stride:")
+                .arg(width).arg(height).arg(depth),
+            QLineEdit::Normal, QString("0 0 0 %1 %2 %3 2").arg(width).arg(height).arg(depth), &accepted);
+        if (!accepted) {
+            return;
+        }
+
+        std::istringstream values(bounds.toStdString());
+        int begin[3], end[3], stride;
+        values >> begin[0] >> begin[1] >> begin[2] >> end[0] >> end[1] >> end[2] >> stride;
+        if (values.fail()) {
+            QMessageBox::warning(this, tr("Open Region of Dataset"),
+                tr("Enter seven numbers: the first voxel, the end and the stride."));
+            return;
+        }
+        const Volume::Region region(begin[0], begin[1], begin[2], end[0], end[1], end[2], stride);
+
+        // The previous dataset may still be loading, or its gradients and histogram computing
+        m_loaderThread->wait();
+        m_derivedDataThread->wait();
+
+        m_combo_dvrGradientStorage->setEnabled(false);
+        m_outOfCoreVolume->close();
+
+        if (!m_volume.loadVolumeDat(file, region, false)) {
+            m_combo_dvrGradientStorage->setEnabled(true);
+            QMessageBox::warning(this, tr("Open Region of Dataset"), tr("The region could not be loaded."));
+            return;
+        }
+        abandonBackgroundWork();
+        emit newVolume(&m_volume);
+        emit newOutOfCoreVolume(m_outOfCoreVolume);
+
+        // The region is not the dataset, so its derived data bypasses the caches of the dataset
+        m_currentRun = m_derivedDataThread->computeFor(&m_volume);
+
+        closeTimeSeries();
+        closeLiveVolume();
+        resetDvrTab();
+    }
+
+    /// Load a time series: one dataset per timestep, played back in the order of the file names
+    void openTimeSeries() {
+        QStringList fileNames = QFileDialog::getOpenFileNames(this,
+            tr("Open Time Series"),
+            "",
+            tr("DataSet (*.dat)"));
+        if (fileNames.isEmpty()) {
+            return;
+        }
+        fileNames.sort();
+
+        // The previous dataset may still be loading, or its gradients and histogram computing
+        m_loaderThread->wait();
+        m_derivedDataThread->wait();
+
+        const Volume::GradientPolicy policy = (Volume::GradientPolicy)m_combo_dvrGradientStorage->currentIndex();
+        if (!m_timeSeries->open(fileNames, policy)) {
+            return;
+        }
+
+        abandonBackgroundWork();
+        m_outOfCoreVolume->close();
+        emit newVolume(m_timeSeries->getCurrentVolume());
+        emit newOutOfCoreVolume(m_outOfCoreVolume);
+        closeLiveVolume();
+
+        // The first timestep has replaced the dataset, which can be freed
+        Volume().swap(m_volume);
+
+        m_combo_dvrGradientStorage->setEnabled(true);
+        m_actionPlay->setEnabled(true);
+        m_actionNextFrame->setEnabled(true);
+        m_actionPreviousFrame->setEnabled(true);
+        showFrameNumber(0);
+
+        resetDvrTab();
+    }
+
+    /// Show the number of the timestep played back
+    void showFrameNumber(int frame) {
+        statusBar()->showMessage(tr("Timestep %1 of %2").arg(frame + 1).arg(m_timeSeries->getFrameCount()));
+    }
+
+    /// Show the volumes that another process, such as a running simulation, publishes in a shared volume ring
+    void openLiveVolume() {
+        bool accepted;
+        const QString name = QInputDialog::getText(this, tr("Connect to Live Volume"),
+            tr("Shared memory name of the producer:"), QLineEdit::Normal, "/volviz", &accepted);
+        if (!accepted || name.isEmpty()) {
+            return;
+        }
+
+        // The previous dataset may still be loading, or its gradients and histogram computing
+        m_loaderThread->wait();
+        m_derivedDataThread->wait();
+
+        const Volume::GradientPolicy policy = (Volume::GradientPolicy)m_combo_dvrGradientStorage->currentIndex();
+        if (!m_liveVolume->open(name.toStdString(), policy)) {
+            QMessageBox::warning(this, tr("Connect to Live Volume"),
+                tr("No volumes are being published under %1.").arg(name));
+            return;
+        }
+
+        abandonBackgroundWork();
+        m_outOfCoreVolume->close();
+        emit newVolume(m_liveVolume->getCurrentVolume());
+        emit newOutOfCoreVolume(m_outOfCoreVolume);
+        closeTimeSeries();
+
+        // The live volume has replaced the dataset, which can be freed
+        Volume().swap(m_volume);
+
+        m_combo_dvrGradientStorage->setEnabled(true);
+        showLiveFrameNumber((int)m_liveVolume->getCurrentFrame());
+
+        resetDvrTab();
+    }
+
+    /// Show the number of the live frame shown
+    void showLiveFrameNumber(int frame) {
+        statusBar()->showMessage(tr("Live frame %1 (%2 skipped)").arg(frame).arg((int)m_liveVolume->getDroppedFrames()));
+    }
+
+    /// The full resolution of a progressively loaded dataset has been loaded in the background: replace the
+    /// preview with it
+    void fullVolumeLoaded() {
+        // The signal is queued, so it may be about a load that has been given up on since, or be followed by the
+        // signal of a load started since
+        if (m_loaderThread->isRunning() || m_loaderThread->getLoadNumber() != m_currentLoad) {
+            return;
+        }
+        m_currentLoad = 0;
+
+        if (!m_loaderThread->succeeded() || m_timeSeries->isOpen() || m_liveVolume->isOpen()) {
+            // Keep showing the preview (or the time series or live volume opened meanwhile)
+            Volume().swap(m_loadingVolume);
+            m_combo_dvrGradientStorage->setEnabled(true);
+            return;
+        }
+
+        m_volume.swap(m_loadingVolume);
+        Volume().swap(m_loadingVolume); // Free the preview
+        emit newVolume(&m_volume);
+
+        m_currentRun = m_derivedDataThread->computeFor(&m_volume, m_loadingFile);
+    }
+
+    /// The gradients and the histogram of the volume have been computed in the background
+    void derivedDataReady() {
+        // The signal is queued, so it may be about a computation that has been given up on since, or be followed by
+        // the signal of a computation started since
+        if (m_derivedDataThread->isRunning() || m_derivedDataThread->getRunNumber() != m_currentRun) {
+            return;
+        }
+        m_currentRun = 0;
+
+        // Share the dataset with the other VolViz processes that open it, and use the shared copy from now on
+        if (!m_derivedDataThread->getDatasetFile().isEmpty()) {
+            SharedVolumeCache::publish(&m_volume, m_derivedDataThread->getDatasetFile());
+        }
+
+        m_combo_dvrGradientStorage->setEnabled(true);
+        emit derivedDataChanged();
+    }
+
     /// Set the maximum value of the slicer slider
     void setMaxSliceNumber(int max) {
         std::cout << "Debug: Set max slice number." << std::endl;
@@ -156,10 +486,52 @@ signals:
     /// Notify that new volume data has been loaded
     void newVolume(Volume *v);
 
+    /// Notify that the gradients and the histogram of the volume are ready
+    void derivedDataChanged();
+
+    /// Notify whether the full resolution of the new volume is streamed from disk (when the volume is open)
+    void newOutOfCoreVolume(OutOfCoreVolume *v);
+
 
     // ************************************************************************************************************
     // *** Private methods ****************************************************************************************
 private:
+    /// Let the previous dataset finish loading in the background, and give up on it, once another volume replaces
+    /// it: the finished() signals of the threads that are still queued are then ignored
+    void abandonBackgroundWork() {
+        m_loaderThread->wait();
+        m_derivedDataThread->wait();
+
+        m_currentLoad = 0;
+        m_currentRun = 0;
+        Volume().swap(m_loadingVolume);
+    }
+
+    /// Stop playing the time series and free its timesteps, once the renderers show another volume
+    void closeTimeSeries() {
+        if (!m_timeSeries->isOpen()) {
+            return;
+        }
+
+        m_actionPlay->setChecked(false);
+        m_timeSeries->close();
+
+        m_actionPlay->setEnabled(false);
+        m_actionNextFrame->setEnabled(false);
+        m_actionPreviousFrame->setEnabled(false);
+        statusBar()->clearMessage();
+    }
+
+    /// Stop showing the live volume, once the renderers show another volume
+    void closeLiveVolume() {
+        if (!m_liveVolume->isOpen()) {
+            return;
+        }
+
+        m_liveVolume->close();
+        statusBar()->clearMessage();
+    }
+
     /// Setup the graphical user interface
     void setupUi() {
         // Create the tab pane
@@ -202,6 +574,8 @@ private:
         //  LoadData()
 
         connect(this, SIGNAL(newVolume(Volume *)), m_glwidgetSlicer, SLOT(setVolume(Volume *)));
+        connect(m_timeSeries, SIGNAL(frameChanged(Volume *)), m_glwidgetSlicer, SLOT(setTimestep(Volume *)));
+        connect(m_liveVolume, SIGNAL(frameChanged(Volume *)), m_glwidgetSlicer, SLOT(setTimestep(Volume *)));
 
         //connect(m_push_slicerTf, SIGNAL(clicked()),this, SLOT(openWindowingDialog()));
         connect(m_hSlider_Slicer, SIGNAL(valueChanged(int)), m_glwidgetSlicer, SLOT(setSlice(int)));
@@ -213,20 +587,36 @@ private:
     void dvrConnections() {
         //  LoadData()
         connect(this, SIGNAL(newVolume(Volume *)), m_glwidgetDvr, SLOT(setVolume(Volume *)));
+        connect(m_loaderThread, SIGNAL(finished()), this, SLOT(fullVolumeLoaded()));
+        connect(m_derivedDataThread, SIGNAL(finished()), this, SLOT(derivedDataReady()));
+        connect(this, SIGNAL(derivedDataChanged()), m_glwidgetDvr, SLOT(updateDerivedData()));
+        connect(this, SIGNAL(newOutOfCoreVolume(OutOfCoreVolume *)), m_glwidgetDvr, SLOT(setOutOfCoreVolume(OutOfCoreVolume *)));
+        connect(m_outOfCoreVolume, SIGNAL(bricksArrived()), m_glwidgetDvr, SLOT(update()));
+        connect(m_timeSeries, SIGNAL(frameChanged(Volume *)), m_glwidgetDvr, SLOT(setTimestep(Volume *)));
+        connect(m_timeSeries, SIGNAL(frameNumberChanged(int)), this, SLOT(showFrameNumber(int)));
+        connect(m_liveVolume, SIGNAL(frameChanged(Volume *)), m_glwidgetDvr, SLOT(setTimestep(Volume *)));
+        connect(m_liveVolume, SIGNAL(frameNumberChanged(int)), this, SLOT(showLiveFrameNumber(int)));
 
         connect(m_combo_dvrRes, SIGNAL(activated(int)), m_glwidgetDvr, SLOT(setRes(int)));
         connect(m_combo_dvrResRotating, SIGNAL(activated(int)), m_glwidgetDvr, SLOT(setResRotating(int)));
+        connect(m_combo_dvrLevelOfDetail, SIGNAL(activated(int)), m_glwidgetDvr, SLOT(setLevelOfDetail(int)));
         connect(m_combo_dvrInterpolationMethod, SIGNAL(activated(int)), m_glwidgetDvr, SLOT(setInterpolationMode(int)));
         connect(m_combo_dvrGradientInterpolationMethod, SIGNAL(activated(int)), m_glwidgetDvr, SLOT(setGradientInterpolationMode(int)));
         //connect(m_combo_dvrGradientMethod, SIGNAL(activated(int)), m_glwidgetDvr, SLOT(setGradientMode(int)));
+        connect(m_combo_dvrGradientStorage, SIGNAL(activated(int)), m_glwidgetDvr, SLOT(setGradientPolicy(int)));
+        connect(m_combo_dvrGradientStorage, SIGNAL(activated(int)), m_timeSeries, SLOT(setGradientPolicy(int)));
+        connect(m_combo_dvrGradientStorage, SIGNAL(activated(int)), m_liveVolume, SLOT(setGradientPolicy(int)));
         connect(m_combo_dvrProjection, SIGNAL(activated(int)), m_glwidgetDvr, SLOT(setViewingMode(int)));
         connect(m_combo_dvrShading, SIGNAL(activated(int)), m_glwidgetDvr, SLOT(setShading(int)));
         connect(m_combo_dvrTfMode, SIGNAL(activated(int)), m_glwidgetDvr, SLOT(setTfMode(int)));
         connect(m_combo_dvrRenderingMethod, SIGNAL(activated(int)), m_glwidgetDvr, SLOT(setRenderingMode(int)));
+        connect(m_combo_dvrRenderingEngine, SIGNAL(activated(int)), m_glwidgetDvr, SLOT(setRenderingEngine(int)));
         connect(m_spinBox_dvrStepSize, SIGNAL(valueChanged(double)), m_glwidgetDvr, SLOT(setStepSize(double)));
         connect(m_hSlider_DvrFhit, SIGNAL(valueChanged(int)), m_glwidgetDvr, SLOT(setHitValue(int)));
         //connect(m_push_dvrTf, SIGNAL(clicked()),this, SLOT(openWindowingDialog()));
         connect(m_push_dvrTf, SIGNAL(clicked()), m_glwidgetDvr, SLOT(openWindowingDialog()));
+        connect(m_push_dvrCompare, SIGNAL(clicked()), m_glwidgetDvr, SLOT(compareWithRayCaster()));
+        connect(m_push_dvrBenchmarkSplatting, SIGNAL(clicked()), m_glwidgetDvr, SLOT(benchmarkSplatting()));
     }
 
     /// Add widgets to the cube tab
@@ -371,6 +761,14 @@ private:
         //m_combo_dvrGradientMethod->addItem(tr("Backward Diff."));
 		m_layoutDvrControl->addWidget(m_combo_dvrGradientMethod);
 
+		m_combo_dvrGradientStorage = new QComboBox(m_widgetDvrControl);
+		m_combo_dvrGradientStorage->setObjectName(QString::fromUtf8("combo_dvrGradientStorage"));
+		m_combo_dvrGradientStorage->addItem(tr("Precomputed"));
+		m_combo_dvrGradientStorage->addItem(tr("On the fly (no memory)"));
+		m_combo_dvrGradientStorage->addItem(tr("Lazy bricks"));
+		m_combo_dvrGradientStorage->addItem(tr("Sparse (skips empty space)"));
+		m_layoutDvrControl->addWidget(m_combo_dvrGradientStorage);
+
 		m_label3_Dvr = new QLabel(m_widgetDvrControl);
 		m_label3_Dvr->setObjectName(QString::fromUtf8("label3_Dvr"));
 		m_label3_Dvr->setText(QApplication::translate("MainWindowClass", "Viewing projection", 0, QApplication::UnicodeUTF8));
@@ -391,6 +789,7 @@ private:
 		m_combo_dvrShading->setObjectName(QString::fromUtf8("combo_dvrShading"));
 		m_combo_dvrShading->addItem(tr("None"));
 		m_combo_dvrShading->addItem(tr("Phong"));
+		m_combo_dvrShading->addItem(tr("Phong + shadows (DVR)"));
 		m_layoutDvrControl->addWidget(m_combo_dvrShading);
 
 		m_label5_Dvr = new QLabel(m_widgetDvrControl);
@@ -404,8 +803,33 @@ private:
         m_combo_dvrRenderingMethod->addItem(tr("Maximum Intensity"));
         m_combo_dvrRenderingMethod->addItem(tr("Average"));
         m_combo_dvrRenderingMethod->addItem(tr("DVR"));
+        m_combo_dvrRenderingMethod->addItem(tr("DVR (Splatting)"));
 		m_layoutDvrControl->addWidget(m_combo_dvrRenderingMethod);
 
+		m_label9_Dvr = new QLabel(m_widgetDvrControl);
+		m_label9_Dvr->setObjectName(QString::fromUtf8("label9_Dvr"));
+		m_label9_Dvr->setText(QApplication::translate("MainWindowClass", "Rendering engine", 0, QApplication::UnicodeUTF8));
+		m_layoutDvrControl->addWidget(m_label9_Dvr);
+
+		m_combo_dvrRenderingEngine = new QComboBox(m_widgetDvrControl);
+		m_combo_dvrRenderingEngine->setObjectName(QString::fromUtf8("combo_dvrRenderingEngine"));
+        m_combo_dvrRenderingEngine->addItem(tr("Ray casting"));
+        m_combo_dvrRenderingEngine->addItem(tr("Voxel traversal (M.I.P, Average)"));
+        m_combo_dvrRenderingEngine->addItem(tr("Fourier slice (Average, parallel)"));
+        m_combo_dvrRenderingEngine->addItem(tr("Shear-warp (DVR, parallel, unshaded)"));
+        m_combo_dvrRenderingEngine->addItem(tr("Isosurface mesh (First hit, parallel)"));
+		m_layoutDvrControl->addWidget(m_combo_dvrRenderingEngine);
+
+		m_push_dvrCompare = new QPushButton(m_widgetDvrControl);
+		m_push_dvrCompare->setObjectName(QString::fromUtf8("push_dvrCompare"));
+        m_push_dvrCompare->setText(QApplication::translate("MainWindowClass", "Compare with ray caster", 0, QApplication::UnicodeUTF8));
+		m_layoutDvrControl->addWidget(m_push_dvrCompare);
+
+		m_push_dvrBenchmarkSplatting = new QPushButton(m_widgetDvrControl);
+		m_push_dvrBenchmarkSplatting->setObjectName(QString::fromUtf8("push_dvrBenchmarkSplatting"));
+        m_push_dvrBenchmarkSplatting->setText(QApplication::translate("MainWindowClass", "Benchmark splatting", 0, QApplication::UnicodeUTF8));
+		m_layoutDvrControl->addWidget(m_push_dvrBenchmarkSplatting);
+
 		m_label7_Dvr = new QLabel(m_widgetDvrControl);
 		m_label7_Dvr->setObjectName(QString::fromUtf8("label7_Dvr"));
 		m_label7_Dvr->setText(QApplication::translate("MainWindowClass", "Rendering resolution", 0, QApplication::UnicodeUTF8));
@@ -433,6 +857,18 @@ private:
         m_combo_dvrResRotating->setCurrentIndex(2);
 		m_layoutDvrControl->addWidget(m_combo_dvrResRotating);
 
+		m_label10_Dvr = new QLabel(m_widgetDvrControl);
+		m_label10_Dvr->setObjectName(QString::fromUtf8("label10_Dvr"));
+		m_label10_Dvr->setText(QApplication::translate("MainWindowClass", "Level of detail", 0, QApplication::UnicodeUTF8));
+		m_layoutDvrControl->addWidget(m_label10_Dvr);
+
+		m_combo_dvrLevelOfDetail = new QComboBox(m_widgetDvrControl);
+		m_combo_dvrLevelOfDetail->setObjectName(QString::fromUtf8("combo_dvrLevelOfDetail"));
+		m_combo_dvrLevelOfDetail->addItem(tr("Lower resolution while moving"));
+		m_combo_dvrLevelOfDetail->addItem(tr("Coarser volume while moving"));
+		m_combo_dvrLevelOfDetail->addItem(tr("Coarser volume while moving or zoomed out"));
+		m_layoutDvrControl->addWidget(m_combo_dvrLevelOfDetail);
+
 		m_combo_dvrTfMode = new QComboBox(m_widgetDvrControl);
 		m_combo_dvrTfMode->setObjectName(QString::fromUtf8("combo_dvrTfMode"));
 		m_combo_dvrTfMode->addItem(tr("1D Transfer Function"));
@@ -484,12 +920,14 @@ private:
 	void resetDvrTab() {
 		m_combo_dvrRes->setCurrentIndex(0);
 		m_combo_dvrResRotating->setCurrentIndex(0);
+		m_combo_dvrLevelOfDetail->setCurrentIndex(0);
 		m_combo_dvrInterpolationMethod->setCurrentIndex(0);
 		m_combo_dvrGradientMethod->setCurrentIndex(0);
 		m_combo_dvrGradientInterpolationMethod->setCurrentIndex(0);
 		m_combo_dvrProjection->setCurrentIndex(0);
 		m_combo_dvrShading->setCurrentIndex(0);
 		m_combo_dvrRenderingMethod->setCurrentIndex(0);
+		m_combo_dvrRenderingEngine->setCurrentIndex(0);
 		m_combo_dvrTfMode->setCurrentIndex(0);
 		m_hSlider_DvrFhit->setValue(0);
         m_spinBox_dvrStepSize->setValue(0.1);
@@ -502,6 +940,52 @@ private:
 		m_actionLoadDataset->setStatusTip(tr("Open Dataset"));
 		connect(m_actionLoadDataset, SIGNAL(triggered()), this, SLOT(open()));
 
+		m_actionLoadRegion = new QAction( tr("Load re&gion of dataset"),this);
+		m_actionLoadRegion->setObjectName(QString::fromUtf8("actionLoad_Region"));
+		m_actionLoadRegion->setStatusTip(tr("Open a cropped or downsampled part of a dataset, reading only that part"));
+		connect(m_actionLoadRegion, SIGNAL(triggered()), this, SLOT(openRegion()));
+
+		m_actionBrowseCatalog = new QAction( tr("&Browse dataset catalog"),this);
+		m_actionBrowseCatalog->setObjectName(QString::fromUtf8("actionBrowse_Catalog"));
+		m_actionBrowseCatalog->setStatusTip(tr("Pick a dataset of a directory by thumbnails, without loading the others"));
+		connect(m_actionBrowseCatalog, SIGNAL(triggered()), this, SLOT(openCatalog()));
+
+		m_actionProgressiveLoading = new QAction( tr("&Progressive loading"),this);
+		m_actionProgressiveLoading->setObjectName(QString::fromUtf8("actionProgressive_Loading"));
+		m_actionProgressiveLoading->setStatusTip(tr("Show a downsampled preview of large datasets while they load"));
+		m_actionProgressiveLoading->setCheckable(true);
+		m_actionProgressiveLoading->setChecked(true);
+
+		m_actionLoadTimeSeries = new QAction( tr("Load &time series"),this);
+		m_actionLoadTimeSeries->setObjectName(QString::fromUtf8("actionLoad_Time_Series"));
+		m_actionLoadTimeSeries->setStatusTip(tr("Open one dataset per timestep, and play them back"));
+		connect(m_actionLoadTimeSeries, SIGNAL(triggered()), this, SLOT(openTimeSeries()));
+
+		m_actionConnectLiveVolume = new QAction( tr("Connect to l&ive volume"),this);
+		m_actionConnectLiveVolume->setObjectName(QString::fromUtf8("actionConnect_Live_Volume"));
+		m_actionConnectLiveVolume->setStatusTip(tr("Show the volumes that a running simulation publishes in shared memory"));
+		connect(m_actionConnectLiveVolume, SIGNAL(triggered()), this, SLOT(openLiveVolume()));
+
+		m_actionPlay = new QAction( tr("&Play"),this);
+		m_actionPlay->setObjectName(QString::fromUtf8("actionPlay"));
+		m_actionPlay->setStatusTip(tr("Play back the time series"));
+		m_actionPlay->setShortcut(QKeySequence(Qt::Key_Space));
+		m_actionPlay->setCheckable(true);
+		m_actionPlay->setEnabled(false);
+		connect(m_actionPlay, SIGNAL(toggled(bool)), m_timeSeries, SLOT(setPlaying(bool)));
+
+		m_actionNextFrame = new QAction( tr("&Next timestep"),this);
+		m_actionNextFrame->setObjectName(QString::fromUtf8("actionNext_Frame"));
+		m_actionNextFrame->setShortcut(QKeySequence(Qt::Key_Period));
+		m_actionNextFrame->setEnabled(false);
+		connect(m_actionNextFrame, SIGNAL(triggered()), m_timeSeries, SLOT(nextFrame()));
+
+		m_actionPreviousFrame = new QAction( tr("P&revious timestep"),this);
+		m_actionPreviousFrame->setObjectName(QString::fromUtf8("actionPrevious_Frame"));
+		m_actionPreviousFrame->setShortcut(QKeySequence(Qt::Key_Comma));
+		m_actionPreviousFrame->setEnabled(false);
+		connect(m_actionPreviousFrame, SIGNAL(triggered()), m_timeSeries, SLOT(previousFrame()));
+
         std::cout << "Debug: Connected main window menus." << std::endl << std::endl;
 
         m_menubar = new QMenuBar(this);
@@ -513,20 +997,54 @@ private:
 		m_menuFile->setObjectName(QString::fromUtf8("menuFile"));
         m_menuFile->setTitle(QApplication::translate("MainWindowClass", "File", 0, QApplication::UnicodeUTF8));
         m_menuFile->addAction(m_actionLoadDataset);
+        m_menuFile->addAction(m_actionLoadRegion);
+        m_menuFile->addAction(m_actionBrowseCatalog);
+        m_menuFile->addAction(m_actionLoadTimeSeries);
+        m_menuFile->addAction(m_actionConnectLiveVolume);
+        m_menuFile->addAction(m_actionProgressiveLoading);
         m_menubar->addAction(m_menuFile->menuAction());
+
+		m_menuPlayback = new QMenu(m_menubar);
+		m_menuPlayback->setObjectName(QString::fromUtf8("menuPlayback"));
+        m_menuPlayback->setTitle(tr("Playback"));
+        m_menuPlayback->addAction(m_actionPlay);
+        m_menuPlayback->addAction(m_actionNextFrame);
+        m_menuPlayback->addAction(m_actionPreviousFrame);
+        m_menubar->addAction(m_menuPlayback->menuAction());
     } /* createMenus() */
 
 
     // ************************************************************************************************************
     // *** Class members ******************************************************************************************
 private:
+    static const int PREVIEW_VOXELS = 1 << 21; // Largest number of voxels of the preview of progressive loading
+    static const int OUT_OF_CORE_VOXELS = 1 << 28; // Datasets with more voxels are streamed from disk,
+    static const int OUT_OF_CORE_BUDGET_MB = 1024; // caching this many megabytes of bricks
+
     Volume m_volume;
+    Volume m_loadingVolume;                 // Full resolution of a progressively loaded dataset, while it loads
+    QString m_loadingFile;                  // File of m_loadingVolume
+    VolumeLoaderThread *m_loaderThread;     // Loads m_loadingVolume
+    int m_currentLoad;                      // Number of the load of m_loaderThread awaited, or 0 if none is
+    DerivedDataThread *m_derivedDataThread; // Computes the gradients and the histogram after loading
+    int m_currentRun;                       // Number of the computation of m_derivedDataThread awaited, or 0
+    OutOfCoreVolume *m_outOfCoreVolume;     // Full resolution of m_volume when it is streamed from disk
+    TimeSeriesVolume *m_timeSeries;         // Shown instead of m_volume while it is open
+    LiveVolume *m_liveVolume;               // Shown instead of m_volume while it is open
 
     GLWidgetCube *m_glwidgetCube;
     GLWidgetSlicer *m_glwidgetSlicer;
     GLWidgetDvr *m_glwidgetDvr;
 
     QAction *m_actionLoadDataset;
+    QAction *m_actionLoadRegion;
+    QAction *m_actionBrowseCatalog;
+    QAction *m_actionLoadTimeSeries;
+    QAction *m_actionConnectLiveVolume;
+    QAction *m_actionProgressiveLoading;
+    QAction *m_actionPlay;
+    QAction *m_actionNextFrame;
+    QAction *m_actionPreviousFrame;
 
     QTabWidget *m_tabWidget;
     QWidget *m_tabSlicer;
@@ -544,6 +1062,8 @@ private:
     QLabel *m_label6_Dvr;
     QLabel *m_label7_Dvr;
     QLabel *m_label8_Dvr;
+    QLabel *m_label9_Dvr;
+    QLabel *m_label10_Dvr;
 
     QHBoxLayout *m_layoutSlicer;
     QVBoxLayout *m_layoutSlicerControl;
@@ -558,11 +1078,14 @@ private:
     QComboBox *m_combo_dvrInterpolationMethod;
     QComboBox *m_combo_dvrGradientInterpolationMethod;
     QComboBox *m_combo_dvrGradientMethod;
+    QComboBox *m_combo_dvrGradientStorage; // Not reset with the other options: the policy stays with the volume
     QComboBox *m_combo_dvrProjection;
     QComboBox *m_combo_dvrShading;
     QComboBox *m_combo_dvrRenderingMethod;
+    QComboBox *m_combo_dvrRenderingEngine;
     QComboBox *m_combo_dvrRes;
     QComboBox *m_combo_dvrResRotating;
+    QComboBox *m_combo_dvrLevelOfDetail;
     QComboBox *m_combo_dvrTfMode;
 
     QSpacerItem *m_spacer1_Dvr;
@@ -578,10 +1101,13 @@ private:
     QCheckBox *m_check_slicerFree;
 
     QPushButton *m_push_dvrTf;
+    QPushButton *m_push_dvrCompare;
+    QPushButton *m_push_dvrBenchmarkSplatting;
     QPushButton *m_push_slicerTf;
 
     QMenuBar *m_menubar;
     QMenu *m_menuFile;
+    QMenu *m_menuPlayback;
 
 
 /*
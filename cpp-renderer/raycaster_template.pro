@@ -25,7 +25,35 @@ SOURCES += main.cpp \
     tf_dialog.cpp \
     gl_tf_editor.cpp \
     transfer_function.cpp \
-    ViewPlane.cpp
+    ViewPlane.cpp \
+    VoxelTraversal.cpp \
+    FourierTransform.cpp \
+    FourierSliceRenderer.cpp \
+    ShearWarpRenderer.cpp \
+    SplatRenderer.cpp \
+    MinMaxGrid.cpp \
+    MarchingCubes.cpp \
+    IsosurfaceRenderer.cpp \
+    IlluminationVolume.cpp \
+    ShadingContext.cpp \
+    SimdMath.cpp \
+    TrilinearSampler.cpp \
+    DerivedDataThread.cpp \
+    VolumeLoaderThread.cpp \
+    DerivedDataCache.cpp \
+    VolumePyramid.cpp \
+    OutOfCoreVolume.cpp \
+    LzCodec.cpp \
+    CompressedVolumeFile.cpp \
+    SparseTileTree.cpp \
+    TimeSeriesVolume.cpp \
+    SharedVolumeRing.cpp \
+    LiveVolume.cpp \
+    SharedVolumeCache.cpp \
+    DatasetThumbnail.cpp \
+    DatasetCatalogDialog.cpp \
+    AtomicAccess.cpp \
+    RayGeometry.cpp
 
 HEADERS  += mainwindow.h \
             Quaternion.h\
@@ -38,7 +66,49 @@ HEADERS  += mainwindow.h \
     tf_dialog.h \
     gl_tf_editor.h \
     transfer_function.h \
-    ViewPlane.h
+    ViewPlane.h \
+    VoxelTraversal.h \
+    FourierTransform.h \
+    FourierSliceRenderer.h \
+    ShearWarpRenderer.h \
+    SplatRenderer.h \
+    MinMaxGrid.h \
+    MarchingCubes.h \
+    IsosurfaceRenderer.h \
+    IlluminationVolume.h \
+    ShadingContext.h \
+    SimdMath.h \
+    TrilinearSampler.h \
+    DerivedDataThread.h \
+    VolumeLoaderThread.h \
+    DerivedDataCache.h \
+    VolumePyramid.h \
+    OutOfCoreVolume.h \
+    LzCodec.h \
+    CompressedVolumeFile.h \
+    SparseTileTree.h \
+    TimeSeriesVolume.h \
+    SharedVolumeRing.h \
+    LiveVolume.h \
+    SharedVolumeCache.h \
+    DatasetThumbnail.h \
+    DatasetCatalogDialog.h \
+    AtomicAccess.h \
+    RayGeometry.h
         
 
 FORMS    +=
+
+# OpenMP parallelizes the data-parallel loops of the rendering engines
+*-g++* {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
+win32-msvc* {
+    QMAKE_CXXFLAGS += -openmp
+}
+
+# POSIX shared memory of live volumes and of the shared volume cache
+unix:!macx {
+    LIBS += -lrt
+}
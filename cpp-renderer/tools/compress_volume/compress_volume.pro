@@ -0,0 +1,26 @@
+#-------------------------------------------------
+#
+# Converter from DAT files to compressed volume files
+#
+#-------------------------------------------------
+
+QT += core
+QT -= gui
+
+TARGET = compress_volume
+CONFIG += console
+CONFIG -= app_bundle
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+SOURCES += main.cpp
+
+# OpenMP compresses the bricks in parallel
+*-g++* {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
+win32-msvc* {
+    QMAKE_CXXFLAGS += -openmp
+}
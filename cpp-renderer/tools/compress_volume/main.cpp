@@ -0,0 +1,65 @@
+#include <QElapsedTimer>
+#include <iostream>
+#include <string>
+#include "CompressedVolumeFile.h"
+#include "Volume.h"
+
+/*
+ * Converts a DAT file to a compressed volume file (.cvol), then loads it back and checks that it holds the same
+ * voxels, reporting the time it takes to load either file.
+ *
+ * Usage: compress_volume <DAT file> [compressed volume file]
+ * The compressed volume file defaults to the DAT file with the extension .cvol.
+ */
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        std::cout << "Usage: compress_volume <DAT file> [compressed volume file]" << std::endl;
+        return 1;
+    }
+
+    const std::string datFilename = argv[1];
+    std::string filename = (argc > 2) ? argv[2] : datFilename;
+    if (argc <= 2) {
+        const std::string::size_type extension = filename.rfind(".dat");
+        if (extension != std::string::npos && extension + 4 == filename.size()) {
+            filename.erase(extension);
+        }
+        filename += ".cvol";
+    }
+
+    if (!CompressedVolumeFile::convert(datFilename, filename)) {
+        return 1;
+    }
+
+    // Only the voxels are compared, so skip the gradients
+    Volume original;
+    original.setGradientPolicy(Volume::ON_THE_FLY_GRADIENTS);
+    Volume decompressed;
+    decompressed.setGradientPolicy(Volume::ON_THE_FLY_GRADIENTS);
+
+    QElapsedTimer timer;
+    timer.start();
+    if (!original.loadVolumeDat(datFilename, false)) {
+        return 1;
+    }
+    const qint64 datTime = timer.elapsed();
+
+    timer.start();
+    CompressedVolumeFile compressed;
+    if (!compressed.open(filename) || !compressed.load(decompressed)) {
+        return 1;
+    }
+    const qint64 compressedTime = timer.elapsed();
+
+    if (decompressed.getVoxelNum() != original.getVoxelNum() ||
+        memcmp(decompressed.getData(), original.getData(), original.getVoxelNum() * sizeof(float)) != 0) {
+        std::cout << "The compressed volume file does not hold the same voxels as the DAT file." << std::endl;
+        return 1;
+    }
+
+    std::cout << "Loading the DAT file took " << datTime << " ms, the compressed volume file " << compressedTime
+              << " ms." << std::endl;
+    return 0;
+}
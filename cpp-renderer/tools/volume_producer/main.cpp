@@ -0,0 +1,171 @@
+#include <QElapsedTimer>
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <unistd.h>
+#include "SharedVolumeRing.h"
+
+/*
+ * Publishes a live stream of volumes in a shared volume ring, as a running simulation would, for testing the live
+ * volumes of VolViz (File > Connect to live volume).
+ *
+ * Without a DAT file, two blobs orbit the middle of a synthetic volume. With a DAT file, a slab of the dataset
+ * sweeps through it along z. Either way only some slices change from frame to frame, as in many simulations.
+ *
+ * Usage: volume_producer [-n name] [-s size] [-r frames per second] [-f frames] [-k slots] [DAT file]
+ * The name defaults to /volviz, the size of the synthetic volume to 128 (voxels along each side), the rate to
+ * 10 frames per second, the number of frames to 0 (until interrupted) and the number of slots of the ring to 3.
+ */
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void interrupt(int)
+{
+    interrupted = 1;
+}
+
+/// Store a voxel value in [0, 4095] as the 16 bits of a DAT file
+static inline void storeVoxel(unsigned char *voxel, int value)
+{
+    voxel[0] = value & 0xff;
+    voxel[1] = value >> 8;
+}
+
+/// Fill a frame with two blobs orbiting the middle of the volume
+static void generateBlobs(unsigned char *voxels, int size, qint64 frame)
+{
+    const float angle = frame * 0.1f;
+    const float radius = size * 0.25f;
+    const float centers[2][3] = {
+        { size * 0.5f + radius * cosf(angle), size * 0.5f + radius * sinf(angle), size * 0.5f },
+        { size * 0.5f - radius * cosf(angle), size * 0.5f - radius * sinf(angle), size * 0.5f }
+    };
+    const float width = size * 0.08f;
+
+    #pragma omp parallel for schedule(static)
+    for (int z = 0 ; z < size ; z++) {
+        for (int y = 0 ; y < size ; y++) {
+            for (int x = 0 ; x < size ; x++) {
+                float value = 0;
+                for (int blob = 0 ; blob < 2 ; blob++) {
+                    const float dx = x - centers[blob][0];
+                    const float dy = y - centers[blob][1];
+                    const float dz = z - centers[blob][2];
+                    value += expf(-(dx * dx + dy * dy + dz * dz) / (2 * width * width));
+                }
+
+                const qint64 index = ((qint64)z * size + y) * size + x;
+                storeVoxel(voxels + 2 * index, std::min((int)(value * 4095), 4095));
+            }
+        }
+    }
+}
+
+/// Fill a frame with the slab of a dataset reached after the given number of frames, and zeros elsewhere
+static void generateSlab(unsigned char *voxels, const std::vector<char> &dataset, int width, int height, int depth,
+                         qint64 frame)
+{
+    const int thickness = std::max(depth / 4, 1);
+    const int first = (int)(frame % (depth + thickness)) - thickness;
+    const qint64 sliceBytes = (qint64)width * height * 2;
+
+    #pragma omp parallel for schedule(static)
+    for (int z = 0 ; z < depth ; z++) {
+        unsigned char *slice = voxels + z * sliceBytes;
+        if (z >= first && z < first + thickness) {
+            memcpy(slice, &dataset[z * sliceBytes], sliceBytes);
+        } else {
+            memset(slice, 0, sliceBytes);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::string name = "/volviz";
+    std::string datFilename;
+    int size = 128;
+    int framesPerSecond = 10;
+    qint64 frameCount = 0;
+    int slotCount = 3;
+
+    int option;
+    while ((option = getopt(argc, argv, "n:s:r:f:k:")) != -1) {
+        switch (option) {
+        case 'n': name = optarg; break;
+        case 's': size = atoi(optarg); break;
+        case 'r': framesPerSecond = std::max(atoi(optarg), 1); break;
+        case 'f': frameCount = atoll(optarg); break;
+        case 'k': slotCount = atoi(optarg); break;
+        default:
+            std::cout << "Usage: volume_producer [-n name] [-s size] [-r frames per second] [-f frames] "
+                         "[-k slots] [DAT file]" << std::endl;
+            return 1;
+        }
+    }
+    if (optind < argc) {
+        datFilename = argv[optind];
+    }
+
+    // The voxels of a DAT file are kept as they are in the file, to be copied into the frames
+    int width = size, height = size, depth = size;
+    std::vector<char> dataset;
+    if (!datFilename.empty()) {
+        std::ifstream file(datFilename.c_str(), std::ifstream::in | std::ifstream::binary);
+        unsigned char header[6];
+        if (!file.read((char*)header, 6)) {
+            std::cerr << "+ Error opening the file " << datFilename << "." << std::endl;
+            return 1;
+        }
+        width = header[0] | (header[1] << 8);
+        height = header[2] | (header[3] << 8);
+        depth = header[4] | (header[5] << 8);
+
+        dataset.resize((size_t)width * height * depth * 2);
+        if (!file.read(&dataset[0], dataset.size())) {
+            std::cerr << "+ The file " << datFilename << " ends prematurely." << std::endl;
+            return 1;
+        }
+    }
+
+    SharedVolumeRing ring;
+    if (!ring.create(name, width, height, depth, slotCount)) {
+        return 1;
+    }
+
+    signal(SIGINT, interrupt);
+    signal(SIGTERM, interrupt);
+
+    std::cout << "Publishing " << width << "x" << height << "x" << depth << " voxels under \"" << name << "\" at "
+              << framesPerSecond << " frames per second. Interrupt to stop." << std::endl;
+
+    QElapsedTimer clock;
+    clock.start();
+
+    for (qint64 frame = 0 ; !interrupted && (frameCount == 0 || frame < frameCount) ; frame++) {
+        unsigned char *voxels = ring.beginWrite();
+        if (dataset.empty()) {
+            generateBlobs(voxels, size, frame);
+        } else {
+            generateSlab(voxels, dataset, width, height, depth, frame);
+        }
+        ring.endWrite();
+
+        // Keep a steady rate however long the frame took to generate
+        const qint64 due = (frame + 1) * 1000 / framesPerSecond;
+        const qint64 wait = due - clock.elapsed();
+        if (wait > 0) {
+            usleep((useconds_t)(wait * 1000));
+        }
+    }
+
+    std::cout << "Published " << ring.getPublishedFrame() + 1 << " frames." << std::endl;
+    ring.close();
+    return 0;
+}
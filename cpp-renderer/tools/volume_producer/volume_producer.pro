@@ -0,0 +1,30 @@
+#-------------------------------------------------
+#
+# Test producer of live volumes in shared memory
+#
+#-------------------------------------------------
+
+QT += core
+QT -= gui
+
+TARGET = volume_producer
+CONFIG += console
+CONFIG -= app_bundle
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+SOURCES += main.cpp
+
+# OpenMP generates the voxels in parallel, and orders the writes to the ring
+*-g++* {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
+win32-msvc* {
+    QMAKE_CXXFLAGS += -openmp
+}
+
+unix:!macx {
+    LIBS += -lrt
+}
@@ -2,6 +2,7 @@
 #define TRANSFER_FUNCTION_H
 
 #include <QObject>
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <fstream>
@@ -175,6 +176,26 @@ public:
         return discretizedSamples.at(targetIndex+4);
     }
 
+    /// Compute the largest alpha value of all samples from 0 up to the specified sample. Where this is zero,
+    /// samples contribute nothing to a DVR composite and may be skipped.
+    double GetMaximumAlpha(double sample) const {
+        assert(sample >= 0 && sample <= 1.);
+
+        int targetIndex = roundToNearest5(sample*discretizedSamples.size());
+
+        // Handle edge case where index is rounded up to the edge of the vector
+        if (targetIndex+4 >= discretizedSamples.size()) {
+            targetIndex -= 5;
+        }
+
+        double maximum = 0;
+        for (int i = 0 ; i <= targetIndex ; i += 5) {
+            maximum = std::max(maximum, discretizedSamples.at(i+4));
+        }
+
+        return maximum;
+    }
+
     /// Remove the target sample from the samples list, or do nothing if it doesn't exist.
     /// Warning: This does not implicitly re-discretize the sample list, you have to do this
     /// manually.